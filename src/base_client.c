@@ -38,12 +38,10 @@ base_client_new(Wm *w, Window win)
 
    dbg("%s() called  \n", __func__);
 
-   c = malloc(sizeof(Client));
+   c = pool_alloc(POOL_CLIENT);
 
    if (c == NULL) return NULL;
 
-   memset(c, 0, sizeof(Client));
-
    /* Stardard bits */
    
    c->type    = MBCLIENT_TYPE_APP; /* start off with common case */
@@ -144,7 +142,7 @@ base_client_new(Wm *w, Window win)
    /* EWMH Icon */
 
 #ifndef STANDALONE
-   c->icon_rgba_data = ewmh_get_icon_prop_data(w, win);
+   c->icon_rgba = icon_cache_get_for_window(w, win);
 #endif
 
    /* WM Hints */
@@ -167,7 +165,7 @@ base_client_new(Wm *w, Window win)
       c->icon = None;
       c->icon_mask = None;
 
-      if (w->config->use_icons && c->icon_rgba_data == NULL)
+      if (w->config->use_icons && c->icon_rgba == NULL)
 	{
 	  if (wmhints->flags & IconPixmapHint)
 	    {
@@ -231,6 +229,7 @@ base_client_new(Wm *w, Window win)
 
   c->has_ping_protocol = False;
   c->pings_pending     = -1;
+  c->ping_queue_idx    = -1;
 
   if (data) XFree(data);
 
@@ -380,6 +379,7 @@ base_client_set_funcs(Client *c)
    c->configure    = &base_client_configure;
    c->reparent     = &base_client_reparent;
    c->redraw       = &base_client_redraw;
+   c->prerender    = &base_client_prerender;
    c->button_press = &base_client_button_press;
    c->get_coverage = &base_client_get_coverage;
    c->move_resize  = &base_client_move_resize;
@@ -410,6 +410,13 @@ base_client_redraw(Client *c, Bool use_cache)
    ;
 }
 
+/* queue the clients frames for theme pre-rendering */
+void
+base_client_prerender(Client *c)
+{
+   ;
+}
+
 /* button press on frame */
 void
 base_client_button_press(Client *c, XButtonEvent *e)
@@ -428,14 +435,7 @@ base_client_iconize(Client *c)
 void
 base_client_move_resize(Client *c)
 {
-  int i;
-
-   for (i=0; i<MSK_COUNT; i++)
-     if (c->backing_masks[i] != None)
-       {
-	 XFreePixmap(c->wm->dpy, c->backing_masks[i]);
-	 c->backing_masks[i] = None;
-       }
+   client_release_backing_masks(c);
 }
 
 
@@ -464,7 +464,6 @@ void /* cb for this needed, or let wm handle it */
 base_client_destroy(Client *c)
 {
   Wm *w = c->wm;
-  int i = 0;
   Client *p = NULL;
 #ifdef USE_ALT_INPUT_WIN
   Client *input_method = NULL;
@@ -473,36 +472,35 @@ base_client_destroy(Client *c)
   /* Free its memory + remove from list */
   dbg("%s() called\n", __func__);
 
-  /* Update focus list and anything that is transient for this */
+  /* Update focus list */
   stack_enumerate(w, p)
      {
        if (p->next_focused_client == c)
 	 p->next_focused_client = c->next_focused_client;
+     }
 
-       /* TODO: It may be safer to destroy any transients automatically 
-        *       This is what we used to do. Its 'assumed' however the app
-        *       will do this its self. 
-        */
-
-       if (p->trans == c)
+  /* TODO: It may be safer to destroy any transients automatically 
+   *       This is what we used to do. Its 'assumed' however the app
+   *       will do this its self. 
+   */
+  while ((p = c->trans_children) != NULL)
+    {
 #ifdef USE_ALT_INPUT_WIN
-	 {
-	   if (p->flags & (CLIENT_TB_ALT_TRANS_FOR_DIALOG|CLIENT_TB_ALT_TRANS_FOR_APP))
-	     {
-	       /* alt input methods ( maemo ) are special cased and 
-                * we need to focibly remove them. We do this later
-                * ( see below ) to be safer with tranciencys and
-                *  no removing in middle of enumeration. 
-	       */
-	       input_method = p;
-	     }
-	   else
-	     p->trans = c->trans;
-	 }
-#else
-	 p->trans = c->trans;
+      if (p->flags & (CLIENT_TB_ALT_TRANS_FOR_DIALOG|CLIENT_TB_ALT_TRANS_FOR_APP))
+	{
+	  /* alt input methods ( maemo ) are special cased and 
+	   * we need to focibly remove them. We do this later
+	   * ( see below ) to be safer with tranciencys.
+	   */
+	  input_method = p;
+	  client_set_transient_for(p, NULL);
+	  continue;
+	}
 #endif
-     }
+      client_set_transient_for(p, c->trans);
+    }
+
+  client_set_transient_for(c, NULL);
 
    /* Whatever we do the below is very likely to fire off a ( harmless ) 
     *  X Error or two. Therefore we trap, just to quiten the warnings.
@@ -513,13 +511,22 @@ base_client_destroy(Client *c)
    wm_sn_cycle_remove(w, c->window);
 #endif       
 
-   if (c->has_ping_protocol && c->pings_pending != -1) 
-     w->n_active_ping_clients--;
+   ewmh_ping_client_stop (c);
+
+#ifdef USE_XSYNC
+   ewmh_sync_client_free (c);
+#endif
+
+   if (c->title_pending != None)
+     w->n_title_pending--;
 
    comp_engine_client_destroy(w, c);
 
    list_remove(&w->client_age_list, (void*)c);
 
+   if (c->type == MBCLIENT_TYPE_APP || c->type == MBCLIENT_TYPE_DESKTOP)
+     theme_frame_menu_invalidate(w->mbtheme);
+
    stack_remove(c);
 
    /* Now free up various resources */
@@ -534,13 +541,13 @@ base_client_destroy(Client *c)
 	   XDestroyWindow(w->dpy, c->frame);
 	 }
 
-       for (i=0; i<MSK_COUNT; i++)
-	 if (c->backing_masks[i] != None)
-	   XFreePixmap(w->dpy, c->backing_masks[i]);
+       client_release_backing_masks(c);
 
        /* No need to free up pixmap icon data client resource  */
 
-       if (c->icon_rgba_data) XFree(c->icon_rgba_data);
+#ifndef STANDALONE
+       if (c->icon_rgba) icon_cache_unref(w, c->icon_rgba);
+#endif
 
        XUngrabButton(w->dpy, Button1, 0, c->window);
      }    
@@ -561,14 +568,14 @@ base_client_destroy(Client *c)
 
     ewmh_update_lists(w); 
 
-    free(c);
+    pool_free(POOL_CLIENT, c);
 
 #ifdef USE_ALT_INPUT_WIN
     if (input_method)
       {
-	 /* were now gone */
-	input_method->trans = NULL;
-	/* Hide will destroy the client */
+	/* Hide will destroy the client, we're already no longer its 
+	 * transient parent.
+	*/
 	input_method->hide(input_method);
       }
 #endif
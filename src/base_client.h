@@ -54,6 +54,10 @@ base_client_reparent (Client *c);
 void 
 base_client_redraw (Client *c, Bool use_cache);
 
+/* queue the clients frames for theme pre-rendering */
+void 
+base_client_prerender (Client *c);
+
 /* Hide any transients */
 void 
 base_client_hide_transients (Client *c);
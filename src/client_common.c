@@ -351,79 +351,187 @@ client_set_focus(Client *c)
 }
 
 
+/*
+ *  Transiency is kept as a tree, each client linking to the clients 
+ *  transient for it, so the lookups below only ever visit actual 
+ *  transients rather than scanning the stack for them.
+ */
+
+/* Client arrays for gathering transients, only malloc'd when big */
+#define CLIENT_TRANS_BUF_SIZE 16
+
+typedef struct MBClientTransients
+{
+  Client **clients;
+  int      n, size;
+  Client  *buf[CLIENT_TRANS_BUF_SIZE];
+
+} MBClientTransients;
+
+static void
+client_transients_init(MBClientTransients *t)
+{
+  t->clients = t->buf;
+  t->n       = 0;
+  t->size    = CLIENT_TRANS_BUF_SIZE;
+}
+
+static void
+client_transients_add(MBClientTransients *t, Client *c)
+{
+  if (t->n == t->size)
+    {
+      t->size *= 2;
+
+      if (t->clients == t->buf)
+	{
+	  t->clients = malloc(sizeof(Client*) * t->size);
+	  memcpy(t->clients, t->buf, sizeof(t->buf));
+	}
+      else
+	t->clients = realloc(t->clients, sizeof(Client*) * t->size);
+    }
+
+  t->clients[t->n++] = c;
+}
+
+static void
+client_transients_free(MBClientTransients *t)
+{
+  if (t->clients != t->buf)
+    free(t->clients);
+}
+
+static int
+client_transients_stack_cmp(const void *a, const void *b)
+{
+  long long pa = (*(Client**)a)->stack_pos, pb = (*(Client**)b)->stack_pos;
+
+  return (pa > pb) - (pa < pb);
+}
+
+/* Into stacking order, bottom first, like a stack_enumerate() */
+static void
+client_transients_sort(MBClientTransients *t)
+{
+  qsort(t->clients, t->n, sizeof(Client*), client_transients_stack_cmp);
+}
+
+/* Adds every dialog transient for c, directly or not */
+static void
+client_transients_add_dialogs(MBClientTransients *t, Client *c)
+{
+  Client *p;
+
+  for (p = c->trans_children; p != NULL; p = p->trans_next)
+    {
+      if (p->type == MBCLIENT_TYPE_DIALOG)
+	client_transients_add(t, p);
+
+      client_transients_add_dialogs(t, p);
+    }
+}
+
+void
+client_set_transient_for(Client *c, Client *trans)
+{
+  Client **link;
+
+  if (c->trans == trans)
+    return;
+
+  if (c->trans != NULL)
+    {
+      for (link = &c->trans->trans_children; 
+	   *link != c; 
+	   link = &(*link)->trans_next)
+	;
+
+      *link = c->trans_next;
+      c->trans_next = NULL;
+    }
+
+  c->trans = trans;
+
+  if (trans != NULL)
+    {
+      c->trans_next         = trans->trans_children;
+      trans->trans_children = c;
+    }
+}
+
 void
 client_get_transient_list(Wm *w, MBList **list, Client *c)
 {
-  Client *p = NULL;
+  MBClientTransients  t;
+  Client             *p = NULL;
+  int                 i;
+
+  client_transients_init(&t);
 
-  stack_enumerate(w,p)
+  if (c == NULL)
     {
-      if (p != c && p->type == MBCLIENT_TYPE_DIALOG)
-	{
-	  Client *trans = p->trans;
-
-	  dbg("%s() checking <%s> trans for <%s>\n",
-	      __func__, p->name, trans ? trans->name : "nothing");
-
-	  if (c == NULL) 
-	    { 			
-	      /* Transient for root dialogs */
-	      if (trans == NULL)
-		{
-		  list_add(list, NULL, 0, p);
-		}
-	      else
-		{
-		  /* The dialog isn't transient for root directly 
-                   * but possibly one of its transient parents are
-		   */
-
-		  while (trans->trans != NULL)
-		    trans = trans->trans;
-
-		  /* trans is now transient for nothing
-                   * so if its a dialog add it.
-		   */
-		  if (trans->type == MBCLIENT_TYPE_DIALOG)
-		    list_add(list, NULL, 0, p);
-		}
-	    }
-	  else
-	    {
-	      /* Follow transients 'down', for a match. */
-
-	      while (trans != NULL && trans != c)
-		trans = trans->trans;
-	      
-	      if (trans == c)
-		{
-		  list_add(list, NULL, 0, p);
-		}
-	      else if (p->trans 
-		       && c->win_group 
-		       && (c->type == MBCLIENT_TYPE_APP
-			   || c->type == MBCLIENT_TYPE_DESKTOP))
-		{
-		  /* Handle window groups and transiency. 
-		   * App windows with matchbox window groups
-                   * 'share' transients  
-		  */
-		  trans = p->trans;
-
-		  while (trans->trans != NULL)
-		    trans = trans->trans;
-
-		  if ((trans->type == MBCLIENT_TYPE_APP
-		       || trans->type == MBCLIENT_TYPE_DESKTOP)
-		      && trans->win_group == c->win_group) 
-		    list_add(list, NULL, 0, p);
-		}
+      /* Transient for root dialogs, and dialogs transient for them
+       * however indirectly.
+      */
+      stack_enumerate_type(w, p, MBCLIENT_TYPE_DIALOG)
+	if (p->trans == NULL)
+	  {
+	    client_transients_add(&t, p);
+	    client_transients_add_dialogs(&t, p);
+	  }
+    }
+  else
+    {
+      client_transients_add_dialogs(&t, c);
 
-	    }
+      if (c->win_group
+	  && (c->type == MBCLIENT_TYPE_APP || c->type == MBCLIENT_TYPE_DESKTOP))
+	{
+	  /* Handle window groups and transiency. 
+	   * App windows with matchbox window groups
+	   * 'share' transients  
+	   */
+	  stack_enumerate_type(w, p, MBCLIENT_TYPE_APP)
+	    if (p != c && p->trans == NULL && p->win_group == c->win_group)
+	      client_transients_add_dialogs(&t, p);
+
+	  stack_enumerate_type(w, p, MBCLIENT_TYPE_DESKTOP)
+	    if (p != c && p->trans == NULL && p->win_group == c->win_group)
+	      client_transients_add_dialogs(&t, p);
 	}
     }
+
+  client_transients_sort(&t);
+
+  for (i = 0; i < t.n; i++)
+    {
+      /* c may be transient for a group member, so drop doubles */
+      if (i > 0 && t.clients[i] == t.clients[i-1])
+	continue;
+
+      dbg("%s() <%s> trans for <%s>\n", __func__, t.clients[i]->name, 
+	  c ? c->name : "root");
+
+      list_add(list, NULL, 0, t.clients[i]);
+    }
+
+  client_transients_free(&t);
 }
 
+/* Gets the clients directly transient for c, in stacking order */
+static void
+client_get_transient_children(Client *c, MBClientTransients *t)
+{
+  Client *p;
+
+  client_transients_init(t);
+
+  for (p = c->trans_children; p != NULL; p = p->trans_next)
+    client_transients_add(t, p);
+
+  client_transients_sort(t);
+}
 
 static Client*
 client_get_highest_transient_recurse (Client *c, 
@@ -431,17 +539,21 @@ client_get_highest_transient_recurse (Client *c,
 				      Client *ignore,
 				      int    *depth)
 {
-  Wm     *w = c->wm;
-  Client *p = NULL;
-  Client *highest = c, *tmp;
-  int     this_depth = 0, max_depth = 0;
+  MBClientTransients  children;
+  Client             *p = NULL;
+  Client             *highest = c, *tmp;
+  int                 this_depth = 0, max_depth = 0, i;
 
   /* FIXME: its likely this can be combined into
    * client_get_highest_transient() somehow.. 
   */
-  stack_enumerate(w,p)
+  client_get_transient_children(c, &children);
+
+  for (i = 0; i < children.n; i++)
     {
-      if (p != c && p->trans && p->trans == c && p != ignore)
+      p = children.clients[i];
+
+      if (p != ignore)
 	{
 	  if (client_flags && !(p->flags & client_flags))
 	    continue;
@@ -460,6 +572,8 @@ client_get_highest_transient_recurse (Client *c,
 	}
     }
 
+  client_transients_free(&children);
+
   *depth += max_depth;
 
   return highest;
@@ -468,14 +582,18 @@ client_get_highest_transient_recurse (Client *c,
 Client*
 client_get_highest_transient(Client *c, int client_flags, Client *ignore)
 {
-  Wm     *w = c->wm;
-  Client *p = NULL;
-  Client *highest = c, *tmp;
-  int     depth = 0, depth_max = 0;
+  MBClientTransients  children;
+  Client             *p = NULL;
+  Client             *highest = c, *tmp;
+  int                 depth = 0, depth_max = 0, i;
+
+  client_get_transient_children(c, &children);
 
-  stack_enumerate(w,p)
+  for (i = 0; i < children.n; i++)
     {
-      if (p != c && p->trans && p->trans == c && p != ignore)
+      p = children.clients[i];
+
+      if (p != ignore)
 	{
 	  depth = 0;
 
@@ -497,6 +615,8 @@ client_get_highest_transient(Client *c, int client_flags, Client *ignore)
 	}
     }
 
+  client_transients_free(&children);
+
   return highest;
 }
 
@@ -598,9 +718,89 @@ client_decor_frames_init(Client *c,
 
 }
 
+/* Finds or creates a solid mask for one side of a frame. Masks only 
+ * depend on the theme, frame type and size so are shared.
+ */
+static Pixmap
+client_backing_mask_get (Client *c, 
+			 int     side, 
+			 int     frame_type, 
+			 int     width, 
+			 int     height)
+{
+  Wm          *w = c->wm;
+  MBShapeMask *mask;
+  MBList      *item;
+  Pixmap       pxm;
+
+  list_enumerate(w->shape_masks, item)
+    {
+      mask = (MBShapeMask *)item->data;
+
+      if (mask->side == side && mask->frame_type == frame_type
+	  && mask->width == width && mask->height == height)
+	{
+	  mask->refcnt++;
+	  return mask->pixmap;
+	}
+    }
+
+  pxm = XCreatePixmap(w->dpy, w->root, width, height, 1);
+
+  if (w->shape_mask_gc == None)
+    {
+      w->shape_mask_gc = XCreateGC(w->dpy, pxm, 0, 0);
+      XSetForeground(w->dpy, w->shape_mask_gc, WhitePixel(w->dpy, w->screen));
+    }
+
+  XFillRectangle(w->dpy, pxm, w->shape_mask_gc, 0, 0, width, height);
+
+  mask = malloc(sizeof(MBShapeMask));
+
+  mask->side       = side;
+  mask->frame_type = frame_type;
+  mask->width      = width;
+  mask->height     = height;
+  mask->pixmap     = pxm;
+  mask->refcnt     = 1;
+
+  list_add(&w->shape_masks, NULL, (int)pxm, (void *)mask);
+
+  return pxm;
+}
+
+/* Drops the clients references to its masks, freeing any unshared */
+void
+client_release_backing_masks (Client *c)
+{
+  Wm          *w = c->wm;
+  MBShapeMask *mask;
+  int          i;
+
+  for (i=0; i<MSK_COUNT; i++)
+    {
+      if (c->backing_masks[i] == None)
+	continue;
+
+      mask = list_find_by_id(w->shape_masks, (int)c->backing_masks[i]);
+
+      if (mask == NULL)
+	XFreePixmap(w->dpy, c->backing_masks[i]);
+      else if (--mask->refcnt == 0)
+	{
+	  XFreePixmap(w->dpy, mask->pixmap);
+	  list_remove(&w->shape_masks, (void *)mask);
+	  free(mask);
+	}
+
+      c->backing_masks[i] = None;
+    }
+}
+
 /* Create masks used for shaped decorations */
 void 
 client_init_backing_mask (Client *c, 
+			  int     frame_type,
 			  int     width, 
 			  int     height, 
 			  int     height_north, 
@@ -608,53 +808,22 @@ client_init_backing_mask (Client *c,
 			  int     width_east, 
 			  int     width_west )
 {
-  Wm *w = c->wm;
-  GC  shape_gc;
-  int i = 0;
-
-   for (i=0; i<MSK_COUNT; i++)
-     if (c->backing_masks[i] != None)
-       XFreePixmap(w->dpy, c->backing_masks[i]);
+  client_release_backing_masks(c);
 
   c->backing_masks[MSK_NORTH] 
-    = XCreatePixmap(w->dpy, w->root, width, height_north, 1);
-
-  shape_gc = XCreateGC( w->dpy, c->backing_masks[MSK_NORTH], 0, 0 );
-
-  XSetForeground(w->dpy, shape_gc, 
-		 WhitePixel( w->dpy, w->screen ));
-
-  XFillRectangle(w->dpy, c->backing_masks[MSK_NORTH],
-		 shape_gc, 0, 0, width, height_north);
+    = client_backing_mask_get(c, MSK_NORTH, frame_type, width, height_north);
 
   if (height_south)
-    {
-      c->backing_masks[MSK_SOUTH] 
-	= XCreatePixmap(w->dpy, w->root, width, height_south, 1);
-
-      XFillRectangle(w->dpy, c->backing_masks[MSK_SOUTH],
-		     shape_gc, 0, 0, width, height_south);
-    }
+    c->backing_masks[MSK_SOUTH] 
+      = client_backing_mask_get(c, MSK_SOUTH, frame_type, width, height_south);
 
   if (width_east)
-    {
-      c->backing_masks[MSK_EAST] 
-	= XCreatePixmap(w->dpy, w->root, width_east, height, 1);
-
-      XFillRectangle(w->dpy, c->backing_masks[MSK_EAST],
-		     shape_gc, 0, 0, width_east, height);
-    }
+    c->backing_masks[MSK_EAST] 
+      = client_backing_mask_get(c, MSK_EAST, frame_type, width_east, height);
 
   if (width_west)
-    {
-      c->backing_masks[MSK_WEST] 
-	= XCreatePixmap(w->dpy, w->root, width_west, height, 1);
-
-      XFillRectangle(w->dpy, c->backing_masks[MSK_WEST],
-		     shape_gc, 0, 0, width_west, height);
-    }
-
-  XFreeGC(w->dpy, shape_gc);
+    c->backing_masks[MSK_WEST] 
+      = client_backing_mask_get(c, MSK_WEST, frame_type, width_west, height);
 }
 
 void
@@ -701,9 +870,7 @@ client_button_new(Client *c,
 		  Bool    want_inputonly, 
 		  void   *data )
 {
-  MBClientButton      *b = malloc(sizeof(MBClientButton));
-
-  memset(b, 0, sizeof(MBClientButton));
+  MBClientButton      *b = pool_alloc(POOL_BUTTON);
 
   client_button_init(c, win_parent, b, 
 		     x, y, width, height, 
@@ -746,9 +913,9 @@ client_buttons_delete_all(Client *c)
       dbg("%s() destroying a button\n", __func__); 
       if (b->win != None)
 	XDestroyWindow(w->dpy, b->win);
-      free(b);
+      pool_free(POOL_BUTTON, b);
       p = l->next;
-      free(l);
+      list_item_free(l);
       l = p;
     }
 
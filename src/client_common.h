@@ -28,6 +28,7 @@
 #include "dialog_client.h"
 #include "list.h"
 #include "misc.h"
+#include "pool.h"
 
 #define client_title_frame(c) (c)->frames_decor[NORTH]
 
@@ -67,6 +68,9 @@ client_want_focus (Client *c);
 Bool
 client_set_focus(Client *c);
 
+void
+client_set_transient_for(Client *c, Client *trans);
+
 void
 client_get_transient_list(Wm *w, MBList **list, Client *c);
 
@@ -94,8 +98,12 @@ client_decor_frames_init(Client *c,
 			 int     height_north,
 			 int     height_south);
 
+void
+client_release_backing_masks (Client *c);
+
 void
 client_init_backing_mask (Client *c, 
+			  int     frame_type,
 			  int     width, 
 			  int     height, 
 			  int     height_north, 
@@ -789,6 +789,9 @@ comp_engine_init (Wm *w)
   w->have_comp_engine     = True;
   w->comp_engine_disabled = False;
 
+  wm_event_handler_add(w, w->damage_event + XDamageNotify, None, 
+		       "composite", comp_engine_handle_events);
+
   comp_stack = NULL;
 
   /* Make the shadow tiles */
@@ -1166,9 +1169,12 @@ comp_engine_render(Wm *w, XserverRegion region)
   Client       *client_top_app = NULL, *t = NULL;
   int           x,y,width,height;
   int           lowlight = 0;
+  long long     start;
 
   if (!w->have_comp_engine || stack_empty(w)) return;
 
+  start = misc_get_time_usec();
+
   dbg("%s() called\n", __func__);
 
   if (!region) 
@@ -1408,6 +1414,8 @@ comp_engine_render(Wm *w, XserverRegion region)
 		    0, 0, 0, 0, 0, 0, w->dpy_width, w->dpy_height);
 
   XSync(w->dpy, False);
+
+  latency_add(LATENCY_COMP_ENGINE_RENDER, misc_get_time_usec() - start);
 }
 
 #endif
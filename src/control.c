@@ -0,0 +1,655 @@
+/*
+ *  Matchbox Window Manager - A lightweight window manager not for the
+ *                            desktop.
+ *
+ *  Authored By Matthew Allum <mallum@o-hand.com>
+ *
+ *  Copyright (c) 2002, 2004 OpenedHand Ltd - http://o-hand.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#include "control.h"
+#include "wm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+/* matchbox-panel's own _MB_COMMAND, see mbpanelcommand() in
+ * matchbox-remote.c
+ */
+#define PANEL_CMD_TOGGLE_VISIBILITY 1
+
+/* Biggest reply line, stats are the long ones */
+#define CONTROL_REPLY_MAX (LATENCY_STATS_MAX + 64)
+
+typedef struct MBControlConn
+{
+  int  fd;			/* -1 if the slot is free */
+  Bool failed;			/* Couldn't keep up with replies */
+  Bool skipping;		/* Throwing away a too long command */
+  char in[CONTROL_LINE_MAX];
+  int  in_len;
+
+} MBControlConn;
+
+typedef struct MBControl
+{
+  Wm            *wm;
+  char          *path;
+  int            fd;
+  MBControlConn  conns[CONTROL_MAX_CONNECTIONS];
+  long long      poll_usec;	/* Last control_poll() select() */
+
+} MBControl;
+
+static MBControl *exit_control;
+
+static void
+control_atexit (void)
+{
+  if (exit_control != NULL)
+    unlink(exit_control->path);
+}
+
+static void
+control_set_fd_flags (int fd)
+{
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  fcntl(fd, F_SETFD, FD_CLOEXEC); /* Not for apps we launch */
+}
+
+/* /tmp/matchbox-<uid>/control-<display>, in a directory only we can
+ * get into as there is nothing else stopping other users connecting.
+ */
+static char*
+control_default_path (Wm *w)
+{
+  struct stat  st;
+  char         dir[64];
+  char        *display = DisplayString(w->dpy), *path, *p;
+
+  snprintf(dir, sizeof(dir), "/tmp/matchbox-%i", (int)getuid());
+
+  if (mkdir(dir, 0700) != 0 && errno != EEXIST)
+    {
+      fprintf(stderr, "matchbox: unable to create %s\n", dir);
+      return NULL;
+    }
+
+  if (lstat(dir, &st) != 0 || !S_ISDIR(st.st_mode)
+      || st.st_uid != getuid() || (st.st_mode & 077))
+    {
+      fprintf(stderr, "matchbox: %s is not private, no control socket\n",
+	      dir);
+      return NULL;
+    }
+
+  path = malloc(strlen(dir) + strlen(display) + 10);
+  sprintf(path, "%s/control-%s", dir, display);
+
+  for (p = path + strlen(dir) + 1; *p; p++)
+    if (*p == '/')
+      *p = '_';
+
+  return path;
+}
+
+static int
+control_listen (char *path)
+{
+  struct sockaddr_un addr;
+  struct stat        st;
+  mode_t             old_mask;
+  int                fd, probe, ok;
+
+  if (strlen(path) >= sizeof(addr.sun_path))
+    {
+      fprintf(stderr, "matchbox: control socket path %s too long\n", path);
+      return -1;
+    }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    return -1;
+
+  old_mask = umask(077);
+
+  ok = (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+
+  /* Left behind by a wm that didn't exit cleanly, unless it answers.
+   * Anything but our own socket there is never touched.
+   */
+  if (!ok && errno == EADDRINUSE)
+    {
+      probe = -1;
+
+      if (lstat(path, &st) != 0 || !S_ISSOCK(st.st_mode) 
+	  || st.st_uid != getuid())
+	fprintf(stderr, "matchbox: %s is in use and not our socket\n", path);
+      else if ((probe = socket(AF_UNIX, SOCK_STREAM, 0)) >= 0
+	       && connect(probe, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+	{
+	  unlink(path);
+	  ok = (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+	}
+      else
+	fprintf(stderr, "matchbox: %s is in use by another window manager\n",
+		path);
+
+      if (probe >= 0)
+	close(probe);
+    }
+
+  umask(old_mask);
+
+  if (!ok || listen(fd, CONTROL_MAX_CONNECTIONS) != 0)
+    {
+      fprintf(stderr, "matchbox: unable to listen on %s\n", path);
+      close(fd);
+      return -1;
+    }
+
+  control_set_fd_flags(fd);
+
+  return fd;
+}
+
+MBControl*
+control_new (Wm *w)
+{
+  MBControl *control;
+  char      *path = getenv("MB_CONTROL_SOCKET");
+  int        fd, i;
+
+  if (path != NULL && *path == '\0')
+    return NULL;
+
+  if (path != NULL)
+    path = strdup(path);
+  else if ((path = control_default_path(w)) == NULL)
+    return NULL;
+
+  if ((fd = control_listen(path)) < 0)
+    {
+      free(path);
+      return NULL;
+    }
+
+  control = malloc(sizeof(MBControl));
+  memset(control, 0, sizeof(MBControl));
+
+  control->wm   = w;
+  control->path = path;
+  control->fd   = fd;
+
+  for (i = 0; i < CONTROL_MAX_CONNECTIONS; i++)
+    control->conns[i].fd = -1;
+
+  exit_control = control;
+  atexit(control_atexit);
+
+  XChangeProperty(w->dpy, w->root, w->atoms[_MB_CONTROL_SOCKET],
+		  XA_STRING, 8, PropModeReplace,
+		  (unsigned char *)path, strlen(path));
+
+  dbg("%s() listening on %s\n", __func__, path);
+
+  return control;
+}
+
+int
+control_fds_set (MBControl *control, fd_set *set, int max_fd)
+{
+  int i;
+
+  FD_SET(control->fd, set);
+  if (control->fd > max_fd)
+    max_fd = control->fd;
+
+  for (i = 0; i < CONTROL_MAX_CONNECTIONS; i++)
+    if (control->conns[i].fd != -1)
+      {
+	FD_SET(control->conns[i].fd, set);
+	if (control->conns[i].fd > max_fd)
+	  max_fd = control->conns[i].fd;
+      }
+
+  return max_fd;
+}
+
+static void
+control_conn_close (MBControlConn *conn)
+{
+  close(conn->fd);
+  conn->fd     = -1;
+  conn->failed   = False;
+  conn->skipping = False;
+  conn->in_len   = 0;
+}
+
+/* Replies are small, so rather than buffer them a client that leaves
+ * the socket full just gets dropped. The wm never blocks on it.
+ */
+static void
+control_reply (MBControlConn *conn, const char *format, ...)
+{
+  static char buf[CONTROL_REPLY_MAX];
+  va_list     args;
+  int         len, done = 0, n;
+
+  if (conn->failed)
+    return;
+
+  va_start(args, format);
+  len = vsnprintf(buf, sizeof(buf) - 1, format, args);
+  va_end(args);
+
+  if (len < 0)
+    return;
+
+  if (len > (int)sizeof(buf) - 2)
+    len = (int)sizeof(buf) - 2;
+
+  buf[len++] = '\n';
+
+  while (done < len)
+    {
+      n = send(conn->fd, buf + done, len - done, MSG_NOSIGNAL);
+
+      if (n < 0 && errno == EINTR)
+	continue;
+
+      if (n <= 0)
+	{
+	  dbg("%s() dropping control connection\n", __func__);
+	  conn->failed = True;
+	  return;
+	}
+
+      done += n;
+    }
+}
+
+static const char*
+control_client_type_name (Client *c)
+{
+  switch (c->type)
+    {
+    case MBCLIENT_TYPE_APP:       return "app";
+    case MBCLIENT_TYPE_DIALOG:    return "dialog";
+    case MBCLIENT_TYPE_TOOLBAR:   return "toolbar";
+    case MBCLIENT_TYPE_PANEL:     return "panel";
+    case MBCLIENT_TYPE_DESKTOP:   return "desktop";
+    case MBCLIENT_TYPE_TASK_MENU: return "task-menu";
+    case MBCLIENT_TYPE_OVERRIDE:  return "override";
+    default:                      return "unknown";
+    }
+}
+
+/* Quotes a title so a reply is always one line */
+static void
+control_quote (char *dst, int len, const char *src)
+{
+  char *p = dst;
+
+  *p++ = '"';
+
+  while (src && *src && p - dst < len - 4)
+    {
+      if (*src == '"' || *src == '\\')
+	*p++ = '\\';
+
+      *p++ = ((unsigned char)*src < ' ') ? ' ' : *src;
+      src++;
+    }
+
+  *p++ = '"';
+  *p   = '\0';
+}
+
+static void
+control_query_clients (MBControl *control, MBControlConn *conn)
+{
+  Wm     *w = control->wm;
+  Client *c;
+  char    name[256];
+
+  stack_enumerate(w, c)
+    {
+      control_quote(name, sizeof(name), (char *)c->name);
+
+      control_reply(conn, "client window=0x%lx frame=0x%lx type=%s "
+		    "x=%i y=%i width=%i height=%i mapped=%i focused=%i "
+		    "trans=0x%lx name=%s",
+		    c->window, c->frame, control_client_type_name(c),
+		    c->x, c->y, c->width, c->height, c->mapped ? 1 : 0,
+		    (c == w->focused_client),
+		    c->trans ? c->trans->window : None, name);
+    }
+}
+
+static void
+control_query_stats (MBControl *control, MBControlConn *conn)
+{
+  Wm   *w = control->wm;
+  char  buf[LATENCY_STATS_MAX];
+
+  latency_stats_describe(buf, sizeof(buf));
+  control_reply(conn, "latency %s", buf);
+
+  pool_stats_describe(buf, sizeof(buf));
+  control_reply(conn, "pool %s", buf);
+
+  control_reply(conn, "x requests=%lu events=%lu",
+		NextRequest(w->dpy) - 1, w->n_x_events);
+}
+
+/* Only themed builds have image caches, a standalone one has nothing
+ * to report.
+ */
+static void
+control_query_cache (MBControl *control, MBControlConn *conn)
+{
+#ifndef STANDALONE
+  Wm               *w = control->wm;
+  MBTheme          *theme = w->mbtheme;
+  struct list_item *item, *scaled;
+  int               n_icons = 0, n_refs = 0, n_scaled = 0;
+  long              icon_bytes = 0;
+
+  if (theme->cache)
+    control_reply(conn, "theme images=%i loaded=%i decode_ms=%li bytes=%li "
+		  "cache_hits=%i cache_misses=%i cache_mapped=%lu",
+		  theme->n_images, theme->n_images_loaded,
+		  theme->image_decode_usec / 1000, theme->image_bytes,
+		  theme->cache->hits, theme->cache->misses,
+		  (unsigned long)theme->cache->map_len);
+  else
+    control_reply(conn, "theme images=%i loaded=%i decode_ms=%li bytes=%li",
+		  theme->n_images, theme->n_images_loaded,
+		  theme->image_decode_usec / 1000, theme->image_bytes);
+
+  list_enumerate(w->icon_cache, item)
+    {
+      MBIcon *icon = (MBIcon *)item->data;
+
+      n_icons++;
+      n_refs     += icon->refcnt;
+      icon_bytes += icon->n_items * sizeof(unsigned long);
+
+      list_enumerate(icon->scaled, scaled)
+	{
+	  MBPixbufImage *img = (MBPixbufImage *)scaled->data;
+
+	  n_scaled++;
+	  icon_bytes += img->width * img->height
+	    * (img->internal_bytespp + img->has_alpha);
+	}
+    }
+
+  control_reply(conn, "icons icons=%i refs=%i scaled=%i bytes=%li",
+		n_icons, n_refs, n_scaled, icon_bytes);
+#endif
+}
+
+static void
+control_panel_toggle (MBControl *control, MBControlConn *conn, int panel_id)
+{
+  Wm     *w = control->wm;
+  XEvent  ev;
+  Window  panel;
+  char    atom_name[64];
+
+  snprintf(atom_name, sizeof(atom_name), "_NET_SYSTEM_TRAY_S%i", panel_id);
+
+  panel = XGetSelectionOwner(w->dpy, XInternAtom(w->dpy, atom_name, False));
+
+  if (panel == None)
+    {
+      control_reply(conn, "error no panel %i", panel_id);
+      return;
+    }
+
+  memset(&ev, 0, sizeof(ev));
+  ev.xclient.type         = ClientMessage;
+  ev.xclient.window       = w->root;
+  ev.xclient.message_type = w->atoms[MB_COMMAND];
+  ev.xclient.format       = 8;
+  ev.xclient.data.l[0]    = PANEL_CMD_TOGGLE_VISIBILITY;
+
+  XSendEvent(w->dpy, panel, False,
+	     SubstructureRedirectMask|SubstructureNotifyMask, &ev);
+
+  control_reply(conn, "ok");
+}
+
+static void
+control_run (MBControl *control, MBControlConn *conn, char *line)
+{
+  Wm   *w = control->wm;
+  char *cmd, *arg;
+
+  while (*line == ' ' || *line == '\t' || *line == '\r')
+    line++;
+
+  for (arg = line + strlen(line);
+       arg > line && (arg[-1] == ' ' || arg[-1] == '\t' || arg[-1] == '\r');
+       arg--)
+    arg[-1] = '\0';
+
+  if (*line == '\0')
+    return;
+
+  cmd = line;
+  arg = strpbrk(line, " \t");
+
+  if (arg != NULL)
+    {
+      *arg++ = '\0';
+      while (*arg == ' ' || *arg == '\t')
+	arg++;
+    }
+
+  dbg("%s() '%s' '%s'\n", __func__, cmd, arg ? arg : "");
+
+  if (!strcmp(cmd, "clients"))
+    control_query_clients(control, conn);
+  else if (!strcmp(cmd, "stats"))
+    control_query_stats(control, conn);
+  else if (!strcmp(cmd, "cache"))
+    control_query_cache(control, conn);
+  else if (!strcmp(cmd, "theme"))
+    {
+#ifndef STANDALONE
+      if (arg == NULL)
+	{
+	  control_reply(conn, "error theme needs a name");
+	  return;
+	}
+      mbtheme_switch(w, arg);
+#else
+      control_reply(conn, "error no theme support");
+      return;
+#endif
+    }
+  else if (!strcmp(cmd, "desktop"))
+    wm_mb_command(w, MB_CMD_DESKTOP);
+  else if (!strcmp(cmd, "next"))
+    wm_mb_command(w, MB_CMD_NEXT);
+  else if (!strcmp(cmd, "prev"))
+    wm_mb_command(w, MB_CMD_PREV);
+  else if (!strcmp(cmd, "panel-toggle"))
+    {
+      control_panel_toggle(control, conn, arg ? atoi(arg) : 0);
+      return;
+    }
+  else if (!strcmp(cmd, "composite"))
+    {
+#ifdef USE_COMPOSITE
+      wm_mb_command(w, MB_CMD_COMPOSITE);
+#else
+      control_reply(conn, "error no composite support");
+      return;
+#endif
+    }
+  else if (!strcmp(cmd, "keys-reload"))
+    {
+#ifndef NO_KBD
+      wm_mb_command(w, MB_CMB_KEYS_RELOAD);
+#else
+      control_reply(conn, "error no keyboard shortcut support");
+      return;
+#endif
+    }
+  else if (!strcmp(cmd, "stats-reset"))
+    wm_mb_command(w, MB_CMD_STATS_RESET);
+  else if (!strcmp(cmd, "exit"))
+    {
+      control_reply(conn, "ok");
+      wm_mb_command(w, MB_CMD_EXIT);
+      return;
+    }
+  else
+    {
+      control_reply(conn, "error unknown command %s", cmd);
+      return;
+    }
+
+  control_reply(conn, "ok");
+}
+
+/* Runs each complete command in the connection's buffer, and with
+ * eof whatever is left.
+ */
+static void
+control_conn_run (MBControl *control, MBControlConn *conn, Bool eof)
+{
+  char *start = conn->in, *end = conn->in + conn->in_len, *p;
+
+  for (p = start; p < end; p++)
+    if (*p == '\n' || *p == ';')
+      {
+	*p = '\0';
+	if (!conn->skipping)
+	  control_run(control, conn, start);
+	conn->skipping = False;
+	start = p + 1;
+      }
+
+  if (eof && start < end && !conn->skipping)
+    {
+      *end = '\0';
+      control_run(control, conn, start);
+      start = end;
+    }
+
+  conn->in_len = end - start;
+  memmove(conn->in, start, conn->in_len);
+}
+
+static void
+control_conn_read (MBControl *control, MBControlConn *conn)
+{
+  int n;
+
+  n = recv(conn->fd, conn->in + conn->in_len,
+	   sizeof(conn->in) - 1 - conn->in_len, 0);
+
+  if (n < 0 && (errno == EAGAIN || errno == EINTR))
+    return;
+
+  if (n <= 0)
+    {
+      if (n == 0)
+	control_conn_run(control, conn, True);
+      control_conn_close(conn);
+      return;
+    }
+
+  conn->in_len += n;
+
+  control_conn_run(control, conn, False);
+
+  /* Skip to the next command, closing now would lose the reply */
+  if (conn->in_len == sizeof(conn->in) - 1)
+    {
+      if (!conn->skipping)
+	control_reply(conn, "error command too long");
+      conn->skipping = True;
+      conn->in_len   = 0;
+    }
+
+  if (conn->failed)
+    control_conn_close(conn);
+}
+
+static void
+control_accept (MBControl *control)
+{
+  int fd, i;
+
+  if ((fd = accept(control->fd, NULL, NULL)) < 0)
+    return;
+
+  for (i = 0; i < CONTROL_MAX_CONNECTIONS; i++)
+    if (control->conns[i].fd == -1)
+      {
+	control_set_fd_flags(fd);
+	control->conns[i].fd = fd;
+	return;
+      }
+
+  send(fd, "error busy\n", 11, MSG_NOSIGNAL|MSG_DONTWAIT);
+  close(fd);
+}
+
+void
+control_process (MBControl *control, fd_set *set)
+{
+  int i;
+
+  for (i = 0; i < CONTROL_MAX_CONNECTIONS; i++)
+    if (control->conns[i].fd != -1 && FD_ISSET(control->conns[i].fd, set))
+      control_conn_read(control, &control->conns[i]);
+
+  if (FD_ISSET(control->fd, set))
+    control_accept(control);
+}
+
+void
+control_poll (MBControl *control)
+{
+  struct timeval tv = { 0, 0 };
+  fd_set         set;
+  int            max_fd;
+  long long      now = misc_get_time_usec();
+
+  /* Called per queued X event, keep the syscall off most of them */
+  if (now - control->poll_usec < CONTROL_POLL_INTERVAL * 1000LL)
+    return;
+
+  control->poll_usec = now;
+
+  FD_ZERO(&set);
+  max_fd = control_fds_set(control, &set, -1);
+
+  if (select(max_fd+1, &set, NULL, NULL, &tv) > 0)
+    control_process(control, &set);
+}
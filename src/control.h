@@ -0,0 +1,87 @@
+/*
+ *  Matchbox Window Manager - A lightweight window manager not for the
+ *                            desktop.
+ *
+ *  Authored By Matthew Allum <mallum@o-hand.com>
+ *
+ *  Copyright (c) 2002, 2004 OpenedHand Ltd - http://o-hand.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#ifndef _MBCONTROL_H_
+#define _MBCONTROL_H_
+
+#include "structs.h"
+
+#include <sys/select.h>
+
+/*
+ *  Local control socket.
+ *
+ *  A Unix domain socket the main loop polls alongside the X connection,
+ *  so tools get replies rather than firing _MB_COMMAND messages and
+ *  watching root properties. It lives at MB_CONTROL_SOCKET, or
+ *  /tmp/matchbox-<uid>/control-<display> by default, and its path is
+ *  published on the root as _MB_CONTROL_SOCKET. Setting MB_CONTROL_SOCKET
+ *  to an empty string turns it off.
+ *
+ *  Requests are commands separated by newlines or ';', any number per
+ *  connection. Each gets zero or more data lines, 'kind key=value ...',
+ *  then a line of 'ok' or 'error <reason>'. Commands are
+ *
+ *    theme <name>       switch theme
+ *    desktop            toggle the desktop
+ *    next, prev         page through apps
+ *    panel-toggle [id]  toggle panel <id>'s visibility
+ *    composite          toggle the compositing engine
+ *    keys-reload        reload key shortcuts
+ *    stats-reset        reset latency stats
+ *    exit               exit the window manager
+ *
+ *  and queries
+ *
+ *    clients            a 'client' line per client, bottom of stack first
+ *    stats              'latency', 'pool' and 'x' lines, as the _MB_*_STATS
+ *    cache              'theme' and 'icons' image cache usage, themed
+ *                       builds only
+ */
+
+#define CONTROL_MAX_CONNECTIONS 8
+#define CONTROL_LINE_MAX        1024
+#define CONTROL_POLL_INTERVAL   5	/* ms, see control_poll() */
+
+struct MBControl;
+
+/* Returns NULL if turned off or the socket can't be set up */
+struct MBControl*
+control_new (Wm *w);
+
+/* Adds the listening and connection fds to set, returns the highest
+ * of them and max_fd.
+ */
+int
+control_fds_set (struct MBControl *control, fd_set *set, int max_fd);
+
+/* Accepts connections and runs requests ready in set */
+void
+control_process (struct MBControl *control, fd_set *set);
+
+/* Runs whatever requests are ready without waiting, for when X events
+ * are queued and the main loop won't get to select() on the sockets.
+ * Only looks every CONTROL_POLL_INTERVAL ms, so requests wait at most
+ * that long behind a busy X queue.
+ */
+void
+control_poll (struct MBControl *control);
+
+#endif
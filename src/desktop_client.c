@@ -34,7 +34,7 @@ desktop_client_new(Wm *w, Window win)
      }
 
    c = base_client_new(w, win); 
-   c->type         = MBCLIENT_TYPE_DESKTOP;
+   stack_set_type(c, MBCLIENT_TYPE_DESKTOP);
    c->configure    = &desktop_client_configure;
    c->reparent     = &desktop_client_reparent;
    c->move_resize  = &desktop_client_move_resize;
@@ -90,6 +90,8 @@ desktop_client_show(Client *c)
     }
   
   c->mapped = True;
+
+  theme_frame_menu_invalidate(w->mbtheme);
 }
 
 void
@@ -101,6 +103,8 @@ desktop_client_unmap(Client *c)
 
    c->mapped = False;
 
+   theme_frame_menu_invalidate(w->mbtheme);
+
    if (w->stack_top_app)
      {
        /* Needed to make sure app window task menu button gets updated */
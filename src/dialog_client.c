@@ -20,6 +20,8 @@
 
 #include "dialog_client.h"
 
+#include <sys/time.h>
+
 static void dialog_client_check_for_state_hints(Client *c);
 static void dialog_client_drag(Client *c);
 static void _get_mouse_position(Wm *w, int *x, int *y);
@@ -32,7 +34,7 @@ dialog_client_new(Wm *w, Window win, Client *trans)
 
    if (!c) return NULL;
 
-   c->type = MBCLIENT_TYPE_DIALOG;
+   stack_set_type(c, MBCLIENT_TYPE_DIALOG);
    
    c->reparent     = &dialog_client_reparent;
    c->move_resize  = &dialog_client_move_resize;
@@ -40,13 +42,14 @@ dialog_client_new(Wm *w, Window win, Client *trans)
    c->configure    = &dialog_client_configure;
    c->button_press = &dialog_client_button_press;
    c->redraw       = &dialog_client_redraw;
+   c->prerender    = &dialog_client_prerender;
    c->show         = &dialog_client_show;
    c->destroy      = &dialog_client_destroy;
    c->get_coverage = &dialog_client_get_coverage;
 
    dialog_client_check_for_state_hints(c);
 
-   c->trans = trans;
+   client_set_transient_for(c, trans);
 
    return c;
 }
@@ -803,6 +806,77 @@ dialog_client_configure(Client *c)
   dialog_init_geometry(c);
 }
 
+/* Figure out which set of theme frames decorate the dialog */
+static void
+dialog_client_get_frame_refs(Client *c, 
+			     int    *frame_ref_top,
+			     int    *frame_ref_east,
+			     int    *frame_ref_west,
+			     int    *frame_ref_south)
+{
+  *frame_ref_top   = FRAME_DIALOG;
+  *frame_ref_east  = FRAME_DIALOG_EAST;
+  *frame_ref_west  = FRAME_DIALOG_WEST;
+  *frame_ref_south = FRAME_DIALOG_SOUTH;
+
+  if (c->flags & CLIENT_BORDERS_ONLY_FLAG 
+      && theme_has_frame_type_defined(c->wm->mbtheme, FRAME_DIALOG_NORTH))
+    *frame_ref_top   = FRAME_DIALOG_NORTH;
+
+  /* 'message dialogs have there own decorations */
+  if (c->flags & CLIENT_HAS_URGENCY_FLAG
+      && theme_has_message_decor(c->wm->mbtheme))
+    {
+      *frame_ref_top   = FRAME_MSG;
+      *frame_ref_east  = FRAME_MSG_EAST;
+      *frame_ref_west  = FRAME_MSG_WEST;
+      *frame_ref_south = FRAME_MSG_SOUTH;
+    }
+  else if (c->flags & CLIENT_BORDERS_ONLY_FLAG
+	   && theme_has_borders_only_decor(c->wm->mbtheme))
+    {
+      *frame_ref_top   = FRAME_DIALOG_NT_NORTH;
+      *frame_ref_east  = FRAME_DIALOG_NT_EAST;
+      *frame_ref_west  = FRAME_DIALOG_NT_WEST;
+      *frame_ref_south = FRAME_DIALOG_NT_SOUTH;
+    }
+}
+
+/* Queues the frames dialog_client_redraw() will paint, at their 
+ * current sizes, for theme_frame_prerender_run().
+*/
+void
+dialog_client_prerender(Client *c)
+{
+  MBTheme *theme = c->wm->mbtheme;
+  Bool     is_shaped;
+  int      offset_north = 0, offset_south = 0, offset_west = 0, offset_east = 0;
+  int      total_w;
+  int      frame_ref_top, frame_ref_east, frame_ref_west, frame_ref_south;
+
+  if (c->flags & CLIENT_TITLE_HIDDEN_FLAG) return;
+
+  offset_north = dialog_client_title_height(c);
+
+  dialog_client_get_offsets(c, &offset_east, &offset_south, &offset_west);
+
+  total_w = offset_east + offset_west + c->width;
+
+  dialog_client_get_frame_refs(c, &frame_ref_top, &frame_ref_east, 
+			       &frame_ref_west, &frame_ref_south);
+
+  is_shaped = theme_frame_wants_shaped_window(theme, frame_ref_top);
+
+  theme_frame_prerender_add(theme, frame_ref_top, 
+			    total_w, offset_north, is_shaped);
+  theme_frame_prerender_add(theme, frame_ref_west, 
+			    offset_west, c->height, is_shaped);
+  theme_frame_prerender_add(theme, frame_ref_east, 
+			    offset_east, c->height, is_shaped);
+  theme_frame_prerender_add(theme, frame_ref_south, 
+			    total_w, offset_south, is_shaped);
+}
+
 void
 dialog_client_redraw(Client *c, Bool use_cache)
 {
@@ -813,10 +887,7 @@ dialog_client_redraw(Client *c, Bool use_cache)
   int offset_north = 0, offset_south = 0, offset_west = 0, offset_east = 0;
   int total_w = 0, total_h = 0;
 
-  int frame_ref_top   = FRAME_DIALOG;
-  int frame_ref_east  = FRAME_DIALOG_EAST;
-  int frame_ref_west  = FRAME_DIALOG_WEST;
-  int frame_ref_south = FRAME_DIALOG_SOUTH;
+  int frame_ref_top, frame_ref_east, frame_ref_west, frame_ref_south;
 
   if (c->flags & CLIENT_TITLE_HIDDEN_FLAG) return;
 
@@ -829,35 +900,16 @@ dialog_client_redraw(Client *c, Bool use_cache)
   total_w = offset_east  + offset_west + c->width;
   total_h = offset_north + offset_south + c->height;
 
-
-  if (c->flags & CLIENT_BORDERS_ONLY_FLAG 
-      && theme_has_frame_type_defined(c->wm->mbtheme, FRAME_DIALOG_NORTH))
-    frame_ref_top   = FRAME_DIALOG_NORTH;
-
-  /* 'message dialogs have there own decorations */
-  if (c->flags & CLIENT_HAS_URGENCY_FLAG
-      && theme_has_message_decor(w->mbtheme))
-    {
-      frame_ref_top   = FRAME_MSG;
-      frame_ref_east  = FRAME_MSG_EAST;
-      frame_ref_west  = FRAME_MSG_WEST;
-      frame_ref_south = FRAME_MSG_SOUTH;
-    }
-  else if (c->flags & CLIENT_BORDERS_ONLY_FLAG
-	   && theme_has_borders_only_decor(c->wm->mbtheme))
-    {
-      frame_ref_top   = FRAME_DIALOG_NT_NORTH;
-      frame_ref_east  = FRAME_DIALOG_NT_EAST;
-      frame_ref_west  = FRAME_DIALOG_NT_WEST;
-      frame_ref_south = FRAME_DIALOG_NT_SOUTH;
-    }
+  dialog_client_get_frame_refs(c, &frame_ref_top, &frame_ref_east, 
+			       &frame_ref_west, &frame_ref_south);
 
   dbg("%s() c->width : %i , offset_east : %i, offset_west : %i\n",
       __func__, c->width, offset_east, offset_west );
 
   is_shaped = theme_frame_wants_shaped_window( c->wm->mbtheme, frame_ref_top);
 
-  if (is_shaped) client_init_backing_mask(c, total_w, c->height, 
+  if (is_shaped) client_init_backing_mask(c, frame_ref_top,
+					  total_w, c->height, 
 					  offset_north, offset_south,
 					  offset_east, offset_west);
 
@@ -1071,18 +1123,130 @@ dialog_client_button_press(Client *c, XButtonEvent *e)
    }
 }
 
+#define DRAG_EVENT_MASK (ButtonPressMask|ButtonReleaseMask \
+			 |PointerMotionMask|SubstructureNotifyMask)
+
+typedef struct MBDragState
+{
+  Client       *c;
+  Window        win_outline;  /* None when dragging the frame itself */
+  int           offset_west, frm_size;
+
+  Bool          pending;      /* c->x/y changed but not yet moved to */
+  long long     pending_usec; /* when the oldest unapplied motion came in */
+  long long     move_usec;
+
+  unsigned long n_motions, n_compressed, n_moves;
+  long long     latency_total, latency_max;
+
+} MBDragState;
+
+/* Like XMaskEvent() but gives up at deadline_usec, 0 blocks */
+static Bool
+dialog_client_drag_next_event (Wm *w, XEvent *ev, long long deadline_usec)
+{
+  while (!XCheckMaskEvent(w->dpy, DRAG_EVENT_MASK, ev))
+    {
+      struct timeval tv;
+      fd_set         readset;
+      int            fd = ConnectionNumber(w->dpy);
+      long long      now;
+
+      if (!deadline_usec)
+	{
+	  XMaskEvent(w->dpy, DRAG_EVENT_MASK, ev);
+	  return True;
+	}
+
+      if ((now = misc_get_time_usec()) >= deadline_usec)
+	return False;
+
+      tv.tv_sec  = (deadline_usec - now) / 1000000;
+      tv.tv_usec = (deadline_usec - now) % 1000000;
+
+      FD_ZERO(&readset);
+      FD_SET(fd, &readset);
+
+      if (select(fd+1, &readset, NULL, NULL, &tv) == 0)
+	return False;
+    }
+
+  return True;
+}
+
+/* Moves the outline, or with an opaque drag the frame, to c->x/y */
+static void
+dialog_client_drag_move (MBDragState *drag)
+{
+  Client   *c = drag->c;
+  Wm       *w = c->wm;
+  long long latency;
+
+  if (drag->win_outline != None)
+    XMoveWindow(w->dpy, drag->win_outline, 
+		c->x - drag->offset_west, c->y - drag->frm_size);
+  else
+    {
+      XMoveWindow(w->dpy, c->frame, 
+		  c->x - drag->offset_west, c->y - drag->frm_size);
+#ifdef USE_COMPOSITE
+      comp_engine_client_configure(w, c);
+
+      if (w->all_damage)
+      	{
+	  comp_engine_render(w, w->all_damage);
+	  XFixesDestroyRegion (w->dpy, w->all_damage);
+	  w->all_damage = None;
+	}
+#endif
+    }
+
+  XFlush(w->dpy);
+
+  drag->move_usec = misc_get_time_usec();
+  drag->pending   = False;
+  drag->n_moves++;
+
+  latency = drag->move_usec - drag->pending_usec;
+
+  drag->latency_total += latency;
+  if (latency > drag->latency_max)
+    drag->latency_max = latency;
+}
+
+static void
+dialog_client_drag_stats_update (MBDragState *drag)
+{
+  Wm  *w = drag->c->wm;
+  char buf[128];
+
+  snprintf(buf, sizeof(buf), 
+	   "motions=%lu compressed=%lu moves=%lu latency_avg=%li latency_max=%li",
+	   drag->n_motions, drag->n_compressed, drag->n_moves,
+	   drag->n_moves ? (long)(drag->latency_total / drag->n_moves) : 0L,
+	   (long)drag->latency_max);
+
+  dbg("%s() %s\n", __func__, buf);
+
+  XChangeProperty(w->dpy, w->root, w->atoms[_MB_DRAG_STATS],
+		  XA_STRING, 8, PropModeReplace,
+		  (unsigned char *)buf, strlen(buf));
+}
+
 static void
 dialog_client_drag(Client *c) /* drag box */
 {
   Wm                  *w = c->wm;
-  XEvent               ev;
+  XEvent               ev, next;
   int                  offset_south = 0, offset_west = 0, offset_east = 0;
   int                  x1, y1, old_cx = c->x, old_cy = c->y;
   int                  frm_size     = dialog_client_title_height(c);
   XSetWindowAttributes attr;
-  Window               win_outline;
+  Window               win_outline  = None;
   XRectangle           rects[1];
   Bool                 done = False, client_removed = False;
+  MBDragState          drag;
+  long long            interval;
 
   dbg("%s called\n", __func__);
 
@@ -1095,32 +1259,49 @@ dialog_client_drag(Client *c) /* drag box */
       != GrabSuccess)
     return;
 
-  attr.override_redirect = True;
-  attr.background_pixel  = BlackPixel(w->dpy, w->screen);  
-
-  win_outline = XCreateWindow(w->dpy, 
-			      w->root,
-			      c->x - offset_west, c->y - frm_size,
-			      c->width + offset_west + offset_east,
-			      c->height + frm_size + offset_south,
-			      0,
-			      CopyFromParent, 
-			      CopyFromParent, 
-			      CopyFromParent,
-			      CWBackPixel|CWOverrideRedirect,
-			      &attr);
-
-  rects[0].x      = 2;  
-  rects[0].y      = 2;
-  rects[0].width  = c->width + offset_west + offset_east - 4;
-  rects[0].height = c->height + frm_size + offset_south  - 4;
-
-  XShapeCombineRectangles (w->dpy, win_outline,
-			   ShapeBounding,
-			   0, 0, rects, 1, ShapeSubtract, 0 );
-
-  XMapWindow (w->dpy, win_outline);
-  XSync (w->dpy, False);
+  memset(&drag, 0, sizeof(MBDragState));
+  drag.c           = c;
+  drag.offset_west = offset_west;
+  drag.frm_size    = frm_size;
+
+  interval = (long long)w->config->drag_update_interval * 1000;
+
+#ifdef USE_COMPOSITE
+  /* With a compositor running moving the real frame is cheap enough */
+  if (!(w->config->opaque_drag && w->have_comp_engine 
+	&& !w->comp_engine_disabled)
+      || w->config->dialog_stratergy == WM_DIALOGS_STRATERGY_STATIC)
+#endif
+    {
+      attr.override_redirect = True;
+      attr.background_pixel  = BlackPixel(w->dpy, w->screen);  
+
+      win_outline = XCreateWindow(w->dpy, 
+				  w->root,
+				  c->x - offset_west, c->y - frm_size,
+				  c->width + offset_west + offset_east,
+				  c->height + frm_size + offset_south,
+				  0,
+				  CopyFromParent, 
+				  CopyFromParent, 
+				  CopyFromParent,
+				  CWBackPixel|CWOverrideRedirect,
+				  &attr);
+
+      rects[0].x      = 2;  
+      rects[0].y      = 2;
+      rects[0].width  = c->width + offset_west + offset_east - 4;
+      rects[0].height = c->height + frm_size + offset_south  - 4;
+
+      XShapeCombineRectangles (w->dpy, win_outline,
+			       ShapeBounding,
+			       0, 0, rects, 1, ShapeSubtract, 0 );
+
+      XMapWindow (w->dpy, win_outline);
+      XSync (w->dpy, False);
+    }
+
+  drag.win_outline = win_outline;
 
   comp_engine_client_show(c->wm, c); 
 
@@ -1130,12 +1311,15 @@ dialog_client_drag(Client *c) /* drag box */
 
   while (!done) 
     {
-      int wanted_x = 0, wanted_y = 0;
-
-      XMaskEvent(c->wm->dpy, 
-		 ButtonPressMask|ButtonReleaseMask
-		 |PointerMotionMask|SubstructureNotifyMask,
-		 &ev);
+      /* A move held back by the frame limit is flushed when its due,
+       * even if the pointer has stopped.
+       */
+      if (!dialog_client_drag_next_event(w, &ev, drag.pending ? 
+					 drag.move_usec + interval : 0))
+	{
+	  dialog_client_drag_move(&drag);
+	  continue;
+	}
 
     switch (ev.type) 
       {
@@ -1159,13 +1343,36 @@ dialog_client_drag(Client *c) /* drag box */
 	if (w->config->dialog_stratergy == WM_DIALOGS_STRATERGY_STATIC)
 	  break;
 
-	wanted_x = (old_cx + (ev.xmotion.x - x1));
-	wanted_y = (old_cy + (ev.xmotion.y - y1));
+	drag.n_motions++;
 
-	c->x = wanted_x;
-	c->y = wanted_y;
+	/* Only the latest queued motion matters, but stop at anything
+	 * else so a release isn't handled out of order.
+	 */
+	while (XCheckMaskEvent(w->dpy, ButtonPressMask|ButtonReleaseMask
+			       |PointerMotionMask, &next))
+	  {
+	    if (next.type != MotionNotify)
+	      {
+		XPutBackEvent(w->dpy, &next);
+		break;
+	      }
+
+	    ev = next;
+	    drag.n_motions++;
+	    drag.n_compressed++;
+	  }
 
-	XMoveWindow(c->wm->dpy, win_outline, c->x-offset_west, c->y-frm_size);
+	if (!drag.pending)
+	  {
+	    drag.pending      = True;
+	    drag.pending_usec = misc_get_time_usec();
+	  }
+
+	c->x = (old_cx + (ev.xmotion.x - x1));
+	c->y = (old_cy + (ev.xmotion.y - y1));
+
+	if (misc_get_time_usec() - drag.move_usec >= interval)
+	  dialog_client_drag_move(&drag);
 	break;
 
       case ButtonRelease:
@@ -1180,7 +1387,9 @@ dialog_client_drag(Client *c) /* drag box */
   XUngrabPointer(w->dpy, CurrentTime);
 
   misc_trap_xerrors(); 
-  XDestroyWindow (w->dpy, win_outline);
+
+  if (win_outline != None)
+    XDestroyWindow (w->dpy, win_outline);
 
   if (client_removed == False) 
     {
@@ -1194,6 +1403,9 @@ dialog_client_drag(Client *c) /* drag box */
     }
 
   misc_untrap_xerrors();
+
+  if (drag.n_motions)
+    dialog_client_drag_stats_update(&drag);
 }
 
 
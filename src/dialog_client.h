@@ -53,6 +53,9 @@ dialog_client_configure (Client *c);
 void 
 dialog_client_redraw (Client *c, Bool use_cache);
 
+void 
+dialog_client_prerender (Client *c);
+
 void 
 dialog_client_button_press (Client *c, XButtonEvent *e);
 
@@ -33,7 +33,7 @@ dockbar_client_new(Wm *w, Window win)
 
    if (!c) return NULL;
 
-   c->type         = MBCLIENT_TYPE_PANEL;
+   stack_set_type(c, MBCLIENT_TYPE_PANEL);
    c->configure    = &dockbar_client_configure;
    c->show         = &dockbar_client_show;
    c->hide         = &dockbar_client_hide;
@@ -22,6 +22,16 @@
 
 static void set_supported(Wm *w);
 static void set_compliant(Wm *w);
+static void ewmh_atom_handlers_init (Wm *w);
+
+#ifdef USE_XSYNC
+static void ewmh_handle_sync_counter_change (Wm *w, Client *c, 
+					     XPropertyEvent *e);
+#endif
+
+#ifndef NO_PING
+static void ewmh_ping_record_pong (Client *c);
+#endif
 
 void
 ewmh_init(Wm *w)
@@ -122,12 +132,25 @@ ewmh_init(Wm *w)
     "_NET_WM_WINDOW_TYPE_NOTIFICATION",
     "_NET_WM_WINDOW_TYPE_DROPDOWN_MENU",
     "_NET_WM_WINDOW_TYPE_POPUP_MENU",
-    "_MB_NUM_SYSTEM_MODAL_WINDOWS_PRESENT"
+    "_MB_NUM_SYSTEM_MODAL_WINDOWS_PRESENT",
+    "_MB_THEME_STATS",
+    "_MB_STARTUP_REPORT",
+    "_MB_PING_STATS",
+    "_MB_TITLE_STATS",
+    "_MB_CONFIGURE_STATS",
+    "_MB_DRAG_STATS",
+    "_MB_EVENT_STATS",
+    "_MB_POOL_STATS",
+    "_MB_X_STATS",
+    "_MB_LATENCY_STATS",
+    "_MB_CONTROL_SOCKET"
   };
 
   XInternAtoms (w->dpy, atom_names, ATOM_COUNT,
                 False, w->atoms);
 
+  ewmh_atom_handlers_init(w);
+
 #ifdef USE_XSYNC
   ewmh_sync_init(w);
 #endif
@@ -151,164 +174,273 @@ ewmh_init_props(Wm *w)
 		  (unsigned char *)&current_desktop, 1);
 }
 
-int
-ewmh_handle_root_message(Wm *w, XClientMessageEvent *e)
+/* 
+ * Atom -> handler table. PropertyNotify and ClientMessage events are
+ * looked up here first so the ( many ) atoms nobody cares about get
+ * thrown away without walking the client list.
+*/
+
+static MBAtomHandler*
+ewmh_atom_handler_slot (Wm *w, Atom atom, Bool create)
 {
-  /* Handle client messages _sent_ to root window */
+  unsigned int mask = ATOM_HANDLER_TABLE_SIZE - 1;
+  unsigned int i, n;
 
-   Client *c = NULL;
+  if (atom == None)
+    return NULL;
 
-   dbg("%s() called\n", __func__);
+  for (n = 0, i = atom & mask; n < ATOM_HANDLER_TABLE_SIZE; n++, i = (i+1) & mask)
+    {
+      if (w->atom_handlers[i].atom == atom)
+	return &w->atom_handlers[i];
 
-   if (e->message_type == w->atoms[_NET_ACTIVE_WINDOW])
-     {
-       dbg("%s() got active window message for win %li", __func__, e->window);
-       if ((c = wm_find_client(w, e->window, WINDOW)) != NULL)
-	 {
-	   if (c->type == MBCLIENT_TYPE_DIALOG
-	       && c->trans != NULL)
-	     {
-	       /* 
-                * If an attempt has been made to activate a hidden
-                * dialog, activate its parent app first.
-                *
-                * Note this is mainly to work with some task selectors
-                * ( eg the gnome one, which activates top dialog ).
-                *
-                * XXX wm_activate_client() should probably do this.
-	       */
-
-	       Client *parent = c->trans;
-
-	       while (parent->trans != NULL)
-		 parent = parent->trans;
-
-	       if (parent != wm_get_visible_main_client(w))
-		 wm_activate_client(parent);
-	     }
-	   /* Likely activated by a TN so start pinging if aggresive setup */
-	   if (w->config->ping_aggressive 
-	       && c->type == MBCLIENT_TYPE_APP
-	       && c != wm_get_visible_main_client(w))
-	     ewmh_ping_client_start (c);
-	   wm_activate_client(c);
-	 }
-       return 1;
-     } 
-   else if (e->message_type == w->atoms[_NET_CLOSE_WINDOW]) 
-     {
-       if ((c = wm_find_client(w, e->window, WINDOW)) != NULL)
-	 client_deliver_delete(c);
-       return 1;
-     } 
-   else if (e->message_type == w->atoms[WM_PROTOCOLS]
-	    && e->data.l[0] == w->atoms[_NET_WM_PING]) 
-     {
-       if ((c = wm_find_client(w, e->data.l[1], WINDOW)) != NULL)
-	 {
-	   dbg("%s() pong from %s\n", __func__, c->name);
+      if (w->atom_handlers[i].atom == None)
+	{
+	  if (!create)
+	    return NULL;
+
+	  w->atom_handlers[i].atom = atom;
+	  w->n_atom_handlers++;
+
+	  return &w->atom_handlers[i];
+	}
+    }
+
+  if (create)
+    fprintf(stderr, "matchbox: atom handler table full, ignoring atom %li\n", 
+	    atom);
+
+  return NULL;
+}
+
+MBAtomHandler*
+ewmh_atom_handler_lookup (Wm *w, Atom atom)
+{
+  return ewmh_atom_handler_slot (w, atom, False);
+}
+
+/* Passing a NULL func unsets any existing handler */
+Bool
+ewmh_set_property_handler (Wm *w, Atom atom, MBPropertyHandlerFunc func)
+{
+  MBAtomHandler *handler;
+
+  if ((handler = ewmh_atom_handler_slot (w, atom, True)) == NULL)
+    return False;
+
+  handler->property = func;
+
+  return True;
+}
+
+Bool
+ewmh_set_message_handler (Wm *w, Atom atom, MBMessageHandlerFunc func)
+{
+  MBAtomHandler *handler;
+
+  if ((handler = ewmh_atom_handler_slot (w, atom, True)) == NULL)
+    return False;
+
+  handler->message = func;
+
+  return True;
+}
+
+/* Handlers for EWMH client messages _sent_ to root window */
 
-	   /* We got a response to a ping. stop pinging it now
-	    * until close button is pressed again. 
+static void
+ewmh_handle_active_window_message (Wm *w, XClientMessageEvent *e)
+{
+  Client *c = NULL;
+
+  dbg("%s() got active window message for win %li", __func__, e->window);
+
+  if ((c = wm_find_client(w, e->window, WINDOW)) != NULL)
+    {
+      if (c->type == MBCLIENT_TYPE_DIALOG
+	  && c->trans != NULL)
+	{
+	  /* 
+	   * If an attempt has been made to activate a hidden
+	   * dialog, activate its parent app first.
+	   *
+	   * Note this is mainly to work with some task selectors
+	   * ( eg the gnome one, which activates top dialog ).
+	   *
+	   * XXX wm_activate_client() should probably do this.
 	   */
-	   if (c->ping_handler_called)
-	     {
-	       int len;
-	       char *buf;
-	       /* aha! this was thought be be dead but has come
-		* alive again..
-	       */
-	       len = strlen(w->config->ping_handler) + 32;
-	       buf = malloc(len);
-
-	       if (buf)
-		 {
-		   snprintf(buf, len-1, "%s %i %li 1",
-			    w->config->ping_handler,
-			    c->pid,
-			    c->window);
-		   
-		   fork_exec(buf);
-		   
-		   free(buf);
-		 }
-	     }
-
-	   if (w->config->ping_aggressive)
-	     {
-	       if (c->pings_pending >= 0)
-		 c->pings_pending--;
-	     }
-	   else
-	     {
-	       /* Regular pinging, assume 1 reply and the  
-		* app is alive. 
-	       */
-	       if (c->pings_pending > 0) 
-		 {
-		   ewmh_ping_client_stop(c);
-		 }
-	     }
-	 }
-     } 
-   else if (e->message_type == w->atoms[WINDOW_STATE]) 
-     {
-       if (e->data.l[1] == w->atoms[WINDOW_STATE_FULLSCREEN]
+
+	  Client *parent = c->trans;
+
+	  while (parent->trans != NULL)
+	    parent = parent->trans;
+
+	  if (parent != wm_get_visible_main_client(w))
+	    wm_activate_client(parent);
+	}
+      /* Likely activated by a TN so start pinging if aggresive setup */
+      if (w->config->ping_aggressive 
+	  && c->type == MBCLIENT_TYPE_APP
+	  && c != wm_get_visible_main_client(w))
+	ewmh_ping_client_start (c);
+      wm_activate_client(c);
+    }
+}
+
+static void
+ewmh_handle_close_window_message (Wm *w, XClientMessageEvent *e)
+{
+  Client *c = NULL;
+
+  if ((c = wm_find_client(w, e->window, WINDOW)) != NULL)
+    client_deliver_delete(c);
+}
+
+static void
+ewmh_handle_protocols_message (Wm *w, XClientMessageEvent *e)
+{
+  Client *c = NULL;
+
+  if ((Atom)e->data.l[0] != w->atoms[_NET_WM_PING])
+    return;
+
+  if ((c = wm_find_client(w, e->data.l[1], WINDOW)) != NULL)
+    {
+      dbg("%s() pong from %s\n", __func__, c->name);
+
+#ifndef NO_PING
+      ewmh_ping_record_pong(c);
+      w->ping_stats_dirty = True;
+#endif
+
+      /* We got a response to a ping. stop pinging it now
+       * until close button is pressed again. 
+       */
+      if (c->ping_handler_called)
+	{
+	  int len;
+	  char *buf;
+	  /* aha! this was thought be be dead but has come
+	   * alive again..
+	   */
+	  len = strlen(w->config->ping_handler) + 32;
+	  buf = malloc(len);
+
+	  if (buf)
+	    {
+	      snprintf(buf, len-1, "%s %i %li 1",
+		       w->config->ping_handler,
+		       c->pid,
+		       c->window);
+	      
+	      fork_exec(buf);
+	      
+	      free(buf);
+	    }
+	}
+
+      if (w->config->ping_aggressive)
+	{
+	  if (c->pings_pending >= 0)
+	    c->pings_pending--;
+	}
+      else
+	{
+	  /* Regular pinging, assume 1 reply and the  
+	   * app is alive. 
+	   */
+	  if (c->pings_pending > 0) 
+	    {
+	      ewmh_ping_client_stop(c);
+	    }
+	}
+    }
+}
+
+static void
+ewmh_handle_state_message (Wm *w, XClientMessageEvent *e)
+{
+  Client *c = NULL;
+
+  if ((Atom)e->data.l[1] == w->atoms[WINDOW_STATE_FULLSCREEN]
+      && ((c = wm_find_client(w, e->window, WINDOW)) != NULL)
+      && c->type == MBCLIENT_TYPE_APP)
+    {
+      dbg("got EWMH fullscreen state change\n");
+      switch (e->data.l[0])
+	{
+	case _NET_WM_STATE_REMOVE:
+	  if (c->flags & CLIENT_FULLSCREEN_FLAG)
+	    main_client_toggle_fullscreen(c);
+	  break;
+	case _NET_WM_STATE_ADD:
+	  if (!(c->flags & CLIENT_FULLSCREEN_FLAG))
+	    main_client_toggle_fullscreen(c);
+	  break;
+	case _NET_WM_STATE_TOGGLE:
+	  main_client_toggle_fullscreen(c);
+	  break;
+	}
+    }
+  else if ((Atom)e->data.l[1] == w->atoms[WINDOW_STATE_ABOVE]
 	   && ((c = wm_find_client(w, e->window, WINDOW)) != NULL)
-	   && c->type == MBCLIENT_TYPE_APP)
-	 {
-	   dbg("got EWMH fullscreen state change\n");
-	   switch (e->data.l[0])
-	     {
-	     case _NET_WM_STATE_REMOVE:
-	       if (c->flags & CLIENT_FULLSCREEN_FLAG)
-		 main_client_toggle_fullscreen(c);
-	       break;
-	     case _NET_WM_STATE_ADD:
-	       if (!(c->flags & CLIENT_FULLSCREEN_FLAG))
-		 main_client_toggle_fullscreen(c);
-	       break;
-	     case _NET_WM_STATE_TOGGLE:
-	       main_client_toggle_fullscreen(c);
-	       break;
-	     }
-	 }
-       else if (e->data.l[1] == w->atoms[WINDOW_STATE_ABOVE]
-		&& ((c = wm_find_client(w, e->window, WINDOW)) != NULL)
-		&& c->type == MBCLIENT_TYPE_DIALOG)
-	 {
-	   dbg("got EWMH above state change\n");
-	   switch (e->data.l[0])
-	     {
-	     case _NET_WM_STATE_REMOVE:
-	       c->flags &= ~CLIENT_HAS_ABOVE_STATE;
-	       break;
-	     case _NET_WM_STATE_ADD:
-	       c->flags |= CLIENT_HAS_ABOVE_STATE;
-	       break;
-	     case _NET_WM_STATE_TOGGLE:
-	       c->flags ^= CLIENT_HAS_ABOVE_STATE;
-	       break;
-	     }
-	   wm_activate_client(c);
-	 }
-       return 1;
-     } 
-   else if (e->message_type == w->atoms[_NET_SHOW_DESKTOP]
-	    && wm_get_desktop(w) ) 
-     {
-       dbg("%s() got desktop message\n", __func__);
-       if (e->data.l[0] == 1)
-	 { 			/* Show the desktop, if not shown */
-	   if (!(w->flags & DESKTOP_RAISED_FLAG))
-	     wm_toggle_desktop(w);
-	 } else {                 /* Hide the desktop, if shown */
-	   if (w->flags & DESKTOP_RAISED_FLAG)
-	     wm_toggle_desktop(w);
-	 }
-     }
-   
-   return 0;
+	   && c->type == MBCLIENT_TYPE_DIALOG)
+    {
+      dbg("got EWMH above state change\n");
+      switch (e->data.l[0])
+	{
+	case _NET_WM_STATE_REMOVE:
+	  c->flags &= ~CLIENT_HAS_ABOVE_STATE;
+	  break;
+	case _NET_WM_STATE_ADD:
+	  c->flags |= CLIENT_HAS_ABOVE_STATE;
+	  break;
+	case _NET_WM_STATE_TOGGLE:
+	  c->flags ^= CLIENT_HAS_ABOVE_STATE;
+	  break;
+	}
+      wm_activate_client(c);
+    }
+}
+
+static void
+ewmh_handle_show_desktop_message (Wm *w, XClientMessageEvent *e)
+{
+  if (!wm_get_desktop(w))
+    return;
+
+  dbg("%s() got desktop message\n", __func__);
+  if (e->data.l[0] == 1)
+    { 			/* Show the desktop, if not shown */
+      if (!(w->flags & DESKTOP_RAISED_FLAG))
+	wm_toggle_desktop(w);
+    } else {                 /* Hide the desktop, if shown */
+      if (w->flags & DESKTOP_RAISED_FLAG)
+	wm_toggle_desktop(w);
+    }
+}
+
+static void
+ewmh_atom_handlers_init (Wm *w)
+{
+  memset(w->atom_handlers, 0, sizeof(w->atom_handlers));
+  w->n_atom_handlers = 0;
+
+  ewmh_set_message_handler (w, w->atoms[_NET_ACTIVE_WINDOW],
+			    ewmh_handle_active_window_message);
+  ewmh_set_message_handler (w, w->atoms[_NET_CLOSE_WINDOW],
+			    ewmh_handle_close_window_message);
+  ewmh_set_message_handler (w, w->atoms[WM_PROTOCOLS],
+			    ewmh_handle_protocols_message);
+  ewmh_set_message_handler (w, w->atoms[WINDOW_STATE],
+			    ewmh_handle_state_message);
+  ewmh_set_message_handler (w, w->atoms[_NET_SHOW_DESKTOP],
+			    ewmh_handle_show_desktop_message);
+
+#ifdef USE_XSYNC
+  ewmh_set_property_handler (w, w->atoms[_NET_WM_SYNC_REQUEST_COUNTER],
+			     ewmh_handle_sync_counter_change);
+#endif
 }
 
 void
@@ -317,6 +449,7 @@ ewmh_update_lists(Wm *w)
    Client        *c = NULL;
    Window        *wins = NULL;
    int            cnt = 0;
+   long long      start = misc_get_time_usec();
    
    dbg("%s(): called %i\n", __func__, n_stack_items(w)); 
 
@@ -469,6 +602,8 @@ ewmh_update_lists(Wm *w)
 		      XA_CARDINAL, 32, PropModeReplace,
 		      (unsigned char *)&modal_blockers, 1);
     }
+
+  latency_add(LATENCY_EWMH_UPDATE_LISTS, misc_get_time_usec() - start);
 }
 
 void
@@ -559,9 +694,9 @@ state_check (Client *c, Atom check, Atom atom_state_wanted)
 {
   Wm   *w = c->wm;
 
-  unsigned long n;
+  unsigned long n, i;
   unsigned long extra;
-  int           format, status, i;
+  int           format, status;
   Atom          realType, *value = NULL;
 
   status = XGetWindowProperty(w->dpy, c->window,
@@ -696,6 +831,193 @@ ewmh_set_current_app_window(Wm *w)
 }
 
 
+#ifndef NO_PING
+
+/* 
+ *  Ping scheduling. Clients being pinged sit in a binary heap ordered
+ *  on when their next ping is due so the event loop can sleep until 
+ *  exactly then and only visit the clients that need a ping.
+ */
+
+static void
+ewmh_ping_queue_swap (Wm *w, int a, int b)
+{
+  Client *tmp = w->ping_queue[a];
+
+  w->ping_queue[a] = w->ping_queue[b];
+  w->ping_queue[b] = tmp;
+
+  w->ping_queue[a]->ping_queue_idx = a;
+  w->ping_queue[b]->ping_queue_idx = b;
+}
+
+static void
+ewmh_ping_queue_sift_up (Wm *w, int i)
+{
+  while (i > 0 
+	 && w->ping_queue[(i-1)/2]->ping_deadline_usec 
+	        > w->ping_queue[i]->ping_deadline_usec)
+    {
+      ewmh_ping_queue_swap(w, i, (i-1)/2);
+      i = (i-1)/2;
+    }
+}
+
+static void
+ewmh_ping_queue_sift_down (Wm *w, int i)
+{
+  int smallest, l, r;
+
+  while (True)
+    {
+      smallest = i;
+      l = 2*i + 1;
+      r = 2*i + 2;
+
+      if (l < w->ping_queue_len 
+	  && w->ping_queue[l]->ping_deadline_usec 
+	        < w->ping_queue[smallest]->ping_deadline_usec)
+	smallest = l;
+
+      if (r < w->ping_queue_len 
+	  && w->ping_queue[r]->ping_deadline_usec 
+	        < w->ping_queue[smallest]->ping_deadline_usec)
+	smallest = r;
+
+      if (smallest == i) 
+	break;
+
+      ewmh_ping_queue_swap(w, i, smallest);
+      i = smallest;
+    }
+}
+
+static void
+ewmh_ping_queue_push (Wm *w, Client *c)
+{
+  if (w->ping_queue_len == w->ping_queue_alloc)
+    {
+      w->ping_queue_alloc = (w->ping_queue_alloc) ? w->ping_queue_alloc * 2 : 8;
+      w->ping_queue = realloc(w->ping_queue, 
+			      sizeof(Client*) * w->ping_queue_alloc);
+    }
+
+  c->ping_queue_idx = w->ping_queue_len++;
+  w->ping_queue[c->ping_queue_idx] = c;
+
+  ewmh_ping_queue_sift_up(w, c->ping_queue_idx);
+}
+
+static void
+ewmh_ping_queue_remove (Wm *w, Client *c)
+{
+  int i = c->ping_queue_idx, last = w->ping_queue_len - 1;
+
+  if (i < 0) 
+    return;
+
+  if (i != last)
+    {
+      ewmh_ping_queue_swap(w, i, last);
+      w->ping_queue_len--;
+      ewmh_ping_queue_sift_down(w, i);
+      ewmh_ping_queue_sift_up(w, i);
+    }
+  else w->ping_queue_len--;
+
+  c->ping_queue_idx = -1;
+}
+
+/* 
+ *  Publish the clients slowest to answer pings as _MB_PING_STATS on 
+ *  the root window, worst first. A client with a ping outstanding is
+ *  ranked by how long it has been waiting, if that is worse than its
+ *  slowest answer so far. Pongs and sends only mark it dirty, it goes
+ *  out from wm_stats_publish() with the other stats.
+ */
+void
+ewmh_ping_stats_publish (Wm *w)
+{
+  Client   *slowest[PING_REPORT_MAX], *c;
+  long      score[PING_REPORT_MAX], s, wait;
+  long long now = misc_get_time_usec();
+  char      buf[PING_REPORT_MAX * 80 + 1], *p = buf;
+  int       n = 0, i, j;
+
+  buf[0] = '\0';
+
+  stack_enumerate(w, c)
+    {
+      if (!c->has_ping_protocol || (!c->ping_n_pongs && !c->ping_sent_usec))
+	continue;
+
+      s = c->ping_rtt_max_usec;
+
+      if (c->ping_sent_usec && (now - c->ping_sent_usec) > s)
+	s = (long)(now - c->ping_sent_usec);
+
+      for (i = 0; i < n && score[i] >= s; i++)
+	;
+
+      if (i >= PING_REPORT_MAX) 
+	continue;
+
+      if (n < PING_REPORT_MAX) 
+	n++;
+
+      for (j = n - 1; j > i; j--)
+	{
+	  slowest[j] = slowest[j-1];
+	  score[j]   = score[j-1];
+	}
+
+      slowest[i] = c;
+      score[i]   = s;
+    }
+
+  for (i = 0; i < n; i++)
+    {
+      c    = slowest[i];
+      wait = (c->ping_sent_usec) ? (long)(now - c->ping_sent_usec) : 0;
+
+      p += snprintf(p, sizeof(buf) - (p - buf), 
+		    "%s0x%lx:last=%li:max=%li:wait=%li:pongs=%i",
+		    (i) ? " " : "", c->window,
+		    c->ping_rtt_usec / 1000, c->ping_rtt_max_usec / 1000,
+		    wait / 1000, c->ping_n_pongs);
+    }
+
+  XChangeProperty(w->dpy, w->root, w->atoms[_MB_PING_STATS],
+		  XA_STRING, 8, PropModeReplace, 
+		  (unsigned char *)buf, strlen(buf));
+
+  w->ping_stats_dirty = False;
+}
+
+static void
+ewmh_ping_record_pong (Client *c)
+{
+  if (!c->ping_sent_usec) 	/* Unsolicited */
+    return;
+
+  c->ping_rtt_usec = (long)(misc_get_time_usec() - c->ping_sent_usec);
+
+  if (c->ping_rtt_usec > c->ping_rtt_max_usec)
+    c->ping_rtt_max_usec = c->ping_rtt_usec;
+
+  c->ping_n_pongs++;
+
+  /* Pongs all carry the same timestamp, so with more than one 
+   * outstanding the best we can do is time from the latest.
+  */
+  c->ping_sent_usec = (c->pings_pending > 1) ? c->ping_last_sent_usec : 0;
+
+  dbg("%s() pong from %s after %li usec\n", 
+      __func__, c->name, c->ping_rtt_usec);
+}
+
+#endif
+
 void
 ewmh_ping_client_start (Client *c)
 {
@@ -705,8 +1027,13 @@ ewmh_ping_client_start (Client *c)
       c->pings_pending       = 0;
       c->pings_sent          = 0;
       c->ping_handler_called = False;
+      c->ping_sent_usec      = 0;
       c->wm->n_active_ping_clients++;
 
+      c->ping_deadline_usec = misc_get_time_usec() 
+	                        + PING_CHECK_FREQ * 1000000LL;
+      ewmh_ping_queue_push(c->wm, c);
+
       dbg("starting pinging '%s' , active: %i\n", 
 	  c->name, c->wm->n_active_ping_clients);
     }
@@ -722,101 +1049,151 @@ ewmh_ping_client_stop (Client *c)
       dbg("stopping pinging '%s' , pending: %i\n", 
 	  c->name, c->pings_pending);
 
-      c->pings_pending = -1;
+      c->pings_pending  = -1;
+      c->ping_sent_usec = 0;
       c->wm->n_active_ping_clients--;
 
+      ewmh_ping_queue_remove(c->wm, c);
+
       dbg("stopping pinging '%s' , active: %i\n", 
 	  c->name, c->wm->n_active_ping_clients);
     }
 #endif
 }
 
-void
-ewmh_hung_app_check(Wm *w)
-{
 #ifndef NO_PING
+static void
+ewmh_ping_client_send (Client *c, long long now)
+{
+  Wm    *w = c->wm;
+  XEvent e;
 
-  Client *c = NULL;
-
-  if (stack_empty(w)) 
-    return;
+  c->pings_pending++;
 
-  dbg("%s() called\n", __func__ );
+  if (!c->ping_sent_usec)
+    c->ping_sent_usec = now;
+  c->ping_last_sent_usec = now;
 
-  stack_enumerate(w, c)
-    {
-      if (c->has_ping_protocol && c->pings_pending != -1)
-	{
-	  XEvent e;
-	  
-	  c->pings_pending++;
+  dbg("%s() pinging %s\n", __func__, c->name);
 
-	  dbg("%s() pinging %s\n", __func__, c->name);
+  memset(&e, 0, sizeof(XEvent));
+  e.type = ClientMessage;
+  e.xclient.window = c->window;
+  e.xclient.message_type = w->atoms[WM_PROTOCOLS];
+  e.xclient.format = 32;
+  e.xclient.data.l[0] = w->atoms[_NET_WM_PING];
 
-	  e.type = ClientMessage;
-	  e.xclient.window = c->window;
-	  e.xclient.message_type = w->atoms[WM_PROTOCOLS];
-	  e.xclient.format = 32;
-	  e.xclient.data.l[0] = w->atoms[_NET_WM_PING];
+  /* To save a load of code bloat, we just set the timestamp
+   * to the client window ID. This could be slightly evil but
+   * makes things much more compact. 
+   */
+  e.xclient.data.l[1] = c->window;
+  XSendEvent(w->dpy, c->window, False, 0, &e);
 
-	  /* To save a load of code bloat, we just set the timestamp
-	   * to the client window ID. This could be slightly evil but
-	   * makes things much more compact. 
-	  */
-	  e.xclient.data.l[1] = c->window;
-	  XSendEvent(w->dpy, c->window, False, 0, &e);
-	  XSync(w->dpy, False);
+  c->pings_sent++;
 
-	  c->pings_sent++;
+  if (c->pings_pending > PING_PENDING_MAX)
+    {
+      if (w->config->ping_handler && c->pid)
+	{
+	  /* fire off external binary to handle hung app 
+	   * if env var is set. 
+	   */
+	  int   len;
+	  char *buf = NULL;
 
-	  if (c->pings_pending > PING_PENDING_MAX)
+	  if (!c->ping_handler_called)
 	    {
-	      if (w->config->ping_handler && c->pid)
+	      len = strlen(w->config->ping_handler) + 32;
+	      buf = malloc(len);
+
+	      if (buf)
 		{
-		  /* fire off external binary to handle hung app 
-                   * if env var is set. 
-		  */
-		  int   len;
-		  char *buf = NULL;
-
-		  if (!c->ping_handler_called)
-		    {
-		      len = strlen(w->config->ping_handler) + 32;
-		      buf = malloc(len);
-
-		      if (buf)
-			{
-			  snprintf(buf, len-1, "%s %i %li",
-				   w->config->ping_handler,
-				   c->pid,
-				   c->window);
-			  
-			  fork_exec(buf);
-			  
-			  free(buf);
-			  c->ping_handler_called = True;
-			}
-		    }
-
-		  /* dont ping any more */
-		   if ( !w->config->ping_aggressive )
-		    {
-		      ewmh_ping_client_stop (c);
-		    }
+		  snprintf(buf, len-1, "%s %i %li",
+			   w->config->ping_handler,
+			   c->pid,
+			   c->window);
+		  
+		  fork_exec(buf);
+		  
+		  free(buf);
+		  c->ping_handler_called = True;
 		}
-	      else
-		client_obliterate(c);
 	    }
 
-	  if (w->config->ping_aggressive 
-	      && c->pings_sent >= PING_CHECK_DURATION)
-	    ewmh_ping_client_stop (c);
+	  /* dont ping any more */
+	  if ( !w->config->ping_aggressive )
+	    {
+	      ewmh_ping_client_stop (c);
+	      return;
+	    }
 	}
+      else
+	client_obliterate(c);
     }
 
+  if (w->config->ping_aggressive 
+      && c->pings_sent >= PING_CHECK_DURATION)
+    ewmh_ping_client_stop (c);
+}
+#endif
+
+/* 
+ *  Called from the event loop whenever clients are being pinged. Sends
+ *  every ping that has come due, then flushes them out in one go.
+ */
+void
+ewmh_ping_check(Wm *w)
+{
+#ifndef NO_PING
+  Client   *c;
+  long long now;
+  int       n_sent = 0;
+
+  if (w->ping_queue_len == 0)
+    return;
+
+  now = misc_get_time_usec();
+
+  while (w->ping_queue_len > 0 
+	 && w->ping_queue[0]->ping_deadline_usec <= now)
+    {
+      c = w->ping_queue[0];
+
+      /* Reschedule first, sending may stop pinging it */
+      c->ping_deadline_usec = now + PING_CHECK_FREQ * 1000000LL;
+      ewmh_ping_queue_sift_down(w, 0);
+
+      ewmh_ping_client_send(c, now);
+      n_sent++;
+    }
+
+  if (n_sent)
+    {
+      dbg("%s() sent %i pings\n", __func__, n_sent);
+      w->ping_stats_dirty = True;
+      XFlush(w->dpy);
+    }
 #endif
 }
 
+/* Shorten the event loop's select() timeout to the next ping due */
+void
+ewmh_ping_get_timeout (Wm *w, struct timeval *tv)
+{
+#ifndef NO_PING
+  long long wait;
+
+  if (w->ping_queue_len == 0)
+    return;
+
+  wait = w->ping_queue[0]->ping_deadline_usec - misc_get_time_usec();
+
+  misc_timeout_shorten(tv, wait);
+#endif
+}
+
+
 static void set_supported(Wm *w) /*  */
 {
   int num_supported = 0;
@@ -922,11 +1299,11 @@ ewmh_get_utf8_prop(Wm *w, Window win, Atom req_atom)
 #ifndef REDUCE_BLOAT
 
 unsigned long *
-ewmh_get_icon_prop_data(Wm *w, Window win)
+ewmh_get_icon_prop_data(Wm *w, Window win, unsigned long *n_items)
 {
   Atom           type;
   int            format, result;
-  unsigned long  bytes_after, n_items;
+  unsigned long  bytes_after;
   unsigned char *data = NULL;
 
   misc_trap_xerrors();
@@ -934,7 +1311,7 @@ ewmh_get_icon_prop_data(Wm *w, Window win)
   result =  XGetWindowProperty (w->dpy, win, w->atoms[_NET_WM_ICON],
 				0, 100000L,
 				False, XA_CARDINAL,
-				&type, &format, &n_items,
+				&type, &format, n_items,
 				&bytes_after, (unsigned char **)&data);
 
   if (misc_untrap_xerrors() || result != Success || data == NULL)
@@ -1054,12 +1431,22 @@ sync_value_increment (XSyncValue *value)
   XSyncValueAdd (value, *value, one, &overflow);
 }
 
+static void
+ewmh_sync_route_event (Wm *w, XEvent *ev)
+{
+  dbg("%s() got ewmh_sync alarm notify\n", __func__);
+  ewmh_sync_handle_event(w, (XSyncAlarmNotifyEvent*)ev);
+}
+
 void
 ewmh_sync_init(Wm *w)
 {
+  int major, minor;
+
   if (!XSyncQueryExtension (w->dpy,
                             &w->sync_event_base,
-                            &w->sync_error_base))
+                            &w->sync_error_base)
+      || !XSyncInitialize (w->dpy, &major, &minor))
     {
       dbg("%s() XSyncQueryExtension FAILED.\n", __func__);
       w->have_xsync = False;
@@ -1067,6 +1454,62 @@ ewmh_sync_init(Wm *w)
     }
 
   w->have_xsync = True;
+
+  wm_event_handler_add(w, w->sync_event_base + XSyncAlarmNotify, None,
+		       "xsync", ewmh_sync_route_event);
+}
+
+static void
+ewmh_sync_client_destroy_alarm(Client *client)
+{
+  Wm *w = client->wm;
+
+  if (client->ewmh_sync_alarm == None)
+    return;
+
+  misc_trap_xerrors();
+  XSyncDestroyAlarm (w->dpy, client->ewmh_sync_alarm);
+  XSync (w->dpy, False);
+  misc_untrap_xerrors();
+
+  client->ewmh_sync_alarm = None;
+}
+
+/* The client has caught up with the last request, or timed out */
+static void
+ewmh_sync_client_done(Client *client, Bool timed_out)
+{
+  Wm  *w       = client->wm;
+  Bool pending = client->ewmh_sync_configure_pending;
+
+  client->ewmh_sync_is_waiting        = False;
+  client->ewmh_sync_configure_pending = False;
+  w->n_sync_waiting--;
+
+  if (timed_out)
+    {
+      client->ewmh_sync_timeouts++;
+
+      dbg("%s() %s timed out ( %i )\n", 
+	  __func__, client->name, client->ewmh_sync_timeouts);
+
+      /* Its counter may have been replaced or reset under us, so set
+       * it up again from scratch. Past a few misses in a row assume 
+       * the client is just broken and stop bothering with it.
+       */
+      if (client->ewmh_sync_timeouts >= SYNC_MAX_TIMEOUTS
+	  || !ewmh_sync_client_init_counter(client))
+	{
+	  dbg("%s() giving up on sync for %s\n", __func__, client->name);
+	  ewmh_sync_client_free(client);
+	  client->has_ewmh_sync = False;
+	}
+    }
+  else client->ewmh_sync_timeouts = 0;
+
+  /* Now give it the geometry held back while waiting */
+  if (pending)
+    client->move_resize(client);
 }
 
 void
@@ -1080,17 +1523,32 @@ ewmh_sync_handle_event(Wm *w, XSyncAlarmNotifyEvent *ev)
 	break;
     }
 
-  if (client) 			/* XXX should check alarm matches */
-    {
-      dbg("%s() found client %s\n", __func__, client->name);
-      client->move_resize(client);
-    }
+  if (client == NULL 
+      || !client->ewmh_sync_is_waiting
+      || ev->state == XSyncAlarmDestroyed)
+    return;
+
+  /* Could be a late reply to an earlier request */
+  if (XSyncValueLessThan (ev->counter_value, client->ewmh_sync_value))
+    return;
+
+  dbg("%s() %s has caught up\n", __func__, client->name);
+
+  ewmh_sync_client_done(client, False);
 }
 
+/* 
+ *  Called before a client is moved or resized. For clients supporting
+ *  _NET_WM_SYNC_REQUEST this sends the request, the configure itself is
+ *  up to the caller. Returns True if the previous request hasn't been 
+ *  answered yet, in which case the caller should hold off; it gets
+ *  called again with the latest geometry once the client catches up.
+ */
 Bool
 ewmh_sync_client_move_resize(Client *client)
 {
   Wm *w = client->wm;
+  XSyncAlarmAttributes values;
   unsigned long highval, lowval;
 
   if (!w->have_xsync) 
@@ -1100,15 +1558,23 @@ ewmh_sync_client_move_resize(Client *client)
     return False;
 
   if (client->ewmh_sync_is_waiting)
-    return False; 		/* XXX WRONG XXX */
+    {
+      client->ewmh_sync_configure_pending = True;
+      return True;
+    }
+
+  if (client->ewmh_sync_alarm == None 
+      && !ewmh_sync_client_init_counter(client))
+    {
+      client->has_ewmh_sync = False;
+      return False;
+    }
 
-  ewmh_sync_client_init_counter(client);
+  sync_value_increment (&client->ewmh_sync_value);
 
   lowval  = XSyncValueLow32 (client->ewmh_sync_value);
   highval = XSyncValueHigh32 (client->ewmh_sync_value);
 
-  sync_value_increment (&client->ewmh_sync_value);
-
   dbg("%s() delivering _NET_WM_SYNC_REQUEST\n", __func__);
 
   client_deliver_message(client, 
@@ -1116,10 +1582,17 @@ ewmh_sync_client_move_resize(Client *client)
 			 w->atoms[_NET_WM_SYNC_REQUEST], 
 			 CurrentTime, lowval, highval,
 			 0);
-  
-  client->ewmh_sync_is_waiting = True;
-  
-  return True;
+
+  /* Move the alarm on to fire when the client reaches this request */
+  values.trigger.wait_value = client->ewmh_sync_value;
+  XSyncChangeAlarm (w->dpy, client->ewmh_sync_alarm, XSyncCAValue, &values);
+
+  client->ewmh_sync_is_waiting    = True;
+  client->ewmh_sync_deadline_usec = misc_get_time_usec() 
+                                      + SYNC_REQUEST_TIMEOUT * 1000LL;
+  w->n_sync_waiting++;
+
+  return False;
 }
 
 Bool
@@ -1128,10 +1601,11 @@ ewmh_sync_client_init_counter(Client *client)
   Wm *w = client->wm;
 
   XSyncAlarmAttributes values;
+  XSyncValue           wait_value;
   Atom                 type;
   int                  format, result;
-  long                 bytes_after, n_items;
-  XID                 *value;
+  unsigned long        bytes_after, n_items;
+  XID                 *value = NULL;
 
   if (!w->have_xsync) 
     return False;
@@ -1139,14 +1613,19 @@ ewmh_sync_client_init_counter(Client *client)
   if (!client->has_ewmh_sync)
     return False;
 
+  ewmh_sync_client_destroy_alarm(client);
+
+  misc_trap_xerrors();
+
   result =  XGetWindowProperty (w->dpy, client->window, 
 				w->atoms[_NET_WM_SYNC_REQUEST_COUNTER],
-				0, 1024L,
+				0, 1L,
 				False, XA_CARDINAL,
 				&type, &format, &n_items,
 				&bytes_after, (unsigned char **)&value);
 
-  if (result != Success || value == NULL || format != 32)
+  if (misc_untrap_xerrors() || result != Success 
+      || value == NULL || format != 32 || n_items < 1)
     {
       dbg("%s() _NET_WM_SYNC_REQUEST_COUNTER failed\n", __func__);
       if (value) XFree (value);
@@ -1156,15 +1635,18 @@ ewmh_sync_client_init_counter(Client *client)
   dbg("%s() creating alarm\n", __func__);
 
   client->ewmh_sync_counter = *value;
+  XFree (value);
+
+  misc_trap_xerrors();
 
   XSyncIntsToValue (&client->ewmh_sync_value, random(), 0);
   XSyncSetCounter (w->dpy, client->ewmh_sync_counter, client->ewmh_sync_value);
 
-  sync_value_increment (&client->ewmh_sync_value);
+  wait_value = client->ewmh_sync_value;
+  sync_value_increment (&wait_value);
 
-  values.events = True;
   values.trigger.counter    = client->ewmh_sync_counter;
-  values.trigger.wait_value = client->ewmh_sync_value;
+  values.trigger.wait_value = wait_value;
   values.trigger.value_type = XSyncAbsolute;
   values.trigger.test_type  = XSyncPositiveComparison;
   XSyncIntToValue (&values.delta, 1);
@@ -1184,11 +1666,81 @@ ewmh_sync_client_init_counter(Client *client)
 					      &values);
   XSync (w->dpy, False);
 
-  /* XXX untrap error here */
+  if (misc_untrap_xerrors())
+    {
+      /* Bogus counter XID */
+      dbg("%s() failed to set up alarm\n", __func__);
+      ewmh_sync_client_destroy_alarm(client);
+      return False;
+    }
 
   return True;
 }
 
+void
+ewmh_sync_client_free(Client *client)
+{
+  if (client->ewmh_sync_is_waiting)
+    {
+      client->ewmh_sync_is_waiting = False;
+      client->wm->n_sync_waiting--;
+    }
+
+  client->ewmh_sync_configure_pending = False;
+
+  ewmh_sync_client_destroy_alarm(client);
+}
+
+/* Called from the event loop while any client is being waited on */
+void
+ewmh_sync_check(Wm *w)
+{
+  Client   *c;
+  long long now = misc_get_time_usec();
+
+  stack_enumerate(w, c)
+    if (c->ewmh_sync_is_waiting && c->ewmh_sync_deadline_usec <= now)
+      ewmh_sync_client_done(c, True);
+}
+
+void
+ewmh_sync_get_timeout(Wm *w, struct timeval *tv)
+{
+  Client   *c;
+  long long wait = 0, now = misc_get_time_usec();
+  Bool      waiting = False;
+
+  stack_enumerate(w, c)
+    if (c->ewmh_sync_is_waiting 
+	&& (!waiting || c->ewmh_sync_deadline_usec - now < wait))
+      {
+	wait    = c->ewmh_sync_deadline_usec - now;
+	waiting = True;
+      }
+
+  if (waiting)
+    misc_timeout_shorten(tv, wait);
+}
+
+/* Client swapped its counter, pick the new one up */
+static void
+ewmh_handle_sync_counter_change (Wm *w, Client *c, XPropertyEvent *e)
+{
+  Bool pending = c->ewmh_sync_configure_pending;
+
+  if (!w->have_xsync || !c->has_ewmh_sync || c->ewmh_sync_alarm == None)
+    return;
+
+  /* Any outstanding request was against the old counter */
+  ewmh_sync_client_free(c);
+
+  if (!ewmh_sync_client_init_counter(c))
+    c->has_ewmh_sync = False;
+
+  if (pending)
+    c->move_resize(c);
+}
+
 #endif
 
 
@@ -1317,7 +1869,7 @@ ewmh_utf8_validate(unsigned char *str, int max_len)
       if (UTF8_LENGTH (result) != len) /* Check for overlong UTF-8 */
         break;
 
-      if (result == -1)
+      if (result == (unsigned int)-1)
         break;
 
       if (!UNICODE_VALID (result))
@@ -24,15 +24,25 @@
 #include "structs.h" 
 #include "wm.h"
 
+#include <sys/time.h>
+
  /* Number of failed pending pings to kill a ping supporting app on */
 #define PING_PENDING_MAX 2 
 
- /* Time in seconds between each hung app check */
+ /* Time in seconds between pings to each app */
 #define PING_CHECK_FREQ  2 
 
+/* Number of clients listed in the _MB_PING_STATS slowest responders */
+#define PING_REPORT_MAX  5
+
 /* Max num of pings to send to an app - used only when in aggresive mode */
 #define PING_CHECK_DURATION 5
 
+/* _NET_WM_SYNC_REQUEST, how long to hold a resize for the client to
+ * catch up, and how many misses before it is treated as not syncing */
+#define SYNC_REQUEST_TIMEOUT 500 /* msecs to wait on a sync request */
+#define SYNC_MAX_TIMEOUTS      3 /* in a row before sync is given up */
+
 /* Non aton defines */
 #define _NET_WM_STATE_REMOVE        0    /* remove/unset property */
 #define _NET_WM_STATE_ADD           1    /* add/set property */
@@ -59,8 +69,14 @@ ewmh_set_active (Wm *w);
 void 
 ewmh_set_current_app_window(Wm *w);
 
-int  
-ewmh_handle_root_message (Wm *w, XClientMessageEvent *e);
+MBAtomHandler*
+ewmh_atom_handler_lookup (Wm *w, Atom atom);
+
+Bool
+ewmh_set_property_handler (Wm *w, Atom atom, MBPropertyHandlerFunc func);
+
+Bool
+ewmh_set_message_handler (Wm *w, Atom atom, MBMessageHandlerFunc func);
 
 unsigned char *
 ewmh_get_utf8_prop (Wm *w, Window win, Atom req_atom);
@@ -84,11 +100,17 @@ void
 ewmh_ping_client_stop (Client *c);
 
 void 
-ewmh_hung_app_check (Wm *w);
+ewmh_ping_check (Wm *w);
+
+void
+ewmh_ping_get_timeout (Wm *w, struct timeval *tv);
+
+void
+ewmh_ping_stats_publish (Wm *w);
 
 #ifndef REDUCE_BLOAT
 unsigned long *
-ewmh_get_icon_prop_data (Wm *w, Window win);
+ewmh_get_icon_prop_data (Wm *w, Window win, unsigned long *n_items);
 #endif
 
 int 
@@ -114,6 +136,15 @@ ewmh_sync_client_move_resize(Client *client);
 Bool
 ewmh_sync_client_init_counter(Client *client);
 
+void
+ewmh_sync_client_free(Client *client);
+
+void
+ewmh_sync_check(Wm *w);
+
+void
+ewmh_sync_get_timeout(Wm *w, struct timeval *tv);
+
 #endif /* USE_XSYNC */
 
 #endif
@@ -0,0 +1,191 @@
+/*
+ *  Matchbox Window Manager - A lightweight window manager not for the
+ *                            desktop.
+ *
+ *  Authored By Matthew Allum <mallum@o-hand.com>
+ *
+ *  Copyright (c) 2002, 2004 OpenedHand Ltd - http://o-hand.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#include "icon-cache.h"
+
+static unsigned long
+_icon_hash (unsigned long *data, unsigned long n_items)
+{
+  unsigned long h = 5381, i;
+
+  for (i = 0; i < n_items; i++)
+    h = ((h << 5) + h) ^ data[i];
+
+  return h;
+}
+
+/* Throws out truncated or bogus icon sets, returns number of icons */
+static int
+_icon_validate (unsigned long *data, unsigned long n_items)
+{
+  unsigned long i = 0;
+  int           n = 0;
+
+  while (i + 2 <= n_items)
+    {
+      unsigned long iw = data[i], ih = data[i+1];
+
+      if (iw == 0 || ih == 0 || iw > 1024 || ih > 1024
+	  || iw * ih > n_items - i - 2)
+	break;
+
+      i += 2 + iw * ih;
+      n++;
+    }
+
+  return n;
+}
+
+/* 
+ * Pick the smallest icon at least as big as wanted, so we only ever 
+ * scale down, or failing that the biggest there is. 
+*/
+static unsigned long*
+_icon_best_fit (MBIcon *icon, unsigned long width, unsigned long height)
+{
+  unsigned long *best = NULL, i = 0;
+
+  while (i + 2 <= icon->n_items)
+    {
+      unsigned long *cur = icon->data + i;
+      unsigned long  iw  = cur[0], ih = cur[1];
+
+      if (iw == 0 || ih == 0 || iw * ih > icon->n_items - i - 2)
+	break;
+
+      if (best == NULL)
+	best = cur;
+      else if (iw >= width && ih >= height)
+	{
+	  if (best[0] < width || best[1] < height 
+	      || iw * ih < best[0] * best[1])
+	    best = cur;
+	}
+      else if ((best[0] < width || best[1] < height)
+	       && iw * ih > best[0] * best[1])
+	best = cur;
+
+      i += 2 + iw * ih;
+    }
+
+  return best;
+}
+
+MBIcon*
+icon_cache_get_for_window (Wm *w, Window win)
+{
+  MBIcon        *icon;
+  MBList        *item;
+  unsigned long *data, n_items, hash;
+
+  if ((data = ewmh_get_icon_prop_data(w, win, &n_items)) == NULL)
+    return NULL;
+
+  if (_icon_validate(data, n_items) == 0)
+    {
+      dbg("%s() bogus _NET_WM_ICON on %li\n", __func__, win);
+      XFree(data);
+      return NULL;
+    }
+
+  hash = _icon_hash(data, n_items);
+
+  list_enumerate(w->icon_cache, item)
+    {
+      icon = (MBIcon *)item->data;
+
+      if (icon->hash == hash && icon->n_items == n_items
+	  && !memcmp(icon->data, data, n_items * sizeof(unsigned long)))
+	{
+	  dbg("%s() sharing icon %p with %li\n", __func__, icon, win);
+	  XFree(data);
+	  icon->refcnt++;
+	  return icon;
+	}
+    }
+
+  icon = malloc(sizeof(MBIcon));
+  memset(icon, 0, sizeof(MBIcon));
+
+  icon->hash    = hash;
+  icon->refcnt  = 1;
+  icon->data    = data;
+  icon->n_items = n_items;
+
+  list_add(&w->icon_cache, NULL, 0, (void *)icon);
+
+  return icon;
+}
+
+/* Returned image is owned by the cache, don't free or modify it */
+MBPixbufImage*
+icon_cache_get_image (Wm *w, MBIcon *icon, int width, int height)
+{
+  MBPixbufImage *img, *scaled;
+  unsigned long *src;
+  int            id;
+
+  /* Keeps id non zero, list_find_by_id() never matches 0 */
+  if (width <= 0 || height <= 0 || width > 0x7fff || height > 0xffff)
+    return NULL;
+
+  id = (width << 16) | height;
+
+  if ((img = list_find_by_id(icon->scaled, id)) != NULL)
+    return img;
+
+  if ((src = _icon_best_fit(icon, width, height)) == NULL)
+    return NULL;
+
+  img = mb_pixbuf_img_new_from_long_data(w->pb, src + 2, src[0], src[1]);
+
+  if (img == NULL)
+    return NULL;
+
+  if (img->width != width || img->height != height) 
+    {
+      scaled = mb_pixbuf_img_scale(w->pb, img, width, height); 
+      mb_pixbuf_img_free(w->pb, img);
+      img = scaled;
+    }
+
+  list_add(&icon->scaled, NULL, id, (void *)img);
+
+  return img;
+}
+
+void
+icon_cache_unref (Wm *w, MBIcon *icon)
+{
+  MBList *item;
+
+  if (--icon->refcnt > 0)
+    return;
+
+  list_remove(&w->icon_cache, (void *)icon);
+
+  list_enumerate(icon->scaled, item)
+    mb_pixbuf_img_free(w->pb, (MBPixbufImage *)item->data);
+
+  list_destroy(&icon->scaled);
+
+  XFree(icon->data);
+  free(icon);
+}
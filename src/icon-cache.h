@@ -0,0 +1,56 @@
+/*
+ *  Matchbox Window Manager - A lightweight window manager not for the
+ *                            desktop.
+ *
+ *  Authored By Matthew Allum <mallum@o-hand.com>
+ *
+ *  Copyright (c) 2002, 2004 OpenedHand Ltd - http://o-hand.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#ifndef _ICON_CACHE_H_
+#define _ICON_CACHE_H_
+
+#include "structs.h"
+#include "list.h"
+#include "ewmh.h"
+
+/*
+ *  Shared _NET_WM_ICON cache.
+ *
+ *  Windows of the same app nearly always carry the same icon set, so
+ *  icons are interned on a hash of their contents and shared between
+ *  clients. Each is scaled once per size asked for, from whichever 
+ *  icon in the set fits that size best.
+ */
+
+typedef struct MBIcon
+{
+  unsigned long  hash;
+  int            refcnt;
+  unsigned long *data;		/* Raw property data */
+  unsigned long  n_items;
+  MBList        *scaled;	/* MBPixbufImage's, id is w << 16 | h */
+
+} MBIcon;
+
+MBIcon*
+icon_cache_get_for_window (Wm *w, Window win);
+
+MBPixbufImage*
+icon_cache_get_image (Wm *w, MBIcon *icon, int width, int height);
+
+void
+icon_cache_unref (Wm *w, MBIcon *icon);
+
+#endif
@@ -485,6 +485,66 @@ keys_get_modifiers(Wm *w)
 
 }
 
+static void
+keys_bindings_free(Wm *w)
+{
+  MBConfigKbd        *kb = w->config->kb;
+  MBConfigKbdBinding *binding, *next;
+  int                 keycode;
+
+  for (keycode = 0; keycode < KBD_N_KEYCODES; keycode++)
+    {
+      for (binding = kb->bindings[keycode]; binding != NULL; binding = next)
+	{
+	  next = binding->next;
+	  free(binding);
+	}
+      kb->bindings[keycode] = NULL;
+    }
+}
+
+/* 
+ *  Build the keycode indexed table wm_handle_keypress() uses so a key 
+ *  press costs a single lookup rather than a walk of every entry with
+ *  a keysym translation each. Bindings keep config file order within
+ *  a keycode so several entries on one key still all fire in order.
+ */
+static void
+keys_bindings_build(Wm *w)
+{
+  MBConfigKbd        *kb = w->config->kb;
+  MBConfigKbdEntry   *entry;
+  MBConfigKbdBinding *binding, **tail;
+  int                 min_kc, max_kc, keycode;
+
+  keys_bindings_free(w);
+
+  XDisplayKeycodes(w->dpy, &min_kc, &max_kc);
+
+  if (max_kc >= KBD_N_KEYCODES) max_kc = KBD_N_KEYCODES - 1;
+
+  for (entry = kb->entrys; entry != NULL; entry = entry->next_entry)
+    {
+      entry->keycode = XKeysymToKeycode(w->dpy, entry->key);
+
+      for (keycode = min_kc; keycode <= max_kc; keycode++)
+	{
+	  if (XKeycodeToKeysym(w->dpy, keycode, entry->index) != entry->key)
+	    continue;
+
+	  binding = malloc(sizeof(MBConfigKbdBinding));
+	  binding->state = entry->ModifierMask;
+	  binding->entry = entry;
+	  binding->next  = NULL;
+
+	  tail = &kb->bindings[keycode];
+	  while (*tail != NULL) 
+	    tail = &(*tail)->next;
+	  *tail = binding;
+	}
+    }
+}
+
 void
 keys_grab(Wm *w, Bool ungrab)
 {
@@ -506,9 +566,9 @@ keys_grab(Wm *w, Bool ungrab)
 	  if (ungrab)
 	    {
 	      dbg("keys, ungrabbing %i , %i\n", 
-		  XKeysymToKeycode(w->dpy, entry->key), entry->ModifierMask);
+		  entry->keycode, entry->ModifierMask);
 	      XUngrabKey(w->dpy, 
-			 XKeysymToKeycode(w->dpy, entry->key), 
+			 entry->keycode, 
 			 entry->ModifierMask | ignored_mask,
 			 w->root);
 	    } else {
@@ -518,10 +578,10 @@ keys_grab(Wm *w, Bool ungrab)
 	      misc_trap_xerrors();
 
 	      dbg("keys, grabbing keycode: %i , mask: %i\n", 
-		  XKeysymToKeycode(w->dpy, entry->key), 
+		  entry->keycode, 
 		  entry->ModifierMask | ignored_mask);
 
-	      XGrabKey(w->dpy, XKeysymToKeycode(w->dpy, entry->key), 
+	      XGrabKey(w->dpy, entry->keycode, 
 		       entry->ModifierMask | ignored_mask,
 		       w->root, True, GrabModeAsync, GrabModeAsync);
 
@@ -558,6 +618,8 @@ keys_entries_free(Wm *w)
     }
 
   w->config->kb->entrys = NULL;
+
+  keys_bindings_free(w);
 }
 
 static void
@@ -571,6 +633,18 @@ keys_load_and_grab(Wm *w)
       return;
     }
 
+  keys_bindings_build(w);
+
+  keys_grab(w, False);
+}
+
+/* Keyboard or modifier mapping changed, keycodes may now be different */
+void
+keys_remap(Wm *w)
+{
+  keys_grab(w, True);
+  keys_get_modifiers(w);
+  keys_bindings_build(w);
   keys_grab(w, False);
 }
 
@@ -586,8 +660,7 @@ void
 keys_init(Wm *w)
 {
   w->config->kb = malloc(sizeof(MBConfigKbd));
-
-  w->config->kb->entrys = NULL;
+  memset(w->config->kb, 0, sizeof(MBConfigKbd));
   
   keys_load_and_grab(w);
 }
@@ -38,6 +38,8 @@ void keys_init(Wm *w);
 
 void keys_grab(Wm *w, Bool want_ungrab);
 
+void keys_remap(Wm *w);
+
 #endif
 
 #endif
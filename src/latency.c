@@ -0,0 +1,148 @@
+/*
+ *  Matchbox Window Manager - A lightweight window manager not for the
+ *                            desktop.
+ *
+ *  Authored By Matthew Allum <mallum@o-hand.com>
+ *
+ *  Copyright (c) 2002, 2004 OpenedHand Ltd - http://o-hand.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#include "latency.h"
+
+typedef struct MBLatency
+{
+  const char         *name;
+  unsigned long       calls;
+  unsigned long long  total;
+  unsigned long       max;
+  unsigned long       buckets[LATENCY_BUCKETS];
+
+} MBLatency;
+
+static MBLatency probes[LATENCY_COUNT] = {
+  { "wm_handle_map_request",        0, 0, 0, { 0 } },
+  { "wm_handle_map_notify",         0, 0, 0, { 0 } },
+  { "wm_handle_unmap_event",        0, 0, 0, { 0 } },
+  { "wm_handle_destroy_event",      0, 0, 0, { 0 } },
+  { "wm_handle_configure_request",  0, 0, 0, { 0 } },
+  { "wm_handle_configure_notify",   0, 0, 0, { 0 } },
+  { "wm_handle_property_change",    0, 0, 0, { 0 } },
+  { "wm_handle_client_message",     0, 0, 0, { 0 } },
+  { "wm_handle_expose_event",       0, 0, 0, { 0 } },
+  { "wm_handle_button_event",       0, 0, 0, { 0 } },
+  { "wm_handle_keypress",           0, 0, 0, { 0 } },
+  { "comp_engine_render",           0, 0, 0, { 0 } },
+  { "theme_frame_paint",            0, 0, 0, { 0 } },
+  { "ewmh_update_lists",            0, 0, 0, { 0 } },
+};
+
+void
+latency_add (MBLatencyProbe probe, long long usec)
+{
+  MBLatency     *l = &probes[probe];
+  unsigned long  v;
+  int            bucket = 0;
+
+  if (usec < 0) 		/* Clock stepped, no monotonic clock */
+    usec = 0;
+
+  for (v = usec; v && bucket < LATENCY_BUCKETS - 1; v >>= 1)
+    bucket++;
+
+  l->buckets[bucket]++;
+  l->calls++;
+  l->total += usec;
+
+  if ((unsigned long)usec > l->max)
+    l->max = usec;
+}
+
+void
+latency_event_add (int type, long long usec)
+{
+  switch (type)
+    {
+    case MapRequest:
+      latency_add(LATENCY_MAP_REQUEST, usec); break;
+#ifdef USE_COMPOSITE
+    case MapNotify:
+      latency_add(LATENCY_MAP_NOTIFY, usec); break;
+#endif
+    case UnmapNotify:
+      latency_add(LATENCY_UNMAP, usec); break;
+    case DestroyNotify:
+      latency_add(LATENCY_DESTROY, usec); break;
+    case ConfigureRequest:
+      latency_add(LATENCY_CONFIGURE_REQUEST, usec); break;
+    case ConfigureNotify:
+      latency_add(LATENCY_CONFIGURE_NOTIFY, usec); break;
+    case PropertyNotify:
+      latency_add(LATENCY_PROPERTY_CHANGE, usec); break;
+    case ClientMessage:
+      latency_add(LATENCY_CLIENT_MESSAGE, usec); break;
+    case Expose:
+      latency_add(LATENCY_EXPOSE, usec); break;
+    case ButtonPress:
+      latency_add(LATENCY_BUTTON, usec); break;
+    case KeyPress:
+      latency_add(LATENCY_KEYPRESS, usec); break;
+    }
+}
+
+void
+latency_reset (void)
+{
+  int i;
+
+  for (i = 0; i < LATENCY_COUNT; i++)
+    {
+      probes[i].calls = 0;
+      probes[i].total = 0;
+      probes[i].max   = 0;
+      memset(probes[i].buckets, 0, sizeof(probes[i].buckets));
+    }
+}
+
+void
+latency_stats_describe (char *buf, int len)
+{
+  char  entry[LATENCY_ENTRY_MAX], *p;
+  int   used = 0, i, b, last;
+
+  buf[0] = '\0';
+
+  for (i = 0; i < LATENCY_COUNT; i++)
+    {
+      MBLatency *l = &probes[i];
+
+      p  = entry;
+      p += snprintf(p, sizeof(entry), "%s%s=%lu:%llu:%lu:",
+		    (i) ? " " : "", l->name, l->calls, l->total, l->max);
+
+      for (last = LATENCY_BUCKETS - 1; last > 0; last--)
+	if (l->buckets[last])
+	  break;
+
+      for (b = 0; b <= last; b++)
+	p += snprintf(p, sizeof(entry) - (p - entry), "%s%lu",
+		      (b) ? "," : "", l->buckets[b]);
+
+      /* Never cut an entry short, a reader would take it as whole */
+      if (used + (p - entry) >= len)
+	break;
+
+      memcpy(buf + used, entry, p - entry + 1);
+      used += p - entry;
+    }
+}
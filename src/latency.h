@@ -0,0 +1,86 @@
+/*
+ *  Matchbox Window Manager - A lightweight window manager not for the
+ *                            desktop.
+ *
+ *  Authored By Matthew Allum <mallum@o-hand.com>
+ *
+ *  Copyright (c) 2002, 2004 OpenedHand Ltd - http://o-hand.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#ifndef _MBLATENCY_H_
+#define _MBLATENCY_H_
+
+#include "structs.h"
+
+/*
+ *  Per handler latency histograms.
+ *
+ *  Each top level event handler, and the few paths known to be costly,
+ *  keep a call count, total and worst time and a histogram of how long
+ *  calls took in power of two buckets of microseconds, timed with
+ *  misc_get_time_usec() ( monotonic where there's clock_gettime ).
+ *  'matchbox-remote -stats' asks for them to be written to
+ *  _MB_LATENCY_STATS, '-stats-reset' starts them over.
+ */
+
+/* Bucket 0 is under 1us, bucket n is [ 2^(n-1), 2^n ) us and the last
+ * one takes everything from about 4s up.
+ */
+#define LATENCY_BUCKETS 24
+
+typedef enum MBLatencyProbe
+{
+  LATENCY_MAP_REQUEST = 0,
+  LATENCY_MAP_NOTIFY,
+  LATENCY_UNMAP,
+  LATENCY_DESTROY,
+  LATENCY_CONFIGURE_REQUEST,
+  LATENCY_CONFIGURE_NOTIFY,
+  LATENCY_PROPERTY_CHANGE,
+  LATENCY_CLIENT_MESSAGE,
+  LATENCY_EXPOSE,
+  LATENCY_BUTTON,
+  LATENCY_KEYPRESS,
+  LATENCY_COMP_ENGINE_RENDER,
+  LATENCY_THEME_FRAME_PAINT,
+  LATENCY_EWMH_UPDATE_LISTS,
+  LATENCY_COUNT
+
+} MBLatencyProbe;
+
+/* Longest latency_stats_describe() entry, a probe name of up to 32
+ * characters and every count at its full 20 digits, and a buffer that
+ * always holds all of them.
+ */
+#define LATENCY_ENTRY_MAX (1 + 32 + 3 * 21 + LATENCY_BUCKETS * 21)
+#define LATENCY_STATS_MAX (LATENCY_COUNT * LATENCY_ENTRY_MAX + 1)
+
+void
+latency_add (MBLatencyProbe probe, long long usec);
+
+/* Adds to whichever wm_handle_* probe handles X events of type */
+void
+latency_event_add (int type, long long usec);
+
+void
+latency_reset (void);
+
+/* Formats "name=calls:total:max:b0,b1,.. ..." into buf, buckets are
+ * only listed up to the last one used. Only whole entries are written,
+ * a buf of LATENCY_STATS_MAX takes them all.
+ */
+void
+latency_stats_describe (char *buf, int len);
+
+#endif
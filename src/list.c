@@ -19,15 +19,21 @@
  */
 
 #include "list.h"
+#include "pool.h"
 
 struct list_item*
 list_new(int id, char *name, void *data)
 {
   struct list_item* list;
-  list = malloc(sizeof(struct list_item));
-  memset(list, 0, sizeof(struct list_item));
+  list = pool_alloc(POOL_LIST_ITEM);
 
-  if (name) list->name = strdup(name);
+  if (name)
+    {
+      if (strlen(name) < LIST_NAME_INLINE)
+	list->name = strcpy(list->name_inline, name);
+      else
+	list->name = strdup(name);
+    }
   if (id)   list->id   = id;
   list->data = data;
   list->next = NULL;
@@ -102,8 +108,7 @@ list_remove(struct list_item** head, void *data)
 	  else
 	    *head = cur->next;
 	    
-	  if (cur->name) free (cur->name);
-	  free(cur);
+	  list_item_free(cur);
 	  return;
 	}
       prev = cur;
@@ -119,10 +124,19 @@ list_destroy(struct list_item** head)
   while (cur != NULL)
     {
       next = cur->next;
-      if (cur->name) free (cur->name);
-      free(cur);
+      list_item_free(cur);
       cur = next;
     }
   *head = NULL;
 }
+
+/* For code walking and freeing a list itself, data is left alone */
+void
+list_item_free(struct list_item* item)
+{
+  if (item->name && item->name != item->name_inline) 
+    free (item->name);
+
+  pool_free(POOL_LIST_ITEM, item);
+}
   
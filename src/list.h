@@ -25,12 +25,16 @@
 
 
 
+/* Most names are short, so keep them in the node rather than strdup */
+#define LIST_NAME_INLINE 16
+
 struct list_item
 {
   char* name;
   int   id;
   void* data;
   struct list_item* next;
+  char  name_inline[LIST_NAME_INLINE];
 };
 
 #define list_enumerate(l,i) for((i)=(l);(i);(i)=(i)->next)
@@ -49,4 +53,6 @@ void list_remove(struct list_item** head, void *data);
 
 void list_destroy(struct list_item** head);
 
+void list_item_free(struct list_item* item);
+
 #endif
@@ -45,6 +45,8 @@ main(int argc, char **argv)
 
    wm_init_existing(w);
 
+   wm_startup_report(w);
+
    wm_event_loop(w);
    
    return 1;
@@ -26,9 +26,10 @@ main_client_new(Wm *w, Window win)
 
    if (!c) return NULL;
    
-   c->type = MBCLIENT_TYPE_APP;
+   stack_set_type(c, MBCLIENT_TYPE_APP);
    c->reparent     = &main_client_reparent;
    c->redraw       = &main_client_redraw;
+   c->prerender    = &main_client_prerender;
    c->button_press = &main_client_button_press;
    c->move_resize  = &main_client_move_resize;
    c->get_coverage = &main_client_get_coverage;
@@ -333,6 +334,14 @@ main_client_move_resize(Client *c)
   if (c->flags & CLIENT_TITLE_HIDDEN_FLAG)
     offset_south = offset_east = offset_west = 0; 
 
+#ifdef USE_XSYNC
+  /* Still redrawing for the last configure, it gets the latest
+   * geometry once its caught up ( or timed out ).
+  */
+  if (ewmh_sync_client_move_resize(c))
+    return;
+#endif
+
   base_client_move_resize(c);
 
   XMoveResizeWindow(w->dpy, c->window, 
@@ -350,41 +359,6 @@ main_client_move_resize(Client *c)
 				  main_client_title_height(c), offset_south);
 
 
-/*
- * Disabled _NET_WM_SYNC code ( Alternate to above XMove*'s )
- * Is unfinished and initial testing did not seem to improve things.
- * Maybe re-try again at a later date.
- *
- * if (!c->ewmh_sync_is_waiting)
- *  {
- *    XMoveResizeWindow(w->dpy, c->window, 
- *			offset_west, main_client_title_height(c), 
- *			c->width, c->height);
- *   }
- * 
- * if (ewmh_sync_client_move_resize(c))
- *   {
- *     dbg("%s() not resizing frame yet\n", __func__);
- *     return; 
- *   }
- *
- * XMoveWindow(w->dpy, c->window, offset_west, main_client_title_height(c));
- * 
- * XResizeWindow(w->dpy, c->title_frame, 
- *		c->width + (offset_east + offset_west),
- *		c->height + main_client_title_height(c) + offset_south);
- * 
- * XMoveResizeWindow(w->dpy, c->frame, 
- *		    c->x - offset_west,
- *		    c->y - main_client_title_height(c), 
- *		    c->width + ( offset_east + offset_west),
- *		    c->height + main_client_title_height(c) + offset_south);
- *
- *  dbg("%s() resizing frame\n", __func__);
- *
- * c->ewmh_sync_is_waiting = False;
- */
-
 }
 
 
@@ -415,6 +389,46 @@ main_client_toggle_fullscreen(Client *c)
 }
 
 
+/* Queues the frames main_client_redraw() will paint, at their 
+ * current sizes, for theme_frame_prerender_run().
+*/
+void
+main_client_prerender(Client *c)
+{
+  Wm  *w = c->wm;
+  Bool is_shaped;
+  int  offset_south, offset_east, offset_west;
+
+  if (!w->config->use_title || c->flags & CLIENT_TITLE_HIDDEN_FLAG
+      || w->flags & TITLE_HIDDEN_FLAG)
+    return;
+
+  offset_south = theme_frame_defined_height_get(w->mbtheme, 
+						FRAME_MAIN_SOUTH);
+  offset_east  = theme_frame_defined_width_get(w->mbtheme, 
+					       FRAME_MAIN_EAST );
+  offset_west  = theme_frame_defined_width_get(w->mbtheme, 
+					       FRAME_MAIN_WEST );
+
+  is_shaped = theme_frame_wants_shaped_window( w->mbtheme, FRAME_MAIN);
+
+  theme_frame_prerender_add(w->mbtheme, FRAME_MAIN, 
+			    c->width + offset_east + offset_west, 
+			    theme_frame_defined_height_get(w->mbtheme, 
+							   FRAME_MAIN),
+			    is_shaped);
+
+  theme_frame_prerender_add(w->mbtheme, FRAME_MAIN_WEST, 
+			    offset_west, c->height, is_shaped);
+
+  theme_frame_prerender_add(w->mbtheme, FRAME_MAIN_EAST, 
+			    offset_east, c->height, is_shaped);
+
+  theme_frame_prerender_add(w->mbtheme, FRAME_MAIN_SOUTH, 
+			    c->width + offset_east + offset_west, 
+			    offset_south, is_shaped);
+}
+
 /* redraws the frame */
 void
 main_client_redraw(Client *c, Bool use_cache)
@@ -452,7 +466,8 @@ main_client_redraw(Client *c, Bool use_cache)
    dbg("%s() cache failed, actual redraw on %s\n", __func__, c->name);
 
    if (is_shaped) 
-     client_init_backing_mask(c, c->width + offset_east + offset_west, 
+     client_init_backing_mask(c, FRAME_MAIN,
+			      c->width + offset_east + offset_west, 
 			      c->height, height , offset_south,
 			      width - offset_east, offset_west);
 
@@ -624,10 +639,7 @@ void main_client_button_press(Client *c, XButtonEvent *e)
 		     {
 		       /* initiate pinging the app anyway for close button */
 		       if (c->has_ping_protocol && c->pings_pending == -1) 
-			 {
-			   c->pings_pending = 0;
-			   w->n_active_ping_clients++;
-			 }
+			 ewmh_ping_client_start (c);
 		     }
 		   return;
 		 }
@@ -859,6 +871,8 @@ main_client_show(Client *c)
      }
 
    c->mapped = True;
+
+   theme_frame_menu_invalidate(w->mbtheme);
 }
 
 void
@@ -914,6 +928,8 @@ main_client_unmap(Client *c)
 
    c->mapped = False;
 
+   theme_frame_menu_invalidate(w->mbtheme);
+
    if (next_client /* only 1 main_client left ? */
        && next_client->type == MBCLIENT_TYPE_APP
        && (next_client == stack_get_below(next_client, MBCLIENT_TYPE_APP)))
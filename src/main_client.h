@@ -56,6 +56,9 @@ main_client_reparent(Client *c);
 void 
 main_client_redraw(Client *c, Bool use_cache);
 
+void 
+main_client_prerender(Client *c);
+
 void 
 main_client_button_press(Client *c, XButtonEvent *e);
 
@@ -26,7 +26,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
 #include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #define MB_CMD_SET_THEME     1
 #define MB_CMD_EXIT          2
@@ -37,6 +40,8 @@
 #define MB_CMD_MISC          7
 #define MB_CMD_COMPOSITE     8
 #define MB_CMB_KEYS_RELOAD   9
+#define MB_CMD_STATS         10
+#define MB_CMD_STATS_RESET   11
 
 #define MB_CMD_PANEL_TOGGLE_VISIBILITY 1
 #define MB_CMD_PANEL_SIZE              2
@@ -49,6 +54,15 @@
 
 Display* dpy;	
 
+static int  control_fd = -1;	/* The wm's control socket, if it has one */
+static Bool stats_table;	/* Print 'latency' replies as a table */
+
+/* What the control socket calls each MB_CMD_*, NULL if it's X only */
+static char *control_commands[] = {
+  NULL, "theme", "exit", "desktop", "next", "prev", NULL, NULL,
+  "composite", "keys-reload", NULL, "stats-reset"
+};
+
 static void
 getRootProperty(char * name, Bool delete)
 {
@@ -120,14 +134,38 @@ mbpanelcommand(int cmd_id, int panel_id)
     }
 }
 
+/* Starts mbdesktop, and exits, if the desktop isn't running */
+static void
+desktop_check(void)
+{
+   Atom desktop_manager_atom;
+
+   desktop_manager_atom = XInternAtom(dpy, "_NET_DESKTOP_MANGER",False);
+
+   if (!XGetSelectionOwner(dpy, desktop_manager_atom))
+     {
+       char *exec_args[] = { NULL };
+
+       fprintf(stderr, "Desktop not running, exiting...\n");
+       switch (fork())
+	 {
+	 case 0:
+	   execvp ("mbdesktop", exec_args);
+	   break;
+	 case -1:
+	   fprintf(stderr, "failed to exec mbdesktop");
+	   break;
+	 }
+       exit(0);
+     }
+}
+
 static void
 mbcommand(int cmd_id, char *data) {
 
    XEvent	ev;
    Window	root;
-   Atom theme_prop, cmd_prop, desktop_manager_atom;
-
-   desktop_manager_atom = XInternAtom(dpy, "_NET_DESKTOP_MANGER",False);
+   Atom theme_prop, cmd_prop;
 
    root = DefaultRootWindow(dpy);
    
@@ -139,25 +177,7 @@ mbcommand(int cmd_id, char *data) {
    }
 
    if (cmd_id == MB_CMD_DESKTOP)
-     {
-       /* Check if desktop is running */
-       if (!XGetSelectionOwner(dpy, desktop_manager_atom))
-	 {
-	   char *exec_args[] = { NULL };
-
-	   fprintf(stderr, "Desktop not running, exiting...\n");
-	   switch (fork())
-	     {
-	     case 0:
-	       execvp ("mbdesktop", exec_args);
-	       break;
-	     case -1:
-	       fprintf(stderr, "failed to exec mbdesktop");
-	       break;
-	     }
-	   exit(0);
-	 }
-     }
+     desktop_check();
    
    cmd_prop = XInternAtom(dpy, "_MB_COMMAND", False);
          
@@ -174,6 +194,238 @@ mbcommand(int cmd_id, char *data) {
 
 }
 
+/* Connects to the socket the wm publishes in _MB_CONTROL_SOCKET */
+static void
+control_connect(void)
+{
+   struct sockaddr_un addr;
+   Atom               prop, realType;
+   unsigned long      n, extra;
+   int                format;
+   char              *path = NULL;
+
+   prop = XInternAtom(dpy, "_MB_CONTROL_SOCKET", True);
+   if (prop == None)
+     return;
+
+   if (XGetWindowProperty(dpy, DefaultRootWindow(dpy), prop, 0L, 512L, 
+			  False, XA_STRING, &realType, &format, &n, &extra,
+			  (unsigned char **) &path) != Success 
+       || path == NULL)
+     return;
+
+   if (strlen(path) < sizeof(addr.sun_path)
+       && (control_fd = socket(AF_UNIX, SOCK_STREAM, 0)) != -1)
+     {
+       memset(&addr, 0, sizeof(addr));
+       addr.sun_family = AF_UNIX;
+       strcpy(addr.sun_path, path);
+
+       /* Left over from a wm that's gone, use X */
+       if (connect(control_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+	 {
+	   close(control_fd);
+	   control_fd = -1;
+	 }
+     }
+
+   XFree(path);
+}
+
+/* Queues a command, replies are read by control_finish() */
+static void
+control_send(char *format, ...)
+{
+   char     buf[1024];
+   va_list  args;
+   int      len, done = 0, n;
+
+   va_start(args, format);
+   len = vsnprintf(buf, sizeof(buf) - 1, format, args);
+   va_end(args);
+
+   if (len < 0 || len > (int)sizeof(buf) - 2)
+     {
+       fprintf(stderr, "matchbox-remote: command too long\n");
+       return;
+     }
+
+   buf[len++] = '\n';
+
+   while (done < len)
+     {
+       if ((n = send(control_fd, buf + done, len - done, MSG_NOSIGNAL)) <= 0)
+	 {
+	   fprintf(stderr, "matchbox-remote: lost the control socket\n");
+	   return;
+	 }
+       done += n;
+     }
+}
+
+/* Goes over the control socket when the wm has one, so all the options
+ * given are run as one batch and any errors reported, else falls back
+ * to a _MB_COMMAND message.
+ */
+static void
+remote_command(int cmd_id, char *data)
+{
+   if (control_fd == -1
+       || cmd_id >= (int)(sizeof(control_commands) / sizeof(char *))
+       || control_commands[cmd_id] == NULL)
+     {
+       mbcommand(cmd_id, data);
+       return;
+     }
+
+   if (cmd_id == MB_CMD_DESKTOP)
+     desktop_check();
+
+   if (data)
+     control_send("%s %s", control_commands[cmd_id], data);
+   else
+     control_send("%s", control_commands[cmd_id]);
+}
+
+/* Upper bound, in usecs, of the bucket pct percent of calls fall in */
+static unsigned long
+stats_percentile(unsigned long *buckets, int n_buckets, 
+		 unsigned long calls, int pct)
+{
+  unsigned long sum = 0;
+  int           i;
+
+  for (i = 0; i < n_buckets; i++)
+    {
+      sum += buckets[i];
+      if (sum * 100 >= calls * pct)
+	break;
+    }
+
+  return 1UL << i;
+}
+
+static void
+print_stats_table(char *value)
+{
+   char *entry, *p;
+
+   printf("%-28s %8s %8s %8s %8s %8s %8s\n", "usecs", 
+	  "calls", "mean", "max", "p50 <", "p90 <", "p99 <");
+
+   /* Entries are name=calls:total:max:bucket,bucket,... */
+   for (entry = strtok(value, " "); entry; entry = strtok(NULL, " "))
+     {
+       unsigned long      calls, max, buckets[32];
+       unsigned long long total;
+       int                n_buckets = 0;
+       char               name[64];
+
+       if (sscanf(entry, "%63[^=]=%lu:%llu:%lu:", name, &calls, &total, 
+		  &max) != 4 || calls == 0)
+	 continue;
+
+       p = strrchr(entry, ':') + 1;
+       while (*p && n_buckets < 32)
+	 {
+	   buckets[n_buckets++] = strtoul(p, &p, 10);
+	   if (*p == ',') p++;
+	 }
+
+       printf("%-28s %8lu %8llu %8lu %8lu %8lu %8lu\n", name, calls,
+	      total / calls, max, 
+	      stats_percentile(buckets, n_buckets, calls, 50),
+	      stats_percentile(buckets, n_buckets, calls, 90),
+	      stats_percentile(buckets, n_buckets, calls, 99));
+     }
+}
+
+static void
+print_stats(void)
+{
+   Window         root = DefaultRootWindow(dpy);
+   Atom           stats_prop, realType;
+   unsigned long  n, extra;
+   int            format, i;
+   char          *value = NULL;
+   XEvent         ev;
+
+   if (control_fd != -1)
+     {
+       stats_table = True;
+       control_send("stats");
+       return;
+     }
+
+   stats_prop = XInternAtom(dpy, "_MB_LATENCY_STATS", False);
+
+   XSelectInput(dpy, root, PropertyChangeMask);
+   mbcommand(MB_CMD_STATS, NULL);
+   XFlush(dpy);
+
+   /* Wait up to 2 seconds for the wm to write them out */
+   for (i = 0; i < 200; i++)
+     {
+       if (XCheckTypedWindowEvent(dpy, root, PropertyNotify, &ev)
+	   && ev.xproperty.atom == stats_prop)
+	 break;
+       if (!XPending(dpy))
+	 usleep(10000);
+     }
+
+   if (i == 200 
+       || XGetWindowProperty(dpy, root, stats_prop, 0L, 4096L, False,
+			     XA_STRING, &realType, &format, &n, &extra,
+			     (unsigned char **) &value) != Success
+       || value == NULL)
+     {
+       fprintf(stderr, "No stats, is matchbox running ?\n");
+       return;
+     }
+
+   print_stats_table(value);
+
+   XFree(value);
+}
+
+/* Reads the replies to everything sent, returns non zero on errors */
+static int
+control_finish(void)
+{
+   FILE   *fp;
+   char   *line = NULL;
+   size_t  len = 0;
+   int     status = 0;
+
+   shutdown(control_fd, SHUT_WR);
+
+   fp = fdopen(control_fd, "r");
+
+   while (getline(&line, &len, fp) != -1)
+     {
+       line[strcspn(line, "\n")] = '\0';
+
+       if (!strcmp(line, "ok"))
+	 continue;
+
+       if (!strncmp(line, "error", 5))
+	 {
+	   fprintf(stderr, "matchbox-remote: %s\n", line);
+	   status = 1;
+	 }
+       else if (stats_table && !strncmp(line, "latency ", 8))
+	 print_stats_table(line + 8);
+       else
+	 printf("%s\n", line);
+     }
+
+   free(line);
+   fclose(fp);
+   control_fd = -1;
+
+   return status;
+}
+
 void
 send_input_manager_request(int show)
 {
@@ -217,6 +469,10 @@ usage(char *progname)
    printf("  -input-toggle [1|0]      Toggle Input method ( requires input-manager )\n");
    printf("  -composite-toggle        Toggle Compositing Engine ( if enabled )\n");
    printf("  -keys-reload             Reload key shortcut config ( if enabled )\n");
+   printf("  -stats                   Print per handler latency stats\n");
+   printf("  -stats-reset             Reset latency stats\n");
+   printf("  -query <commands>        Send commands, eg. 'clients; cache', over\n");
+   printf("                           the control socket and print the replies\n");
 
 
    /*
@@ -230,7 +486,7 @@ usage(char *progname)
 int main(int argc, char* argv[])
 {
   char *display_name = (char *)getenv("DISPLAY");
-  int i;
+  int i, status = 0;
 
   if (argc < 2) usage(argv[0]);
   
@@ -240,6 +496,8 @@ int main(int argc, char* argv[])
      exit(1);
   }
 
+  control_connect();
+
   /* pass command line */
   for (i=1; argv[i]; i++) {
      char *arg = argv[i];
@@ -248,7 +506,7 @@ int main(int argc, char* argv[])
 	{
 	case 't' :
 	  if (argv[i+1] != NULL)
-	    mbcommand(MB_CMD_SET_THEME, argv[i+1]);
+	    remote_command(MB_CMD_SET_THEME, argv[i+1]);
 	  i++;
 	  break;
 	case 'r' :
@@ -256,19 +514,19 @@ int main(int argc, char* argv[])
 	  i++;
 	  break;
 	case 'e':
-	  mbcommand(MB_CMD_EXIT, NULL);
+	  remote_command(MB_CMD_EXIT, NULL);
 	  break;
 	case 'd':
-	  mbcommand(MB_CMD_DESKTOP, NULL);
+	  remote_command(MB_CMD_DESKTOP, NULL);
 	  break;
 	case 'n':
-	  mbcommand(MB_CMD_NEXT, NULL);
+	  remote_command(MB_CMD_NEXT, NULL);
 	  break;
 	case 'c':
-	  mbcommand(MB_CMD_COMPOSITE, NULL);
+	  remote_command(MB_CMD_COMPOSITE, NULL);
 	  break;
 	case 'k':
-	  mbcommand(MB_CMB_KEYS_RELOAD, NULL);
+	  remote_command(MB_CMB_KEYS_RELOAD, NULL);
 	  break;
 	case 'p':
 	  if (!strcmp(arg+1,"panel-toggle"))
@@ -276,17 +534,39 @@ int main(int argc, char* argv[])
 	      int panel_id = 0;
 	      
 	      if (argc > i+1) panel_id = atoi(argv[i+1]);
-	      mbpanelcommand(MB_CMD_PANEL_TOGGLE_VISIBILITY, panel_id);
+	      if (control_fd != -1)
+		control_send("panel-toggle %i", panel_id);
+	      else
+		mbpanelcommand(MB_CMD_PANEL_TOGGLE_VISIBILITY, panel_id);
 	    }
 	  else if (strcmp(arg+1,"prev") == 0 || strlen(arg+1) == 1)
 	    {
-	      mbcommand(MB_CMD_PREV, NULL);
+	      remote_command(MB_CMD_PREV, NULL);
 	    }
 	  else usage(argv[0]);
 	  break;
 	case 'm':
 	  mbcommand(MB_CMD_SHOW_EXT_MENU, NULL);
 	  break;
+	case 's':
+	  if (!strcmp(arg+1, "stats"))
+	    print_stats();
+	  else if (!strcmp(arg+1, "stats-reset"))
+	    remote_command(MB_CMD_STATS_RESET, NULL);
+	  else usage(argv[0]);
+	  break;
+	case 'q':
+	  if (strcmp(arg+1, "query") || argv[i+1] == NULL)
+	    usage(argv[0]);
+	  else if (control_fd == -1)
+	    {
+	      fprintf(stderr, "No control socket, is matchbox running ?\n");
+	      status = 1;
+	    }
+	  else
+	    control_send("%s", argv[i+1]);
+	  i++;
+	  break;
 	case 'x':
 	  mbcommand(MB_CMD_MISC, NULL);
 	  break;
@@ -302,9 +582,12 @@ int main(int argc, char* argv[])
 	}
      }
   }
+  if (control_fd != -1 && control_finish())
+    status = 1;
+
   XSync(dpy, False);
   XCloseDisplay(dpy);
 
-  return 0;
+  return status;
 }    
 
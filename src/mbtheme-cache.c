@@ -0,0 +1,401 @@
+/*
+ *  Matchbox Window Manager - A lightweight window manager not for the
+ *                            desktop.
+ *
+ *  Authored By Matthew Allum <mallum@o-hand.com>
+ *
+ *  Copyright (c) 2002, 2004 OpenedHand Ltd - http://o-hand.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#include "mbtheme-cache.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+
+typedef struct MBThemeCacheRecord
+{
+  MBPixbufImage *img;		/* Owned by the theme, not us */
+  long           mtime;
+  long           size;
+
+} MBThemeCacheRecord;
+
+static unsigned long
+_img_data_len (MBPixbufImage *img)
+{
+  return (unsigned long)img->width * img->height 
+    * (img->internal_bytespp + img->has_alpha);
+}
+
+static unsigned long
+_path_hash (char *str)
+{
+  unsigned long h = 5381;
+
+  while (*str)
+    h = ((h << 5) + h) + (unsigned char)*str++;
+
+  return h;
+}
+
+static Bool
+_ensure_dir (char *path)
+{
+  struct stat st;
+
+  if (stat(path, &st) == 0)
+    return S_ISDIR(st.st_mode);
+
+  return (mkdir(path, 0755) == 0);
+}
+
+static void
+_record_loaded (MBThemeCache  *cache,
+		char          *filename,
+		MBPixbufImage *img,
+		struct stat   *st)
+{
+  MBThemeCacheRecord *rec;
+
+  rec = malloc(sizeof(MBThemeCacheRecord));
+  rec->img   = img;
+  rec->mtime = (long)st->st_mtime;
+  rec->size  = (long)st->st_size;
+
+  list_add(&cache->loaded, filename, 0, (void *)rec);
+}
+
+static Bool
+_entry_is_loaded (MBThemeCache *cache, MBThemeCacheEntry *e)
+{
+  return (list_find_by_name(cache->loaded, e->filename) != NULL);
+}
+
+static void
+_unmap (MBThemeCache *cache)
+{
+  if (cache->map)
+    munmap(cache->map, cache->map_len);
+
+  cache->map     = NULL;
+  cache->map_len = 0;
+  cache->header  = NULL;
+  cache->entries = NULL;
+}
+
+/* Check the blob is one we wrote for this theme file and display */
+static Bool
+_validate (MBThemeCache *cache, MBPixbuf *pb)
+{
+  MBThemeCacheHeader *hdr = cache->header;
+  unsigned long       table_end;
+  unsigned int        i;
+
+  if (cache->map_len < sizeof(MBThemeCacheHeader))
+    return False;
+
+  if (hdr->magic != MBTHEME_CACHE_MAGIC
+      || hdr->version != MBTHEME_CACHE_VERSION
+      || hdr->bytespp != (unsigned int)pb->internal_bytespp
+      || hdr->theme_mtime != cache->theme_mtime)
+    return False;
+
+  table_end = sizeof(MBThemeCacheHeader)
+    + (unsigned long)hdr->n_entries * sizeof(MBThemeCacheEntry);
+
+  if (table_end > cache->map_len)
+    return False;
+
+  for (i = 0; i < hdr->n_entries; i++)
+    {
+      MBThemeCacheEntry *e = &cache->entries[i];
+
+      /* Written so a bogus offset or length can't wrap past map_len */
+      if (e->data_offset < table_end
+	  || e->data_offset > cache->map_len
+	  || e->data_len > cache->map_len - e->data_offset
+	  || e->filename[sizeof(e->filename)-1] != '\0')
+	return False;
+    }
+
+  return True;
+}
+
+MBThemeCache*
+mbtheme_cache_open (MBPixbuf *pb,
+		    char     *theme_filename)
+{
+  MBThemeCache *cache;
+  struct stat   st;
+  char         *home = getenv("HOME");
+  int           fd;
+
+  if (home == NULL || getenv("MB_THEME_NO_CACHE"))
+    return NULL;
+
+  if (stat(theme_filename, &st))
+    return NULL;
+
+  cache = malloc(sizeof(MBThemeCache));
+  memset(cache, 0, sizeof(MBThemeCache));
+
+  cache->theme_mtime = (long)st.st_mtime;
+
+  cache->path = malloc(strlen(home) + 64);
+  sprintf(cache->path, "%s/.matchbox/cache/theme-%08lx.bin",
+	  home, _path_hash(theme_filename) & 0xffffffffUL);
+
+  dbg("%s() using %s for %s\n", __func__, cache->path, theme_filename);
+
+  if ((fd = open(cache->path, O_RDONLY)) < 0)
+    return cache;
+
+  if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+      cache->map_len = st.st_size;
+      cache->map = mmap(NULL, cache->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+
+      if (cache->map == MAP_FAILED)
+	{
+	  cache->map = NULL;
+	  cache->map_len = 0;
+	}
+    }
+
+  close(fd);
+
+  if (cache->map)
+    {
+      cache->header  = (MBThemeCacheHeader *)cache->map;
+      cache->entries = (MBThemeCacheEntry *)
+	(cache->map + sizeof(MBThemeCacheHeader));
+
+      if (!_validate(cache, pb))
+	{
+	  dbg("%s() %s is stale, ignoring\n", __func__, cache->path);
+	  _unmap(cache);
+	}
+    }
+
+  return cache;
+}
+
+MBPixbufImage*
+mbtheme_cache_lookup (MBThemeCache *cache,
+		      MBPixbuf     *pb,
+		      char         *filename)
+{
+  MBPixbufImage     *img;
+  MBThemeCacheEntry *e = NULL;
+  struct stat        st;
+  unsigned int       i;
+
+  if (cache->map == NULL || stat(filename, &st))
+    goto miss;
+
+  for (i = 0; i < cache->header->n_entries; i++)
+    if (!strcmp(cache->entries[i].filename, filename))
+      {
+	e = &cache->entries[i];
+	break;
+      }
+
+  if (e == NULL || e->mtime != (long)st.st_mtime || e->size != (long)st.st_size)
+    goto miss;
+
+  if (e->has_alpha)
+    img = mb_pixbuf_img_rgba_new(pb, e->width, e->height);
+  else
+    img = mb_pixbuf_img_rgb_new(pb, e->width, e->height);
+
+  if (img == NULL)
+    goto miss;
+
+  if (_img_data_len(img) != e->data_len)
+    {
+      mb_pixbuf_img_free(pb, img);
+      goto miss;
+    }
+
+  memcpy(img->rgba, cache->map + e->data_offset, e->data_len);
+
+  _record_loaded(cache, filename, img, &st);
+  cache->hits++;
+
+  return img;
+
+ miss:
+  cache->misses++;
+  cache->dirty = True;
+  return NULL;
+}
+
+void
+mbtheme_cache_add (MBThemeCache  *cache,
+		   char          *filename,
+		   MBPixbufImage *img)
+{
+  struct stat st;
+
+  if (strlen(filename) >= sizeof(((MBThemeCacheEntry*)0)->filename))
+    return;
+
+  if (stat(filename, &st))
+    return;
+
+  _record_loaded(cache, filename, img, &st);
+  cache->dirty = True;
+}
+
+void
+mbtheme_cache_save (MBThemeCache *cache,
+		    MBPixbuf     *pb)
+{
+  MBThemeCacheHeader  hdr;
+  MBThemeCacheEntry   entry;
+  MBList             *item;
+  FILE               *fp;
+  char               *tmp_path, *dir, *p;
+  unsigned long       offset;
+  unsigned int        n = 0, n_kept = 0, i;
+
+  dbg("%s() %i hits, %i misses\n", __func__, cache->hits, cache->misses);
+
+  if (!cache->dirty)
+    return;
+
+  /* One try per batch of loads, a read only home isn't retried */
+  cache->dirty = False;
+
+  list_enumerate(cache->loaded, item)
+    n++;
+
+  /* Images are loaded lazily, so carry over any still valid entries 
+   * from the old blob that haven't been asked for (yet).
+  */
+  if (cache->map)
+    for (i = 0; i < cache->header->n_entries; i++)
+      if (!_entry_is_loaded(cache, &cache->entries[i]))
+	n_kept++;
+
+  if (n + n_kept == 0)
+    return;
+
+  dir = strdup(cache->path);
+  p   = strrchr(dir, '/');
+  *p  = '\0';
+  p   = strrchr(dir, '/');
+  *p  = '\0';
+
+  /* ~/.matchbox may well not exist yet either */
+  if (!_ensure_dir(dir))
+    { free(dir); return; }
+
+  *p = '/';
+
+  if (!_ensure_dir(dir))
+    { free(dir); return; }
+
+  free(dir);
+
+  tmp_path = malloc(strlen(cache->path) + 8);
+  sprintf(tmp_path, "%s.%i", cache->path, (int)getpid());
+
+  if ((fp = fopen(tmp_path, "wb")) == NULL)
+    {
+      free(tmp_path);
+      return;
+    }
+
+  memset(&hdr, 0, sizeof(MBThemeCacheHeader));
+  hdr.magic       = MBTHEME_CACHE_MAGIC;
+  hdr.version     = MBTHEME_CACHE_VERSION;
+  hdr.bytespp     = pb->internal_bytespp;
+  hdr.n_entries   = n + n_kept;
+  hdr.theme_mtime = cache->theme_mtime;
+
+  fwrite(&hdr, sizeof(MBThemeCacheHeader), 1, fp);
+
+  offset = sizeof(MBThemeCacheHeader) 
+    + (n + n_kept) * sizeof(MBThemeCacheEntry);
+
+  list_enumerate(cache->loaded, item)
+    {
+      MBThemeCacheRecord *rec = (MBThemeCacheRecord *)item->data;
+
+      memset(&entry, 0, sizeof(MBThemeCacheEntry));
+      strncpy(entry.filename, item->name, sizeof(entry.filename) - 1);
+      entry.mtime       = rec->mtime;
+      entry.size        = rec->size;
+      entry.width       = rec->img->width;
+      entry.height      = rec->img->height;
+      entry.has_alpha   = rec->img->has_alpha;
+      entry.data_offset = offset;
+      entry.data_len    = _img_data_len(rec->img);
+
+      fwrite(&entry, sizeof(MBThemeCacheEntry), 1, fp);
+
+      offset += entry.data_len;
+    }
+
+  if (cache->map)
+    for (i = 0; i < cache->header->n_entries; i++)
+      if (!_entry_is_loaded(cache, &cache->entries[i]))
+	{
+	  entry = cache->entries[i];
+	  entry.data_offset = offset;
+
+	  fwrite(&entry, sizeof(MBThemeCacheEntry), 1, fp);
+
+	  offset += entry.data_len;
+	}
+
+  list_enumerate(cache->loaded, item)
+    {
+      MBThemeCacheRecord *rec = (MBThemeCacheRecord *)item->data;
+
+      fwrite(rec->img->rgba, _img_data_len(rec->img), 1, fp);
+    }
+
+  if (cache->map)
+    for (i = 0; i < cache->header->n_entries; i++)
+      if (!_entry_is_loaded(cache, &cache->entries[i]))
+	fwrite(cache->map + cache->entries[i].data_offset,
+	       cache->entries[i].data_len, 1, fp);
+
+  if (fclose(fp) != 0 || rename(tmp_path, cache->path) != 0)
+    {
+      fprintf(stderr, "matchbox: failed to write theme cache %s\n",
+	      cache->path);
+      unlink(tmp_path);
+    }
+
+  free(tmp_path);
+}
+
+void
+mbtheme_cache_free (MBThemeCache *cache)
+{
+  MBList *item;
+
+  _unmap(cache);
+
+  list_enumerate(cache->loaded, item)
+    free(item->data);
+
+  list_destroy(&cache->loaded);
+
+  free(cache->path);
+  free(cache);
+}
@@ -0,0 +1,103 @@
+/*
+ *  Matchbox Window Manager - A lightweight window manager not for the
+ *                            desktop.
+ *
+ *  Authored By Matthew Allum <mallum@o-hand.com>
+ *
+ *  Copyright (c) 2002, 2004 OpenedHand Ltd - http://o-hand.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#ifndef _MBTHEME_CACHE_H_
+#define _MBTHEME_CACHE_H_
+
+#include "structs.h"
+#include "list.h"
+
+/*
+ *  Compiled theme cache.
+ *
+ *  Decoding the PNG/JPEG pixmaps a theme references is by far the most
+ *  expensive part of loading a theme. As images get decoded their pixel
+ *  data, in libmb's internal format, is written out to
+ *  ~/.matchbox/cache/ and mmap'd on later starts. The blob is keyed
+ *  on the theme.xml path and thrown away if theme.xml, any of the image
+ *  files or the display's pixbuf format changes.
+ */
+
+#define MBTHEME_CACHE_MAGIC    0x4d425443 /* 'MBTC' */
+#define MBTHEME_CACHE_VERSION  1
+
+typedef struct MBThemeCacheHeader
+{
+  unsigned int magic;
+  unsigned int version;
+  unsigned int bytespp;	   /* pb->internal_bytespp data was stored with */
+  unsigned int n_entries;
+  long         theme_mtime;
+
+} MBThemeCacheHeader;
+
+typedef struct MBThemeCacheEntry
+{
+  char          filename[256];
+  long          mtime;
+  long          size;
+  int           width;
+  int           height;
+  int           has_alpha;
+  unsigned long data_offset;
+  unsigned long data_len;
+
+} MBThemeCacheEntry;
+
+typedef struct MBThemeCache
+{
+  char               *path;
+  long                theme_mtime;
+
+  unsigned char      *map; 	   /* mmap'd blob, NULL if none/invalid */
+  size_t              map_len;
+  MBThemeCacheHeader *header;
+  MBThemeCacheEntry  *entries;
+
+  MBList             *loaded;	   /* Images to write out on save */
+  Bool                dirty;
+
+  int                 hits;
+  int                 misses;
+
+} MBThemeCache;
+
+MBThemeCache*
+mbtheme_cache_open (MBPixbuf *pb,
+		    char     *theme_filename);
+
+MBPixbufImage*
+mbtheme_cache_lookup (MBThemeCache *cache,
+		      MBPixbuf     *pb,
+		      char         *filename);
+
+void
+mbtheme_cache_add (MBThemeCache  *cache,
+		   char          *filename,
+		   MBPixbufImage *img);
+
+void
+mbtheme_cache_save (MBThemeCache *cache,
+		    MBPixbuf     *pb);
+
+void
+mbtheme_cache_free (MBThemeCache *cache);
+
+#endif
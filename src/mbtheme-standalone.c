@@ -488,6 +488,41 @@ _theme_paint_pixmap_border( MBTheme *theme,
 
 }
 
+void
+theme_frame_prerender_add (MBTheme *theme,
+			   int      frame_type,
+			   int      dw,
+			   int      dh,
+			   Bool     has_alpha)
+{
+  return;
+}
+
+void
+theme_frame_prerender_run (MBTheme *theme)
+{
+  return;
+}
+
+void
+theme_frame_prerender_clear (MBTheme *theme)
+{
+  return;
+}
+
+/* Standalone menus are cheap enough to paint when opened */
+void
+theme_frame_menu_invalidate (MBTheme *theme)
+{
+  return;
+}
+
+Bool
+theme_frame_menu_update (MBTheme *theme)
+{
+  return True;
+}
+
 Bool 
 theme_frame_paint( MBTheme *theme, 		   
 		   Client  *c, 
@@ -498,6 +533,7 @@ theme_frame_paint( MBTheme *theme,
   Wm    *w = theme->wm;
   int    decor_idx = 0;
   Pixmap pxm_backing  = None; 
+  long long start = misc_get_time_usec();
 
   pxm_backing = XCreatePixmap(theme->wm->dpy, theme->wm->root, dw, dh, 
 			      DefaultDepth(theme->wm->dpy, theme->wm->screen));
@@ -621,6 +657,8 @@ theme_frame_paint( MBTheme *theme,
 
   XFreePixmap(w->dpy, pxm_backing);
 
+  latency_add(LATENCY_THEME_FRAME_PAINT, misc_get_time_usec() - start);
+
   return True;
 }
 
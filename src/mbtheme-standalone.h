@@ -200,6 +200,19 @@ theme_frame_button_paint (MBTheme       *theme,
 			  int            dest_w,
 			  int            dest_h );
 
+void
+theme_frame_prerender_add (MBTheme       *theme,
+			   int            frame_type,
+			   int            dw,
+			   int            dh,
+			   Bool           has_alpha);
+
+void
+theme_frame_prerender_run (MBTheme       *theme);
+
+void
+theme_frame_prerender_clear (MBTheme       *theme);
+
 Bool     
 theme_frame_paint (MBTheme       *theme,
 		   Client        *c,
@@ -211,6 +224,12 @@ void
 theme_frame_menu_paint (MBTheme       *theme,
 			Client        *c);
 
+void
+theme_frame_menu_invalidate (MBTheme       *theme);
+
+Bool
+theme_frame_menu_update (MBTheme       *theme);
+
 Bool     
 theme_frame_menu_get_dimentions (MBTheme       *theme,
 				  int           *w,
@@ -20,10 +20,20 @@
 
 #include "mbtheme.h" 
 
+#include <sys/time.h>
+
+#ifdef USE_THREADED_PRERENDER
+#include <pthread.h>
+#endif
+
 #ifdef HAVE_XCURSOR
 #include <X11/Xcursor/Xcursor.h>
 #endif
 
+#ifndef MAXPATHLEN
+#define MAXPATHLEN 256
+#endif
+
 #define GET_INT_ATTR(n,k,v) \
     { if (get_attr((n), (k))) (v) = atoi(get_attr((n), (k))); else (v) = 0; }
 
@@ -110,6 +120,111 @@ static void show_parse_error(Wm *w, XMLNode *node,
 
 /* ---------------------------------------------------- Painting Code -- */
 
+void
+theme_image_stats_publish (MBTheme *theme)
+{
+  char buf[128];
+
+  snprintf(buf, sizeof(buf), "images=%i loaded=%i decode_ms=%li bytes=%li",
+	   theme->n_images, theme->n_images_loaded,
+	   theme->image_decode_usec / 1000, theme->image_bytes);
+
+  dbg("%s() %s\n", __func__, buf);
+
+  XChangeProperty(theme->wm->dpy, theme->wm->root, 
+		  theme->wm->atoms[_MB_THEME_STATS], XA_STRING, 8,
+		  PropModeReplace, (unsigned char*)buf, strlen(buf));
+
+  theme->image_stats_dirty = False;
+}
+
+static Wm *exit_wm;
+
+static void
+theme_image_cache_atexit (void)
+{
+  if (exit_wm->mbtheme && exit_wm->mbtheme->cache)
+    mbtheme_cache_save(exit_wm->mbtheme->cache, exit_wm->pb);
+}
+
+/* A cold start decodes images one paint at a time, saving the whole 
+ * blob after each would rewrite it once per image.
+ */
+void
+theme_image_cache_check (MBTheme *theme)
+{
+  if (theme->cache && theme->cache->dirty
+      && misc_get_time_usec() - theme->image_load_usec 
+         >= THEME_CACHE_SAVE_DELAY * 1000LL)
+    mbtheme_cache_save(theme->cache, theme->wm->pb);
+}
+
+void
+theme_image_cache_get_timeout (MBTheme *theme, struct timeval *tv)
+{
+  if (theme->cache && theme->cache->dirty)
+    misc_timeout_shorten(tv, theme->image_load_usec 
+			 + THEME_CACHE_SAVE_DELAY * 1000LL 
+			 - misc_get_time_usec());
+}
+
+/* Theme pixmaps are only decoded when something first paints with 
+ * them, lots of themes carry images for frames a device never shows.
+ */
+MBPixbufImage*
+theme_image_get (MBTheme      *theme, 
+		 MBThemeImage *image)
+{
+  MBPixbuf       *pb = theme->wm->pb;
+  MBPixbufImage  *img;
+  struct timeval  tv_start, tv_end;
+  Bool            from_cache = False;
+
+  if (image->img != NULL) 
+    return image->img;
+
+  gettimeofday(&tv_start, NULL);
+
+  if (theme->cache)
+    from_cache = ((img = mbtheme_cache_lookup(theme->cache, pb, 
+					      image->filename)) != NULL);
+
+  if (!from_cache)
+    img = mb_pixbuf_img_new_from_file(pb, image->filename);
+
+  gettimeofday(&tv_end, NULL);
+
+  theme->image_decode_usec += (tv_end.tv_sec - tv_start.tv_sec) * 1000000
+                               + (tv_end.tv_usec - tv_start.tv_usec);
+  theme->image_stats_dirty = True;
+
+  if (img == NULL)
+    {
+      /* File went away or got corrupted since parsing, paint nothing.
+       * The placeholder isn't counted as loaded. */
+      fprintf(stderr, "matchbox: failed to load theme image %s\n", 
+	      image->filename);
+      img = mb_pixbuf_img_rgba_new(pb, 1, 1);
+      mb_pixbuf_img_fill(pb, img, 0, 0, 0, 0);
+      image->img = img;
+      return img;
+    }
+
+  if (!from_cache && theme->cache)
+    {
+      mbtheme_cache_add(theme->cache, image->filename, img);
+      theme->image_load_usec = misc_get_time_usec();
+    }
+
+  image->img = img;
+
+  theme->n_images_loaded++;
+  theme->image_bytes += img->width * img->height 
+                          * (img->internal_bytespp + img->has_alpha);
+
+  return img;
+}
+
 static int 
 lookup_frame_type(char *name)
 {
@@ -125,15 +240,13 @@ void theme_frame_icon_paint(MBTheme *t, Client *c,
 			    int x, int y)
 {
   MBPixbufImage *img = NULL;
-  unsigned long *data = NULL;
 
-  if (c->icon_rgba_data != NULL)
+  /* Shared and already scaled, so paint straight from the cache */
+  if (c->icon_rgba != NULL
+      && (img = icon_cache_get_image(t->wm, c->icon_rgba, 16, 16)) != NULL)
     {
-      data = c->icon_rgba_data;
-
-      img = mb_pixbuf_img_new_from_long_data(t->wm->pb,
-                                             (data+2),
-                                             data[0], data[1]);
+      mb_pixbuf_img_composite(t->wm->pb, img_dest, img, x, y);
+      return;
     }
   else 
     {
@@ -285,7 +398,7 @@ theme_frame_button_paint(MBTheme *theme,
 	    {
 	      /* Now paint the actual button if required */
 	      int            copy_w, copy_h;
-	      MBPixbufImage *img_backing = NULL;
+	      MBPixbufImage *img_backing = NULL, *img_button = NULL;
 	      Pixmap         pxm_button;
 	      MBPixbuf      *pb = w->pb;
 
@@ -318,18 +431,20 @@ theme_frame_button_paint(MBTheme *theme,
 
 	      if (state == ACTIVE)
 		{
-		  if (button->img_active->width > button_w)
+		  img_button = theme_image_get(theme, button->img_active);
+
+		  if (img_button->width > button_w)
 		    copy_w = button_w;
 		  else
-		    copy_w = button->img_active->width;
+		    copy_w = img_button->width;
 
-		  if (button->img_active->height > button_h)
+		  if (img_button->height > button_h)
 		    copy_h = button_h;
 		  else
-		    copy_h = button->img_active->height;
+		    copy_h = img_button->height;
 
 		  mb_pixbuf_img_copy_composite_with_alpha(pb, img_backing,
-							  button->img_active, 
+							  img_button, 
 							  0, 0, copy_w, copy_h,
 							  0, 0, 
 							  button->img_active_blend);
@@ -337,18 +452,20 @@ theme_frame_button_paint(MBTheme *theme,
 		} 
 	      else 
 		{
-		  if (button->img_inactive->width > button_w)
+		  img_button = theme_image_get(theme, button->img_inactive);
+
+		  if (img_button->width > button_w)
 		    copy_w = button_w;
 		  else
-		    copy_w = button->img_inactive->width;
+		    copy_w = img_button->width;
 		  
-		  if (button->img_inactive->height > button_h)
+		  if (img_button->height > button_h)
 		    copy_h = button_h;
 		  else
-		    copy_h = button->img_inactive->height;
+		    copy_h = img_button->height;
 
 		  mb_pixbuf_img_copy_composite_with_alpha(pb, img_backing,
-							  button->img_inactive, 
+							  img_button, 
 							  0, 0, copy_w, copy_h,
 							  0, 0,
 							  button->img_inactive_blend);
@@ -482,7 +599,7 @@ _theme_paint_core( MBTheme       *theme,
 
   while (layer_list_item != NULL)
     {
-      MBPixbufImage *img_tmp = NULL;
+      MBPixbufImage *img_tmp = NULL, *img_layer = NULL;
       int            tx, ty, tw, th, x, y, w, h;
 
       layer_cur = (MBThemeLayer *)layer_list_item->data;
@@ -499,8 +616,10 @@ _theme_paint_core( MBTheme       *theme,
       if ( layer_list_item->id == LAYER_PIXMAP 
 	   || layer_list_item->id == LAYER_PIXMAP_TILED)
 	{
-	  if ( layer_cur->w->unit == object) w = layer_cur->img->width;
-	  if ( layer_cur->h->unit == object) h = layer_cur->img->height;
+	  img_layer = theme_image_get(theme, layer_cur->img);
+
+	  if ( layer_cur->w->unit == object) w = img_layer->width;
+	  if ( layer_cur->h->unit == object) h = img_layer->height;
 	}
 
       /* Clip if calculated sizes are bigger than dest */
@@ -539,7 +658,7 @@ _theme_paint_core( MBTheme       *theme,
 	  break;
 
 	case LAYER_PIXMAP:
-	  img_tmp = mb_pixbuf_img_scale(theme->wm->pb, layer_cur->img, w, h);
+	  img_tmp = mb_pixbuf_img_scale(theme->wm->pb, img_layer, w, h);
 	  dbg("%s() Layer is pixmap\n", __func__);
 	  break;
 
@@ -547,22 +666,22 @@ _theme_paint_core( MBTheme       *theme,
 	  dbg("%s() Layer is pixmap tiled %i x %i\n", __func__, w, h);
 	  img_tmp = mb_pixbuf_img_new(theme->wm->pb, w, h);
 	  
-	  for (ty=0; ty < h; ty += layer_cur->img->height)
-	    for (tx=0; tx < w; tx += layer_cur->img->width)
+	  for (ty=0; ty < h; ty += img_layer->height)
+	    for (tx=0; tx < w; tx += img_layer->width)
 	      {
-		if ( (tx + layer_cur->img->width) > w )
-		  tw = layer_cur->img->width - ((tx+layer_cur->img->width)-w);
+		if ( (tx + img_layer->width) > w )
+		  tw = img_layer->width - ((tx+img_layer->width)-w);
 		else
-		  tw = layer_cur->img->width;
+		  tw = img_layer->width;
 		
-		if ( (ty + layer_cur->img->height) > h )
-		  th = layer_cur->img->height-((ty+layer_cur->img->height)-h);
+		if ( (ty + img_layer->height) > h )
+		  th = img_layer->height-((ty+img_layer->height)-h);
 		else
-		  th = layer_cur->img->height;
+		  th = img_layer->height;
 		
 		dbg("%s() Tiling %i x %i, +%i+%i\n", __func__, tw, th, tx, ty);
 		mb_pixbuf_img_copy_composite(theme->wm->pb, img, 
-					     layer_cur->img,
+					     img_layer,
 					     0, 0, tw, th, tx + x, ty + y);
 	      }
 	  break;
@@ -588,6 +707,247 @@ _theme_paint_core( MBTheme       *theme,
     }
 }
 
+/* 
+ *  Decoration pre-rendering.
+ *
+ *  On a theme switch or screen resize every client's frames get
+ *  repainted in one go. The layer compositing is pure CPU work on 
+ *  MBPixbufImages so we collect the distinct frame/size pairs needed
+ *  up front and rasterize them ( in parallel where we can ) before 
+ *  the clients are redrawn. theme_frame_paint() then just picks up 
+ *  the result and does the X side.
+ */
+
+typedef struct MBThemePrerender
+{
+  MBThemeFrame  *frame;
+  int            frame_type;
+  int            width;
+  int            height;
+  Bool           has_alpha;
+  MBPixbufImage *img;
+
+} MBThemePrerender;
+
+/* Frames whose layers are placed relative to the label depend on 
+ * frame->label_x/w which theme_frame_paint() sets per paint. 
+*/
+static Bool
+_theme_frame_can_prerender (MBThemeFrame *frame)
+{
+  MBList *item;
+
+  list_enumerate(frame->layers, item)
+    {
+      MBThemeLayer *layer = (MBThemeLayer *)item->data;
+
+      if (item->id == LAYER_LABEL || item->id == LAYER_ICON)
+	continue;
+
+      if (layer->x->unit == textx || layer->x->unit == textw
+	  || layer->w->unit == textx || layer->w->unit == textw)
+	return False;
+    }
+
+  return True;
+}
+
+void
+theme_frame_prerender_add (MBTheme *theme,
+			   int      frame_type,
+			   int      dw,
+			   int      dh,
+			   Bool     has_alpha)
+{
+  MBThemePrerender *job;
+  MBThemeFrame     *frame;
+  MBList           *item;
+
+  if (dw <= 0 || dh <= 0 || theme->disable_pixbuf_cache)
+    return;
+
+  frame = (MBThemeFrame *)list_find_by_id(theme->frames, frame_type);
+
+  if (frame == NULL || !_theme_frame_can_prerender(frame))
+    return;
+
+  list_enumerate(theme->prerenders, item)
+    {
+      job = (MBThemePrerender *)item->data;
+
+      if (job->frame_type == frame_type && job->width == dw 
+	  && job->height == dh && job->has_alpha == has_alpha)
+	return;
+    }
+
+  /* Images are decoded here, on the main thread, as theme_image_get()
+   * may hit the disk cache and touches the root window stats. 
+  */
+  list_enumerate(frame->layers, item)
+    if (item->id == LAYER_PIXMAP || item->id == LAYER_PIXMAP_TILED)
+      theme_image_get(theme, ((MBThemeLayer *)item->data)->img);
+
+  job = malloc(sizeof(MBThemePrerender));
+  memset(job, 0, sizeof(MBThemePrerender));
+
+  job->frame      = frame;
+  job->frame_type = frame_type;
+  job->width      = dw;
+  job->height     = dh;
+  job->has_alpha  = has_alpha;
+
+  list_add(&theme->prerenders, NULL, frame_type, (void *)job);
+}
+
+static void
+_theme_prerender_job (MBTheme *theme, MBThemePrerender *job)
+{
+  if (job->has_alpha)
+    job->img = mb_pixbuf_img_rgba_new(theme->wm->pb, job->width, job->height);
+  else
+    job->img = mb_pixbuf_img_rgb_new(theme->wm->pb, job->width, job->height);
+
+  _theme_paint_core(theme, NULL, job->frame, job->img, 
+		    0, 0, job->width, job->height);
+}
+
+#ifdef USE_THREADED_PRERENDER
+
+#define PRERENDER_MAX_THREADS 8
+
+typedef struct MBThemePrerenderQueue
+{
+  MBTheme           *theme;
+  MBThemePrerender **jobs;
+  int                n_jobs;
+  int                next;
+  pthread_mutex_t    lock;
+
+} MBThemePrerenderQueue;
+
+static void*
+_theme_prerender_worker (void *data)
+{
+  MBThemePrerenderQueue *queue = (MBThemePrerenderQueue *)data;
+  int                    i;
+
+  while (True)
+    {
+      pthread_mutex_lock(&queue->lock);
+      i = queue->next++;
+      pthread_mutex_unlock(&queue->lock);
+
+      if (i >= queue->n_jobs) 
+	break;
+
+      _theme_prerender_job(queue->theme, queue->jobs[i]);
+    }
+
+  return NULL;
+}
+
+#endif
+
+void
+theme_frame_prerender_run (MBTheme *theme)
+{
+  MBList            *item;
+  MBThemePrerender **jobs;
+  int                n_jobs = 0, i = 0;
+
+  list_enumerate(theme->prerenders, item)
+    if (((MBThemePrerender *)item->data)->img == NULL)
+      n_jobs++;
+
+  if (n_jobs == 0) 
+    return;
+
+  jobs = malloc(sizeof(MBThemePrerender*) * n_jobs);
+
+  list_enumerate(theme->prerenders, item)
+    if (((MBThemePrerender *)item->data)->img == NULL)
+      jobs[i++] = (MBThemePrerender *)item->data;
+
+#ifdef USE_THREADED_PRERENDER
+  {
+    MBThemePrerenderQueue queue;
+    pthread_t             threads[PRERENDER_MAX_THREADS];
+    int                   n_threads = 0, n_cpus;
+
+    n_cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (n_cpus > PRERENDER_MAX_THREADS) n_cpus = PRERENDER_MAX_THREADS;
+    if (n_cpus > n_jobs) n_cpus = n_jobs;
+
+    queue.theme  = theme;
+    queue.jobs   = jobs;
+    queue.n_jobs = n_jobs;
+    queue.next   = 0;
+    pthread_mutex_init(&queue.lock, NULL);
+
+    /* The main thread takes jobs too, so we need one less worker. If 
+     * a thread fails to start the rest just get more work.
+    */
+    for (i = 0; i < n_cpus - 1; i++)
+      if (pthread_create(&threads[n_threads], NULL, 
+			 _theme_prerender_worker, &queue) == 0)
+	n_threads++;
+
+    dbg("%s() %i jobs on %i threads\n", __func__, n_jobs, n_threads + 1);
+
+    _theme_prerender_worker(&queue);
+
+    for (i = 0; i < n_threads; i++)
+      pthread_join(threads[i], NULL);
+
+    pthread_mutex_destroy(&queue.lock);
+  }
+#else
+  for (i = 0; i < n_jobs; i++)
+    _theme_prerender_job(theme, jobs[i]);
+#endif
+
+  free(jobs);
+}
+
+static MBPixbufImage*
+_theme_frame_prerendered_get (MBTheme *theme,
+			      int      frame_type,
+			      int      dw,
+			      int      dh,
+			      Bool     has_alpha)
+{
+  MBList *item;
+
+  list_enumerate(theme->prerenders, item)
+    {
+      MBThemePrerender *job = (MBThemePrerender *)item->data;
+
+      if (job->img && job->frame_type == frame_type && job->width == dw 
+	  && job->height == dh && job->has_alpha == has_alpha)
+	return job->img;
+    }
+
+  return NULL;
+}
+
+void
+theme_frame_prerender_clear (MBTheme *theme)
+{
+  MBList *item;
+
+  list_enumerate(theme->prerenders, item)
+    {
+      MBThemePrerender *job = (MBThemePrerender *)item->data;
+
+      if (job->img) 
+	mb_pixbuf_img_free(theme->wm->pb, job->img);
+      free(job);
+    }
+
+  list_destroy(&theme->prerenders);
+}
+
 Bool
 theme_frame_paint( MBTheme *theme, 
 		   Client  *c, 
@@ -606,6 +966,7 @@ theme_frame_paint( MBTheme *theme,
   int               decor_idx = 0;
   MBDrawable       *drawable = NULL;
   MBPixbuf         *pixbuf = w->pb;
+  long long         start;
 
   if (dw == 0 || dh == 0)
     return False;
@@ -614,6 +975,8 @@ theme_frame_paint( MBTheme *theme,
 
   if (frame == NULL) return False;
 
+  start = misc_get_time_usec();
+
 #ifdef USE_COMPOSITE
    if (c->is_argb32)
      pixbuf = w->argb_pb;
@@ -664,6 +1027,7 @@ theme_frame_paint( MBTheme *theme,
 				     theme->app_win_pxm_cache[decor_idx]);
 	  XClearWindow(w->dpy, c->frames_decor[decor_idx]);
 	  XSync(w->dpy, False);
+	  latency_add(LATENCY_THEME_FRAME_PAINT, misc_get_time_usec() - start);
 	  return True;
 	}
     }
@@ -684,12 +1048,26 @@ theme_frame_paint( MBTheme *theme,
       /* Other window decors are just kept around whilst the client exists 
        * so things like buttons can composite onto them.  
       */
+      Bool           has_alpha;
+      MBPixbufImage *img_prerendered;
+
       theme_img_cache_clear (theme, frame_type);
 
-      if (c->backing_masks[MSK_NORTH] != None  /* Need alpha chan for shape */
-	  || c->backing_masks[MSK_SOUTH]!= None
-	  || c->backing_masks[MSK_EAST] != None
-	  || c->backing_masks[MSK_WEST] != None )
+      has_alpha = (c->backing_masks[MSK_NORTH] != None /* Need alpha for shape */
+		   || c->backing_masks[MSK_SOUTH]!= None
+		   || c->backing_masks[MSK_EAST] != None
+		   || c->backing_masks[MSK_WEST] != None );
+
+      img_prerendered = _theme_frame_prerendered_get(theme, frame_type, 
+						     dw, dh, has_alpha);
+      if (img_prerendered)
+	{
+	  dbg("%s() using prerendered frame %i\n", __func__, frame_type);
+	  theme->img_caches[frame_type] = mb_pixbuf_img_clone(theme->wm->pb,
+							      img_prerendered);
+	  have_img_cached = True;
+	}
+      else if (has_alpha)
 	theme->img_caches[frame_type] = mb_pixbuf_img_rgba_new(theme->wm->pb,
 							       dw,dh);
       else
@@ -875,13 +1253,24 @@ theme_frame_paint( MBTheme *theme,
 
   mb_drawable_unref(drawable);
 
+  latency_add(LATENCY_THEME_FRAME_PAINT, misc_get_time_usec() - start);
+
   return True;
 }
 
 /**** Task list painting *******/
 
-Bool
-theme_frame_menu_get_dimentions(MBTheme* theme, int *w, int *h)
+/*
+ *  The task menu is kept rendered on the theme, rather than being built
+ *  from scratch every time its opened. theme_frame_menu_invalidate() is
+ *  called when anything it lists may have changed and the next 
+ *  theme_frame_menu_update(), normally from the event loop once idle, 
+ *  repaints just the rows that actually differ. The whole surface is 
+ *  only rebuilt if the menu changes size.
+ */
+
+static Bool
+_theme_frame_menu_measure(MBTheme* theme, int *w, int *h)
 {
   Client       *p     = NULL;
   MBThemeFrame *frame = NULL;
@@ -935,22 +1324,62 @@ theme_frame_menu_get_dimentions(MBTheme* theme, int *w, int *h)
   return True;
 }
 
+/* Visible apps, then iconized / hidden apps, then the desktop at the 
+ * bottom if there is one. Returns the number of entries.
+ */
+static int
+_theme_frame_menu_entries (MBTheme *theme, Client ***entries_ret)
+{
+  Wm      *w = theme->wm;
+  Client  *p, *visible_main, **entries;
+  MBList  *item;
+  int      n = 0, pass;
+
+  visible_main = wm_get_visible_main_client(w);
+
+  list_enumerate(w->client_age_list, item)
+    n++;
+
+  entries = malloc(sizeof(Client*) * (n + 1));
+  n       = 0;
+
+  for (pass = 0; pass < 2; pass++)
+    list_enumerate(w->client_age_list, item)
+      {
+	p = (Client*)item->data;
+
+	if (p->type == MBCLIENT_TYPE_APP 
+	    && p->name && !(p->flags & CLIENT_IS_DESKTOP_FLAG)
+	    && (pass == 0) == (p->mapped != False)
+	    && p != visible_main)
+	  entries[n++] = p;
+      }
+
+  if ((p = wm_get_desktop(w)) != NULL) 
+    entries[n++] = p;
+
+  *entries_ret = entries;
+
+  return n;
+}
+
 static void
 _theme_frame_menu_paint_text_entry(MBTheme      *theme, 
 				   MBFont       *font, 
 				   MBColor      *color, 
-				   Client       *c, 
+				   int           menu_width,
 				   Client       *entry, 
 				   MBDrawable   *dest,
 				   int           x,
 				   int           y)
 {
-  int text_height, text_width, y_offset;
+  Wm  *w = theme->wm;
+  int  text_height, text_width, y_offset;
 
-  text_height = MBMAX( c->wm->config->use_icons + MENU_ICON_PADDING,
+  text_height = MBMAX( w->config->use_icons + MENU_ICON_PADDING,
 		      mb_font_get_height(font) + MENU_ENTRY_PADDING );
 
-  text_width  = c->width - c->wm->config->use_icons - MENU_ENTRY_PADDING;
+  text_width  = menu_width - w->config->use_icons - MENU_ENTRY_PADDING;
 
   y_offset    = y + (text_height - (mb_font_get_height(font)))/2;
 
@@ -965,10 +1394,237 @@ _theme_frame_menu_paint_text_entry(MBTheme      *theme,
   mb_col_unref(color); 	/* set_color refs */
 }
 
+static void
+_theme_frame_menu_row_free (MBTheme *theme, MBThemeMenuRow *row)
+{
+  if (row->name)   free(row->name);
+  if (row->active) mb_drawable_unref(row->active);
+
+  memset(row, 0, sizeof(MBThemeMenuRow));
+}
+
+static void
+_theme_frame_menu_free (MBTheme *theme)
+{
+  MBThemeMenu *menu = theme->menu;
+  int          i;
+
+  if (menu == NULL) 
+    return;
+
+  for (i = 0; i < menu->n_rows; i++)
+    _theme_frame_menu_row_free(theme, &menu->rows[i]);
+
+  if (menu->rows)     free(menu->rows);
+  if (menu->bg)       mb_pixbuf_img_free(theme->wm->pb, menu->bg);
+  if (menu->img)      mb_pixbuf_img_free(theme->wm->pb, menu->img);
+  if (menu->drawable) mb_drawable_unref(menu->drawable);
+  if (menu->mask)     XFreePixmap(theme->wm->dpy, menu->mask);
+
+  free(menu);
+  theme->menu = NULL;
+}
+
+static Bool
+_theme_frame_menu_row_matches (MBThemeMenuRow *row, Client *entry)
+{
+  return (row->entry == entry 
+	  && row->win == entry->window
+	  && row->icon_hash == (entry->icon_rgba ? entry->icon_rgba->hash : 0)
+	  && row->name_is_utf8 == entry->name_is_utf8
+	  && row->name && entry->name && !strcmp(row->name, entry->name));
+}
+
+/* Paints a rows icon into menu->img, over a clean copy of the 
+ * background, and records what was painted. 
+ */
+static void
+_theme_frame_menu_row_paint_icon (MBTheme        *theme,
+				  MBThemeFrame   *frame,
+				  MBThemeMenu    *menu,
+				  int             i,
+				  Client         *entry)
+{
+  MBThemeMenuRow *row = &menu->rows[i];
+  int             y   = frame->border_n + (i * menu->item_h);
+  int             h   = MBMIN(menu->item_h, menu->height - y);
+  int             icon_offset;
+
+  _theme_frame_menu_row_free(theme, row);
+
+  row->entry        = entry;
+  row->win          = entry->window;
+  row->icon_hash    = entry->icon_rgba ? entry->icon_rgba->hash : 0;
+  row->name         = entry->name ? strdup(entry->name) : NULL;
+  row->name_is_utf8 = entry->name_is_utf8;
+
+  if (h <= 0) return;
+
+  icon_offset = (menu->item_h - theme->wm->config->use_icons) / 2;
+  if (icon_offset < 0) icon_offset = 0;
+
+  mb_pixbuf_img_copy (theme->wm->pb, menu->img, menu->bg,
+		      0, y, menu->width, h, 0, y);
+
+  theme_frame_icon_paint(theme, entry, menu->img, 
+			 frame->border_w + MENU_ENTRY_PADDING/2, 
+			 y + icon_offset);
+}
+
+static void
+_theme_frame_menu_row_paint_text (MBTheme        *theme,
+				  MBThemeFrame   *frame,
+				  MBThemeMenu    *menu,
+				  int             i)
+{
+  _theme_frame_menu_paint_text_entry(theme, frame->font, frame->color,
+				     menu->width, menu->rows[i].entry, 
+				     menu->drawable,
+				     MENU_ENTRY_PADDING 
+				     + theme->wm->config->use_icons 
+				     + frame->border_w, 
+				     frame->border_n + (i * menu->item_h));
+}
+
+static void
+_theme_frame_menu_update_mask (MBTheme *theme, MBThemeMenu *menu)
+{
+  Wm *w = theme->wm;
+
+  if (!theme_frame_wants_shaped_window(theme, FRAME_MENU))
+    return;
+
+  if (menu->mask == None)
+    menu->mask = XCreatePixmap(w->dpy, w->root, menu->width, menu->height, 1);
+
+  mb_pixbuf_img_render_to_mask(w->pb, menu->img, menu->mask, 0, 0);
+}
+
 void
-theme_frame_menu_highlight_entry(Client         *c, 
-				 MBClientButton *button, 
-				 int             mode)
+theme_frame_menu_invalidate (MBTheme *theme)
+{
+  if (theme) theme->menu_dirty = True;
+}
+
+Bool
+theme_frame_menu_update (MBTheme *theme)
+{
+  Wm             *w = theme->wm;
+  MBThemeFrame   *frame;
+  MBThemeMenu    *menu;
+  MBPixbufImage  *strip;
+  Client        **entries = NULL;
+  int             width, height, n_entries, n_changed = 0, i, y, h;
+
+  if (!theme->menu_dirty)
+    return (theme->menu != NULL);
+
+  theme->menu_dirty = False;
+
+  frame = (MBThemeFrame *)list_find_by_id(theme->frames, FRAME_MENU);
+
+  if (frame == NULL || !_theme_frame_menu_measure(theme, &width, &height))
+    {
+      _theme_frame_menu_free(theme);
+      return False;
+    }
+
+  n_entries = _theme_frame_menu_entries(theme, &entries);
+
+  menu = theme->menu;
+
+  if (menu == NULL || menu->width != width || menu->height != height 
+      || menu->n_rows != n_entries)
+    {
+      /* Different size, so everything moves. Start again */
+      _theme_frame_menu_free(theme);
+
+      menu = theme->menu = malloc(sizeof(MBThemeMenu));
+      memset(menu, 0, sizeof(MBThemeMenu));
+
+      menu->width  = width;
+      menu->height = height;
+      menu->item_h = MBMAX( w->config->use_icons + MENU_ICON_PADDING,
+			    mb_font_get_height(frame->font) 
+			    + MENU_ENTRY_PADDING );
+      menu->n_rows = n_entries;
+      menu->rows   = malloc(sizeof(MBThemeMenuRow) * (n_entries + 1));
+      memset(menu->rows, 0, sizeof(MBThemeMenuRow) * (n_entries + 1));
+
+      menu->bg = mb_pixbuf_img_new(w->pb, width, height);
+      _theme_paint_core(theme, NULL, frame, menu->bg, 0, 0, width, height);
+
+      menu->img      = mb_pixbuf_img_clone(w->pb, menu->bg);
+      menu->drawable = mb_drawable_new(w->pb, width, height);
+
+      for (i = 0; i < n_entries; i++)
+	_theme_frame_menu_row_paint_icon(theme, frame, menu, i, entries[i]);
+
+      mb_pixbuf_img_render_to_drawable(w->pb, menu->img, 
+				       mb_drawable_pixmap(menu->drawable), 
+				       0, 0);
+
+      for (i = 0; i < n_entries; i++)
+	_theme_frame_menu_row_paint_text(theme, frame, menu, i);
+
+      n_changed = n_entries;
+    }
+  else 
+    {
+      for (i = 0; i < n_entries; i++)
+	{
+	  if (_theme_frame_menu_row_matches(&menu->rows[i], entries[i]))
+	    continue;
+
+	  _theme_frame_menu_row_paint_icon(theme, frame, menu, i, entries[i]);
+
+	  y = frame->border_n + (i * menu->item_h);
+	  h = MBMIN(menu->item_h, menu->height - y);
+
+	  if (h > 0)
+	    {
+	      strip = mb_pixbuf_img_new(w->pb, menu->width, h);
+	      mb_pixbuf_img_copy (w->pb, strip, menu->img, 
+				  0, y, menu->width, h, 0, 0);
+	      mb_pixbuf_img_render_to_drawable(w->pb, strip, 
+						mb_drawable_pixmap(menu->drawable),
+						0, y);
+	      mb_pixbuf_img_free(w->pb, strip);
+	    }
+
+	  _theme_frame_menu_row_paint_text(theme, frame, menu, i);
+
+	  n_changed++;
+	}
+    }
+
+  if (n_changed)
+    _theme_frame_menu_update_mask(theme, menu);
+
+  dbg("%s() %i of %i rows repainted\n", __func__, n_changed, n_entries);
+
+  free(entries);
+
+  return True;
+}
+
+Bool
+theme_frame_menu_get_dimentions(MBTheme* theme, int *w, int *h)
+{
+  if (!theme_frame_menu_update(theme))
+    return False;
+
+  *w = theme->menu->width;
+  *h = theme->menu->height;
+  
+  return True;
+}
+
+/* Renders the highlighted version of a row, kept until the row changes */
+static MBDrawable*
+_theme_frame_menu_row_active_get (Client         *c, 
+				  MBThemeMenuRow *row,
+				  MBClientButton *button)
 {
   Wm            *w = c->wm;
   MBTheme       *theme = w->mbtheme;
@@ -978,14 +1634,13 @@ theme_frame_menu_highlight_entry(Client         *c,
   MBDrawable    *drw;
   MBThemeFrame  *frame;
   MBFont        *font;
-  Client        *entry = (Client *)button->data;
-  int            offset, item_h;
+  Client        *entry = row->entry;
+  int            offset;
 
-  frame = (MBThemeFrame *)list_find_by_id(theme->frames, FRAME_MENU);
-
-  if (frame == NULL) 
-    return;
+  if (row->active)
+    return row->active;
 
+  frame = (MBThemeFrame *)list_find_by_id(theme->frames, FRAME_MENU);
   font  = frame->font;
 
   if (frame->hl_color)
@@ -995,72 +1650,98 @@ theme_frame_menu_highlight_entry(Client         *c,
       b = mb_col_blue(frame->hl_color);
     } 
 
-  dbg("%s() painting +%i+%i %ix%i\n", __func__, 
-      button->x, button->y, button->w, button->h);
-
-  if (mode == INACTIVE)
+  img = mb_pixbuf_img_rgba_new(c->wm->pb, button->w, button->h);
+      
+  mb_pixbuf_img_copy (w->pb, img, theme->menu->img,
+		      button->x, button->y, button->w, button->h, 0, 0);
+      
+  for ( xx=4; xx < (button->w - 4); xx++)
     {
-      XClearWindow(w->dpy, c->frame);
+      mb_pixbuf_img_plot_pixel(w->pb, img, xx, 0,
+			       r, g, b);
+      mb_pixbuf_img_plot_pixel(w->pb, img, xx, button->h-2,
+			       r, g, b);
     }
-  else
-    {
-      img = mb_pixbuf_img_rgba_new(c->wm->pb, button->w, button->h);
       
-      mb_pixbuf_img_copy (w->pb, img, w->mbtheme->img_caches[FRAME_MENU],
-			  button->x, button->y, button->w, button->h, 0, 0);
-      
-      for ( xx=4; xx < (button->w - 4); xx++)
-	{
-	  mb_pixbuf_img_plot_pixel(w->pb, img, xx, 0,
-				   r, g, b);
-	  mb_pixbuf_img_plot_pixel(w->pb, img, xx, button->h-2,
-				   r, g, b);
-	}
+  for ( xx=3; xx < (button->w - 3); xx++)
+    {
+      mb_pixbuf_img_plot_pixel(w->pb, img, xx, 1,
+			       r, g, b);
+      mb_pixbuf_img_plot_pixel(w->pb, img, xx, button->h-3,
+			       r, g, b);
+    }
       
-      for ( xx=3; xx < (button->w - 3); xx++)
-	{
-	  mb_pixbuf_img_plot_pixel(w->pb, img, xx, 1,
-				   r, g, b);
-	  mb_pixbuf_img_plot_pixel(w->pb, img, xx, button->h-3,
-				   r, g, b);
-	}
+  for ( xx=2; xx < button->w-2; xx++)
+    for ( yy=2; yy < button->h-3; yy++)
+      mb_pixbuf_img_plot_pixel(w->pb, img, xx, yy,r, g, b);
       
-      for ( xx=2; xx < button->w-2; xx++)
-	for ( yy=2; yy < button->h-3; yy++)
-	  mb_pixbuf_img_plot_pixel(w->pb, img, xx, yy,r, g, b);
+  drw = mb_drawable_new(w->pb, button->w, button->h);
+
+  theme_frame_icon_paint(theme, entry, img, 
+			 MENU_ENTRY_PADDING/2,  
+			 (button->h - w->config->use_icons)/2); 
+
+  mb_pixbuf_img_render_to_drawable(w->pb, img, mb_drawable_pixmap(drw), 
+				   0, 0);
       
-      drw = mb_drawable_new(w->pb, button->w, button->h);
+  /* Now repaint font  */
 
-      theme_frame_icon_paint(w->mbtheme, (Client *)button->data, img, 
-			     MENU_ENTRY_PADDING/2,  
-			     (button->h - w->config->use_icons)/2); 
+  offset = (theme->menu->item_h - (mb_font_get_height(font))) / 2;
 
-      mb_pixbuf_img_render_to_drawable(w->pb, img, mb_drawable_pixmap(drw), 
-				       0, 0);
+  mb_font_render_simple (font, 
+			 drw,
+			 c->wm->config->use_icons + MENU_ENTRY_PADDING,
+			 offset,
+			 c->width - c->wm->config->use_icons - MENU_ENTRY_PADDING,
+			 (unsigned char*)entry->name,
+			 (entry->name_is_utf8) ? MB_ENCODING_UTF8 : MB_ENCODING_LATIN,
+			 MB_FONT_RENDER_OPTS_CLIP_TRAIL);
       
-      /* Now repaint font  */
+  mb_pixbuf_img_free(w->pb, img);
 
-      item_h = MBMAX( c->wm->config->use_icons + MENU_ICON_PADDING,
-		      mb_font_get_height(font) + MENU_ENTRY_PADDING );
+  return (row->active = drw);
+}
+
+void
+theme_frame_menu_highlight_entry(Client         *c, 
+				 MBClientButton *button, 
+				 int             mode)
+{
+  Wm             *w = c->wm;
+  MBThemeMenu    *menu = w->mbtheme->menu;
+  MBThemeMenuRow *row = NULL;
+  MBDrawable     *drw;
+  int             i;
 
-      offset = (item_h - (mb_font_get_height(font))) / 2;
+  if (menu == NULL) 
+    return;
+
+  for (i = 0; i < menu->n_rows; i++)
+    if (menu->rows[i].entry == (Client *)button->data)
+      {
+	row = &menu->rows[i];
+	break;
+      }
+
+  if (row == NULL)
+    return;
+
+  dbg("%s() painting +%i+%i %ix%i\n", __func__, 
+      button->x, button->y, button->w, button->h);
+
+  /* Both states are pre-rendered, so this is just a blit */
+  if (mode == INACTIVE)
+    {
+      XClearArea(w->dpy, c->frame, 
+		 button->x, button->y, button->w, button->h, False);
+    }
+  else
+    {
+      drw = _theme_frame_menu_row_active_get(c, row, button);
 
-      mb_font_render_simple (font, 
-			     drw,
-			     c->wm->config->use_icons + MENU_ENTRY_PADDING,
-			     offset,
-			     c->width - c->wm->config->use_icons - MENU_ENTRY_PADDING,
-			     (unsigned char*)entry->name,
-			     (entry->name_is_utf8) ? MB_ENCODING_UTF8 : MB_ENCODING_LATIN,
-			     MB_FONT_RENDER_OPTS_CLIP_TRAIL);
-      
       XCopyArea(w->dpy, mb_drawable_pixmap(drw), 
 		c->frame, w->mbtheme->gc, 0, 0, 
 		button->w, button->h, button->x, button->y);
-
-      mb_pixbuf_img_free(w->pb, img);
-      mb_drawable_unref(drw);
-
     }
 
   XSync(w->dpy, False);
@@ -1085,177 +1766,40 @@ void
 theme_frame_menu_paint(MBTheme* theme, Client *c)
 {
   Wm             *w = c->wm;
-  Client         *p;
   MBThemeFrame   *frame;
-  MBPixbufImage  *img;
-  MBFont         *font ;
-  MBColor        *color;
+  MBThemeMenu    *menu;
   MBClientButton *button = NULL;
-  MBList         *item;
-  MBDrawable     *drawable;
-  int             item_h, item_x, item_current_y, item_text_w, icon_offset = 0;
-
+  int             i, item_text_w;
 
   frame = (MBThemeFrame *)list_find_by_id(theme->frames, FRAME_MENU);
 
-  if (frame == NULL) return;
-
-  font  = frame->font;
-  color = frame->color;
-
-  item_h = MBMAX( c->wm->config->use_icons + MENU_ICON_PADDING,
-		  mb_font_get_height(font) + MENU_ENTRY_PADDING );
-
-  icon_offset = (item_h - c->wm->config->use_icons) / 2;
-
-  if (icon_offset < 0) icon_offset = 0;
-
-  drawable = mb_drawable_new(w->pb, c->width, c->height);
-    
-  img = mb_pixbuf_img_new(theme->wm->pb, c->width, c->height);
-
-  /* render background */
-  _theme_paint_core( theme, c, frame, img, 0, 0, c->width, c->height );
-  
-  /* render icons */
-  item_current_y = frame->border_n;
-
-  list_enumerate(w->client_age_list, item)
-    {
-      p = (Client*)item->data;
-      if (p->type == MBCLIENT_TYPE_APP 
-	  && p->name && !(p->flags & CLIENT_IS_DESKTOP_FLAG)
-	  && p->mapped 
-	  && p != wm_get_visible_main_client(w))
-	{
-	  theme_frame_icon_paint(theme, p, img, 
-				 frame->border_w + MENU_ENTRY_PADDING/2, 
-				 item_current_y  + icon_offset);
-	  item_current_y += item_h;
-	}
-    }
-
-  list_enumerate(w->client_age_list, item)
-    {
-      p = (Client*)item->data;
-
-      if (p->type == MBCLIENT_TYPE_APP 
-	  && p->name && !(p->flags & CLIENT_IS_DESKTOP_FLAG)
-	  && !p->mapped /* client_get_state(p) == IconicState */
-	  && p != wm_get_visible_main_client(w))
-      {
-	theme_frame_icon_paint(theme, p, img, 
-			       frame->border_w + MENU_ENTRY_PADDING/2, 
-			       item_current_y + icon_offset); 
-	item_current_y += item_h;
-      }
-    }
-
-   if ((p = wm_get_desktop(c->wm)) != NULL) 
-     {
-       dbg("%s() got desktop menu entry\n", __func__);
-       theme_frame_icon_paint(theme, p, img, 
-			      frame->border_w + MENU_ENTRY_PADDING/2, 
-			      item_current_y + icon_offset); 
-     }
-
-   /* render the pixbuf */
-
-   mb_pixbuf_img_render_to_drawable(theme->wm->pb, img, 
-				    mb_drawable_pixmap(drawable), 0, 0);
-
-  if (c->backing_masks[MSK_NORTH] != None)
-    mb_pixbuf_img_render_to_mask(theme->wm->pb, img, 
-				 c->backing_masks[MSK_NORTH], 0, 0);
-
-  if (theme->img_caches[FRAME_MENU] != NULL)
-    mb_pixbuf_img_free(theme->wm->pb, theme->img_caches[FRAME_MENU]);
-
-  theme->img_caches[FRAME_MENU] = img;    
+  if (frame == NULL || !theme_frame_menu_update(theme)) 
+    return;
 
-   /* Now render fonts */
+  menu = theme->menu;
 
-  item_current_y = frame->border_n;
-  item_x = MENU_ENTRY_PADDING + c->wm->config->use_icons + frame->border_w;
   item_text_w = c->width - (frame->border_e + frame->border_w);
 
-  /* Visible apps */
-
-  list_enumerate(w->client_age_list, item)
+  for (i = 0; i < menu->n_rows; i++)
     {
-      p = (Client*)item->data;
-
-      if (p->type == MBCLIENT_TYPE_APP 
-	  && p->name && !(p->flags & CLIENT_IS_DESKTOP_FLAG)
-	  && p->mapped
-	  && p != wm_get_visible_main_client(w))
-	{
-	  _theme_frame_menu_paint_text_entry(theme, font, color, 
-					     c, p, drawable, 
-					     item_x, item_current_y);
-	  
-	  button = client_button_new(c, c->frame, frame->border_w, 
-				     item_current_y, 
-				     item_text_w, 
-				     item_h,
-				     True, (void* )p );
-	  
-	  list_add(&c->buttons, NULL, 0, (void *)button);
-	  
-	  item_current_y += item_h;
-	}
-    }
-    
-  /* Iconized / hidden apps */
-
-  list_enumerate(w->client_age_list, item)
-    {
-      p = (Client*)item->data;
-
-      if (p->type == MBCLIENT_TYPE_APP 
-	  && p->name && !(p->flags & CLIENT_IS_DESKTOP_FLAG)
-	  && !p->mapped
-	  && p != wm_get_visible_main_client(w))
-	{
-	  _theme_frame_menu_paint_text_entry(theme, font, color, 
-					     c, p, drawable, 
-					     item_x, item_current_y);
-	  
-	  button = client_button_new(c, c->frame, frame->border_w, 
-				     item_current_y, 
-				     item_text_w, 
-				     item_h,
-				   True, (void* )p );
-	  
-	  list_add(&c->buttons, NULL, 0, (void *)button);
-	  
-	  item_current_y += item_h;
-	}
-    }
-  
-  /* The desktop at the bottom, if there is one. */
-
-  if ((p = wm_get_desktop(c->wm)) != NULL) 
-    {
-      _theme_frame_menu_paint_text_entry(theme, font, color, 
-					 c, p, drawable, 
-					 item_x, item_current_y);
-
       button = client_button_new(c, c->frame, frame->border_w, 
-				 item_current_y, 
+				 frame->border_n + (i * menu->item_h),
 				 item_text_w, 
-				 item_h,
-				 True, (void* )p );
+				 menu->item_h,
+				 True, (void* )menu->rows[i].entry );
       
       list_add(&c->buttons, NULL, 0, (void *)button);
     }
-  
 
-  XSetWindowBackgroundPixmap(w->dpy, c->frame, mb_drawable_pixmap(drawable));
+  if (menu->mask != None)
+    XShapeCombineMask(w->dpy, c->frame, ShapeBounding, 0, 0, 
+		      menu->mask, ShapeSet);
+
+  XSetWindowBackgroundPixmap(w->dpy, c->frame, 
+			     mb_drawable_pixmap(menu->drawable));
   XClearWindow(w->dpy, c->frame);
   XSync(c->wm->dpy, False);
 
-  mb_drawable_unref(drawable);
   return;
 }
 
@@ -1550,10 +2094,10 @@ mbtheme_button_new (MBTheme *theme,
 
     }
 
-  button->img_active   = (MBPixbufImage*)list_find_by_name(theme->images, 
-							   img_active_id);
-  button->img_inactive = (MBPixbufImage*)list_find_by_name(theme->images, 
-							   img_inactive_id);
+  button->img_active   = (MBThemeImage*)list_find_by_name(theme->images, 
+							  img_active_id);
+  button->img_inactive = (MBThemeImage*)list_find_by_name(theme->images, 
+							  img_inactive_id);
 
   if (button->img_inactive == NULL && button->inputonly == False) 
     {
@@ -1745,7 +2289,7 @@ parse_frame_layer_tag (MBTheme      *theme,
     case LAYER_PIXMAP:
     case LAYER_PIXMAP_TILED:
       attr = get_attr(inode, "pixmap");
-      layer_new->img = (MBPixbufImage*)list_find_by_name(theme->images, attr);
+      layer_new->img = (MBThemeImage*)list_find_by_name(theme->images, attr);
 
       if (layer_new->img == NULL) return ERROR_INCORRECT_PARAMS;
       break;
@@ -1753,7 +2297,7 @@ parse_frame_layer_tag (MBTheme      *theme,
     case LAYER_PICTURE_TILED:
     case LAYER_PICTURE:
       attr = get_attr(inode, "picture");
-      layer_new->img = (MBPixbufImage*)list_find_by_name(theme->images, attr);
+      layer_new->img = (MBThemeImage*)list_find_by_name(theme->images, attr);
       if (layer_new->img == NULL) return ERROR_INCORRECT_PARAMS;
       break;
 
@@ -1819,7 +2363,7 @@ mbtheme_frame_free (MBTheme      *theme,
       free(layer->w);
       free(layer->h);
       free(layer);
-      free(cur);
+      list_item_free(cur);
 
       cur = next;
     }
@@ -1837,7 +2381,7 @@ mbtheme_frame_free (MBTheme      *theme,
       free(button->w);
       free(button->h);
       free(button);
-      free(cur);
+      list_item_free(cur);
 
       cur = next;
     }
@@ -2032,16 +2576,33 @@ static int
 parse_pixmap_tag (MBTheme *theme, 
 		  XMLNode *node)
 {
-  MBPixbufImage *img = NULL;
+  MBThemeImage *image = NULL;
+  struct stat   st;
+  char          path[MAXPATHLEN];
   char *id         = get_attr(node, "id");
   char *filename   = get_attr(node, "filename");
 
   if ( id == NULL || filename == NULL ) return ERROR_MISSING_PARAMS;
 
-  if ((img = mb_pixbuf_img_new_from_file(theme->wm->pb, filename)) == NULL)
+  /* Only check it exists now, decoding waits for theme_image_get() */
+
+  if (filename[0] == '/')
+    snprintf(path, MAXPATHLEN, "%s", filename);
+  else if (getcwd(path, MAXPATHLEN) != NULL)
+    snprintf(path + strlen(path), MAXPATHLEN - strlen(path), "/%s", filename);
+  else
+    return ERROR_LOADING_RESOURCE;
+
+  if (stat(path, &st) || !S_ISREG(st.st_mode))
     return ERROR_LOADING_RESOURCE;
 
-  list_add(&theme->images, id, 0, (void *)img);  
+  image = malloc(sizeof(MBThemeImage));
+  image->filename = strdup(path);
+  image->img      = NULL;
+
+  list_add(&theme->images, id, 0, (void *)image);  
+
+  theme->n_images++;
 
   return 1;
 }
@@ -2102,14 +2663,17 @@ static int
 parse_app_icon_tag (MBTheme *theme, 
 		    XMLNode *node)
 {
+  MBThemeImage  *image = NULL;
   MBPixbufImage *img = NULL;
   char *pixmap_attr     = get_attr(node, "pixmap");
 
   if ( pixmap_attr == NULL ) return ERROR_MISSING_PARAMS;
 
-  img = (MBPixbufImage*)list_find_by_name(theme->images, pixmap_attr);
+  image = (MBThemeImage*)list_find_by_name(theme->images, pixmap_attr);
+
+  if (image == NULL) return ERROR_INCORRECT_PARAMS;
 
-  if (img == NULL) return ERROR_INCORRECT_PARAMS;
+  img = theme_image_get(theme, image);
 
   if (theme->wm->img_generic_icon) 
     mb_pixbuf_img_free(theme->wm->pb, theme->wm->img_generic_icon);
@@ -2207,6 +2771,8 @@ mbtheme_new (Wm *w)
   for (i=0; i<3; i++)
     t->app_win_pxm_cache[i] = None;
 
+  t->menu_dirty = True;
+
   gv.graphics_exposures = False;
   gv.function           = GXcopy;
   t->gc = XCreateGC(w->dpy, w->root, GCGraphicsExposures|GCFunction, &gv);
@@ -2248,20 +2814,26 @@ mbtheme_free (Wm      *w,
   while (cur != NULL)
     {
       next = cur->next;
-      if (cur->name) free(cur->name);
       mbtheme_frame_free (theme, (MBThemeFrame*)cur->data);
-      free(cur);
+      list_item_free(cur);
       cur = next;
     }
   theme->frames = NULL;
 
+  /* Before the images go, the cache saves straight from them */
+  if (theme->cache) 
+    mbtheme_cache_save(theme->cache, w->pb);
+
   cur = theme->images;
   while (cur != NULL)
     {
+      MBThemeImage *image = (MBThemeImage *)cur->data;
+
       next = cur->next;
-      if (cur->name) free(cur->name);
-      mb_pixbuf_img_free(w->pb, (MBPixbufImage *)cur->data);
-      free(cur);
+      if (image->img) mb_pixbuf_img_free(w->pb, image->img);
+      free(image->filename);
+      free(image);
+      list_item_free(cur);
       cur = next;
     }
   theme->images = NULL;
@@ -2270,9 +2842,8 @@ mbtheme_free (Wm      *w,
   while (cur != NULL)
     {
       next = cur->next;
-      if (cur->name) free(cur->name);
       mb_col_unref((MBColor*)cur->data);
-      free(cur);
+      list_item_free(cur);
       cur = next;
     }
   theme->colors = NULL;
@@ -2281,13 +2852,15 @@ mbtheme_free (Wm      *w,
   while (cur != NULL)
     {
       next = cur->next;
-      if (cur->name) free(cur->name);
       mb_font_unref((MBFont*)cur->data);
-      free(cur);
+      list_item_free(cur);
       cur = next;
     }
   theme->fonts = NULL;
 
+  if (theme->cache) 
+    mbtheme_cache_free(theme->cache);
+
   if (theme->gc) XFreeGC(w->dpy, theme->gc);
   if (theme->band_gc) XFreeGC(w->dpy, theme->band_gc);
   if (theme->mask_gc) XFreeGC(w->dpy, theme->mask_gc);
@@ -2296,6 +2869,10 @@ mbtheme_free (Wm      *w,
 
   theme_pixmap_cache_clear_all( theme );
 
+  theme_frame_prerender_clear (theme);
+
+  _theme_frame_menu_free (theme);
+
   free(theme);
 
   w->mbtheme = NULL;
@@ -2332,7 +2909,18 @@ mbtheme_switch (Wm   *w,
 	}
     }
 
-  /* Now resize ( due to new frames ) + repaint everything */
+  /* Now resize ( due to new frames ) + repaint everything. Geometry
+   * is worked out first so all the new decorations can be rasterized
+   * in one go before any client gets redrawn.
+   */
+
+  stack_enumerate(w, p)
+    {
+      p->configure(p);
+      p->prerender(p);
+    }
+
+  theme_frame_prerender_run(w->mbtheme);
 
   stack_enumerate(w, p)
     {
@@ -2367,11 +2955,12 @@ mbtheme_switch (Wm   *w,
 	  XDestroyRegion (xregion);
 	}
       
-      p->configure(p);
       p->move_resize(p);
       p->redraw(p, False);
     }
 
+  theme_frame_prerender_clear(w->mbtheme);
+
   ewmh_update_rects(w); /* theme *could* affect this */
     
   XSync(w->dpy, False);
@@ -2444,10 +3033,6 @@ mbtheme_init (Wm   *w,
   char theme_filename[255] = DEFAULTTHEME;
   char *theme_path = NULL;
 
-#ifndef MAXPATHLEN
-#define MAXPATHLEN 256
-#endif
-
   char orig_wd[MAXPATHLEN];
   
   if (theme_name != NULL) { 
@@ -2506,7 +3091,7 @@ mbtheme_init (Wm   *w,
      if (!strncmp(theme_filename, DEFAULTTHEME, 255))
        exit(1); 		    /* give up, the defualt theme is corrupt */
      fprintf(stderr, "matchbox-wm: switching to default\n");
-     xml_parser_free(parser, root_node); 
+     xml_parser_free(parser); 
      return mbtheme_init (w, NULL); /* try again with defualt */
    }
 
@@ -2518,12 +3103,14 @@ mbtheme_init (Wm   *w,
        if (!strncmp(theme_filename, DEFAULTTHEME, 255))
 	 exit(1); 	   /* give up, the defualt theme is corrupt */
        fprintf(stderr, "matchbox: switching to default\n");
-       xml_parser_free(parser, root_node); 
+       xml_parser_free(parser); 
        return mbtheme_init (w, NULL); 
      }       
 
    w->mbtheme = mbtheme_new(w);
 
+   w->mbtheme->cache = mbtheme_cache_open(w->pb, theme_filename);
+
    if (get_attr(root_node, "cache") 
        && !strcasecmp(get_attr(root_node, "cache"), "false"))
      {
@@ -2539,7 +3126,7 @@ mbtheme_init (Wm   *w,
 	 if ((err = parse_color_tag(w->mbtheme, cnode)) < 0)
 	   {
 	     show_parse_error(w, cnode, theme_filename, err);
-	     xml_parser_free(parser, root_node); 
+	     xml_parser_free(parser); 
 	     return mbtheme_init (w, NULL); 
 	   }
 
@@ -2550,7 +3137,7 @@ mbtheme_init (Wm   *w,
 	 if ((err = parse_font_tag(w->mbtheme, cnode)) < 0)
 	   {
 	     show_parse_error(w, cnode, theme_filename, err);
-	     xml_parser_free(parser, root_node); 
+	     xml_parser_free(parser); 
 	     return mbtheme_init (w, NULL); 
 	   }
 	 continue;
@@ -2561,7 +3148,7 @@ mbtheme_init (Wm   *w,
 	 if ((err = parse_frame_tag(w->mbtheme, cnode, theme_filename)) < 0)
 	   {
 	     show_parse_error(w, cnode, theme_filename, err);
-	     xml_parser_free(parser, root_node); 
+	     xml_parser_free(parser); 
 	     return mbtheme_init (w, NULL); 
 	   }
 	 continue;
@@ -2572,7 +3159,7 @@ mbtheme_init (Wm   *w,
 	 if ((err =parse_pixmap_tag(w->mbtheme, cnode)) < 0)
 	   {
 	     show_parse_error(w, cnode, theme_filename, err);
-	     xml_parser_free(parser, root_node); 
+	     xml_parser_free(parser); 
 	     return mbtheme_init (w, NULL); 
 	   }
 	 continue;
@@ -2583,7 +3170,7 @@ mbtheme_init (Wm   *w,
 	if ((err =parse_lowlight_tag(w->mbtheme, cnode)) < 0)
 	  {
 	    show_parse_error(w, cnode, theme_filename, err);
-	    xml_parser_free(parser, root_node); 
+	    xml_parser_free(parser); 
 	    return mbtheme_init (w, NULL); 
 	  }
 	 continue;
@@ -2594,7 +3181,7 @@ mbtheme_init (Wm   *w,
 	if ((err =parse_app_icon_tag(w->mbtheme, cnode)) < 0)
 	  {
 	    show_parse_error(w, cnode, theme_filename, err);
-	    xml_parser_free(parser, root_node); 
+	    xml_parser_free(parser); 
 	    return mbtheme_init (w, NULL); 
 	  }
 	 continue;
@@ -2606,7 +3193,7 @@ mbtheme_init (Wm   *w,
 	if ((err =parse_shadow_tag(w->mbtheme, cnode)) < 0)
 	  {
 	    show_parse_error(w, cnode, theme_filename, err);
-	    xml_parser_free(parser, root_node); 
+	    xml_parser_free(parser); 
 	    return mbtheme_init (w, NULL); 
 	  }
 	 continue;
@@ -2636,9 +3223,17 @@ mbtheme_init (Wm   *w,
 #endif
    }
 
+   w->mbtheme->image_stats_dirty = True;
+
+   if (exit_wm == NULL)
+     {
+       exit_wm = w;
+       atexit(theme_image_cache_atexit);
+     }
+
    chdir(orig_wd);
 
-   xml_parser_free(parser, root_node); 
+   xml_parser_free(parser); 
 
    comp_engine_theme_init(w);
 
@@ -25,11 +25,15 @@
 #include "xml.h"
 #include "wm.h"
 #include "list.h"
+#include "mbtheme-cache.h"
+#include "icon-cache.h"
 
 #define ERROR_MISSING_PARAMS   -1
 #define ERROR_INCORRECT_PARAMS -2
 #define ERROR_LOADING_RESOURCE -3
 
+#define THEME_CACHE_SAVE_DELAY 2000 /* msecs */
+
 typedef struct _mb_theme_param 
 {
    enum { 
@@ -69,6 +73,14 @@ typedef struct _mb_theme_label
   MBThemeParam  *sublabel_label_clip_w;
 } MBThemeLabel;
 
+/* A theme <pixmap>. Decoded on first paint of something using it. */
+typedef struct _mb_theme_image
+{
+  char          *filename; 	/* Absolute, theme dir is only cwd at parse */
+  MBPixbufImage *img;
+
+} MBThemeImage;
+
 typedef struct _mb_theme_button {
    
   int action;
@@ -82,8 +94,8 @@ typedef struct _mb_theme_button {
   MBThemeParam *w;
   MBThemeParam *h;
 
-  MBPixbufImage *img_active;
-  MBPixbufImage *img_inactive;
+  MBThemeImage  *img_active;
+  MBThemeImage  *img_inactive;
 
   int img_active_blend;
   int img_inactive_blend;
@@ -98,7 +110,7 @@ typedef struct _mb_theme_layer {
   MBThemeParam *h;
   
   MBColor  *color;
-  MBPixbufImage *img;
+  MBThemeImage  *img;
   MBThemeLabel  *label;  
   
   MBColor  *color_end; 	/* for gradients */
@@ -150,6 +162,31 @@ typedef struct _mb_theme_frame
    
 } MBThemeFrame;
 
+/* A task menu row, and what it was painted from */
+typedef struct MBThemeMenuRow
+{
+  Client        *entry;
+  Window         win;	     /* To spot a reused Client */
+  char          *name;
+  Bool           name_is_utf8;
+  unsigned long  icon_hash;  /* 0 for no _NET_WM_ICON */
+  MBDrawable    *active;     /* Highlighted version, rendered on demand */
+
+} MBThemeMenuRow;
+
+/* Task menu kept rendered between openings, see theme_frame_menu_update() */
+typedef struct MBThemeMenu
+{
+  int             width, height, item_h;
+  MBPixbufImage  *bg;	     /* Just the frame */
+  MBPixbufImage  *img;	     /* Frame and icons */
+  MBDrawable     *drawable;  /* Frame, icons and labels */
+  Pixmap          mask;      /* None unless shaped */
+  MBThemeMenuRow *rows;
+  int             n_rows;
+
+} MBThemeMenu;
+
 typedef struct _mbtheme {
 
   struct list_item* frames;
@@ -180,6 +217,25 @@ typedef struct _mbtheme {
   /* disable cacheing, not recommened */
   Bool           disable_pixbuf_cache;
 
+  /* Compiled image cache */
+  MBThemeCache  *cache;
+
+  /* Lazy image loading stats, see theme_image_get() */
+  int            n_images;
+  int            n_images_loaded;
+  long           image_decode_usec;
+  long           image_bytes;
+  Bool           image_stats_dirty;
+  long long      image_load_usec; /* When the last image was decoded */
+
+  /* Frames rasterized ahead of a theme switch / screen resize, 
+   * see theme_frame_prerender_run()
+  */
+  struct list_item* prerenders;
+
+  MBThemeMenu      *menu;
+  Bool              menu_dirty;
+
   struct _wm    *wm;
    
 } MBTheme;
@@ -237,6 +293,23 @@ theme_img_cache_clear_all (MBTheme       *theme );
 void
 theme_pixmap_cache_clear_all( MBTheme *theme );
 
+MBPixbufImage*
+theme_image_get (MBTheme       *theme,
+		 MBThemeImage  *image);
+
+/* Publishes _MB_THEME_STATS, see wm_stats_publish() */
+void
+theme_image_stats_publish (MBTheme *theme);
+
+/* Writes the compiled image cache out once image loading has been
+ * quiet for THEME_CACHE_SAVE_DELAY, called every event loop pass.
+ */
+void
+theme_image_cache_check (MBTheme *theme);
+
+void
+theme_image_cache_get_timeout (MBTheme *theme, struct timeval *tv);
+
 
 void     
 theme_frame_button_paint (MBTheme       *theme,
@@ -247,6 +320,19 @@ theme_frame_button_paint (MBTheme       *theme,
 			  int            dest_w,
 			  int            dest_h );
 
+void
+theme_frame_prerender_add (MBTheme       *theme,
+			   int            frame_type,
+			   int            dw,
+			   int            dh,
+			   Bool           has_alpha);
+
+void
+theme_frame_prerender_run (MBTheme       *theme);
+
+void
+theme_frame_prerender_clear (MBTheme       *theme);
+
 Bool     
 theme_frame_paint (MBTheme       *theme,
 		   Client        *c,
@@ -263,6 +349,12 @@ void
 theme_frame_menu_paint (MBTheme       *theme,
 			Client        *c);
 
+void
+theme_frame_menu_invalidate (MBTheme       *theme);
+
+Bool
+theme_frame_menu_update (MBTheme       *theme);
+
 Bool     
 theme_frame_menu_get_dimentions  (MBTheme       *theme,
 				  int           *w,
@@ -20,6 +20,9 @@
 
 #include "misc.h"
 
+#include <sys/time.h>
+#include <sys/wait.h>
+
 static int trapped_error_code = 0;
 static int (*old_error_handler) (Display *d, XErrorEvent *e);
 
@@ -217,3 +220,38 @@ misc_scale_wm_app_icon(Wm *w)
     }
 #endif
 }
+
+/* Microseconds from some arbitrary point, unaffected by clock changes */
+long long
+misc_get_time_usec(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+  {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+  }
+}
+
+/* Shortens the event loop's select() timeout to wait_usec if that is 
+ * sooner. A zero timeout means block forever, so never goes below 1ms.
+ */
+void
+misc_timeout_shorten(struct timeval *tv, long long wait_usec)
+{
+  if (wait_usec < 1000)
+    wait_usec = 1000;
+
+  if ((tv->tv_sec == 0 && tv->tv_usec == 0)
+      || wait_usec < (long long)tv->tv_sec * 1000000 + tv->tv_usec)
+    {
+      tv->tv_sec  = wait_usec / 1000000;
+      tv->tv_usec = wait_usec % 1000000;
+    }
+}
@@ -56,5 +56,11 @@ mwm_get_decoration_flags(Wm *w, Window win);
 void
 misc_scale_wm_app_icon(Wm *w);
 
+long long
+misc_get_time_usec(void);
+
+void
+misc_timeout_shorten(struct timeval *tv, long long wait_usec);
+
 #endif
 
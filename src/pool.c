@@ -0,0 +1,160 @@
+/*
+ *  Matchbox Window Manager - A lightweight window manager not for the
+ *                            desktop.
+ *
+ *  Authored By Matthew Allum <mallum@o-hand.com>
+ *
+ *  Copyright (c) 2002, 2004 OpenedHand Ltd - http://o-hand.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#include "pool.h"
+#include "list.h"
+
+/* Objects are rounded up to this so anything in a slab stays aligned */
+#define POOL_ALIGN (2 * sizeof(void *))
+
+typedef struct MBPoolSlab
+{
+  struct MBPoolSlab *next;
+  unsigned char     *mem;
+
+} MBPoolSlab;
+
+typedef struct MBPool
+{
+  const char *name;
+  size_t      obj_size;
+  int         objs_per_slab;
+
+  void       *free_list;    /* Free objects, linked through first word */
+  MBPoolSlab *slabs;
+
+  int         n_slabs;
+  int         n_used;
+  int         n_free;
+  int         n_peak;
+
+} MBPool;
+
+static MBPool pools[POOL_COUNT] = {
+  { "client",    sizeof(Client),           16,  NULL, NULL, 0, 0, 0, 0 },
+  { "button",    sizeof(MBClientButton),   32,  NULL, NULL, 0, 0, 0, 0 },
+  { "list_item", sizeof(struct list_item), 128, NULL, NULL, 0, 0, 0, 0 },
+};
+
+static unsigned long serial;
+
+static Bool
+pool_grow (MBPool *pool)
+{
+  MBPoolSlab *slab;
+  size_t      size;
+  int         i;
+
+  size = (pool->obj_size + POOL_ALIGN - 1) & ~(POOL_ALIGN - 1);
+
+  if ((slab = malloc(sizeof(MBPoolSlab))) == NULL)
+    return False;
+
+  if ((slab->mem = malloc(size * pool->objs_per_slab)) == NULL)
+    {
+      free(slab);
+      return False;
+    }
+
+  dbg("%s() adding slab %i to %s pool\n", __func__,
+      pool->n_slabs + 1, pool->name);
+
+  for (i = pool->objs_per_slab - 1; i >= 0; i--)
+    {
+      void **obj = (void **)(slab->mem + (i * size));
+
+      *obj = pool->free_list;
+      pool->free_list = obj;
+    }
+
+  slab->next   = pool->slabs;
+  pool->slabs  = slab;
+  pool->n_free += pool->objs_per_slab;
+  pool->n_slabs++;
+
+  return True;
+}
+
+void*
+pool_alloc (MBPoolType type)
+{
+  MBPool *pool = &pools[type];
+  void   *obj;
+
+  if (pool->free_list == NULL && !pool_grow(pool))
+    return NULL;
+
+  obj = pool->free_list;
+  pool->free_list = *(void **)obj;
+
+  pool->n_free--;
+  pool->n_used++;
+
+  if (pool->n_used > pool->n_peak)
+    pool->n_peak = pool->n_used;
+
+  serial++;
+
+  memset(obj, 0, pool->obj_size);
+
+  return obj;
+}
+
+void
+pool_free (MBPoolType type, void *obj)
+{
+  MBPool *pool = &pools[type];
+
+  if (obj == NULL)
+    return;
+
+#ifdef DEBUG
+  /* Make use after free show up */
+  memset(obj, 0xa5, pool->obj_size);
+#endif
+
+  *(void **)obj = pool->free_list;
+  pool->free_list = obj;
+
+  pool->n_free++;
+  pool->n_used--;
+
+  serial++;
+}
+
+unsigned long
+pool_serial (void)
+{
+  return serial;
+}
+
+void
+pool_stats_describe (char *buf, int len)
+{
+  char *p = buf;
+  int   i;
+
+  *p = '\0';
+
+  for (i = 0; i < POOL_COUNT && p - buf < len - 1; i++)
+    p += snprintf(p, len - (p - buf), "%s%s=%i:%i:%i:%i",
+		  (i) ? " " : "", pools[i].name, pools[i].n_used,
+		  pools[i].n_free, pools[i].n_peak, pools[i].n_slabs);
+}
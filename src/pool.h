@@ -0,0 +1,60 @@
+/*
+ *  Matchbox Window Manager - A lightweight window manager not for the
+ *                            desktop.
+ *
+ *  Authored By Matthew Allum <mallum@o-hand.com>
+ *
+ *  Copyright (c) 2002, 2004 OpenedHand Ltd - http://o-hand.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#ifndef _MBPOOL_H_
+#define _MBPOOL_H_
+
+#include "structs.h"
+
+/*
+ *  Fixed size object pools.
+ *
+ *  Clients, buttons and list nodes are created and thrown away for
+ *  every tooltip and menu that comes and goes. Rather than have each
+ *  one hit malloc, objects are carved out of slabs and kept on a free
+ *  list for reuse, so the heap stays flat over long uptimes. Slabs are
+ *  never handed back; a pool only ever grows to its peak.
+ */
+
+typedef enum MBPoolType
+{
+  POOL_CLIENT = 0,
+  POOL_BUTTON,
+  POOL_LIST_ITEM,
+  POOL_COUNT
+
+} MBPoolType;
+
+/* Returns zero'd memory for one object, NULL on failure */
+void*
+pool_alloc (MBPoolType type);
+
+void
+pool_free (MBPoolType type, void *obj);
+
+/* Bumped on every alloc/free, so callers can tell if stats changed */
+unsigned long
+pool_serial (void);
+
+/* Formats "name=used:free:peak:slabs ..." into buf */
+void
+pool_stats_describe (char *buf, int len);
+
+#endif
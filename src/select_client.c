@@ -121,7 +121,7 @@ select_client_new(Wm *w)
 		       &attr);
 
    c = base_client_new(w, win);
-   c->type = MBCLIENT_TYPE_TASK_MENU;
+   stack_set_type(c, MBCLIENT_TYPE_TASK_MENU);
    client_title_frame(c) = c->frame = c->window;
 
    comp_engine_client_init(w, c); 
@@ -299,23 +299,14 @@ void
 select_client_redraw(Client *c, Bool use_cache)
 {
    MBTheme *theme = c->wm->mbtheme;
-   Bool is_shaped = False;
 
    dbg("%s() called\n", __func__);
 
    if (use_cache)
      return;
 
-   is_shaped = theme_frame_wants_shaped_window( theme, FRAME_MENU);
-
-   if (is_shaped) 
-     client_init_backing_mask(c, c->width, 0, c->height, 0, 0, 0 );
-
+   /* Also sets the shape, from the menu kept on the theme */
    theme_frame_menu_paint( theme, c);
-  
-   if (is_shaped)
-     XShapeCombineMask( c->wm->dpy, c->frame, ShapeBounding, 0, 0, 
-			c->backing_masks[MSK_NORTH], ShapeSet);
 
    XClearWindow(c->wm->dpy, c->frame);
 
@@ -20,6 +20,220 @@
 
 #include "stack.h"
 
+/*
+ *  As well as the stack itself, each client sits on a list of just the
+ *  clients of its type, in the same order, so the type queries below
+ *  only visit clients that could match. Every client also has a 
+ *  stack_pos which only ever increases going up the stack, so clients
+ *  on different type lists can be ordered without walking between them.
+ */
+
+#define STACK_POS_GAP (1LL<<16)
+
+/* Clients stack_move_type_above_client() can move without a malloc */
+#define STACK_MOVE_BUF_SIZE 32
+
+/* Neighbours stack_get_above() / stack_get_below() check before going
+ * to the type lists. Paging through apps nearly always finds one right
+ * next door, and a plain step beats a lookup per type in the mask.
+ */
+#define STACK_SCAN_STEPS 4
+
+#define stack_type_bit(t) (1U<<(t))
+
+int
+stack_type_index(MBClientTypeEnum type)
+{
+  int t = 0;
+
+  while (type > 1)
+    {
+      type >>= 1;
+      t++;
+    }
+
+  return t;
+}
+
+static void
+stack_renumber(Wm *w)
+{
+  Client    *c;
+  long long  pos = 0;
+
+  dbg("%s() called\n", __func__);
+
+  stack_enumerate(w,c)
+    {
+      c->stack_pos = pos;
+      pos += STACK_POS_GAP;
+    }
+}
+
+/* Called once client is linked into the stack */
+static void
+stack_pos_assign(Client *client)
+{
+  Client *below = client->below, *above = client->above;
+
+  if (below && above)
+    {
+      if (above->stack_pos - below->stack_pos < 2)
+	stack_renumber(client->wm);
+      else
+	client->stack_pos = below->stack_pos 
+	  + (above->stack_pos - below->stack_pos) / 2;
+    }
+  else if (below)
+    client->stack_pos = below->stack_pos + STACK_POS_GAP;
+  else if (above)
+    client->stack_pos = above->stack_pos - STACK_POS_GAP;
+  else
+    client->stack_pos = 0;
+}
+
+static void
+stack_type_add(Client *client)
+{
+  Wm     *w = client->wm;
+  int     t = stack_type_index(client->type);
+  Client *c = w->stack_type_bottom[t];
+
+  /* New clients go on the bottom, raised ones on the top, so check 
+   * the bottom then search down from the top.
+  */
+  if (c != NULL && c->stack_pos < client->stack_pos)
+    {
+      c = w->stack_type_top[t];
+
+      while (c->stack_pos > client->stack_pos)
+	c = c->type_below;
+    }
+  else c = NULL;
+
+  /* c is now whatever should be directly below, if anything */
+  client->type_below = c;
+  client->type_above = (c) ? c->type_above : w->stack_type_bottom[t];
+
+  if (client->type_below) 
+    client->type_below->type_above = client;
+  else
+    w->stack_type_bottom[t] = client;
+
+  if (client->type_above) 
+    client->type_above->type_below = client;
+  else
+    w->stack_type_top[t] = client;
+
+  w->stack_type_n_items[t]++;
+}
+
+static void
+stack_type_remove(Client *client)
+{
+  Wm *w = client->wm;
+  int t = stack_type_index(client->type);
+
+  if (client->type_below) 
+    client->type_below->type_above = client->type_above;
+  else
+    w->stack_type_bottom[t] = client->type_above;
+
+  if (client->type_above) 
+    client->type_above->type_below = client->type_below;
+  else
+    w->stack_type_top[t] = client->type_below;
+
+  client->type_above = client->type_below = NULL;
+
+  w->stack_type_n_items[t]--;
+}
+
+/* Nearest client of type t above / below client in the stack. Steps
+ * through the stack and along the type list together, so it costs 
+ * whichever is shorter.
+ */
+static Client*
+stack_type_find_above(Client *client, int t)
+{
+  Client *s = client->above, *c = client->wm->stack_type_bottom[t];
+
+  if (client->type == stack_type_bit(t))
+    return client->type_above;
+
+  while (True)
+    {
+      if (s == NULL || s->type == stack_type_bit(t))
+	return s;
+
+      if (c == NULL || c->stack_pos > client->stack_pos)
+	return c;
+
+      s = s->above;
+      c = c->type_above;
+    }
+}
+
+static Client*
+stack_type_find_below(Client *client, int t)
+{
+  Client *s = client->below, *c = client->wm->stack_type_top[t];
+
+  if (client->type == stack_type_bit(t))
+    return client->type_below;
+
+  while (True)
+    {
+      if (s == NULL || s->type == stack_type_bit(t))
+	return s;
+
+      if (c == NULL || c->stack_pos < client->stack_pos)
+	return c;
+
+      s = s->below;
+      c = c->type_below;
+    }
+}
+
+/* Highest / lowest mapped client of any type in mask */
+static Client*
+stack_type_highest(Wm *w, int mask)
+{
+  Client *c, *found = NULL;
+  int     t;
+
+  for (t = 0; t < STACK_N_TYPES; t++)
+    if (mask & stack_type_bit(t))
+      {
+	for (c = w->stack_type_top[t]; c && !c->mapped; c = c->type_below)
+	  ;
+
+	if (c && (!found || c->stack_pos > found->stack_pos))
+	  found = c;
+      }
+
+  return found;
+}
+
+static Client*
+stack_type_lowest(Wm *w, int mask)
+{
+  Client *c, *found = NULL;
+  int     t;
+
+  for (t = 0; t < STACK_N_TYPES; t++)
+    if (mask & stack_type_bit(t))
+      {
+	for (c = w->stack_type_bottom[t]; c && !c->mapped; c = c->type_above)
+	  ;
+
+	if (c && (!found || c->stack_pos < found->stack_pos))
+	  found = c;
+      }
+
+  return found;
+}
+
 void
 stack_add_above_client(Client *client, Client *client_below)
 {
@@ -50,6 +264,9 @@ stack_add_above_client(Client *client, Client *client_below)
     w->stack_top = client;
 
   w->stack_n_items++;
+
+  stack_pos_assign(client);
+  stack_type_add(client);
 }
 
 
@@ -72,6 +289,8 @@ stack_remove(Client *client)
 {
   Wm *w = client->wm;
 
+  stack_type_remove(client);
+
   if (w->stack_top == w->stack_bottom)
     {
       w->stack_top = w->stack_bottom = NULL;
@@ -93,17 +312,33 @@ stack_remove(Client *client)
   w->stack_n_items--;
 }
 
+/* Clients get added to the stack before their type is known, so type
+ * changes have to come through here to keep them on the right list.
+ */
+void
+stack_set_type(Client *client, MBClientTypeEnum type)
+{
+  Wm   *w = client->wm;
+  Bool  in_stack = (client->below != NULL || w->stack_bottom == client);
+
+  if (client->type == type)
+    return;
+
+  if (in_stack)
+    stack_type_remove(client);
+
+  client->type = type;
+
+  if (in_stack)
+    stack_type_add(client);
+}
+
 void
 stack_move_client_above_type(Client *client, int type_below)
 {
-  Wm     *w = client->wm;
-  Client *highest_client = NULL, *c = NULL;
+  Client *highest_client;
 
-  stack_enumerate(w,c)
-    {
-      if ((c->type & type_below) && c->mapped)
-	highest_client = c;
-    }
+  highest_client = stack_type_highest(client->wm, type_below);
 
   if (highest_client)
     stack_move_above_client(client, highest_client);
@@ -133,19 +368,37 @@ stack_move_type_above_client(Wm               *w,
 			     MBClientTypeEnum  wanted_type, 
 			     Client           *client)
 {
-  MBList *list = NULL, *list_item = NULL;
+  Client  *buf[STACK_MOVE_BUF_SIZE], **list = buf, *c;
+  int      n = 0, n_max = 0, i, t;
 
-  stack_get_type_list(w, &list, wanted_type);
+  for (t = 0; t < STACK_N_TYPES; t++)
+    if (wanted_type & stack_type_bit(t))
+      n_max += w->stack_type_n_items[t];
 
-  list_enumerate(list, list_item)
-    {
-      Client *cur = (Client *)list_item->data;
-      if (cur->mapped) 
-	stack_move_above_client(cur, client);
-    }
+  if (n_max == 0)
+    return;
 
-  list_destroy(&list);
-  
+  if (n_max > STACK_MOVE_BUF_SIZE)
+    list = malloc(sizeof(Client*) * n_max);
+
+  /* Take a copy first, in stacking order, as moving reorders things */
+  for (t = 0; t < STACK_N_TYPES; t++)
+    if (wanted_type & stack_type_bit(t))
+      for (c = w->stack_type_bottom[t]; c; c = c->type_above)
+	if (c->mapped)
+	  {
+	    for (i = n; i > 0 && list[i-1]->stack_pos > c->stack_pos; i--)
+	      list[i] = list[i-1];
+
+	    list[i] = c;
+	    n++;
+	  }
+
+  for (i = 0; i < n; i++)
+    stack_move_above_client(list[i], client);
+
+  if (list != buf)
+    free(list);
 }
 
 
@@ -242,13 +495,7 @@ stack_cycle_backward(Wm *w, MBClientTypeEnum type_to_cycle)
 Client*
 stack_get_highest(Wm *w, MBClientTypeEnum wanted_type)
 {
-  Client *c = NULL;
-
-  stack_enumerate_reverse(w,c)
-    if (c->type == wanted_type && c->mapped)
-      return c;
-
-  return NULL;
+  return stack_type_highest(w, wanted_type);
 }
 
 
@@ -256,35 +503,50 @@ stack_get_highest(Wm *w, MBClientTypeEnum wanted_type)
 Client*
 stack_get_lowest(Wm *w, MBClientTypeEnum wanted_type)
 {
-  Client *c = NULL;
-
-  stack_enumerate(w,c)
-    if (c->type == wanted_type && c->mapped)
-      return c;
-
-  return NULL;
+  return stack_type_lowest(w, wanted_type);
 }
 
 Client*
 stack_get_above(Client* client_below, MBClientTypeEnum wanted_type)
 {
   Wm     *w = client_below->wm;
-  Client *c = client_below->above;
+  Client *c, *from = client_below, *found = NULL, *wrapped = NULL;
+  int     t, i;
 
   if (wanted_type == MBCLIENT_TYPE_ANY)
     return (client_below->above) ? client_below->above : w->stack_bottom; 
 
-  while ( c != client_below )
+  for (i = 0; i < STACK_SCAN_STEPS && from->above; i++)
     {
-      if (c == NULL)
-	c = w->stack_bottom;
+      from = from->above;
 
-      if (c->type == wanted_type && c->mapped)
-	return c;
+      if ((from->type & wanted_type) && from->mapped)
+	return from;
+    }
 
-      c = c->above;
+  /* Sparse mask, carry on from where the scan stopped along the lists */
+  for (t = 0; t < STACK_N_TYPES; t++)
+    {
+      if (!(wanted_type & stack_type_bit(t)))
+	continue;
+
+      /* Lowest mapped above client_below */
+      c = stack_type_find_above(from, t);
+
+      while (c && !c->mapped)
+	c = c->type_above;
+
+      if (c && (!found || c->stack_pos < found->stack_pos))
+	found = c;
     }
 
+  if (found)
+    return found;
+
+  /* Nothing above, so wrap round to the bottom */
+  if ((wrapped = stack_type_lowest(w, wanted_type)) != NULL)
+    return wrapped;
+
   return client_below;
 }
 
@@ -294,19 +556,40 @@ stack_get_below(Client*          client_above,
 		MBClientTypeEnum wanted_type)
 {
   Wm     *w = client_above->wm;
-  Client *c = client_above->below;
+  Client *c, *from = client_above, *found = NULL, *wrapped = NULL;
+  int     t, i;
 
-  while ( c != client_above )
+  for (i = 0; i < STACK_SCAN_STEPS && from->below; i++)
     {
-      if (c == NULL)
-	c = w->stack_top;
+      from = from->below;
 
-      if (c->type == wanted_type && c->mapped)
-	return c;
+      if ((from->type & wanted_type) && from->mapped)
+	return from;
+    }
 
-      c = c->below;
+  /* Sparse mask, carry on from where the scan stopped along the lists */
+  for (t = 0; t < STACK_N_TYPES; t++)
+    {
+      if (!(wanted_type & stack_type_bit(t)))
+	continue;
+
+      /* Highest mapped below client_above */
+      c = stack_type_find_below(from, t);
+
+      while (c && !c->mapped)
+	c = c->type_below;
+
+      if (c && (!found || c->stack_pos > found->stack_pos))
+	found = c;
     }
 
+  if (found)
+    return found;
+
+  /* Nothing below, so wrap round to the top */
+  if ((wrapped = stack_type_highest(w, wanted_type)) != NULL)
+    return wrapped;
+
   return client_above;
 }
 
@@ -530,77 +813,447 @@ stack_move_above_extended(Client *client,
 #endif
 
 
-#if 0
+#ifdef STACK_TEST
+
+/* 
+ *  Test bits for stack. 
+ *
+ *  Checks the type sublists and queries against a plain scan of the 
+ *  stack through lots of random restacks, type changes and map/unmaps,
+ *  then times the two against each other. From a configured tree:
+ *
+ *   cd src && cc -fcommon -DSTACK_TEST -I.. -I. stack.c list.c pool.c -lX11
+ *
+ *  ( plus `pkg-config --cflags libmb` for a non standalone build ).
+ */
+
+#include <sys/time.h>
+
+void
+client_get_transient_list(Wm *w, MBList **list, Client *c)
+{
+}
 
-/* Test bits for stack  */
+void
+misc_trap_xerrors(void)
+{
+}
 
 int
-main(int argc, char **argv)
+misc_untrap_xerrors(void)
 {
-  Wm *w;
-  int i = 0; 
-  Client *c, *midc, *midc2; 
+  return 0;
+}
 
+static MBClientTypeEnum test_types[] = {
+  MBCLIENT_TYPE_APP, MBCLIENT_TYPE_APP, MBCLIENT_TYPE_APP, 
+  MBCLIENT_TYPE_APP, MBCLIENT_TYPE_DIALOG, MBCLIENT_TYPE_DIALOG,
+  MBCLIENT_TYPE_TOOLBAR, MBCLIENT_TYPE_PANEL, MBCLIENT_TYPE_DESKTOP,
+  MBCLIENT_TYPE_TASK_MENU, MBCLIENT_TYPE_OVERRIDE
+};
 
-  w = malloc(sizeof(Wm));
-  memset(w, 0, sizeof(Wm));
+#define N_TEST_TYPES (sizeof(test_types) / sizeof(MBClientTypeEnum))
+
+#define test_random_type() test_types[rand() % N_TEST_TYPES]
+
+static int test_failures;
+
+#define test_assert(expr, ...)                           \
+ if (!(expr)) {                                          \
+     fprintf(stderr, "%s:%i: %s failed: ", __func__,     \
+	     __LINE__, #expr);                           \
+     fprintf(stderr, __VA_ARGS__);                       \
+     fprintf(stderr, "\n");                              \
+     test_failures++;                                    \
+ }
+
+/* What the queries did before the type lists, as a reference */
+
+static Client*
+ref_get_highest(Wm *w, int mask)
+{
+  Client *c;
+
+  stack_enumerate_reverse(w,c)
+    if ((c->type & mask) && c->mapped)
+      return c;
+
+  return NULL;
+}
+
+static Client*
+ref_get_lowest(Wm *w, int mask)
+{
+  Client *c;
+
+  stack_enumerate(w,c)
+    if ((c->type & mask) && c->mapped)
+      return c;
 
-  for (i=0; i<10; i++)
+  return NULL;
+}
+
+static Client*
+ref_get_above(Client* client_below, int mask)
+{
+  Wm     *w = client_below->wm;
+  Client *c = client_below->above;
+
+  while ( c != client_below )
     {
-      char    buf[64];
+      if (c == NULL)
+	c = w->stack_bottom;
 
-      sprintf(buf, "Client-%i", i);
-      
-      c = client_new(w, buf);
+      /* The original relied on client_below matching to stop here */
+      if (c == client_below)
+	break;
 
-      stack_append_top(c);
+      if ((c->type & mask) && c->mapped)
+	return c;
 
-      if (i == 5) midc = c;
-      if (i == 6) midc2 = c;
+      c = c->above;
     }
 
-  printf("w->stack_top : %s, next %p   w->stack_bottom : %s, prev %p\n", 
-	 w->stack_top->name, w->stack_top->above, 
-	 w->stack_bottom->name, w->stack_bottom->below);
+  return client_below;
+}
+
+static Client*
+ref_get_below(Client* client_above, int mask)
+{
+  Wm     *w = client_above->wm;
+  Client *c = client_above->below;
+
+  while ( c != client_above )
+    {
+      if (c == NULL)
+	c = w->stack_top;
 
+      if (c == client_above)
+	break;
 
-  stack_move_below_client(w->stack_top, w->stack_bottom);
-  stack_move_above_client(w->stack_bottom, w->stack_top);
+      if ((c->type & mask) && c->mapped)
+	return c;
 
-  printf("w->stack_top : %s, next %p   w->stack_bottom : %s, prev %p\n", 
-	 w->stack_top->name, w->stack_top->above, 
-	 w->stack_bottom->name, w->stack_bottom->below);
+      c = c->below;
+    }
 
+  return client_above;
+}
+
+/* Copies the stack bottom to top into list, returns count */
+static int
+test_stack_snapshot(Wm *w, Client **list)
+{
+  Client *c;
+  int     n = 0;
 
   stack_enumerate(w,c)
+    list[n++] = c;
+
+  return n;
+}
+
+/* The old stack_move_type_above_client() on a snapshot */
+static void
+ref_move_type_above_client(Client **list, int n, int mask, Client *client)
+{
+  Client *matched[1024];
+  int     n_matched = 0, i, j, k;
+
+  for (i = 0; i < n; i++)
+    if ((list[i]->type & mask) && list[i]->mapped)
+      matched[n_matched++] = list[i];
+
+  for (k = 0; k < n_matched; k++)
     {
-      printf("%s\n", c->name);
-    }
+      Client *cur = matched[k];
+
+      if (cur == client)
+	continue;
 
-  printf("\n");
+      for (i = 0; list[i] != cur; i++)
+	;
+      for (; i < n - 1; i++)
+	list[i] = list[i+1];
+
+      if (client == NULL)
+	j = 0;
+      else
+	{
+	  for (j = 0; list[j] != client; j++)
+	    ;
+	  j++;
+	}
 
-  printf("\n");
+      for (i = n - 1; i > j; i--)
+	list[i] = list[i-1];
 
-  stack_remove(w->stack_top);
+      list[j] = cur;
+    }
+}
 
-  stack_remove(w->stack_bottom);
+static void
+test_check_consistency(Wm *w)
+{
+  Client *c, *expect;
+  int     t, n, n_total = 0;
 
   stack_enumerate(w,c)
     {
-      printf("%s\n", c->name);
+      test_assert(c->above == NULL || c->above->stack_pos > c->stack_pos,
+		  "stack_pos not increasing");
+      n_total++;
     }
 
-  stack_move_below_client(w->stack_top, w->stack_bottom);
-  stack_move_above_client(midc, midc2);
+  test_assert(n_total == w->stack_n_items, "%i != %i", 
+	      n_total, w->stack_n_items);
 
-  printf("\n");
+  for (t = 0; t < STACK_N_TYPES; t++)
+    {
+      n = 0;
+      expect = w->stack_bottom;
 
+      for (c = w->stack_type_bottom[t]; c; c = c->type_above)
+	{
+	  while (expect && expect->type != stack_type_bit(t))
+	    expect = expect->above;
 
-  stack_enumerate(w,c)
+	  test_assert(c == expect, "type %i list out of order", t);
+
+	  if (c != expect)
+	    return;
+
+	  test_assert(c->type_above || w->stack_type_top[t] == c,
+		      "type %i top wrong", t);
+
+	  expect = expect->above;
+	  n++;
+	}
+
+      while (expect && expect->type != stack_type_bit(t))
+	expect = expect->above;
+
+      test_assert(expect == NULL, "type %i list missing clients", t);
+      test_assert(n == w->stack_type_n_items[t], "type %i count %i != %i",
+		  t, n, w->stack_type_n_items[t]);
+    }
+}
+
+static void
+test_check_queries(Wm *w, Client *c, int mask)
+{
+  test_assert(stack_get_highest(w, mask) == ref_get_highest(w, mask),
+	      "mask %i", mask);
+  test_assert(stack_get_lowest(w, mask) == ref_get_lowest(w, mask),
+	      "mask %i", mask);
+  test_assert(stack_get_above(c, mask) == ref_get_above(c, mask),
+	      "mask %i", mask);
+  test_assert(stack_get_below(c, mask) == ref_get_below(c, mask),
+	      "mask %i", mask);
+}
+
+static Client*
+test_client_new(Wm *w, MBClientTypeEnum type)
+{
+  Client *c = pool_alloc(POOL_CLIENT);
+
+  c->wm     = w;
+  c->type   = type;
+  c->mapped = (rand() % 4 != 0);
+
+  return c;
+}
+
+static long long
+test_now_usec (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void
+test_random_ops(int n_clients, int n_ops)
+{
+  Wm      *w;
+  Client **clients, **snap, *c, *other;
+  int      i, n, mask;
+
+  w = malloc(sizeof(Wm));
+  memset(w, 0, sizeof(Wm));
+
+  clients = malloc(sizeof(Client*) * n_clients);
+  snap    = malloc(sizeof(Client*) * n_clients);
+
+  for (i = 0; i < n_clients; i++)
+    {
+      clients[i] = test_client_new(w, MBCLIENT_TYPE_APP);
+
+      if (rand() % 2)
+	stack_prepend_bottom(clients[i]);
+      else
+	stack_append_top(clients[i]);
+
+      /* Like base_client_new() then the real constructor */
+      stack_set_type(clients[i], test_random_type());
+    }
+
+  test_check_consistency(w);
+
+  for (i = 0; i < n_ops && !test_failures; i++)
+    {
+      c     = clients[rand() % n_clients];
+      other = clients[rand() % n_clients];
+      mask  = test_random_type();
+
+      if (rand() % 3 == 0)
+	mask |= test_random_type();
+
+      switch (rand() % 8)
+	{
+	case 0:
+	  stack_move_above_client(c, other);
+	  break;
+	case 1:
+	  stack_move_above_client(c, NULL);
+	  break;
+	case 2:
+	  stack_move_top(c);
+	  break;
+	case 3:
+	  stack_set_type(c, test_random_type());
+	  break;
+	case 4:
+	  c->mapped = !c->mapped;
+	  break;
+	case 5:
+	  stack_remove(c);
+	  stack_prepend_bottom(c);
+	  break;
+	case 6:
+	  n = test_stack_snapshot(w, snap);
+	  ref_move_type_above_client(snap, n, mask, other);
+	  stack_move_type_above_client(w, mask, other);
+	  n = 0;
+	  stack_enumerate(w, c)
+	    {
+	      test_assert(c == snap[n], "move type %i above wrong at %i", 
+			  mask, n);
+	      n++;
+	    }
+	  break;
+	case 7:
+	  if (rand() % 2)
+	    stack_cycle_forward(w, MBCLIENT_TYPE_APP);
+	  else
+	    stack_cycle_backward(w, MBCLIENT_TYPE_APP);
+	  break;
+	}
+
+      test_check_consistency(w);
+      test_check_queries(w, clients[rand() % n_clients], mask);
+      test_check_queries(w, clients[rand() % n_clients], 
+			 clients[rand() % n_clients]->type);
+    }
+
+  /* Squeeze clients in between the same two, forcing a renumber */
+  stack_move_above_client(clients[1], clients[0]);
+
+  for (i = 2; i < n_clients && i < 40; i++)
+    stack_move_above_client(clients[i], clients[0]);
+
+  test_check_consistency(w);
+
+  printf("%i clients, %i random ops: %s\n", n_clients, n_ops,
+	 test_failures ? "FAILED" : "ok");
+
+  free(clients);
+  free(snap);
+  free(w);
+}
+
+static void
+test_bench(int n_clients, int rounds)
+{
+  Wm         *w;
+  Client    **clients, *c;
+  int         i, r;
+  long long   start, t_ref, t_new;
+  unsigned long sum = 0;
+
+  w = malloc(sizeof(Wm));
+  memset(w, 0, sizeof(Wm));
+
+  clients = malloc(sizeof(Client*) * n_clients);
+
+  /* Mostly apps, a few dialogs and a couple of panels on top */
+  for (i = 0; i < n_clients; i++)
     {
-      printf("%s\n", c->name);
+      clients[i] = test_client_new(w, (i % 50 == 0) ? MBCLIENT_TYPE_DIALOG 
+				   : MBCLIENT_TYPE_APP);
+      stack_append_top(clients[i]);
     }
 
+  for (i = 0; i < 2; i++)
+    stack_append_top(test_client_new(w, MBCLIENT_TYPE_PANEL));
+
+  printf("\n%i clients, %i rounds, ns per call  ref / indexed\n", 
+	 n_clients, rounds);
+
+#define BENCH(what, ref_expr, new_expr)                          \
+  start = test_now_usec();                                       \
+  for (r = 0; r < rounds; r++)                                   \
+    for (i = 0; i < n_clients; i++)                              \
+      { c = (ref_expr); sum += (unsigned long)c; }               \
+  t_ref = test_now_usec() - start;                               \
+  start = test_now_usec();                                       \
+  for (r = 0; r < rounds; r++)                                   \
+    for (i = 0; i < n_clients; i++)                              \
+      { c = (new_expr); sum += (unsigned long)c; }               \
+  t_new = test_now_usec() - start;                               \
+  printf("%-24s %10.1f / %.1f\n", what,                          \
+	 t_ref * 1000.0 / ((long)rounds * n_clients),            \
+	 t_new * 1000.0 / ((long)rounds * n_clients));
+
+  BENCH("get_highest(DIALOG)", 
+	ref_get_highest(w, MBCLIENT_TYPE_DIALOG),
+	stack_get_highest(w, MBCLIENT_TYPE_DIALOG));
+  BENCH("get_lowest(PANEL)", 
+	ref_get_lowest(w, MBCLIENT_TYPE_PANEL),
+	stack_get_lowest(w, MBCLIENT_TYPE_PANEL));
+  BENCH("get_above(DIALOG)", 
+	ref_get_above(clients[i], MBCLIENT_TYPE_DIALOG),
+	stack_get_above(clients[i], MBCLIENT_TYPE_DIALOG));
+  BENCH("get_below(APP)", 
+	ref_get_below(clients[i], MBCLIENT_TYPE_APP),
+	stack_get_below(clients[i], MBCLIENT_TYPE_APP));
+
+  start = test_now_usec();
+  for (r = 0; r < rounds; r++)
+    stack_move_type_above_client(w, MBCLIENT_TYPE_PANEL, 
+				 clients[r % n_clients]);
+  printf("%-24s %10s / %.1f\n", "move_type_above(PANEL)", "-",
+	 (test_now_usec() - start) * 1000.0 / rounds);
+
+  if (sum == 42) printf("\n");
+
+  free(clients);
+  free(w);
+}
+
+int
+main(int argc, char **argv)
+{
+  srand(argc > 1 ? atoi(argv[1]) : 1);
+
+  test_random_ops(10, 2000);
+  test_random_ops(200, 20000);
+
+  test_bench(100, 1000);
+  test_bench(1000, 100);
+
+  return (test_failures) ? 1 : 0;
 }
 
 #endif
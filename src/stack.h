@@ -38,6 +38,10 @@
    for ((c)=(w)->stack_bottom; (c) != NULL; (c)=(c)->above) \
      if ((c)->trans == (t))
 
+#define stack_enumerate_type(w,c,type)                      \
+ for ((c)=(w)->stack_type_bottom[stack_type_index(type)];  \
+      (c) != NULL; (c)=(c)->type_above)
+
 #define stack_move_top(c) \
  stack_move_above_client((c), (c)->wm->stack_top)
 
@@ -63,6 +67,12 @@ stack_prepend_bottom(Client *client);
 void
 stack_remove(Client *client);
 
+void
+stack_set_type(Client *client, MBClientTypeEnum type);
+
+int
+stack_type_index(MBClientTypeEnum type);
+
 void
 stack_move_transients_to_top(Wm *w, Client *client_trans_for, int flags);
 
@@ -103,6 +103,7 @@
 /* Simple Macros  */
 
 #define MBMAX(x,y) ((x>y)?(x):(y))
+#define MBMIN(x,y) ((x<y)?(x):(y))
 
 #ifdef DEBUG
 #define dbg(txt, args... ) fprintf(stderr, "WM-DEBUG: " txt, ##args )
@@ -128,6 +129,12 @@
 
 #define N_DECOR_FRAMES 4
 
+#define LAYOUT_REDECORATE  (1<<0) /* wm_update_layout() needs a title repaint */
+
+#define TITLE_UPDATE_INTERVAL 1000 /* msecs between unfocused title repaints */
+#define DRAG_UPDATE_INTERVAL  16   /* msecs between dialog drag moves */
+#define STATS_INTERVAL        1000 /* msecs between root window stats updates */
+
 /* Shadow defaults, only used with composite */
 
 #define SHADOW_RADIUS 6
@@ -145,6 +152,8 @@
 #define MB_CMD_MISC        7 	/* spare, used for debugging */
 #define MB_CMD_COMPOSITE   8
 #define MB_CMB_KEYS_RELOAD 9
+#define MB_CMD_STATS       10	/* Write out _MB_LATENCY_STATS */
+#define MB_CMD_STATS_RESET 11
 
 /* Atoms, if you change these check ewmh_init() first */
 
@@ -224,6 +233,17 @@ enum {
   _NET_WM_WINDOW_TYPE_DROPDOWN_MENU,
   _NET_WM_WINDOW_TYPE_POPUP_MENU,
   _MB_NUM_SYSTEM_MODAL_WINDOWS_PRESENT,
+  _MB_THEME_STATS,
+  _MB_STARTUP_REPORT,
+  _MB_PING_STATS,
+  _MB_TITLE_STATS,
+  _MB_CONFIGURE_STATS,
+  _MB_DRAG_STATS,
+  _MB_EVENT_STATS,
+  _MB_POOL_STATS,
+  _MB_X_STATS,
+  _MB_LATENCY_STATS,
+  _MB_CONTROL_SOCKET,
   ATOM_COUNT
 
 } MBAtomEnum;
@@ -250,6 +270,8 @@ typedef enum
 
 } MBClientTypeEnum;
 
+#define STACK_N_TYPES 9		/* One per MBClientTypeEnum bit */
+
 enum {
   MSK_NORTH = 0,
   MSK_SOUTH,
@@ -258,6 +280,19 @@ enum {
   MSK_COUNT
 };
 
+/* A decoration shape mask shared by every client whose frame of the
+ * same type and side is the same size.
+ */
+typedef struct MBShapeMask
+{
+  int    side;			/* MSK_NORTH etc */
+  int    frame_type;
+  int    width, height;
+  Pixmap pixmap;
+  int    refcnt;
+
+} MBShapeMask;
+
 /* Decoration buttons */
 
 typedef struct _mb_client_button
@@ -314,8 +349,29 @@ typedef struct _mb_client_button
 
 typedef struct _client
 {
+  /* Stack walks, stack_get_above() and friends and the compositor's
+   * paint loop only look at what's up here, so it's kept together at
+   * the front. On 64bit everything up to the position fits in the first
+   * cache line.
+  */
+  struct _client   *above, *below;
+  struct _wm       *wm;
+
   /* What type of client this instance is */
   MBClientTypeEnum  type;
+  Bool              mapped;	                 /* Bogus ? */
+  long              flags;
+
+  Window	    window, frame;
+  int		    x, y, width, height;
+
+  struct _client   *trans;
+
+  /* Neighbours of the same type and order in the stack, see stack.c */
+  struct _client   *type_above, *type_below;
+  long long         stack_pos;
+
+  /* Cold from here on */
 
   /* Window identification / title stuff */
 
@@ -350,28 +406,27 @@ typedef struct _client
   Bool              name_is_utf8;
   char             *bin_name; 	
   unsigned char    *startup_id;
-  Window	    window;
 
   /* General Window props */
 
   XSizeHints	   *size;
-  struct _client   *trans;
+
+  /* Clients transient for this one, see client_set_transient_for() */
+  struct _client   *trans_children, *trans_next;
 
   Visual           *visual;
   Colormap	    cmap;
-  int		    x, y, width, height;
   int               init_width, init_height;
   int               gravity;
   XID               win_group;
   Pixmap            icon, icon_mask;
-  Bool              mapped;	                 /* Bogus ? */
 #ifndef REDUCE_BLOAT
-  unsigned long    *icon_rgba_data;
+  struct MBIcon    *icon_rgba;	/* Shared, see icon-cache.c */
 #endif
 
   /* Decoration etc */
 
-  Window	    frame, frames_decor[N_DECOR_FRAMES];
+  Window	    frames_decor[N_DECOR_FRAMES];
   Pixmap            backing_masks[MSK_COUNT];
 
   Bool              have_cache, have_set_bg;
@@ -384,7 +439,7 @@ typedef struct _client
   /* State stuff */
 
   int		    ignore_unmap;
-  long              flags;
+  struct _client   *next_focused_client;
 
   /* Hung app support */
 
@@ -395,6 +450,27 @@ typedef struct _client
   int               pings_sent;
   Bool              ping_handler_called;
 
+  /* Ping scheduling and round trip stats, see ewmh_ping_check() */
+  int               ping_queue_idx; /* -1 when not scheduled */
+  long long         ping_deadline_usec;
+  long long         ping_sent_usec; /* oldest unanswered ping */
+  long long         ping_last_sent_usec;
+  long              ping_rtt_usec;
+  long              ping_rtt_max_usec;
+  int               ping_n_pongs;
+
+  /* Geometry before the current wm_update_layout() and what it 
+   * still has to do for us ( LAYOUT_* flags ).
+  */
+  int               layout_x, layout_y, layout_width, layout_height;
+  int               layout_pending;
+
+  /* Title change coalescing, see wm_title_update_queue() */
+  Atom              title_pending; /* None when title is up to date */
+  long long         title_paint_usec;
+  int               title_n_updates;
+  int               title_n_repaints;
+
   char             *host_machine;
   pid_t             pid;
 
@@ -404,21 +480,16 @@ typedef struct _client
   XSyncValue        ewmh_sync_value;
   XSyncAlarm        ewmh_sync_alarm;
   Bool              ewmh_sync_is_waiting;
+  Bool              ewmh_sync_configure_pending; /* held back meanwhile */
+  long long         ewmh_sync_deadline_usec;
+  int               ewmh_sync_timeouts; /* in a row */
 #endif
 
-  /* References */
-   
-  struct _wm       *wm;
-
-  /* New */
-
-  struct _client   *above, *below;
-  struct _client   *next_focused_client;
-
   /* Client methods */
   
   void (* reparent)( struct _client* c );
   void (* redraw)( struct _client* c, Bool use_cache );
+  void (* prerender)( struct _client* c );
   void (* button_press) (struct _client *c, XButtonEvent *e);
   void (* move_resize)( struct _client* c );
   void (* configure)( struct _client* c );
@@ -460,6 +531,7 @@ typedef struct _kbdconfig_entry
 {
   int                      action;
   KeySym                   key;
+  KeyCode                  keycode; /* What we grabbed, see keys_grab() */
   int                      ModifierMask;
   int                      index;
   char                    *sdata;
@@ -469,10 +541,23 @@ typedef struct _kbdconfig_entry
 
 } MBConfigKbdEntry;
 
+/* Key press lookup table, rebuilt on keymap changes */
+typedef struct _kbdconfig_binding
+{
+  int                        state; /* cleaned of lock modifiers */
+  struct _kbdconfig_entry   *entry;
+  struct _kbdconfig_binding *next;
+
+} MBConfigKbdBinding;
+
+#define KBD_N_KEYCODES 256
+
 typedef struct _kbdconfig
 {
   struct _kbdconfig_entry *entrys;
 
+  MBConfigKbdBinding      *bindings[KBD_N_KEYCODES]; /* by keycode */
+
   int MetaMask, HyperMask, SuperMask, AltMask, 
     ModeMask, NumLockMask, ScrollLockMask, lock_mask;
 
@@ -514,12 +599,17 @@ typedef struct _wm_config
   int          use_icons;
   char        *ping_handler;
   Bool         ping_aggressive;
+  int          title_update_interval; /* msecs, unfocused clients */
+  int          drag_update_interval;  /* msecs, 0 for every motion */
+  Bool         opaque_drag;	      /* Move dialogs not outlines if 
+				       * compositing */
   
   MBConfigKbd *kb;
   char        *kbd_conf_file;
 
   char        *force_dialogs;
   char        *sm_client_id;
+  Bool         startup_report;
 } Wm_config;
 
 
@@ -557,6 +647,66 @@ typedef struct _sn_execmapping_item
 
 typedef struct list_item MBList; 
 
+/* Startup instrumentation, see wm_startup_phase_start() */
+
+enum {
+  STARTUP_WM_NEW = 0,
+  STARTUP_LOAD_CONFIG,
+  STARTUP_KEYS_INIT,
+  STARTUP_EWMH_INIT,
+  STARTUP_COMP_ENGINE_INIT,
+  STARTUP_THEME_INIT,
+  STARTUP_INIT_EXISTING,
+  N_STARTUP_PHASES
+};
+
+typedef struct MBStartupPhase
+{
+  long long     start_usec;
+  long long     usec;
+  unsigned long start_request;
+  unsigned long n_requests;
+
+} MBStartupPhase;
+
+/* Per atom PropertyNotify / ClientMessage handlers, see ewmh.c */
+
+struct _wm;
+
+typedef void (*MBPropertyHandlerFunc) (struct _wm          *w, 
+				       Client              *c, 
+				       XPropertyEvent      *e);
+
+typedef void (*MBMessageHandlerFunc)  (struct _wm          *w,
+				       XClientMessageEvent *e);
+
+#define ATOM_HANDLER_TABLE_SIZE 64 /* Must be a power of 2 */
+
+typedef struct MBAtomHandler
+{
+  Atom                  atom;	/* None for an unused slot */
+  MBPropertyHandlerFunc property;
+  MBMessageHandlerFunc  message;
+
+} MBAtomHandler;
+
+/* Events a subsystem has asked for, see wm_event_handler_add() */
+
+typedef void (*MBEventHandlerFunc) (struct _wm *w, XEvent *ev);
+
+#define EVENT_HANDLER_TYPES 128 /* Event types, extensions included, are 7 bits */
+
+typedef struct MBEventHandler
+{
+  const char            *name;	   /* Subsystem, for stats */
+  Window                 window;   /* None for any */
+  MBEventHandlerFunc     func;
+  unsigned long          n_events;
+  long long              usec;
+  struct MBEventHandler *next;
+
+} MBEventHandler;
+
 /* Main WM struct  */
 
 typedef struct _wm
@@ -579,6 +729,11 @@ typedef struct _wm
 
   Client           *stack_top, *stack_bottom;
   int               stack_n_items;     
+
+  /* Per client type sublists of the above, indexed by type bit */
+  Client           *stack_type_top[STACK_N_TYPES];
+  Client           *stack_type_bottom[STACK_N_TYPES];
+  int               stack_type_n_items[STACK_N_TYPES];
   Client           *stack_top_app; 
   Client           *client_desktop;
 
@@ -670,6 +825,7 @@ typedef struct _wm
   Bool              have_xsync;
   int               sync_event_base;
   int               sync_error_base;
+  int               n_sync_waiting; /* Clients yet to answer a request */
 #endif
 
 #if USE_SM
@@ -686,8 +842,50 @@ typedef struct _wm
 #endif
 
   int n_active_ping_clients; 	/* Number of apps we are pinging */
+
+  /* Clients being pinged, a binary heap on ping_deadline_usec */
+  struct _client  **ping_queue;
+  int               ping_queue_len, ping_queue_alloc;
+  Bool              ping_stats_dirty;
+
+  MBList           *icon_cache; /* Shared MBIcon's */
+  MBList           *shape_masks; /* Shared MBShapeMask's */
+  GC                shape_mask_gc;
+
+  /* Coalesced title changes waiting to be painted */
+  int               n_title_pending;
+  unsigned long     title_n_updates, title_n_repaints;
+  Bool              title_stats_dirty;
+
+  /* ConfigureRequest received, folded into a later one, acted on */
+  unsigned long     n_configure_requests, n_configure_merged;
+  unsigned long     n_configure_applied;
+  Bool              configure_stats_dirty;
+
   int n_modals_present;		/* Number of modal windows present */
 
+  long long         startup_base_usec;
+  long long         startup_ready_usec; /* Time to first frame */
+  MBStartupPhase    startup_phases[N_STARTUP_PHASES];
+
+  /* Open addressed on atom, built at ewmh_init() */
+  MBAtomHandler     atom_handlers[ATOM_HANDLER_TABLE_SIZE];
+  int               n_atom_handlers;
+
+  /* Non core event handlers, on event type */
+  MBEventHandler   *event_handlers[EVENT_HANDLER_TYPES];
+  Bool              event_stats_dirty;
+
+  unsigned long     pool_stats_serial;
+
+  unsigned long     n_x_events;
+  unsigned long     x_stats_request; /* NextRequest() at last update */
+
+  long long         stats_usec;	/* Last wm_stats_publish() */
+
+  struct MBTrace   *trace;	/* Event recorder, NULL unless MB_TRACE */
+  struct MBControl *control;	/* Control socket, see control.h */
+
 } Wm;
 
 #ifdef USE_PANGO
@@ -43,12 +43,13 @@ toolbar_client_new(Wm *w, Window win)
        return main_client_new(w, win);
      }
 
-   c->type = MBCLIENT_TYPE_TOOLBAR;
+   stack_set_type(c, MBCLIENT_TYPE_TOOLBAR);
    
    c->configure    = &toolbar_client_configure;
    c->reparent     = &toolbar_client_reparent;
    c->button_press = &toolbar_client_button_press;
    c->redraw       = &toolbar_client_redraw;
+   c->prerender    = &toolbar_client_prerender;
    c->hide         = &toolbar_client_hide;
    c->iconize      = &toolbar_client_hide;
    c->show         = &toolbar_client_show;
@@ -346,6 +347,26 @@ toolbar_win_offset(Client *c)
      }
 }
 
+void
+toolbar_client_prerender(Client *c)
+{
+  Wm *w = c->wm;
+
+  int max_offset = theme_frame_defined_width_get(w->mbtheme, 
+						 FRAME_UTILITY_MAX);
+  int min_offset = theme_frame_defined_height_get(w->mbtheme, 
+						  FRAME_UTILITY_MIN);
+
+  if (c->flags & CLIENT_TITLE_HIDDEN_FLAG) return;
+
+  if (c->flags & CLIENT_IS_MINIMIZED)
+    theme_frame_prerender_add(w->mbtheme, FRAME_UTILITY_MIN, 
+			      c->width + max_offset, min_offset, False);
+  else
+    theme_frame_prerender_add(w->mbtheme, FRAME_UTILITY_MAX, 
+			      max_offset, c->height, False);
+}
+
 void
 toolbar_client_redraw(Client *c, Bool use_cache)
 {
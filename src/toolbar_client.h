@@ -56,6 +56,9 @@ toolbar_client_reparent(Client *c);
 void 
 toolbar_client_redraw(Client *c, Bool use_cache);
 
+void 
+toolbar_client_prerender(Client *c);
+
 int 
 toolbar_win_offset(Client *c);
 
@@ -39,7 +39,7 @@ toolbar_client_new(Wm *w, Window win)
 
   if (!c) return NULL;
 
-  c->type = MBCLIENT_TYPE_DIALOG; 
+  stack_set_type(c, MBCLIENT_TYPE_DIALOG);
    
   c->configure    = &toolbar_client_configure;
   c->reparent     = &toolbar_client_reparent;
@@ -162,7 +162,7 @@ toolbar_client_configure(Client *c)
 	    dialog_init_height = dialog_client->height;
 
 	  c->mapped = True; 	/* Hack Hack */
-	  c->type = MBCLIENT_TYPE_TOOLBAR; 
+	  stack_set_type(c, MBCLIENT_TYPE_TOOLBAR);
 
 	  dbg("%s() checking for available geom\n", __func__);
 
@@ -183,7 +183,7 @@ toolbar_client_configure(Client *c)
 	      client_deliver_config(dialog_client);
 	    }
 
-	  c->type = MBCLIENT_TYPE_DIALOG; 
+	  stack_set_type(c, MBCLIENT_TYPE_DIALOG);
 	  c->mapped = tmp_mapped;
 	  
 	}
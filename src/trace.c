@@ -0,0 +1,355 @@
+/*
+ *  Matchbox Window Manager - A lightweight window manager not for the
+ *                            desktop.
+ *
+ *  Authored By Matthew Allum <mallum@o-hand.com>
+ *
+ *  Copyright (c) 2002, 2004 OpenedHand Ltd - http://o-hand.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#include "trace.h"
+#include "wm.h"
+
+/* Open addressed on atom, must be a power of two */
+#define TRACE_ATOM_TABLE_SIZE 512
+
+typedef struct MBTraceAtom
+{
+  Atom  atom;
+  char *name;
+
+} MBTraceAtom;
+
+typedef struct MBTrace
+{
+  Wm            *wm;
+  char          *path;
+
+  MBTraceRecord *records;
+  int            size;
+  int            next;		/* Where the next record goes */
+  int            n_records;
+  unsigned long  n_lost;
+  long long      base_usec;
+
+  /* Names are looked up as atoms are first seen, so a dump at exit
+   * never needs to talk to the server.
+   */
+  MBTraceAtom    atoms[TRACE_ATOM_TABLE_SIZE];
+  int            n_atoms;
+
+} MBTrace;
+
+static volatile sig_atomic_t dump_pending;
+static MBTrace              *exit_trace;
+
+static void
+trace_sigusr1 (int sig)
+{
+  dump_pending = 1;
+}
+
+static void
+trace_atexit (void)
+{
+  if (exit_trace != NULL)
+    trace_dump(exit_trace);
+}
+
+MBTrace*
+trace_new (Wm *w)
+{
+  MBTrace          *trace;
+  struct sigaction  act;
+  char             *path = getenv("MB_TRACE");
+
+  if (path == NULL || *path == '\0')
+    return NULL;
+
+  trace = malloc(sizeof(MBTrace));
+  memset(trace, 0, sizeof(MBTrace));
+
+  trace->wm   = w;
+  trace->path = strdup(path);
+  trace->size = getenv("MB_TRACE_SIZE") ?
+    atoi(getenv("MB_TRACE_SIZE")) : TRACE_DEFAULT_SIZE;
+
+  if (trace->size < 16)
+    trace->size = 16;
+
+  if ((trace->records = malloc(sizeof(MBTraceRecord) * trace->size)) == NULL)
+    {
+      fprintf(stderr, "matchbox: unable to allocate %i trace records\n",
+	      trace->size);
+      free(trace->path);
+      free(trace);
+      return NULL;
+    }
+
+  trace->base_usec = misc_get_time_usec();
+
+  memset(&act, 0, sizeof(struct sigaction));
+  act.sa_handler = trace_sigusr1;
+  sigaction(SIGUSR1, &act, NULL);
+
+  exit_trace = trace;
+  atexit(trace_atexit);
+
+  dbg("%s() tracing %i events to %s\n", __func__, trace->size, trace->path);
+
+  return trace;
+}
+
+static void
+trace_atom_note (MBTrace *trace, Atom atom)
+{
+  int   i = (atom * 2654435761UL) & (TRACE_ATOM_TABLE_SIZE - 1);
+  char *name;
+
+  if (atom == None)
+    return;
+
+  while (trace->atoms[i].atom != None)
+    {
+      if (trace->atoms[i].atom == atom)
+	return;
+      i = (i + 1) & (TRACE_ATOM_TABLE_SIZE - 1);
+    }
+
+  /* Keep the table sparse, past this atoms just go unnamed */
+  if (trace->n_atoms >= TRACE_ATOM_TABLE_SIZE * 3 / 4)
+    return;
+
+  misc_trap_xerrors();
+  name = XGetAtomName(trace->wm->dpy, atom);
+  if (misc_untrap_xerrors() || name == NULL)
+    return;
+
+  trace->atoms[i].atom = atom;
+  trace->atoms[i].name = strdup(name);
+  trace->n_atoms++;
+
+  XFree(name);
+}
+
+static int
+trace_client_type (Client *c)
+{
+  switch (c->type)
+    {
+    case MBCLIENT_TYPE_APP:       return TRACE_CLIENT_APP;
+    case MBCLIENT_TYPE_DIALOG:    return TRACE_CLIENT_DIALOG;
+    case MBCLIENT_TYPE_TOOLBAR:   return TRACE_CLIENT_TOOLBAR;
+    case MBCLIENT_TYPE_PANEL:     return TRACE_CLIENT_PANEL;
+    case MBCLIENT_TYPE_DESKTOP:   return TRACE_CLIENT_DESKTOP;
+    case MBCLIENT_TYPE_TASK_MENU: return TRACE_CLIENT_TASK_MENU;
+    case MBCLIENT_TYPE_OVERRIDE:  return TRACE_CLIENT_OVERRIDE;
+    default:                      return TRACE_CLIENT_NONE;
+    }
+}
+
+void
+trace_event (MBTrace   *trace,
+	     XEvent    *ev,
+	     long long  start,
+	     long long  end)
+{
+  Wm            *w = trace->wm;
+  MBTraceRecord *r = &trace->records[trace->next];
+  Client        *c;
+  int            i;
+
+  if (++trace->next == trace->size)
+    trace->next = 0;
+
+  if (trace->n_records < trace->size)
+    trace->n_records++;
+  else
+    trace->n_lost++;
+
+  memset(r, 0, sizeof(MBTraceRecord));
+
+  r->usec         = start - trace->base_usec;
+  r->handler_usec = (end > start) ? end - start : 0;
+  r->type         = ev->type;
+  r->window       = ev->xany.window;
+
+  /* Enough of each event to replay what the client asked for */
+  switch (ev->type)
+    {
+    case MapRequest:
+      r->window = ev->xmaprequest.window;
+      if ((c = wm_find_client(w, r->window, WINDOW)) != NULL)
+	{
+	  r->flags  = trace_client_type(c);
+	  r->x      = c->x;
+	  r->y      = c->y;
+	  r->width  = c->width;
+	  r->height = c->height;
+	  if (c->trans)
+	    r->data[0] = c->trans->window;
+	}
+      break;
+    case MapNotify:
+      r->window = ev->xmap.window;
+      if (ev->xmap.override_redirect)
+	r->flags = TRACE_CLIENT_OVERRIDE;
+      break;
+    case UnmapNotify:
+      r->window = ev->xunmap.window;
+      if (wm_find_client(w, r->window, WINDOW) == NULL)
+	r->detail = TRACE_UNMAP_WITHDRAWN;
+      break;
+    case DestroyNotify:
+      r->window = ev->xdestroywindow.window;
+      break;
+    case ConfigureRequest:
+      r->window = ev->xconfigurerequest.window;
+      r->x      = ev->xconfigurerequest.x;
+      r->y      = ev->xconfigurerequest.y;
+      r->width  = ev->xconfigurerequest.width;
+      r->height = ev->xconfigurerequest.height;
+      r->flags  = ev->xconfigurerequest.value_mask;
+      break;
+    case ConfigureNotify:
+      r->window = ev->xconfigure.window;
+      r->x      = ev->xconfigure.x;
+      r->y      = ev->xconfigure.y;
+      r->width  = ev->xconfigure.width;
+      r->height = ev->xconfigure.height;
+      break;
+    case PropertyNotify:
+      r->atom   = ev->xproperty.atom;
+      r->detail = ev->xproperty.state;
+      trace_atom_note(trace, r->atom);
+      break;
+    case ClientMessage:
+      r->atom   = ev->xclient.message_type;
+      r->detail = ev->xclient.format;
+      for (i = 0; i < 3; i++)
+	r->data[i] = ev->xclient.data.l[i];
+      trace_atom_note(trace, r->atom);
+      if (r->atom == w->atoms[WINDOW_STATE])
+	{
+	  trace_atom_note(trace, r->data[1]);
+	  trace_atom_note(trace, r->data[2]);
+	}
+      break;
+    case ButtonPress:
+    case ButtonRelease:
+      r->detail = ev->xbutton.button;
+      r->flags  = ev->xbutton.state;
+      r->x      = ev->xbutton.x_root;
+      r->y      = ev->xbutton.y_root;
+      break;
+    case MotionNotify:
+      r->flags  = ev->xmotion.state;
+      r->x      = ev->xmotion.x_root;
+      r->y      = ev->xmotion.y_root;
+      break;
+    case KeyPress:
+    case KeyRelease:
+      r->detail = ev->xkey.keycode;
+      r->flags  = ev->xkey.state;
+      break;
+    }
+}
+
+void
+trace_check (MBTrace *trace)
+{
+  if (dump_pending)
+    {
+      dump_pending = 0;
+      trace_dump(trace);
+    }
+}
+
+void
+trace_get_timeout (MBTrace *trace, struct timeval *tv)
+{
+  misc_timeout_shorten(tv, TRACE_POLL_INTERVAL * 1000LL);
+}
+
+/* Writes the ring out oldest first, via a temp file so a reader never
+ * sees half a trace. Only stdio, as this can run from exit().
+ */
+Bool
+trace_dump (MBTrace *trace)
+{
+  MBTraceHeader header;
+  FILE         *fp;
+  char         *tmp_path;
+  int           first, i;
+  size_t        n_old, n_new;
+  Bool          ok;
+
+  tmp_path = malloc(strlen(trace->path) + 5);
+  sprintf(tmp_path, "%s.tmp", trace->path);
+
+  if ((fp = fopen(tmp_path, "w")) == NULL)
+    {
+      fprintf(stderr, "matchbox: unable to write trace to %s\n", tmp_path);
+      free(tmp_path);
+      return False;
+    }
+
+  memset(&header, 0, sizeof(MBTraceHeader));
+  header.magic         = MBTRACE_MAGIC;
+  header.version       = MBTRACE_VERSION;
+  header.record_size   = sizeof(MBTraceRecord);
+  header.n_records     = trace->n_records;
+  header.n_atoms       = trace->n_atoms;
+  header.n_lost        = trace->n_lost;
+  header.screen_width  = trace->wm->dpy_width;
+  header.screen_height = trace->wm->dpy_height;
+  header.root          = trace->wm->root;
+
+  ok = (fwrite(&header, sizeof(MBTraceHeader), 1, fp) == 1);
+
+  first = (trace->n_records < trace->size) ? 0 : trace->next;
+  n_old = trace->n_records - first;
+  n_new = first;
+
+  if (ok && trace->n_records)
+    ok = (fwrite(&trace->records[first], sizeof(MBTraceRecord), 
+		 n_old, fp) == n_old
+	  && fwrite(trace->records, sizeof(MBTraceRecord), 
+		    n_new, fp) == n_new);
+
+  for (i = 0; ok && i < TRACE_ATOM_TABLE_SIZE; i++)
+    if (trace->atoms[i].name != NULL)
+      {
+	uint32_t atom = trace->atoms[i].atom;
+	uint16_t len  = strlen(trace->atoms[i].name);
+
+	ok = (fwrite(&atom, sizeof(atom), 1, fp) == 1
+	      && fwrite(&len, sizeof(len), 1, fp) == 1
+	      && fwrite(trace->atoms[i].name, 1, len, fp) == len);
+      }
+
+  if (fclose(fp) != 0 || !ok || rename(tmp_path, trace->path) != 0)
+    {
+      fprintf(stderr, "matchbox: failed writing trace to %s\n", trace->path);
+      unlink(tmp_path);
+      free(tmp_path);
+      return False;
+    }
+
+  fprintf(stderr, "matchbox: wrote %i trace records ( %lu lost ) to %s\n",
+	  trace->n_records, trace->n_lost, trace->path);
+
+  free(tmp_path);
+  return True;
+}
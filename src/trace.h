@@ -0,0 +1,130 @@
+/*
+ *  Matchbox Window Manager - A lightweight window manager not for the
+ *                            desktop.
+ *
+ *  Authored By Matthew Allum <mallum@o-hand.com>
+ *
+ *  Copyright (c) 2002, 2004 OpenedHand Ltd - http://o-hand.com
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#ifndef _MBTRACE_H_
+#define _MBTRACE_H_
+
+#include <stdint.h>
+
+/*
+ *  X event trace recorder.
+ *
+ *  With MB_TRACE set to a file name, every event the main loop handles
+ *  is kept in a ring buffer of MB_TRACE_SIZE records ( default
+ *  TRACE_DEFAULT_SIZE ) along with when it came in and how long it took
+ *  to handle. The ring is written out on SIGUSR1 and at exit, and can
+ *  be replayed against Xvfb with util/trace-replay.
+ *
+ *  The file is a MBTraceHeader, n_records MBTraceRecords oldest first,
+ *  then n_atoms of ( uint32 atom, uint16 length, name ) so atoms can be
+ *  re-interned on another server. Fields are fixed size so traces from
+ *  a device can be read on a 64bit host, but are in the recording
+ *  machine's byte order.
+ *
+ *  Only the format is visible with MBTRACE_FORMAT_ONLY defined, for
+ *  tools building outside the tree.
+ */
+
+#define MBTRACE_MAGIC    0x4d425452 /* 'MBTR' */
+#define MBTRACE_VERSION  1
+
+/* What a MapRequest'd window became, record.flags */
+typedef enum MBTraceClientType
+{
+  TRACE_CLIENT_NONE = 0,	/* Not managed */
+  TRACE_CLIENT_APP,
+  TRACE_CLIENT_DIALOG,
+  TRACE_CLIENT_TOOLBAR,
+  TRACE_CLIENT_PANEL,
+  TRACE_CLIENT_DESKTOP,
+  TRACE_CLIENT_TASK_MENU,
+  TRACE_CLIENT_OVERRIDE
+
+} MBTraceClientType;
+
+/* record.detail for UnmapNotify, the client let go of its window */
+#define TRACE_UNMAP_WITHDRAWN 1
+
+typedef struct MBTraceHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t record_size;
+  uint32_t n_records;
+  uint32_t n_atoms;
+  uint32_t n_lost;		/* Overwritten in the ring before a dump */
+  uint16_t screen_width;
+  uint16_t screen_height;
+  uint32_t root;		/* So replays can tell root messages */
+
+} MBTraceHeader;
+
+typedef struct MBTraceRecord
+{
+  int64_t  usec;		/* Since tracing started */
+  uint32_t handler_usec;	/* Time spent handling the event */
+  uint32_t window;		/* Window the event is about */
+  uint32_t atom;		/* Property or message type */
+  uint32_t data[3];		/* ClientMessage data, MapRequest
+				   data[0] is the transient for window */
+  int16_t  x, y;		/* Requested, or managed, geometry */
+  uint16_t width, height;
+  uint8_t  type;		/* X event type */
+  uint8_t  detail;		/* Button, keycode or property state */
+  uint16_t flags;		/* ConfigureRequest value mask, key or
+				   button state, MBTraceClientType */
+  uint32_t pad;
+
+} MBTraceRecord;
+
+#ifndef MBTRACE_FORMAT_ONLY
+
+#include "structs.h"
+
+#define TRACE_DEFAULT_SIZE   65536 /* Records kept, about 3MB */
+#define TRACE_POLL_INTERVAL  1000  /* msecs, how late a SIGUSR1 dump is */
+
+struct MBTrace;
+
+/* Returns NULL unless MB_TRACE is set */
+struct MBTrace*
+trace_new (Wm *w);
+
+/* Records ev, handled between start and end usecs */
+void
+trace_event (struct MBTrace *trace,
+	     XEvent         *ev,
+	     long long       start,
+	     long long       end);
+
+/* Dumps the ring if a SIGUSR1 came in */
+void
+trace_check (struct MBTrace *trace);
+
+/* Caps the select() timeout, so SIGUSR1 gets seen when idle */
+void
+trace_get_timeout (struct MBTrace *trace, struct timeval *tv);
+
+Bool
+trace_dump (struct MBTrace *trace);
+
+#endif
+
+#endif
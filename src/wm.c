@@ -36,7 +36,15 @@ static void wm_xsettings_notify_cb (const char       *name,
 				    void             *data);
 #endif
 
+static void wm_atom_handlers_init(Wm *w);
+
+#ifdef USE_XSETTINGS
+static void wm_xsettings_handle_event (Wm *w, XEvent *ev);
+#endif
+
 #ifdef USE_LIBSN
+static void wm_sn_handle_event (Wm *w, XEvent *ev);
+
 static void wm_sn_timeout_check (Wm *w);
 
 static void wm_sn_exec(Wm *w, char* name, char* bin_name, char *desc);
@@ -62,9 +70,17 @@ wm_new(int argc, char **argv)
    w = malloc(sizeof(Wm));
    memset(w, 0, sizeof(Wm));
 
+   w->startup_base_usec = misc_get_time_usec();
+
+   wm_startup_phase_start(w, STARTUP_WM_NEW);
+
    w->flags = STARTUP_FLAG;
 
+   wm_startup_phase_start(w, STARTUP_LOAD_CONFIG);
+
    wm_load_config(w, &argc, argv);
+
+   wm_startup_phase_end(w, STARTUP_LOAD_CONFIG);
    
    XSetErrorHandler(handle_xerror); 
 
@@ -126,6 +142,16 @@ wm_new(int argc, char **argv)
    w->xsettings_client = xsettings_client_new (w->dpy, w->screen,
 					       wm_xsettings_notify_cb,
 					       NULL, (void *)w );
+
+   /* Manager selection changes on the root and settings changes on the 
+    * managers window. 
+   */
+   wm_event_handler_add(w, PropertyNotify, None, "xsettings", 
+			wm_xsettings_handle_event);
+   wm_event_handler_add(w, ClientMessage, None, "xsettings", 
+			wm_xsettings_handle_event);
+   wm_event_handler_add(w, DestroyNotify, None, "xsettings", 
+			wm_xsettings_handle_event);
 #endif 
 
 #ifndef STANDALONE
@@ -144,14 +170,23 @@ wm_new(int argc, char **argv)
 #endif
 
 #ifndef NO_KBD
+   wm_startup_phase_start(w, STARTUP_KEYS_INIT);
    keys_init(w);
+   wm_startup_phase_end(w, STARTUP_KEYS_INIT);
 #endif
 
+   wm_startup_phase_start(w, STARTUP_EWMH_INIT);
    ewmh_init(w);
+   wm_atom_handlers_init(w);
+   wm_startup_phase_end(w, STARTUP_EWMH_INIT);
 
+   wm_startup_phase_start(w, STARTUP_COMP_ENGINE_INIT);
    comp_engine_init (w);
+   wm_startup_phase_end(w, STARTUP_COMP_ENGINE_INIT);
 
+   wm_startup_phase_start(w, STARTUP_THEME_INIT);
    mbtheme_init(w, w->config->theme);
+   wm_startup_phase_end(w, STARTUP_THEME_INIT);
 
    ewmh_init_props(w);
 
@@ -170,16 +205,105 @@ wm_new(int argc, char **argv)
    w->sn_busy_cnt     = 0;
    w->sn_cycles       = NULL;
    w->sn_mapping_list = NULL;
+
+   /* Startup notification is all client messages */
+   wm_event_handler_add(w, ClientMessage, None, "libsn", wm_sn_handle_event);
 #endif
 
    /* Panel/Dock in titlebar stuff */
    w->have_titlebar_panel = NULL;
 
+   w->trace   = trace_new(w);
+   w->control = control_new(w);
+
    w->flags ^= STARTUP_FLAG; 	/* Remove startup flag */
 
+   wm_startup_phase_end(w, STARTUP_WM_NEW);
+
    return w;
 }
 
+static char *StartupPhaseNames[N_STARTUP_PHASES] = {
+  "wm_new",
+  "wm_load_config",
+  "keys_init",
+  "ewmh_init",
+  "comp_engine_init",
+  "mbtheme_init",
+  "wm_init_existing"
+};
+
+/* 
+ *  Startup instrumentation. Each phase records how long it took and 
+ *  how many X requests it generated. With --startup-report we XSync
+ *  at the end of each phase so requests are charged to the phase 
+ *  that made them rather than whoever next flushes.
+ */
+void
+wm_startup_phase_start(Wm *w, int phase)
+{
+  MBStartupPhase *p = &w->startup_phases[phase];
+
+  p->start_request = (w->dpy) ? NextRequest(w->dpy) : 0;
+  p->start_usec    = misc_get_time_usec();
+}
+
+void
+wm_startup_phase_end(Wm *w, int phase)
+{
+  MBStartupPhase *p = &w->startup_phases[phase];
+
+  if (w->dpy && w->config && w->config->startup_report)
+    XSync(w->dpy, False);
+
+  p->usec = misc_get_time_usec() - p->start_usec;
+
+  if (w->dpy)
+    p->n_requests = NextRequest(w->dpy) - p->start_request;
+}
+
+/* Called once managing existing windows is done and everything is 
+ * on screen. Publishes the phase timings on the root window as 
+ * _MB_STARTUP_REPORT and prints them if --startup-report was given.
+*/
+void
+wm_startup_report(Wm *w)
+{
+  char  buf[512], *p = buf;
+  int   i;
+
+  XSync(w->dpy, False);
+
+  w->startup_ready_usec = misc_get_time_usec() - w->startup_base_usec;
+
+  for (i = 0; i < N_STARTUP_PHASES; i++)
+    p += snprintf(p, sizeof(buf) - (p - buf), "%s=%lli/%lu ", 
+		  StartupPhaseNames[i], 
+		  w->startup_phases[i].usec, 
+		  w->startup_phases[i].n_requests);
+
+  snprintf(p, sizeof(buf) - (p - buf), "first_frame=%lli", 
+	   w->startup_ready_usec);
+
+  XChangeProperty(w->dpy, w->root, w->atoms[_MB_STARTUP_REPORT],
+		  XA_STRING, 8, PropModeReplace, 
+		  (unsigned char *)buf, strlen(buf));
+
+  if (!w->config->startup_report)
+    return;
+
+  fprintf(stderr, "matchbox: startup report ( usec, X requests )\n");
+
+  for (i = 0; i < N_STARTUP_PHASES; i++)
+    fprintf(stderr, "matchbox:   %-20s %10lli %6lu\n", 
+	    StartupPhaseNames[i], 
+	    w->startup_phases[i].usec, 
+	    w->startup_phases[i].n_requests);
+
+  fprintf(stderr, "matchbox:   %-20s %10lli\n", 
+	  "first_frame", w->startup_ready_usec);
+}
+
 
 void
 wm_usage(char *progname)
@@ -202,6 +326,7 @@ wm_usage(char *progname)
 #ifdef USE_SM
    printf("\t--sm-client-id    <session id>\n");
 #endif
+   printf("\t--startup-report\n");
 
 #ifdef STANDALONE
    printf("\t-titlebar_panel   <x11 geometry>\n");
@@ -322,6 +447,13 @@ wm_load_config (Wm   *w,
    w->config->dialog_stratergy = WM_DIALOGS_STRATERGY_CONSTRAINED;
    w->config->ping_handler     = getenv("MB_HUNG_APP_HANDLER");
    w->config->ping_aggressive = getenv("MB_AGGRESSIVE_PING") ? True : False;
+   w->config->title_update_interval 
+     = getenv("MB_TITLE_UPDATE_INTERVAL") ? 
+     atoi(getenv("MB_TITLE_UPDATE_INTERVAL")) : TITLE_UPDATE_INTERVAL;
+   w->config->drag_update_interval 
+     = getenv("MB_DRAG_UPDATE_INTERVAL") ? 
+     atoi(getenv("MB_DRAG_UPDATE_INTERVAL")) : DRAG_UPDATE_INTERVAL;
+   w->config->opaque_drag = getenv("MB_OPAQUE_DRAG") ? True : False;
 
 #ifdef USE_COMPOSITE
    w->config->dialog_shade = True;
@@ -450,6 +582,11 @@ wm_load_config (Wm   *w,
        continue;
      }
 #endif
+      if (!strcmp ("--startup-report", argv[i])) 
+	{
+	  w->config->startup_report = True;
+	  continue;
+	}
 
       wm_usage (argv[0]);
    }
@@ -473,7 +610,7 @@ wm_load_config (Wm   *w,
    char              *type;
    XrmValue          value;
    
-   static int opTableEntries = 12;
+   static int opTableEntries = 13;
    static XrmOptionDescRec opTable[] = {
       {"-theme",       ".theme",           XrmoptionSepArg, (XPointer) NULL},
       {"-use_titlebar",".titlebar",        XrmoptionSepArg, (XPointer) NULL},
@@ -487,6 +624,7 @@ wm_load_config (Wm   *w,
       {"--sm-client-id",  ".session",      XrmoptionSepArg, (XPointer) NULL},
       {"-use_super_modal", ".supermodal",  XrmoptionSepArg, (XPointer) NULL},
       {"-kbdconfig", ".kbdconfig",         XrmoptionSepArg, (XPointer) NULL},
+      {"--startup-report", ".startupreport", XrmoptionNoArg, (XPointer) "yes"},
    };
 
    XrmInitialize();
@@ -510,6 +648,13 @@ wm_load_config (Wm   *w,
    w->config->dialog_stratergy = WM_DIALOGS_STRATERGY_CONSTRAINED;
    w->config->ping_handler     = getenv("MB_HUNG_APP_HANDLER");
    w->config->ping_aggressive  = getenv("MB_AGGRESSIVE_PING") ? True : False;
+   w->config->title_update_interval 
+     = getenv("MB_TITLE_UPDATE_INTERVAL") ? 
+     atoi(getenv("MB_TITLE_UPDATE_INTERVAL")) : TITLE_UPDATE_INTERVAL;
+   w->config->drag_update_interval 
+     = getenv("MB_DRAG_UPDATE_INTERVAL") ? 
+     atoi(getenv("MB_DRAG_UPDATE_INTERVAL")) : DRAG_UPDATE_INTERVAL;
+   w->config->opaque_drag = getenv("MB_OPAQUE_DRAG") ? True : False;
 
    if (XrmGetResource(rDB, "matchbox.display",
 		      "Matchbox.Display",
@@ -592,6 +737,14 @@ wm_load_config (Wm   *w,
 	 }
      }   
 
+   if (XrmGetResource(rDB, "matchbox.startupreport", 
+		      "Matchbox.Startupreport",
+		      &type, &value) == True)
+   {
+      if(strncmp(value.addr, "yes", (int) value.size) == 0)
+	 w->config->startup_report = True;
+   }
+
    if (XrmGetResource(rDB, "matchbox.supermodal", "Matchbox.Supermodal",
 		      &type, &value) == True)
    {
@@ -702,6 +855,8 @@ wm_init_existing(Wm *w)
    Window dummyw1, dummyw2, *wins;
    XWindowAttributes attr;
    Client *c;
+
+   wm_startup_phase_start(w, STARTUP_INIT_EXISTING);
    
    /* set blank hints */
    ewmh_update_rects(w); 
@@ -722,6 +877,8 @@ wm_init_existing(Wm *w)
       }
    }
    XFree(wins);
+
+   wm_startup_phase_end(w, STARTUP_INIT_EXISTING);
 }
 
 
@@ -755,11 +912,17 @@ get_xevent_timed(Wm             *w,
 		 XEvent         *event_return, 
 		 struct timeval *tv)
 {
+  struct timeval *timeout = tv;
+
   if (tv->tv_usec == 0 && tv->tv_sec == 0)
     {
 #ifndef USE_SM
-      XNextEvent(w->dpy, event_return);
-      return True;
+      if (w->control == NULL)
+	{
+	  XNextEvent(w->dpy, event_return);
+	  return True;
+	}
+      timeout = NULL; 		/* Block, but see control requests */
 #else
       tv->tv_sec = 5;
 #endif
@@ -782,7 +945,11 @@ get_xevent_timed(Wm             *w,
 	    fd = w->sm_ice_fd; 	/* for +1 below */
 	}
 #endif
-      if (select(fd+1, &readset, NULL, NULL, tv) == 0) 
+      if (w->control)
+	fd = control_fds_set(w->control, &readset, fd);
+
+      /* Timed out, or a signal got in and readset is junk */
+      if (select(fd+1, &readset, NULL, NULL, timeout) <= 0) 
 	{
 	  return False;
 	}
@@ -795,10 +962,23 @@ get_xevent_timed(Wm             *w,
 	      return False;
 	    }
 #endif
+	  if (w->control)
+	    {
+	      control_process(w->control, &readset);
+
+	      if (!FD_ISSET(ConnectionNumber(w->dpy), &readset))
+		return False;
+	    }
+
 	  XNextEvent(w->dpy, event_return);
 	  return True;
       }
     } else {
+      /* Events already queued, don't let a steady stream of them starve
+       * the control sockets. */
+      if (w->control)
+	control_poll(w->control);
+
       XNextEvent(w->dpy, event_return);
       return True;
     }
@@ -839,8 +1019,7 @@ wm_handle_map_notify(Wm *w, Window win)
     {
       dbg("%s() making new overide redirect window\n", __func__);
 
-      new_client = malloc(sizeof(Client));
-      memset(new_client, 0, sizeof(Client));
+      new_client = pool_alloc(POOL_CLIENT);
 
       new_client->x      = attr.x;
       new_client->y      = attr.y;
@@ -871,13 +1050,254 @@ wm_handle_map_notify(Wm *w, Window win)
 }
 #endif
 
+/* 
+ *  Subsystems with an interest in raw events register here for just the
+ *  event types, extension ones included, and optionally window they 
+ *  need, rather than being handed every event.
+ */
+void
+wm_event_handler_add (Wm                 *w,
+		      int                 type,
+		      Window              win,
+		      const char         *name,
+		      MBEventHandlerFunc  func)
+{
+  MBEventHandler *h, **tail;
+
+  if (type < 0 || type >= EVENT_HANDLER_TYPES)
+    return;
+
+  for (tail = &w->event_handlers[type]; *tail; tail = &(*tail)->next)
+    if ((*tail)->func == func && (*tail)->window == win)
+      return; 			/* eg comp_engine_reinit() */
+
+  h = malloc(sizeof(MBEventHandler));
+  memset(h, 0, sizeof(MBEventHandler));
+
+  h->name   = name;
+  h->window = win;
+  h->func   = func;
+
+  *tail = h;
+}
+
+static void
+wm_event_dispatch (Wm *w, XEvent *ev)
+{
+  MBEventHandler *h;
+  long long       start;
+
+  if (ev->type >= EVENT_HANDLER_TYPES)
+    return;
+
+  for (h = w->event_handlers[ev->type]; h != NULL; h = h->next)
+    {
+      if (h->window != None && h->window != ev->xany.window)
+	continue;
+
+      start = misc_get_time_usec();
+
+      h->func(w, ev);
+
+      h->usec += misc_get_time_usec() - start;
+      h->n_events++;
+
+      w->event_stats_dirty = True;
+    }
+}
+
+#define EVENT_STATS_MAX_SUBSYSTEMS 16
+
+/* Per subsystem event counts and time spent, "name=events:usecs ..." */
+static void
+wm_event_stats_publish (Wm *w)
+{
+  const char     *names[EVENT_STATS_MAX_SUBSYSTEMS];
+  unsigned long   n_events[EVENT_STATS_MAX_SUBSYSTEMS];
+  long long       usec[EVENT_STATS_MAX_SUBSYSTEMS];
+  MBEventHandler *h;
+  char            buf[512], *p = buf;
+  int             type, i, n_names = 0;
+
+  for (type = 0; type < EVENT_HANDLER_TYPES; type++)
+    for (h = w->event_handlers[type]; h != NULL; h = h->next)
+      {
+	for (i = 0; i < n_names; i++)
+	  if (!strcmp(names[i], h->name))
+	    break;
+
+	if (i == n_names)
+	  {
+	    if (n_names == EVENT_STATS_MAX_SUBSYSTEMS)
+	      continue;
+
+	    names[i]    = h->name;
+	    n_events[i] = 0;
+	    usec[i]     = 0;
+	    n_names++;
+	  }
+
+	n_events[i] += h->n_events;
+	usec[i]     += h->usec;
+      }
+
+  *p = '\0';
+
+  for (i = 0; i < n_names && (size_t)(p - buf) < sizeof(buf) - 1; i++)
+    p += snprintf(p, sizeof(buf) - (p - buf), "%s%s=%lu:%lli",
+		  (i) ? " " : "", names[i], n_events[i], usec[i]);
+
+  XChangeProperty(w->dpy, w->root, w->atoms[_MB_EVENT_STATS],
+		  XA_STRING, 8, PropModeReplace,
+		  (unsigned char *)buf, strlen(buf));
+
+  w->event_stats_dirty = False;
+}
+
+/* Client, button and list node pool usage, 
+ * "name=used:free:peak:slabs ..." 
+ */
+static void
+wm_pool_stats_publish (Wm *w)
+{
+  char buf[256];
+
+  pool_stats_describe(buf, sizeof(buf));
+
+  XChangeProperty(w->dpy, w->root, w->atoms[_MB_POOL_STATS],
+		  XA_STRING, 8, PropModeReplace,
+		  (unsigned char *)buf, strlen(buf));
+
+  w->pool_stats_serial = pool_serial();
+}
+
+/* Total X requests made and events received, "requests=N events=N",
+ * for benchmarks to diff. Only requests make it pending, else the 
+ * PropertyNotify for our own update would keep it going.
+ */
+static void
+wm_x_stats_publish (Wm *w)
+{
+  char buf[64];
+
+  snprintf(buf, sizeof(buf), "requests=%lu events=%lu",
+	   NextRequest(w->dpy) - 1, w->n_x_events);
+
+  XChangeProperty(w->dpy, w->root, w->atoms[_MB_X_STATS],
+		  XA_STRING, 8, PropModeReplace,
+		  (unsigned char *)buf, strlen(buf));
+
+  w->x_stats_request = NextRequest(w->dpy);
+}
+
+/* "requests=N merged=N applied=N" for ConfigureRequests */
+static void
+wm_configure_stats_publish (Wm *w)
+{
+  char buf[96];
+
+  snprintf(buf, sizeof(buf), "requests=%lu merged=%lu applied=%lu",
+	   w->n_configure_requests, w->n_configure_merged,
+	   w->n_configure_applied);
+
+  XChangeProperty(w->dpy, w->root, w->atoms[_MB_CONFIGURE_STATS],
+		  XA_STRING, 8, PropModeReplace,
+		  (unsigned char *)buf, strlen(buf));
+
+  w->configure_stats_dirty = False;
+}
+
+/* "updates=N repaints=N" for title changes */
+static void
+wm_title_stats_publish (Wm *w)
+{
+  char buf[64];
+
+  snprintf(buf, sizeof(buf), "updates=%lu repaints=%lu", 
+	   w->title_n_updates, w->title_n_repaints);
+
+  XChangeProperty(w->dpy, w->root, w->atoms[_MB_TITLE_STATS],
+		  XA_STRING, 8, PropModeReplace,
+		  (unsigned char *)buf, strlen(buf));
+
+  w->title_stats_dirty = False;
+}
+
+static Bool
+wm_stats_pending (Wm *w)
+{
+  return (w->title_stats_dirty 
+	  || w->configure_stats_dirty
+#ifndef NO_PING
+	  || w->ping_stats_dirty
+#endif
+	  || w->event_stats_dirty
+	  || w->pool_stats_serial != pool_serial()
+#ifndef STANDALONE
+	  || w->mbtheme->image_stats_dirty
+#endif
+	  || w->x_stats_request != NextRequest(w->dpy));
+}
+
+/* The root window stats that change with nearly every event are 
+ * published together, at most every STATS_INTERVAL, rather than each
+ * on its own throttle. Called every event loop pass.
+ */
+static void
+wm_stats_publish (Wm *w)
+{
+  long long now = misc_get_time_usec();
+
+  if (!wm_stats_pending(w) || now - w->stats_usec < STATS_INTERVAL * 1000LL)
+    return;
+
+  if (w->title_stats_dirty)
+    wm_title_stats_publish(w);
+
+  if (w->configure_stats_dirty)
+    wm_configure_stats_publish(w);
+
+#ifndef NO_PING
+  if (w->ping_stats_dirty)
+    ewmh_ping_stats_publish(w);
+#endif
+
+  if (w->event_stats_dirty)
+    wm_event_stats_publish(w);
+
+  if (w->pool_stats_serial != pool_serial())
+    wm_pool_stats_publish(w);
+
+#ifndef STANDALONE
+  if (w->mbtheme->image_stats_dirty)
+    theme_image_stats_publish(w->mbtheme);
+#endif
+
+  /* Last, so it counts the requests above and not just the next ones */
+  if (w->x_stats_request != NextRequest(w->dpy))
+    wm_x_stats_publish(w);
+
+  w->stats_usec = now;
+}
+
+/* Wake up for pending stats, so an idle wm still publishes what 
+ * handling the last event changed.
+ */
+static void
+wm_stats_get_timeout (Wm *w, struct timeval *tv)
+{
+  if (wm_stats_pending(w))
+    misc_timeout_shorten(tv, w->stats_usec + STATS_INTERVAL * 1000LL 
+			 - misc_get_time_usec());
+}
+
 /* Main event loop, timeout for polling stuff */
 void
 wm_event_loop(Wm* w)
 {
   XEvent ev;
-  int hung_app_timer = 0;
   struct timeval tvt;
+  long long start;
 
   for (;;) 
     {
@@ -897,13 +1317,36 @@ wm_event_loop(Wm* w)
 
 #ifndef NO_PING
       if (w->n_active_ping_clients)
-	tvt.tv_sec = 1;
+	ewmh_ping_get_timeout(w, &tvt);
+#endif
+
+      if (w->n_title_pending)
+	wm_title_update_get_timeout(w, &tvt);
+
+#ifdef USE_XSYNC
+      if (w->n_sync_waiting)
+	ewmh_sync_get_timeout(w, &tvt);
 #endif
 
+      wm_stats_get_timeout(w, &tvt);
+
+#ifndef STANDALONE
+      theme_image_cache_get_timeout(w->mbtheme, &tvt);
+#endif
+
+      if (w->trace)
+	trace_get_timeout(w->trace, &tvt);
+
       if (get_xevent_timed(w, &ev, &tvt))
 	{
+	  w->n_x_events++;
+
+	  start = misc_get_time_usec();
 
-	  switch (ev.type) 
+	  /* Extension events, mostly damage, go straight to whoever
+	   * registered for them. 
+	   */
+	  if (ev.type < LASTEvent) switch (ev.type) 
 	  {
 #ifdef USE_COMPOSITE
 	  case MapNotify:
@@ -936,6 +1379,8 @@ wm_event_loop(Wm* w)
 	  case MappingNotify:
 	    dbg("%s() got MappingNotify\n", __func__);
 	    XRefreshKeyboardMapping(&ev.xmapping);
+	    if (ev.xmapping.request != MappingPointer)
+	      keys_remap(w);
 	    break;
 #endif
 	  default:
@@ -943,25 +1388,12 @@ wm_event_loop(Wm* w)
 	    break;
 	  }
 
-	comp_engine_handle_events(w, &ev);
-
-#ifdef USE_XSYNC
-     if (w->have_xsync
-	 && ev.type == w->sync_event_base + XSyncAlarmNotify)
-	{
-	  dbg("%s() got ewmh_sync alarm notify\n", __func__);
-	  ewmh_sync_handle_event(w, (XSyncAlarmNotifyEvent*)&ev);
-	}
-#endif
+	latency_event_add(ev.type, misc_get_time_usec() - start);
 
-#ifdef USE_XSETTINGS
-	if (w->xsettings_client != NULL)
-	  xsettings_client_process_event(w->xsettings_client, &ev);
-#endif
+	wm_event_dispatch(w, &ev);
 
-#ifdef USE_LIBSN
-	sn_display_process_event (w->sn_display, &ev);
-#endif
+	if (w->trace)
+	  trace_event(w->trace, &ev, start, misc_get_time_usec());
 
       } else {
 
@@ -976,16 +1408,34 @@ wm_event_loop(Wm* w)
 	  g_main_context_iteration (w->gconf_context, FALSE);
 #endif
 
+         }
 
 #ifndef NO_PING
-	/* check for hung apps every PING_CHECK_FREQ seconds */
-	if (++hung_app_timer >= PING_CHECK_FREQ && w->n_active_ping_clients)
-	  {
-	    hung_app_timer = 0;
-	    ewmh_hung_app_check(w);
-	  }
+      /* Not just on timeouts, a busy event stream musn't starve pings */
+      if (w->n_active_ping_clients)
+	ewmh_ping_check(w);
+#endif
+
+      if (w->n_title_pending)
+	wm_title_update_check(w);
+
+      wm_stats_publish(w);
+
+#ifndef STANDALONE
+      theme_image_cache_check(w->mbtheme);
+#endif
+
+      if (w->trace)
+	trace_check(w->trace);
+
+      /* Keep the task menu ready for the next time its opened */
+      if (!XEventsQueued(w->dpy, QueuedAlready))
+	theme_frame_menu_update(w->mbtheme);
+
+#ifdef USE_XSYNC
+      if (w->n_sync_waiting)
+	ewmh_sync_check(w);
 #endif
-         }
 
 #ifdef USE_COMPOSITE
       if (w->all_damage)
@@ -1072,7 +1522,8 @@ void
 wm_handle_keypress(Wm *w, XKeyEvent *e)
 {
 #ifndef NO_KBD
-  MBConfigKbdEntry *entry =  w->config->kb->entrys;
+  MBConfigKbdBinding *binding;
+  MBConfigKbdEntry   *entry;
   Client *p = NULL;
   int state = e->state;
 
@@ -1099,11 +1550,14 @@ wm_handle_keypress(Wm *w, XKeyEvent *e)
    /* Don't care about Caps/Num/Scroll lock here */
    state &= ~w->config->kb->lock_mask;
 
-   while (entry != NULL)
+   for (binding = w->config->kb->bindings[e->keycode]; 
+	binding != NULL; 
+	binding = binding->next)
      {
-       if (XKeycodeToKeysym(w->dpy, e->keycode, entry->index) == entry->key
-	   && state == entry->ModifierMask )
+       if (binding->state == state)
 	{
+	  entry = binding->entry;
+
 	  switch (entry->action) 
 	    {
 	    case KEY_ACTN_EXEC:
@@ -1184,7 +1638,6 @@ wm_handle_keypress(Wm *w, XKeyEvent *e)
 	      break;
 	    }
 	}
-      entry = entry->next_entry;
     }
 #endif
 }
@@ -1224,6 +1677,8 @@ wm_handle_configure_notify(Wm *w, XConfigureEvent *e)
 
 	theme_pixmap_cache_clear_all( w->mbtheme );
 
+	theme_frame_menu_invalidate( w->mbtheme );
+
 
 	stack_enumerate(w, p)
 	 {
@@ -1285,6 +1740,16 @@ wm_handle_configure_notify(Wm *w, XConfigureEvent *e)
 	       break;
 	     }
 
+	   p->prerender(p);
+	 }
+
+	/* New sized decorations for everything now get rasterized 
+	 * together, before we start redrawing. 
+	*/
+	theme_frame_prerender_run(w->mbtheme);
+
+	stack_enumerate(w, p)
+	 {
 	   /* we leave desktop/titlebar dock till last */
 	   if (p != cdesktop && p != ctitledock) 	
 	     {
@@ -1299,6 +1764,8 @@ wm_handle_configure_notify(Wm *w, XConfigureEvent *e)
 
 	 }
 
+	theme_frame_prerender_clear(w->mbtheme);
+
 
 	 if (cdesktop)
 	   {
@@ -1328,8 +1795,9 @@ wm_handle_configure_notify(Wm *w, XConfigureEvent *e)
 }
 
 
-void
-wm_handle_configure_request (Wm *w, XConfigureRequestEvent *e )
+/* Returns True if the request changed anything server side */
+static Bool
+wm_configure_request_process (Wm *w, XConfigureRequestEvent *e)
 {
    Client         *c = wm_find_client(w, e->window, WINDOW);
    XWindowChanges  xwc;
@@ -1366,7 +1834,7 @@ wm_handle_configure_request (Wm *w, XConfigureRequestEvent *e )
        misc_trap_xerrors();
        XConfigureWindow(w->dpy, e->window, e->value_mask, &xwc);
        misc_untrap_xerrors();
-       return;
+       return True;
      }
 
    /* Process exactly what changes have been reuested */
@@ -1466,7 +1934,7 @@ wm_handle_configure_request (Wm *w, XConfigureRequestEvent *e )
 	   
 	   c = wm_make_new_client(w, win_tmp);
 	   if (c) c->ignore_unmap++;
-	   return;
+	   return True;
         } 
      } 
 
@@ -1479,7 +1947,7 @@ wm_handle_configure_request (Wm *w, XConfigureRequestEvent *e )
 	   c->height = e->height;
 	   c->move_resize(c);
 	   wm_update_layout(w, c, change_amount); 
-	   return;
+	   return True;
 	 }
      }
 
@@ -1598,10 +2066,22 @@ wm_handle_configure_request (Wm *w, XConfigureRequestEvent *e )
 		     trans_client->move_resize(trans_client);
 		     trans_client->redraw(trans_client, False);
 		   }
+		 return True;
 	       }
-	     return;
+	     return False;
 	   }
 #endif
+	   /* Constraining may well have put it straight back where it 
+	    * was, in which case theres nothing to move or repaint.
+	    */
+	   if (req_x == c->x && req_y == c->y 
+	       && req_w == c->width && req_h == c->height
+	       && !want_activate)
+	     {
+	       client_deliver_config(c);
+	       return False;
+	     }
+
 	   if (c->width == req_w && c->height == req_h)
 	     want_fake_configure = True; 
 
@@ -1634,7 +2114,7 @@ wm_handle_configure_request (Wm *w, XConfigureRequestEvent *e )
 	   comp_engine_client_configure(w, c);
 	   comp_engine_client_show(w, c);
 
-	   return;
+	   return True;
 	 }
      }
 
@@ -1642,36 +2122,136 @@ wm_handle_configure_request (Wm *w, XConfigureRequestEvent *e )
     * Code should fall back to this.
     */
    client_deliver_config(c);
+
+   return False;
 }
 
 
-void
-wm_handle_map_request(Wm *w, XMapRequestEvent *e)
+typedef struct MBConfigureScan
 {
-   Client *c = wm_find_client(w, e->window, WINDOW);
+  Window win;
+  Bool   blocked;
 
-   if (!c) {
-      wm_make_new_client(w, e->window);
-   } else {
-      dbg("%s() Honoring map request for %s\n", __func__, c->name);
-      wm_activate_client(c);
-   }
-}
+} MBConfigureScan;
 
-void
-wm_handle_unmap_event(Wm *w, XUnmapEvent *e)
+/* XCheckIfEvent() predicate picking out further ConfigureRequests for
+ * the same window. Gives up at anything that changes whether or how
+ * the window is managed, as later requests belong after that.
+ */
+static Bool
+wm_configure_request_predicate (Display *dpy, XEvent *ev, XPointer arg)
 {
-   Client *c = wm_find_client(w, e->window, WINDOW);
+  MBConfigureScan *scan = (MBConfigureScan *)arg;
 
-   if (!c) return;
+  if (scan->blocked)
+    return False;
 
-   dbg("%s() for client %s\n", __func__, c->name);
+  switch (ev->type)
+    {
+    case ConfigureRequest:
+      return (ev->xconfigurerequest.window == scan->win);
+    case MapRequest:
+      scan->blocked = (ev->xmaprequest.window == scan->win);
+      break;
+    case UnmapNotify:
+      scan->blocked = (ev->xunmap.window == scan->win);
+      break;
+    case DestroyNotify:
+      scan->blocked = (ev->xdestroywindow.window == scan->win);
+      break;
+    case ReparentNotify:
+      scan->blocked = (ev->xreparent.window == scan->win);
+      break;
+    }
 
-   if (c->ignore_unmap)
-     {
-       c->ignore_unmap--;
-       dbg("%s() ignoring .. \n", __func__ );
-     }
+  return False;
+}
+
+/* Folds any already queued ConfigureRequests for e's window into e, so 
+ * a client resizing in a tight loop gets one configure, not dozens.
+ */
+static void
+wm_configure_request_coalesce (Wm *w, XConfigureRequestEvent *e)
+{
+  MBConfigureScan scan;
+  XEvent          ev;
+
+  scan.win     = e->window;
+  scan.blocked = False;
+
+  while (XCheckIfEvent(w->dpy, &ev, wm_configure_request_predicate, 
+		       (XPointer)&scan))
+    {
+      XConfigureRequestEvent *next = &ev.xconfigurerequest;
+
+      if (next->value_mask & CWX)           e->x            = next->x;
+      if (next->value_mask & CWY)           e->y            = next->y;
+      if (next->value_mask & CWWidth)       e->width        = next->width;
+      if (next->value_mask & CWHeight)      e->height       = next->height;
+      if (next->value_mask & CWBorderWidth) e->border_width = next->border_width;
+
+      /* Stacking is one request, a newer stack mode without a sibling
+       * mustn't pick up an older request's sibling. */
+      if (next->value_mask & CWStackMode)
+	{
+	  e->detail      = next->detail;
+	  e->above       = next->above;
+	  e->value_mask &= ~CWSibling;
+	}
+      else if (next->value_mask & CWSibling)
+	e->above = next->above;
+
+      e->value_mask |= next->value_mask;
+
+      w->n_configure_requests++;
+      w->n_configure_merged++;
+    }
+}
+
+void
+wm_handle_configure_request (Wm *w, XConfigureRequestEvent *e )
+{
+  w->n_configure_requests++;
+
+  wm_configure_request_coalesce(w, e);
+
+  if (wm_configure_request_process(w, e))
+    w->n_configure_applied++;
+
+  dbg("%s() requests %lu merged %lu applied %lu\n", __func__,
+      w->n_configure_requests, w->n_configure_merged, 
+      w->n_configure_applied);
+
+  w->configure_stats_dirty = True;
+}
+
+void
+wm_handle_map_request(Wm *w, XMapRequestEvent *e)
+{
+   Client *c = wm_find_client(w, e->window, WINDOW);
+
+   if (!c) {
+      wm_make_new_client(w, e->window);
+   } else {
+      dbg("%s() Honoring map request for %s\n", __func__, c->name);
+      wm_activate_client(c);
+   }
+}
+
+void
+wm_handle_unmap_event(Wm *w, XUnmapEvent *e)
+{
+   Client *c = wm_find_client(w, e->window, WINDOW);
+
+   if (!c) return;
+
+   dbg("%s() for client %s\n", __func__, c->name);
+
+   if (c->ignore_unmap)
+     {
+       c->ignore_unmap--;
+       dbg("%s() ignoring .. \n", __func__ );
+     }
    else
      {
        if (!c->mapped) return; 	/* TODO: Check this */
@@ -1714,182 +2294,163 @@ wm_handle_destroy_event(Wm *w, XDestroyWindowEvent *e)
     wm_remove_client(w, c);
 }
 
-void
-wm_handle_client_message(Wm *w, XClientMessageEvent *e)
+static void
+wm_handle_mb_command_message(Wm *w, XClientMessageEvent *e)
 {
-   Client *c = wm_find_client(w, e->window, WINDOW);
-
-   dbg("%s() messgae type is %li\n", __func__, e->message_type);
-
-   /* Handle messages from mbcontrol */
-   if (e->message_type == w->atoms[MB_COMMAND])
-     {				
-       dbg("%s() mb command requested %li\n", __func__, e->data.l[0] );
-       switch (e->data.l[0])
-	 {
+  /* Handle messages from mbcontrol */
+  dbg("%s() mb command requested %li\n", __func__, e->data.l[0] );
+  switch (e->data.l[0])
+    {
 #ifndef STANDALONE
-	 case MB_CMD_SET_THEME :
-	   {
-	     Atom          realType;
-	     unsigned long n;
-	     unsigned long extra;
-	     int           format;
-	     int           status;
-	     char         *value = NULL;
-
-	     dbg("%s() atempting to switch theme\n", __func__ );
-
-	     status = XGetWindowProperty(w->dpy, w->root,
-					 w->atoms[_MB_THEME], 0L, 512L, False,
-					 AnyPropertyType, &realType,
-					 &format, &n, &extra,
-					 (unsigned char **) &value);
+    case MB_CMD_SET_THEME :
+      {
+	Atom          realType;
+	unsigned long n;
+	unsigned long extra;
+	int           format;
+	int           status;
+	char         *value = NULL;
+
+	dbg("%s() atempting to switch theme\n", __func__ );
+
+	status = XGetWindowProperty(w->dpy, w->root,
+				    w->atoms[_MB_THEME], 0L, 512L, False,
+				    AnyPropertyType, &realType,
+				    &format, &n, &extra,
+				    (unsigned char **) &value);
 	     
-	     if (status == Success && value != NULL)
-	       {
-		 dbg("%s() switching theme to %s\n", __func__, value);
-		 mbtheme_switch(w, value);
-	       }
+	if (status == Success && value != NULL)
+	  {
+	    dbg("%s() switching theme to %s\n", __func__, value);
+	    mbtheme_switch(w, value);
+	  }
 
-	     if (value) 
-	       XFree(value);
+	if (value) 
+	  XFree(value);
 
-	     return;
-	   }
+	return;
+      }
 #endif
-	 case MB_CMD_EXIT      :
-	   exit(0);
-	 case MB_CMD_NEXT      :
-	   wm_activate_client(stack_cycle_backward(w, MBCLIENT_TYPE_APP));
-	   break;
-	 case MB_CMD_PREV      :
-	   wm_activate_client(stack_cycle_forward(w, MBCLIENT_TYPE_APP));
-	   break;
-	 case MB_CMD_DESKTOP   :
-	   wm_toggle_desktop(w);
-	   break;
-	 case MB_CMD_MISC:  /* This is used for random testing stuff */
-	   /* comp_engine_deinit(w); */
+    default:
+      wm_mb_command(w, e->data.l[0]);
+      break;
+    }
+}
+
+/* Runs a _MB_COMMAND, also used by the control socket */
+void
+wm_mb_command(Wm *w, int cmd)
+{
+  switch (cmd)
+    {
+    case MB_CMD_EXIT      :
+      exit(0);
+    case MB_CMD_NEXT      :
+      wm_activate_client(stack_cycle_backward(w, MBCLIENT_TYPE_APP));
+      break;
+    case MB_CMD_PREV      :
+      wm_activate_client(stack_cycle_forward(w, MBCLIENT_TYPE_APP));
+      break;
+    case MB_CMD_DESKTOP   :
+      wm_toggle_desktop(w);
+      break;
+    case MB_CMD_MISC:  /* This is used for random testing stuff */
+      /* comp_engine_deinit(w); */
 #ifdef DEBUG
-	   /* comp_engine_time(w); Not used atm XXX DO_TIMINGS */
-	   dbg("*** Toggling composite visual debugging ***\n");
-	   w->flags ^= DEBUG_COMPOSITE_VISIBLE_FLAG;
+      /* comp_engine_time(w); Not used atm XXX DO_TIMINGS */
+      dbg("*** Toggling composite visual debugging ***\n");
+      w->flags ^= DEBUG_COMPOSITE_VISIBLE_FLAG;
 #endif
-	   break;
+      break;
 #ifndef NO_KBD
-	 case MB_CMB_KEYS_RELOAD:
-	   keys_reinit(w); 
-	   break;
+    case MB_CMB_KEYS_RELOAD:
+      keys_reinit(w); 
+      break;
 #endif
 
 #ifdef USE_COMPOSITE
-	 case MB_CMD_COMPOSITE:
-	   if (w->comp_engine_disabled)
-	     comp_engine_reinit(w);
-	   else
-	     comp_engine_deinit(w);
-	   break;
+    case MB_CMD_COMPOSITE:
+      if (w->comp_engine_disabled)
+	comp_engine_reinit(w);
+      else
+	comp_engine_deinit(w);
+      break;
 #endif
-	 }
-       return;
-     }
-	
-   if (e->message_type == w->atoms[WM_CHANGE_STATE])
-     {
-       dbg("%s() messagae type is change state\n", __func__ );
-       if (c && e->format == 32 && e->data.l[0] == IconicState)
-	 {
-	   c->iconize(c);
-	 }
-       return;
-     }
+    case MB_CMD_STATS:
+      {
+	char buf[LATENCY_STATS_MAX];
 
-   /* Also handle any EWMH messages */
-   ewmh_handle_root_message(w, e);   
+	latency_stats_describe(buf, sizeof(buf));
+	XChangeProperty(w->dpy, w->root, w->atoms[_MB_LATENCY_STATS],
+			XA_STRING, 8, PropModeReplace,
+			(unsigned char *)buf, strlen(buf));
+      }
+      break;
+    case MB_CMD_STATS_RESET:
+      latency_reset();
+      break;
+    }
 }
 
-
-void
-wm_handle_property_change(Wm *w, XPropertyEvent *e)
+static void
+wm_handle_change_state_message(Wm *w, XClientMessageEvent *e)
 {
-  Bool update_titlebar = False;
-
   Client *c = wm_find_client(w, e->window, WINDOW);
 
-  if (!c) return; 
+  dbg("%s() messagae type is change state\n", __func__ );
+  if (c && e->format == 32 && e->data.l[0] == IconicState)
+    {
+      c->iconize(c);
+    }
+}
 
-  if (c->type == MBCLIENT_TYPE_OVERRIDE) return;
+void
+wm_handle_client_message(Wm *w, XClientMessageEvent *e)
+{
+   MBAtomHandler *handler;
 
-#ifdef DEBUG
- {
-   char *atomname = XGetAtomName(w->dpy, e->atom);
+   dbg("%s() messgae type is %li\n", __func__, e->message_type);
 
-   dbg("%s() on %s, atom is %li ( %s )\n", 
-       __func__, c->name, e->atom, atomname );
+   handler = ewmh_atom_handler_lookup(w, e->message_type);
 
-   if (atomname) free(atomname);
- }
-#endif   
+   if (handler && handler->message)
+     handler->message(w, e);
+}
 
-  /* Window Name changes */
-  if (e->atom == XA_WM_NAME && !c->name_is_utf8)
-    {
-      if (c->name) XFree(c->name);
+/* 
+ * Title changes. Some apps ( download managers, build monitors.. ) put
+ * progress in their title and change it many times a second. Each
+ * repaint means re-measuring and uploading the titlebar, so changes to
+ * unfocused clients are coalesced and only the latest is painted, at
+ * most every title_update_interval msecs. The focused client is always
+ * painted straight away.
+*/
 
-      misc_trap_xerrors(); 
+static void
+wm_title_update_apply(Wm *w, Client *c)
+{
+  Atom atom = c->title_pending;
 
-      XFetchName(w->dpy, c->window, (char **)&c->name);
+  c->title_pending = None;
+  w->n_title_pending--;
 
-      if (!misc_untrap_xerrors())
-	{
-	  base_client_process_name(c);
-	  dbg("%s() XA_WM_NAME change, name is %s\n", __func__, c->name);
-	  update_titlebar = True;
-	}
-    }
-  else if (e->atom == w->atoms[WM_TRANSIENT_FOR])
+  if (atom == XA_WM_NAME)
     {
-      Client *new_trans_client;
-      Window  trans_win = 0;
-      int     success = 0;
+      if (c->name_is_utf8)
+	return;
 
-      dbg("%s() got a tranciency change\n", __func__);
+      if (c->name) XFree(c->name);
 
       misc_trap_xerrors(); 
 
-      success = XGetTransientForHint(w->dpy, c->window, &trans_win);
-
-      if (!misc_untrap_xerrors() && success)
-	if ((new_trans_client = wm_find_client(w, trans_win, WINDOW)) != NULL)
-	  {
-	    Client *p = new_trans_client;
-
-	    dbg("%s() <%s> changing trans", __func__, new_trans_client->name);
-
-	    /* Dont let clients be change transiency to themselves
-             * either directly or recursively.
-	    */
-	    while (p != NULL)
-	      {
-		if (p == c)
-		  {
-		    dbg("%s() CLIENT WARNING: %s ( %li ) transient for self\n",
-			__func__, c->name, c->window);
-		    c->trans = NULL;
-		    return; 
-		  }
-		p = p->trans;
-	      }
-
-	    c->trans = new_trans_client;
-
-	    return;
-	  }
+      XFetchName(w->dpy, c->window, (char **)&c->name);
 
-      c->trans = NULL;
+      if (misc_untrap_xerrors())
+	return;
 
+      dbg("%s() XA_WM_NAME change, name is %s\n", __func__, c->name);
     }
-  else if (e->atom == w->atoms[_NET_WM_NAME])
+  else
     {
       if (c->name) 
 	{
@@ -1899,7 +2460,8 @@ wm_handle_property_change(Wm *w, XPropertyEvent *e)
 
       misc_trap_xerrors(); 	/* avoid possible X Errors */
 
-      c->name = (char*)ewmh_get_utf8_prop(w, c->window, w->atoms[_NET_WM_NAME]);
+      c->name = (char*)ewmh_get_utf8_prop(w, c->window, 
+					  w->atoms[_NET_WM_NAME]);
       misc_untrap_xerrors();
 
       if (c->name)
@@ -1910,47 +2472,267 @@ wm_handle_property_change(Wm *w, XPropertyEvent *e)
 	  XFetchName(w->dpy, c->window, (char **)&c->name);
 	}
 
-      base_client_process_name(c);
       dbg("%s() NET_WM_NAME change, name is %s\n", __func__, c->name);
-      update_titlebar = True;
     }
-  else  if (e->atom == w->atoms[WM_PROTOCOLS])
-    {
-      int orig_flags = c->flags;
 
-      dbg("%s() WM_PROTOCOLS changed, flags %i\n", __func__, orig_flags);
+  base_client_process_name(c);
+  c->redraw(c, False);
 
-      client_get_wm_protocols(c);
+  if (c->type == MBCLIENT_TYPE_APP || c->type == MBCLIENT_TYPE_DESKTOP)
+    theme_frame_menu_invalidate(w->mbtheme);
 
-      dbg("%s() WM_PROTOCOLS changed, flags now %li\n", __func__, c->flags);
+  c->title_paint_usec = misc_get_time_usec();
+  c->title_n_repaints++;
+  w->title_n_repaints++;
+  w->title_stats_dirty = True;
+}
 
-      /* If flags have changed, likely means a WM_CONTEXT_HELP|etc has changed 
-       * and thus titlebar needs a repaint.
-      */
-      if (c->flags != orig_flags)
-	{
-	  dbg("%s() WM_PROTOCOLS changed flags, repainting\n", __func__);
+static void
+wm_title_update_queue(Wm *w, Client *c, Atom atom)
+{
+  long long interval = (long long)w->config->title_update_interval * 1000;
 
-	  /* Buttons will get recreated on demand via repaint */
-	  client_buttons_delete_all(c);
-	  update_titlebar = True;
-	}
-    }
-  else  if (e->atom == w->atoms[WM_CHANGE_STATE])
+  if (atom == XA_WM_NAME && c->name_is_utf8)
+    return;
+
+  c->title_n_updates++;
+  w->title_n_updates++;
+  w->title_stats_dirty = True;
+
+  /* _NET_WM_NAME falls back to WM_NAME so always wins */
+  if (c->title_pending == None)
     {
-      dbg("%s() state change, name is %s\n", __func__, c->name);
-      if(client_get_state(c) == WithdrawnState)
+      c->title_pending = atom;
+      w->n_title_pending++;
+    }
+  else if (atom == w->atoms[_NET_WM_NAME])
+    c->title_pending = atom;
+
+  if (c == w->focused_client
+      || misc_get_time_usec() - c->title_paint_usec >= interval)
+    wm_title_update_apply(w, c);
+}
+
+/* Paints any coalesced titles now due, called every event loop pass */
+void
+wm_title_update_check(Wm *w)
+{
+  long long now, interval;
+  Client   *c;
+
+  now      = misc_get_time_usec();
+  interval = (long long)w->config->title_update_interval * 1000;
+
+  if (w->n_title_pending && !stack_empty(w))
+    stack_enumerate(w,c)
+      if (c->title_pending != None
+	  && (c == w->focused_client
+	      || now - c->title_paint_usec >= interval))
+	wm_title_update_apply(w, c);
+}
+
+/* Shortens the select() timeout to when the next title is due */
+void
+wm_title_update_get_timeout(Wm *w, struct timeval *tv)
+{
+  long long now, interval, due, wait = 0;
+  Bool      pending = False;
+  Client   *c;
+
+  now      = misc_get_time_usec();
+  interval = (long long)w->config->title_update_interval * 1000;
+
+  if (w->n_title_pending && !stack_empty(w))
+    stack_enumerate(w,c)
+      if (c->title_pending != None)
 	{
-	  wm_remove_client(w, c);
+	  due = c->title_paint_usec + interval - now;
+	  if (!pending || due < wait)
+	    wait = due;
+	  pending = True;
 	}
+
+  if (pending)
+    misc_timeout_shorten(tv, wait);
+}
+
+/* Window Name changes */
+static void
+wm_handle_wm_name_change(Wm *w, Client *c, XPropertyEvent *e)
+{
+  wm_title_update_queue(w, c, XA_WM_NAME);
+}
+
+static void
+wm_handle_transient_for_change(Wm *w, Client *c, XPropertyEvent *e)
+{
+  Client *new_trans_client;
+  Window  trans_win = 0;
+  int     success = 0;
+
+  dbg("%s() got a tranciency change\n", __func__);
+
+  misc_trap_xerrors(); 
+
+  success = XGetTransientForHint(w->dpy, c->window, &trans_win);
+
+  if (!misc_untrap_xerrors() && success)
+    if ((new_trans_client = wm_find_client(w, trans_win, WINDOW)) != NULL)
+      {
+	Client *p = new_trans_client;
+
+	dbg("%s() <%s> changing trans", __func__, new_trans_client->name);
+
+	/* Dont let clients be change transiency to themselves
+	 * either directly or recursively.
+	*/
+	while (p != NULL)
+	  {
+	    if (p == c)
+	      {
+		dbg("%s() CLIENT WARNING: %s ( %li ) transient for self\n",
+		    __func__, c->name, c->window);
+		client_set_transient_for(c, NULL);
+		return; 
+	      }
+	    p = p->trans;
+	  }
+
+	client_set_transient_for(c, new_trans_client);
+
+	return;
+      }
+
+  client_set_transient_for(c, NULL);
+}
+
+static void
+wm_handle_net_wm_name_change(Wm *w, Client *c, XPropertyEvent *e)
+{
+  wm_title_update_queue(w, c, w->atoms[_NET_WM_NAME]);
+}
+
+static void
+wm_handle_wm_protocols_change(Wm *w, Client *c, XPropertyEvent *e)
+{
+  int orig_flags = c->flags;
+
+  dbg("%s() WM_PROTOCOLS changed, flags %i\n", __func__, orig_flags);
+
+  client_get_wm_protocols(c);
+
+  dbg("%s() WM_PROTOCOLS changed, flags now %li\n", __func__, c->flags);
+
+  /* If flags have changed, likely means a WM_CONTEXT_HELP|etc has changed 
+   * and thus titlebar needs a repaint.
+  */
+  if (c->flags != orig_flags)
+    {
+      dbg("%s() WM_PROTOCOLS changed flags, repainting\n", __func__);
+
+      /* Buttons will get recreated on demand via repaint */
+      client_buttons_delete_all(c);
+      c->redraw(c, False);
     }
-  else if (e->atom == w->atoms[CM_TRANSLUCENCY])
+}
+
+static void
+wm_handle_change_state_change(Wm *w, Client *c, XPropertyEvent *e)
+{
+  dbg("%s() state change, name is %s\n", __func__, c->name);
+  if(client_get_state(c) == WithdrawnState)
     {
-      comp_engine_client_get_trans_prop(w, c);
-      comp_engine_client_repair(w, c);
+      wm_remove_client(w, c);
     }
-  
-  if (update_titlebar)  c->redraw(c, False);
+}
+
+#ifndef STANDALONE
+/* Only place icons get refetched, they're shared and cached otherwise */
+static void
+wm_handle_net_wm_icon_change(Wm *w, Client *c, XPropertyEvent *e)
+{
+  struct MBIcon *icon;
+
+  /* Lookup before unref, so an unchanged icon keeps its scaled images */
+  icon = icon_cache_get_for_window(w, c->window);
+
+  if (c->icon_rgba) 
+    icon_cache_unref(w, c->icon_rgba);
+
+  c->icon_rgba = icon;
+
+  c->redraw(c, False);
+
+  theme_frame_menu_invalidate(w->mbtheme);
+}
+#endif
+
+static void
+wm_handle_translucency_change(Wm *w, Client *c, XPropertyEvent *e)
+{
+  comp_engine_client_get_trans_prop(w, c);
+  comp_engine_client_repair(w, c);
+}
+
+void
+wm_handle_property_change(Wm *w, XPropertyEvent *e)
+{
+  MBAtomHandler *handler;
+  Client        *c;
+
+  /* Most property changes are of no interest to us, so throw
+   * them away before going looking for the client.
+  */
+  handler = ewmh_atom_handler_lookup(w, e->atom);
+
+  if (handler == NULL || handler->property == NULL)
+    return;
+
+  c = wm_find_client(w, e->window, WINDOW);
+
+  if (!c) return; 
+
+  if (c->type == MBCLIENT_TYPE_OVERRIDE) return;
+
+#ifdef DEBUG
+ {
+   char *atomname = XGetAtomName(w->dpy, e->atom);
+
+   dbg("%s() on %s, atom is %li ( %s )\n", 
+       __func__, c->name, e->atom, atomname );
+
+   if (atomname) free(atomname);
+ }
+#endif   
+
+  handler->property(w, c, e);
+}
+
+/* Hook up the WM's own property and message handlers */
+static void
+wm_atom_handlers_init(Wm *w)
+{
+  ewmh_set_message_handler(w, w->atoms[MB_COMMAND],
+			   wm_handle_mb_command_message);
+  ewmh_set_message_handler(w, w->atoms[WM_CHANGE_STATE],
+			   wm_handle_change_state_message);
+
+  ewmh_set_property_handler(w, XA_WM_NAME, 
+			    wm_handle_wm_name_change);
+  ewmh_set_property_handler(w, w->atoms[WM_TRANSIENT_FOR], 
+			    wm_handle_transient_for_change);
+  ewmh_set_property_handler(w, w->atoms[_NET_WM_NAME], 
+			    wm_handle_net_wm_name_change);
+  ewmh_set_property_handler(w, w->atoms[WM_PROTOCOLS], 
+			    wm_handle_wm_protocols_change);
+  ewmh_set_property_handler(w, w->atoms[WM_CHANGE_STATE], 
+			    wm_handle_change_state_change);
+  ewmh_set_property_handler(w, w->atoms[CM_TRANSLUCENCY], 
+			    wm_handle_translucency_change);
+#ifndef STANDALONE
+  ewmh_set_property_handler(w, w->atoms[_NET_WM_ICON], 
+			    wm_handle_net_wm_icon_change);
+#endif
 }
 
 /* If configured force a app window be treated as a dialog */
@@ -2135,7 +2917,7 @@ wm_make_new_client(Wm *w, Window win)
 	  c = dialog_client_new(w, win, t);
 	}
       else if (c->type == MBCLIENT_TYPE_DIALOG) /* already exists, update  */
-	c->trans = t;  		/* TODO: what about other types 
+	client_set_transient_for(c, t); /* TODO: what about other types 
 				         being transient for things ?*/
 
       /* Make sure above state is inherited if parent has it */
@@ -2279,19 +3061,16 @@ wm_remove_client(Wm *w, Client *c)
   XUngrabServer(w->dpy);
 }
 
-/* wm_update_layout() is called in the presence of a panel/toolbar
- * changing its size / appearing. It re-layouts all windows for it
- * to fit. 
+/* Geometry pass of wm_update_layout(), only works out where everything
+ * goes. Nothing is sent to the server until wm_layout_apply().
  */
-void
-wm_update_layout(Wm         *w, 
-		 Client     *client_changed, 
-		 signed int  change_amount) /* XXX Change to relayout */
+static void
+wm_layout_compute(Wm         *w, 
+		  Client     *client_changed, 
+		  signed int  change_amount)
 {
  Client *p = NULL;
 
- XGrabServer(w->dpy);
-
  stack_enumerate(w,p)
    {
      if (p == client_changed)
@@ -2311,12 +3090,7 @@ wm_update_layout(Wm         *w,
 		   break;
 		 p->width += change_amount;
 		 p->x     -= change_amount;
-		 p->move_resize(p);
-		 theme_img_cache_clear( w->mbtheme, FRAME_MAIN );
-		 client_deliver_config(p);
-		 client_buttons_delete_all(p);
-		 theme_pixmap_cache_clear_all(w->mbtheme);
-		 main_client_redraw(p, False); /* force title redraw */
+		 p->layout_pending |= LAYOUT_REDECORATE; /* width changed */
 		 break;
 	       case MBCLIENT_TYPE_TOOLBAR :
 	       case MBCLIENT_TYPE_PANEL    :
@@ -2343,8 +3117,6 @@ wm_update_layout(Wm         *w,
 		     p->x     -= change_amount;
 		   }
 
-		 p->move_resize(p);
-		 client_deliver_config(p);
 
 	       default:
 		 break;
@@ -2362,12 +3134,7 @@ wm_update_layout(Wm         *w,
 		 if (p->flags & CLIENT_FULLSCREEN_FLAG)
 		   break;
 		 p->width += change_amount;
-		 p->move_resize(p);
-		 client_deliver_config(p);
-		 theme_img_cache_clear( w->mbtheme, FRAME_MAIN );
-		 theme_pixmap_cache_clear_all(w->mbtheme);
-		 client_buttons_delete_all(p);
-		 main_client_redraw(p, False); /* force title redraw */
+		 p->layout_pending |= LAYOUT_REDECORATE; /* width changed */
 		 break;
 	       case MBCLIENT_TYPE_TOOLBAR :
 	       case MBCLIENT_TYPE_PANEL   :
@@ -2398,8 +3165,6 @@ wm_update_layout(Wm         *w,
 		   {
 		     p->width += change_amount;
 		   }
-		 p->move_resize(p);
-		 client_deliver_config(p);
 
 	       default:
 		 break;
@@ -2418,7 +3183,6 @@ wm_update_layout(Wm         *w,
 		   break;
 		 p->height += change_amount;
 		 p->y      -= change_amount;
-		 p->move_resize(p);
 		 /* XXX shouldn't be any need to redraw here as 
                   * width won't have changed so no need to repaint 
                   * entire toolbar. 
@@ -2432,15 +3196,12 @@ wm_update_layout(Wm         *w,
 		  * theme_pixmap_cache_clear_all(w->mbtheme);
 		  * main_client_redraw(p, False);
 		 */
-		 client_deliver_config(p);
 		 break;
 	       case MBCLIENT_TYPE_PANEL :
 		 if (p->flags & CLIENT_DOCK_NORTH
 		     || p->flags & CLIENT_DOCK_TITLEBAR)
 		   {
 		     p->y -= change_amount;
-		     p->move_resize(p);
-		     client_deliver_config(p);
 		   }
 		 break;
 	       default:
@@ -2466,7 +3227,6 @@ wm_update_layout(Wm         *w,
 		     && client_changed->type == MBCLIENT_TYPE_PANEL)
 		   break;
 		 p->height += change_amount;
-		 p->move_resize(p);
 		 /*
 		  * See above as to why this is commented out.
                   *
@@ -2474,19 +3234,14 @@ wm_update_layout(Wm         *w,
 		  * theme_pixmap_cache_clear_all(w->mbtheme);
 		  * main_client_redraw(p, False);
                   */
-		 client_deliver_config(p);
 		 break;
 	       case MBCLIENT_TYPE_TOOLBAR :
 		 p->y += change_amount;
-		 p->move_resize(p);
-		 client_deliver_config(p);
 		 break;
 	       case MBCLIENT_TYPE_PANEL :
 		 if (p->flags & CLIENT_DOCK_SOUTH)
 		   {
 		     p->y += change_amount;
-		     p->move_resize(p);
-		     client_deliver_config(p);
 		   }
 		 break;
 	       case MBCLIENT_TYPE_DIALOG :
@@ -2516,8 +3271,6 @@ wm_update_layout(Wm         *w,
 	                   |CLIENT_TB_ALT_TRANS_FOR_APP))
 	   {
 	     p->configure(p);
-	     p->move_resize(p);
-	     client_deliver_config(p);
 	     continue;
 	   }
 #else
@@ -2536,17 +3289,81 @@ wm_update_layout(Wm         *w,
 	     || force_height)
 	   {
 	     p->x = req_x; p->y = req_y; p->width = req_w; p->height = req_h;
-	     p->move_resize(p);
-	     client_deliver_config(p);
 	   }
        }
    }
+}
+
+/* Apply pass of wm_update_layout(), one configure per client that 
+ * actually moved and one repaint per decoration that needs it.
+ */
+static void
+wm_layout_apply(Wm *w)
+{
+ Client *p = NULL;
+ Bool    redecorate = False;
+
+ stack_enumerate(w, p)
+   if (p->layout_pending & LAYOUT_REDECORATE)
+     redecorate = True;
+
+ /* Cached frame images are for the old size, clear them just the once */
+ if (redecorate)
+   {
+     theme_img_cache_clear( w->mbtheme, FRAME_MAIN );
+     theme_pixmap_cache_clear_all(w->mbtheme);
+   }
+
+ stack_enumerate(w, p)
+   {
+     if (p->x != p->layout_x || p->y != p->layout_y
+	 || p->width != p->layout_width || p->height != p->layout_height)
+       {
+	 p->move_resize(p);
+	 client_deliver_config(p);
+       }
+
+     if (p->layout_pending & LAYOUT_REDECORATE)
+       {
+	 client_buttons_delete_all(p);
+	 main_client_redraw(p, False); /* force title redraw */
+       }
+
+     p->layout_pending = 0;
+   }
+}
+
+/* wm_update_layout() is called in the presence of a panel/toolbar
+ * changing its size / appearing. It re-layouts all windows for it
+ * to fit. 
+ */
+void
+wm_update_layout(Wm         *w, 
+		 Client     *client_changed, 
+		 signed int  change_amount) /* XXX Change to relayout */
+{
+ Client *p = NULL;
+
+ /* Remember where everything was, so only real changes get applied */
+ stack_enumerate(w, p)
+   {
+     p->layout_x       = p->x;
+     p->layout_y       = p->y;
+     p->layout_width   = p->width;
+     p->layout_height  = p->height;
+     p->layout_pending = 0;
+   }
+
+ wm_layout_compute(w, client_changed, change_amount);
+
+ XGrabServer(w->dpy);
+
+ wm_layout_apply(w);
 
  ewmh_update_rects(w);
 
  XSync(w->dpy, False);
  XUngrabServer(w->dpy);
-
 }
 
 
@@ -3028,6 +3845,13 @@ wm_get_desktop(Wm *w)
 #define XSET_CURSOR_THEME_NAME 6
 #define XSET_CURSOR_THEME_SIZE 7
 
+static void
+wm_xsettings_handle_event (Wm *w, XEvent *ev)
+{
+  if (w->xsettings_client != NULL)
+    xsettings_client_process_event(w->xsettings_client, ev);
+}
+
 static void
 wm_xsettings_notify_cb (const char       *name,
 			XSettingsAction   action,
@@ -3361,6 +4185,12 @@ wm_sn_cycle_update_xid(Wm *w, const char *bin_name, Window xid)
   wm_sn_cycle_update_root_prop(w);
 }
 
+static void
+wm_sn_handle_event (Wm *w, XEvent *ev)
+{
+  sn_display_process_event (w->sn_display, ev);
+}
+
 static void 
 wm_sn_monitor_event_func (SnMonitorEvent *event,
 			  void            *user_data)
@@ -34,6 +34,10 @@
 #include "ewmh.h"
 #include "composite-engine.h"
 #include "session.h"
+#include "pool.h"
+#include "trace.h"
+#include "latency.h"
+#include "control.h"
 
 #ifdef STANDALONE
 #include "mbtheme-standalone.h"
@@ -67,6 +71,15 @@ wm_load_config(Wm *w, int *argc, char *argv[]);
 void 
 wm_init_existing(Wm *w);
 
+void
+wm_startup_phase_start(Wm *w, int phase);
+
+void
+wm_startup_phase_end(Wm *w, int phase);
+
+void
+wm_startup_report(Wm *w);
+
 /* events */
 void 
 wm_event_loop(Wm* w);
@@ -101,6 +114,19 @@ wm_handle_client_message(Wm *w, XClientMessageEvent *e);
 void 
 wm_handle_property_change(Wm *w, XPropertyEvent *e);
 
+void
+wm_title_update_check(Wm *w);
+
+void
+wm_title_update_get_timeout(Wm *w, struct timeval *tv);
+
+void
+wm_event_handler_add (Wm                 *w,
+		      int                 type,
+		      Window              win,
+		      const char         *name,
+		      MBEventHandlerFunc  func);
+
 void 
 wm_handle_enter_notify(Wm *w, XEnterWindowEvent *e);
 
@@ -138,6 +164,9 @@ wm_get_visible_main_client(Wm *w);
 void 
 wm_toggle_desktop(Wm *w);
 
+void 			/* cmd is a MB_CMD_*, bar MB_CMD_SET_THEME */
+wm_mb_command(Wm *w, int cmd);
+
 Client 
 *wm_get_desktop(Wm *w);
 
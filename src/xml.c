@@ -1,4 +1,4 @@
-/* 
+/*
  *  Matchbox Window Manager - A lightweight window manager not for the
  *                            desktop.
  *
@@ -19,163 +19,177 @@
  */
 
 /*
- *  xml.c provides a very simple DOM for an xml file.  
- *  It can use expat or slightly limited ( no cdata, utf8 ) 
+ *  xml.c provides a very simple DOM for an xml file.
+ *  It can use expat or slightly limited ( no entities, utf8 )
  *  internal parser.
  *
- *  This isn't used by a standalone matchbox. 
+ *  Everything hanging off a parsed document is carved out of a single
+ *  arena owned by the parser. The internal parser copies the document
+ *  into the arena once and then slices tag, key and value strings
+ *  out of that copy in place, so parsing does no per string
+ *  allocation and freeing is just dropping a handful of chunks.
+ *
+ *  This isn't used by a standalone matchbox.
  */
 
 #define _GNU_SOURCE
 
 #include "xml.h"
 
-#ifdef USE_EXPAT
-static void 
-node_start_cb(void *data, const char *tag, const char **expat_attr);
-#else
-static void node_start_cb( XMLParser *parser, const char *tag, Params *attr);
-#endif
+#define ARENA_CHUNK_SIZE  (16 * 1024)
+#define ARENA_ALIGN       (2 * sizeof(void *))
 
-#ifdef USE_EXPAT
-static void node_end_cb(void *data, const char *tag);
-#else
-static void node_end_cb( XMLParser *parser, const char *tag );
+typedef struct _xml_arena_chunk {
+   struct _xml_arena_chunk *next;
+   size_t                   size;
+   size_t                   used;
+} XMLArenaChunk;
 
-static char *parse(XMLParser *parser, char *doc);
+struct _xml_arena {
+   XMLArenaChunk *chunks;
+};
 
-static void node_cdata_cb( XMLParser *parser, char *cdata);
+#define CHUNK_HDR_SIZE \
+   ((sizeof(XMLArenaChunk) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
 
-#endif
+static XMLArena*
+arena_new(void)
+{
+   XMLArena *arena = (XMLArena *)malloc(sizeof(XMLArena));
+   arena->chunks = NULL;
+   return arena;
+}
+
+static void*
+arena_alloc(XMLArena *arena, size_t len)
+{
+   XMLArenaChunk *chunk = arena->chunks;
+   void          *mem;
+
+   len = (len + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
 
-static char* load_file(const char* filename);
+   if (chunk == NULL || chunk->size - chunk->used < len)
+     {
+       size_t size = (len > ARENA_CHUNK_SIZE) ? len : ARENA_CHUNK_SIZE;
 
-static void _params_free(Params *params);
+       if ((chunk = (XMLArenaChunk *)malloc(CHUNK_HDR_SIZE + size)) == NULL)
+	 {
+	   fprintf(stderr, "Matchbox: Couldn't allocate memory for XML parser\n");
+	   exit(-1);
+	 }
 
-static Params *_params_clone(Params *params);
+       chunk->size = size;
+       chunk->used = 0;
 
-static void _xml_parser_free(XMLNode *node);
+       /* Keep a partly used chunk current if the new one is a one off
+        * oversized allocation ( like the document itself ).
+	*/
+       if (size > ARENA_CHUNK_SIZE && arena->chunks != NULL)
+	 {
+	   chunk->next = arena->chunks->next;
+	   arena->chunks->next = chunk;
+	 }
+       else
+	 {
+	   chunk->next = arena->chunks;
+	   arena->chunks = chunk;
+	 }
+     }
 
-static Nlist *list_add_node(XMLNode *dest, XMLNode *new);
+   mem = (char *)chunk + CHUNK_HDR_SIZE + chunk->used;
+   chunk->used += len;
 
-#ifndef DEBUG
-static jmp_buf Jbuf;
-#endif
+   return mem;
+}
 
-Params*
-attr_to_params(const char **attr)
+static char*
+arena_strdup(XMLArena *arena, const char *str)
 {
-  Params *p = NULL, *q = NULL;
-  if (attr != NULL && attr[0] != NULL)
-    {
-      int i = 0;
-      p = q = xml_params_new();
-      while(attr[i] && attr[i+1])
-	{
-	  q->key = strdup(attr[i]);
-	  q->value = strdup(attr[i+1]);
-	  if (attr[i+2])
-	    {
-	      q->next = xml_params_new();
-	      q = q->next;
-	    }
-	  i += 2;
-	}
-      return p;
-    } else {
-      return NULL;
-    }
+   size_t len = strlen(str) + 1;
+   char  *dup = (char *)arena_alloc(arena, len);
+
+   memcpy(dup, str, len);
+   return dup;
 }
-     
-Nlist *list_add_node(XMLNode *dest, XMLNode *new)
+
+static void
+arena_free(XMLArena *arena)
 {
-   Nlist *tmp;
+   XMLArenaChunk *chunk = arena->chunks, *next;
 
-   if (dest->kids == NULL)
-     {
-       dest->kids = (Nlist *)malloc(sizeof(Nlist));
-       tmp = dest->kids;
-     } 
-   else 
+   while (chunk != NULL)
      {
-       for(tmp = dest->kids; tmp->next != NULL; tmp = tmp->next);
-       tmp->next = (Nlist *)malloc(sizeof(Nlist));
-       tmp = tmp->next;
+       next = chunk->next;
+       free(chunk);
+       chunk = next;
      }
 
-   tmp->next = NULL;
-   tmp->data = new;
-   return tmp;
+   free(arena);
 }
 
-XMLNode *xml_node_new(const char *name, Params *attr)
+static XMLNode*
+node_new(XMLParser *parser, char *tag)
 {
-   XMLNode *n = (XMLNode *)malloc(sizeof(XMLNode));
-   memset(n, 0, sizeof(XMLNode));
+   XMLNode *node = (XMLNode *)arena_alloc(parser->arena, sizeof(XMLNode));
 
-   n->tag    = strdup(name);
-   n->attr   = _params_clone(attr);
+   memset(node, 0, sizeof(XMLNode));
+   node->tag = tag;
 
-   return n;
+   return node;
 }
 
-#ifdef USE_EXPAT
-static void 
-node_start_cb(void *data, const char *tag, const char **expat_attr)
+static Params*
+node_add_attr(XMLParser *parser, XMLNode *node, Params *tail,
+	      char *key, char *value)
 {
-  XMLParser *parser = (XMLParser *)data;
-  Params *attr = attr_to_params(expat_attr);
+   Params *p = (Params *)arena_alloc(parser->arena, sizeof(Params));
 
-#else
-static void 
-node_start_cb( XMLParser *parser, const char *tag, Params *attr)
-{
-#endif
-  if (parser->root_node == NULL)
-    {
-      parser->root_node = xml_node_new(tag, attr);
-      parser->_current_node = parser->root_node;
-    } 
-  else 
-    {
-      Nlist *tmp;
-      tmp = list_add_node(parser->_current_node, xml_node_new(tag, attr));
-      tmp->data->parent = parser->_current_node;
-      parser->_current_node = tmp->data; 
-    }
+   p->key   = key;
+   p->value = value;
+   p->next  = NULL;
 
-  _params_free(attr); /* xml_node_new rather confusingly make a copy */
-}
+   if (tail)
+     tail->next = p;
+   else
+     node->attr = p;
 
-#ifdef USE_EXPAT
-static void 
-node_end_cb(void *data, const char *tag)
-{
-  XMLParser *parser = (XMLParser *)data;
-#else
-static void node_end_cb( XMLParser *parser, const char *tag )
-{
-#endif
-   parser->_current_node = parser->_current_node->parent; 
+   return p;
 }
 
-
-#ifndef USE_EXPAT
-static void node_cdata_cb( XMLParser *parser, char *cdata)
+/* Link a freshly created node in as the last child of the current one
+ * and make it current. Returns False on a second document root.
+ */
+static int
+node_push(XMLParser *parser, XMLNode *node)
 {
-   if (cdata == NULL) return;
-   if (parser->_current_node->cdata == NULL)
-     parser->_current_node->cdata = strdup(cdata);
-   else 
+   XMLNode *parent = parser->_current_node;
+   Nlist   *item;
+
+   if (parent == NULL)
      {
-       parser->_current_node->cdata =
-	 (char *)realloc(parser->_current_node->cdata,
-			 sizeof(char)*(strlen(parser->_current_node->cdata))
-			 + sizeof(char)*(strlen(cdata)+1));
-       strcat(parser->_current_node->cdata, cdata);
+       if (parser->root_node != NULL)
+	 return 0;
+
+       parser->root_node = parser->_current_node = node;
+       return 1;
      }
+
+   item = (Nlist *)arena_alloc(parser->arena, sizeof(Nlist));
+   item->data = node;
+   item->next = NULL;
+
+   if (parent->_kids_tail)
+     parent->_kids_tail->next = item;
+   else
+     parent->kids = item;
+
+   parent->_kids_tail = item;
+
+   node->parent = parent;
+   parser->_current_node = node;
+
+   return 1;
 }
-#endif
 
 #ifdef DEBUG
 void xml_dump(XMLNode *node, int depth)
@@ -185,7 +199,7 @@ void xml_dump(XMLNode *node, int depth)
    char crap[] = "-------";
    char more_crap[] = "       ";
    printf("+%s %s\n", &crap[5-depth], node->tag);
-   
+
    for(p = node->attr; p != NULL; p = p->next)
    {
       printf(" %s %s = %s\n", &more_crap[5-depth], p->key, p->value);
@@ -193,7 +207,7 @@ void xml_dump(XMLNode *node, int depth)
 
    if (node->cdata)
       printf(" %s%s\n", &more_crap[5-depth], node->cdata);
-   
+
    for(tmp = node->kids; tmp != NULL; tmp = tmp->next)
    {
       xml_dump(tmp->data, depth+2);
@@ -201,288 +215,236 @@ void xml_dump(XMLNode *node, int depth)
 }
 #endif
 
-static Params * 
-_params_clone(Params *params)
-{
-  Params *params_clone = NULL, *params_cur = NULL;;
+#ifdef USE_EXPAT
 
-  if (params == NULL) return NULL;
+static void
+node_start_cb(void *data, const char *tag, const char **expat_attr)
+{
+  XMLParser *parser = (XMLParser *)data;
+  XMLNode   *node;
+  Params    *tail = NULL;
+  int        i;
 
-  params_cur = params_clone = xml_params_new();
+  node = node_new(parser, arena_strdup(parser->arena, tag));
 
-  while(params != NULL)
-     {
-       if (params->key)   params_cur->key   = strdup(params->key);
-       if (params->value) params_cur->value = strdup(params->value);
-       if (params->next)  
-	 {
-	   params_cur->next = xml_params_new();
-	   params_cur = params_cur->next;
-	 }
-       params = params->next;
-     }
+  for (i = 0; expat_attr[i] && expat_attr[i+1]; i += 2)
+    tail = node_add_attr(parser, node, tail,
+			 arena_strdup(parser->arena, expat_attr[i]),
+			 arena_strdup(parser->arena, expat_attr[i+1]));
 
-  return params_clone;
+  node_push(parser, node);
 }
 
-static void 
-_params_free(Params *params)
+static void
+node_end_cb(void *data, const char *tag)
 {
-  Params *params_cpy = NULL;
-  while(params != NULL)
-    {
-      params_cpy = params;
+  XMLParser *parser = (XMLParser *)data;
 
-      params = params_cpy->next;
+  parser->_current_node = parser->_current_node->parent;
+}
 
-      if (params_cpy->key) free(params_cpy->key);
-      if (params_cpy->value) free(params_cpy->value);
+#else
 
-      free (params_cpy);
-    }
-}
+#define IS_NAME_END(c) \
+   ((c) == '\0' || isspace((unsigned char)(c)) || (c) == '>' \
+    || (c) == '/' || (c) == '=')
 
-static void 
-_xml_parser_free(XMLNode *node)
+static void
+node_cdata_append(XMLParser *parser, char *cdata, size_t len)
 {
-  Nlist *tmp, *old_tmp = NULL;
-
-  _params_free(node->attr);
-  
-  if (node->cdata) free(node->cdata);
-  if (node->tag)  free(node->tag);
-  
-  tmp = node->kids;
-  
-  while (tmp != NULL)
-    {
-      old_tmp = tmp->next;
-      _xml_parser_free(tmp->data);
-      
-      free(tmp);
-      tmp = old_tmp;
-    }
+   XMLNode *node = parser->_current_node;
+   char    *joined;
+   size_t   old_len;
 
-  free(node);
-}
+   if (node == NULL) return;
 
-Params *xml_params_new(void)
-{
-   Params *p = (Params *)malloc(sizeof(Params));
-   p->next = NULL;
-   return p;
-}
+   /* Indentation between elements isn't interesting */
+   while (len && isspace((unsigned char)*cdata)) { cdata++; len--; }
 
-#ifndef USE_EXPAT
+   if (len == 0) return;
 
-#define CHECK_EOF(p) \
-            if ((*p) == '\0') { printf("end of file?\n"); return NULL; }
+   if (node->cdata == NULL)
+     {
+       node->cdata = cdata; 	/* already terminated in place */
+       return;
+     }
 
-#define SHD(c) ((*c) != '\0')
+   old_len = strlen(node->cdata);
+   joined  = (char *)arena_alloc(parser->arena, old_len + len + 1);
 
+   memcpy(joined, node->cdata, old_len);
+   memcpy(joined + old_len, cdata, len);
+   joined[old_len + len] = '\0';
 
-static char *parse(XMLParser *parser, char *doc)
-{
-   char *p = doc;
-   
-   /* Temporary data */
-   char *oe_data = NULL;
-   char *e_data = NULL;
-   char *ce_data = NULL;
-   char *key_data = NULL;
-   char *val_data = NULL;
-   Params *attr_params = NULL, *start_params = NULL;
-   int skip_spaces = 0, in_value = 0;
-   int in_comment = 0, done = 0;
-
-   do {
-     if (*p == '<') 
-       {
-	 if (*(p+1) == '!')
-	   in_comment++;
-	 else if (*(p+1) == '?')
-	   while(SHD(p) && *p != '>')
-	     p++;
-	 else if (!in_comment)
-	   done = 1;
-       }
-	 
-     if (in_comment && *p == '-' 
-	 && SHD(p+1) && *(p+1) == '-'
-	 && SHD(p+2) && *(p+2) == '>' )
-       {
-	 p += 3;
-	 in_comment--;
-       }
-     if (!done) p++;
-   } while( SHD(p) && !done );
+   node->cdata = joined;
+}
 
-   CHECK_EOF(p);
+/* Single pass, non recursive parse of doc, which is modified in place.
+ * Nesting is tracked through the parent links of the nodes themselves.
+ * Returns NULL on malformed input rather than trusting it.
+ */
+static XMLNode*
+parse(XMLParser *parser, char *doc)
+{
+   char *p = doc, *text, *name, *key, *value, *end;
+   char  c, quote;
 
-   *p = '\0';
+   while (1)
+     {
+       /* character data up to the next tag */
+       text = p;
+       while (*p != '\0' && *p != '<') p++;
 
-   oe_data = ++p;  /* Pointer to open tag name  */
-   
+       c = *p;
 
-   while (SHD(p) && *p != '>') /* advance to end of first tag  */
-   {
-      if (isspace(*p) && !skip_spaces)  /* possible attribute key */
-      {
-	 *p = '\0'; 
-	 if (SHD(p+1) && !isspace(*(p+1))
-	     && *(p+1) != '>' && *(p+1) != '/')
+       if (p > text && parser->_current_node)
 	 {
-	    if (attr_params == NULL)
-	    {
-	       attr_params = xml_params_new();
-	       start_params = attr_params;
-	    } else {
-	       attr_params->next = xml_params_new();
-	       attr_params = attr_params->next;
-	    }
-	    key_data = p+1;
-	    //attr_params->key = p+1;
+	   *p = '\0';
+	   node_cdata_append(parser, text, p - text);
 	 }
-	 p++;
-      }
-      else if (*p == '=' && !in_value)   /* beginning of attribute value  */
-      {
-	 *p = '\0'; 
-	 attr_params->key = strdup(key_data);
-
-	 p += 2; /* skipp first " */
-	 val_data = p;
-	 //attr_params->value = p;
-	 skip_spaces = 1;      /* ignore spaces in value */
-	 in_value = 1;
-	 key_data = NULL;
-      }
-      else if (*p == '"')      /* end of attribute value */
-      {
-	 *p = '\0'; 
-	 attr_params->value = strdup(val_data);
-	 val_data = NULL;
-	 skip_spaces = 0;
-	 in_value=0;
-	 p++;
-      } else {
-	 p++;
-      }
-   }
 
-   *p = '\0';    /* end possible dangling value pointer */
+       if (c == '\0') break;
 
-   /* fire all callback */
-   parser->start_element_cb(parser, oe_data, start_params);
-   
-   if (*(p-1) == '/') {    /* catch <tag/>  */
-      *(p-1) = '\0';
-      parser->data_cb(parser, NULL);
-      parser->end_element_cb(parser, oe_data);
-      return p +1;          /* TODO: catch possible segfualt */
-   }
+       p++; 			/* skip '<' */
 
-   do {
-      if (*p != '<') p++;  /* TODO: fixme ... maybe  */
+       if (!strncmp(p, "!--", 3))
+	 {
+	   if ((end = strstr(p + 3, "-->")) == NULL) return NULL;
+	   p = end + 3;
+	   continue;
+	 }
 
-      e_data = p;    	   /* grab cdata  */
-      while (SHD(p) && *p != '<') p++;
+       if (*p == '?')
+	 {
+	   if ((end = strstr(p + 1, "?>")) == NULL) return NULL;
+	   p = end + 2;
+	   continue;
+	 }
 
-      *p = '\0';
-      parser->data_cb(parser, e_data); /* ? */
+       if (*p == '!') 		/* DOCTYPE and friends */
+	 {
+	   if ((end = strchr(p, '>')) == NULL) return NULL;
+	   p = end + 1;
+	   continue;
+	 }
 
-      if (*(p+1) == '!') 
-	{  
-	 *p = '\0'; p++;
-	 while (!(SHD(p) && *p == '-' 
-		  && SHD(p+1) && *(p+1) == '-'
-		  && SHD(p+2) && *(p+2) == '>'))
-	   p++;
-      } else {
-      
-	//if (!*p) return NULL;  /* catch possible segfualt  */
-	 
-	 if (*(p+1) == '/')   /* close tag  */
+       if (*p == '/') 		/* close tag */
 	 {
-	   //*p = '\0';
-	   // parser->data_cb(parser, e_data); /* cdata callback  */
-	    p+=2;                 /* skip /> */
-	    ce_data = p;
-	    while (SHD(p) && *p != '>') p++; 
-	    *p = '\0';
-	    parser->end_element_cb(parser, ce_data);
-	    return p+1;          /* TODO catch possible segfualt  */
-	 } else {
-	   //*p = '\0';
-	   // parser->data_cb(parser, e_data);
-	    *p = '<';
-	    p = parse(parser, p);  /* recurse into inner tags */
+	   name = ++p;
+	   while (!IS_NAME_END(*p)) p++;
+	   end = p;
+	   while (isspace((unsigned char)*p)) p++;
+	   if (*p != '>') return NULL;
+	   *end = '\0';
+
+	   if (parser->_current_node == NULL
+	       || strcmp(name, parser->_current_node->tag))
+	     return NULL;
+
+	   parser->_current_node = parser->_current_node->parent;
+	   p++;
+
+	   if (parser->_current_node == NULL) break; /* root closed */
+
+	   continue;
 	 }
-      }
 
-   } while (SHD(p));
+       /* open tag */
 
-   return p;
-}
+       name = p;
+       while (!IS_NAME_END(*p)) p++;
+       if (p == name) return NULL;
 
-#endif
+       {
+	 XMLNode *node;
+	 Params  *tail = NULL;
 
-static char* 
-load_file(const char* filename) 
-{
-  struct stat st;
-  FILE*       fp;
-  char*       str;
-  int         len;
+	 /* name gets terminated along with whatever follows it */
+	 node = node_new(parser, name);
 
-  if (stat(filename, &st)) return NULL;
+	 if (!node_push(parser, node)) return NULL;
 
-  if (!(fp = fopen(filename, "rb"))) return NULL;
+	 while (1)
+	   {
+	     while (isspace((unsigned char)*p)) { *p = '\0'; p++; }
 
-  str = (char *)malloc(sizeof(char)*(st.st_size + 1));
-  len = fread(str, 1, st.st_size, fp);
-  if (len >= 0) str[len] = '\0';
+	     if (*p == '>')
+	       {
+		 *p++ = '\0';
+		 break;
+	       }
 
-  fclose(fp);
+	     if (*p == '/' && *(p+1) == '>')
+	       {
+		 *p = '\0';
+		 p += 2;
+		 parser->_current_node = node->parent;
+		 break;
+	       }
 
-  return str;
-}
+	     /* attribute, key = "value" or key = 'value' */
 
-#ifndef DEBUG
-static void 
-catch_sigsegv(int sig)
-{
-   signal(SIGSEGV, SIG_DFL);
-   longjmp(Jbuf, 1);
+	     key = p;
+	     while (!IS_NAME_END(*p)) p++;
+	     if (p == key) return NULL;
+	     end = p;
+
+	     while (isspace((unsigned char)*p)) p++;
+	     if (*p != '=') return NULL;
+	     p++;
+	     while (isspace((unsigned char)*p)) p++;
+
+	     if (*p != '"' && *p != '\'') return NULL;
+	     quote = *p++;
+	     value = p;
+
+	     while (*p != '\0' && *p != quote) p++;
+	     if (*p == '\0') return NULL;
+
+	     *end = '\0';
+	     *p++ = '\0';
+
+	     tail = node_add_attr(parser, node, tail, key, value);
+	   }
+
+	 if (parser->_current_node == NULL) break; /* <root/> */
+       }
+     }
+
+   /* Unclosed tags or no document element at all */
+   if (parser->root_node == NULL || parser->_current_node != NULL)
+     return NULL;
+
+   return parser->root_node;
 }
+
 #endif
 
-XMLParser 
+XMLParser
 *xml_parser_new(void)
 {
    XMLParser *parser;
    parser = (XMLParser *)malloc(sizeof(XMLParser));
-   parser->start_element_cb = NULL;
-   parser->end_element_cb   = NULL;
-   parser->data_cb          = NULL;
+   parser->arena            = arena_new();
    parser->root_node        = NULL;
    parser->_current_node    = NULL;
 
    return parser;
 }
 
-void 
-xml_parser_free(XMLParser *parser, XMLNode *root)
+void
+xml_parser_free(XMLParser *parser)
 {
-   if (root) _xml_parser_free(root);
+   /* Frees the document with it, every node lives in the arena */
+   arena_free(parser->arena);
    free(parser);
 }
 
-XMLNode*
-xml_parse_data_dom(XMLParser *parser, char *data)
-{
 #ifdef USE_EXPAT
 
+static XMLNode*
+parse_expat(XMLParser *parser, char *data, size_t len)
+{
   XML_Parser p = XML_ParserCreate(NULL);
 
   if (! p) {
@@ -495,51 +457,175 @@ xml_parse_data_dom(XMLParser *parser, char *data)
 
   XML_SetUserData(p, (void *)parser);
 
-  if (! XML_Parse(p, data, strlen(data), 1)) {
+  if (! XML_Parse(p, data, len, 1)) {
     fprintf(stderr, "Matchbox: XML Parse error at line %ld:\n%s\n",
-	    XML_GetCurrentLineNumber(p),
+	    (long)XML_GetCurrentLineNumber(p),
 	    XML_ErrorString(XML_GetErrorCode(p)));
+    XML_ParserFree(p);
     return NULL;
   }
-  
+
+  XML_ParserFree(p);
+
   return parser->root_node;
+}
+
+#endif
 
+XMLNode*
+xml_parse_data_dom(XMLParser *parser, char *data)
+{
+#ifdef USE_EXPAT
+  return parse_expat(parser, data, strlen(data));
 #else
-  int success = 1;
-  parser->start_element_cb = &node_start_cb;
-  parser->end_element_cb   = &node_end_cb;
-  parser->data_cb          = &node_cdata_cb;
-   
-#ifndef DEBUG
-  signal(SIGSEGV, catch_sigsegv);
-  if (setjmp(Jbuf)) success = 0;
+  /* Parse a private copy, the DOM's strings point into it */
+  return parse(parser, arena_strdup(parser->arena, data));
 #endif
+}
 
-   if (parse(parser, data) == NULL) 
-     success = 0;
+XMLNode*
+xml_parse_file_dom(XMLParser *parser, char *filename)
+{
+  struct stat st;
+  FILE*       fp;
+  char*       data;
+  size_t      len;
 
-#ifndef DEBUG
-   signal(SIGSEGV, NULL);
-#endif   
+  if (stat(filename, &st)) return NULL;
+
+  if (!(fp = fopen(filename, "rb"))) return NULL;
+
+  /* Read straight into the arena, no extra copy needed */
+  data = (char *)arena_alloc(parser->arena, st.st_size + 1);
+  len  = fread(data, 1, st.st_size, fp);
+  data[len] = '\0';
 
-   if (success) return parser->root_node;
-   return NULL;
+  fclose(fp);
+
+#ifdef USE_EXPAT
+  return parse_expat(parser, data, len);
+#else
+  return parse(parser, data);
 #endif
 }
 
-XMLNode*
-xml_parse_file_dom(XMLParser *parser, char *filename)
+#if 0
+
+/* Test bits for the parser. Benchmarks parsing of, and then fuzzes,
+ * the files given, eg;
+ *
+ *  gcc -O2 -I.. xml.c -o xmltest
+ *  ./xmltest ../data/themes/Default/matchbox/theme.xml
+ */
+
+#include <time.h>
+
+static double
+now(void)
 {
-  XMLNode *root;
-  char *data = load_file(filename);
-  if (data != NULL)
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char*
+slurp(const char *filename, size_t *len)
+{
+  FILE *fp = fopen(filename, "rb");
+  char *data;
+
+  if (fp == NULL) return NULL;
+
+  fseek(fp, 0, SEEK_END);
+  *len = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+
+  data = malloc(*len + 1);
+  *len = fread(data, 1, *len, fp);
+  data[*len] = '\0';
+
+  fclose(fp);
+
+  return data;
+}
+
+int
+main(int argc, char **argv)
+{
+  int i, j, iterations = 2000, fuzz_runs = 20000;
+
+  srand(1);
+
+  for (i = 1; i < argc; i++)
     {
-      if ((root = xml_parse_data_dom(parser, data)) != NULL)
+      XMLParser *parser;
+      size_t     len;
+      char      *data, *fuzz;
+      double     start, elapsed;
+      int        accepted = 0;
+
+      if ((data = slurp(argv[i], &len)) == NULL)
 	{
-	  free(data); 
-	  return root;
+	  printf("%s: cant read\n", argv[i]);
+	  continue;
 	}
+
+      /* Throughput */
+
+      start = now();
+
+      for (j = 0; j < iterations; j++)
+	{
+	  parser = xml_parser_new();
+	  if (xml_parse_data_dom(parser, data) == NULL)
+	    printf("%s: parse failed\n", argv[i]);
+	  xml_parser_free(parser);
+	}
+
+      elapsed = now() - start;
+
+      printf("%s: %i bytes, %.1f us/parse, %.1f MB/s\n", argv[i], (int)len,
+	     elapsed * 1e6 / iterations,
+	     (len * (double)iterations) / elapsed / (1024 * 1024));
+
+      /* Fuzz, random byte flips, inserted metachars and truncation.
+       * We only care that nothing crashes or reads out of bounds.
+       */
+
+      fuzz = malloc(len + 1);
+
+      for (j = 0; j < fuzz_runs; j++)
+	{
+	  static const char meta[] = "<>/='\"!?- \0";
+	  int n = 1 + rand() % 8;
+
+	  memcpy(fuzz, data, len + 1);
+
+	  while (n--)
+	    {
+	      size_t off = rand() % len;
+
+	      switch (rand() % 3)
+		{
+		case 0: fuzz[off] = rand() % 256;                     break;
+		case 1: fuzz[off] = meta[rand() % (sizeof(meta) - 1)]; break;
+		case 2: fuzz[off] = '\0';                             break;
+		}
+	    }
+
+	  parser = xml_parser_new();
+	  if (xml_parse_data_dom(parser, fuzz) != NULL) accepted++;
+	  xml_parser_free(parser);
+	}
+
+      printf("%s: %i fuzz runs, %i still parsed\n",
+	     argv[i], fuzz_runs, accepted);
+
+      free(fuzz);
+      free(data);
     }
-   return NULL;
+
+  return 0;
 }
 
+#endif
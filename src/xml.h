@@ -24,9 +24,6 @@
 #include <string.h>
 #include <ctype.h>
 #include <sys/stat.h>
-#include <setjmp.h>
-#include <signal.h>
-#include <sys/wait.h>
 
 #include "config.h"
 
@@ -53,32 +50,34 @@ typedef struct _xml_node {
    struct _xml_node *parent; 
    Nlist            *kids;
 
+   Nlist            *_kids_tail; /* For O(1) appends while parsing */
+
 } XMLNode;
 
+/* All nodes, params, lists and strings belonging to a parsed document
+ * live in the parsers arena and go away together in xml_parser_free().
+ */
+typedef struct _xml_arena XMLArena;
+
 typedef struct _xmlparser {
-   void (* start_element_cb)( struct _xmlparser  *parser,
-			      const char *tag, Params *attr);
-   void (* end_element_cb)( struct  _xmlparser *parser, const char *tag );
-   void (* data_cb)( struct  _xmlparser *parser, char *data );
-   XMLNode *root_node;
-   XMLNode *_current_node;
+   XMLArena *arena;
+   XMLNode  *root_node;
+   XMLNode  *_current_node;
 } XMLParser;
 
-
-XMLNode *xml_node_new(const char *name, Params *attr);
-
 #ifdef DEBUG
 void xml_dump(XMLNode *node, int depth);
 #endif
 
 /* --------------------------------------------------------------- */
 
-Params *xml_params_new(void);
-
 XMLParser *xml_parser_new(void);
 
 XMLNode *xml_parse_data_dom(XMLParser *parser, char *data);
 
 XMLNode *xml_parse_file_dom(XMLParser *parser, char *filename);
 
-void xml_parser_free(XMLParser *parser, XMLNode *root);
+/* Frees the parser and the whole document with it, nodes from
+ * xml_parse_*_dom() can't be used afterwards.
+ */
+void xml_parser_free(XMLParser *parser);
@@ -0,0 +1,564 @@
+/*
+ *  bench-client - drive a running window manager through a synthetic
+ *  workload and report what it cost as JSON.
+ *
+ *  Maps a dock and -t toolbars, then -a app windows, and for -n rounds
+ *  each of
+ *
+ *    dialog     map and unmap a dialog transient for the top app
+ *    override   map and unmap an override redirect 'menu'
+ *    focus      activate the next app via _NET_ACTIVE_WINDOW
+ *    panel      resize the dock, making the wm relayout every app
+ *
+ *  then retitles apps -n times in one burst before unmapping them all
+ *  again. Map latency is from XMapWindow() to the MapNotify, which for
+ *  managed windows only comes once the wm has framed and mapped them. Unmaps are timed until the window drops
+ *  out of _NET_CLIENT_LIST, focus until _NET_ACTIVE_WINDOW changes and
+ *  panel resizes until the top app sees its ConfigureNotify. Renames
+ *  give the wm nothing to reply with, so are timed as one burst ending
+ *  with a focus change.
+ *
+ *  The wm's own X request and event counts come from its _MB_X_STATS
+ *  root property, read before and after the workload. Given the wm's
+ *  pid with -p, its cpu time over the workload and peak RSS are read
+ *  from /proc too.
+ *
+ *  cc -o bench-client bench-client.c -lX11
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/select.h>
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include <X11/Xutil.h>
+
+#define MAX_WINS   256
+#define TIMEOUT    1000000	/* usecs to wait for the wm */
+
+/* Matches STATS_INTERVAL in src/structs.h, plus some slack */
+#define X_STATS_WAIT 1500000
+
+enum {
+  ATOM_TYPE = 0,
+  ATOM_TYPE_DIALOG,
+  ATOM_TYPE_TOOLBAR,
+  ATOM_TYPE_DOCK,
+  ATOM_ACTIVE_WINDOW,
+  ATOM_CLIENT_LIST,
+  ATOM_WM_NAME,
+  ATOM_UTF8_STRING,
+  ATOM_X_STATS,
+  ATOM_COUNT
+};
+
+static char *atom_names[] = {
+  "_NET_WM_WINDOW_TYPE",
+  "_NET_WM_WINDOW_TYPE_DIALOG",
+  "_NET_WM_WINDOW_TYPE_TOOLBAR",
+  "_NET_WM_WINDOW_TYPE_DOCK",
+  "_NET_ACTIVE_WINDOW",
+  "_NET_CLIENT_LIST",
+  "_NET_WM_NAME",
+  "UTF8_STRING",
+  "_MB_X_STATS",
+};
+
+typedef struct Times
+{
+  const char *name;
+  long long   v[MAX_WINS * 4];
+  int         n;
+  int         timeouts;
+
+} Times;
+
+static Display *dpy;
+static Window   root;
+static Atom     atoms[ATOM_COUNT];
+
+static Times t_map_app      = { "map_app",      { 0 }, 0, 0 };
+static Times t_map_toolbar  = { "map_toolbar",  { 0 }, 0, 0 };
+static Times t_map_dialog   = { "map_dialog",   { 0 }, 0, 0 };
+static Times t_map_override = { "map_override", { 0 }, 0, 0 };
+static Times t_unmap_app    = { "unmap_app",    { 0 }, 0, 0 };
+static Times t_unmap_dialog = { "unmap_dialog", { 0 }, 0, 0 };
+static Times t_focus        = { "focus",        { 0 }, 0, 0 };
+static Times t_panel        = { "panel_resize", { 0 }, 0, 0 };
+static Times t_rename       = { "rename_burst", { 0 }, 0, 0 };
+
+static long long
+now_usec (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void
+times_add (Times *t, long long usec)
+{
+  if (usec < 0)
+    t->timeouts++;
+  else if (t->n < (int) (sizeof (t->v) / sizeof (long long)))
+    t->v[t->n++] = usec;
+}
+
+static int
+cmp_ll (const void *a, const void *b)
+{
+  long long x = *(long long *)a, y = *(long long *)b;
+
+  return (x > y) - (x < y);
+}
+
+static void
+times_print (Times *t, int last)
+{
+  long long total = 0;
+  int       i;
+
+  qsort (t->v, t->n, sizeof (long long), cmp_ll);
+
+  for (i = 0; i < t->n; i++)
+    total += t->v[i];
+
+  printf ("    \"%s\": { \"n\": %i, \"median\": %lli, \"mean\": %lli, "
+	  "\"max\": %lli, \"timeouts\": %i }%s\n",
+	  t->name, t->n,
+	  (t->n) ? t->v[t->n / 2] : 0, (t->n) ? total / t->n : 0,
+	  (t->n) ? t->v[t->n - 1] : 0, t->timeouts, (last) ? "" : ",");
+}
+
+static Window
+win_new (int x, int y, int width, int height, Atom type, char *name,
+	 Bool override)
+{
+  XSetWindowAttributes attr;
+  Window               win;
+
+  attr.override_redirect = override;
+  attr.background_pixel  = WhitePixel (dpy, DefaultScreen (dpy));
+  attr.event_mask        = StructureNotifyMask;
+
+  win = XCreateWindow (dpy, root, x, y, width, height, 0,
+		       CopyFromParent, CopyFromParent, CopyFromParent,
+		       CWOverrideRedirect|CWBackPixel|CWEventMask, &attr);
+
+  XStoreName (dpy, win, name);
+
+  if (type != None)
+    XChangeProperty (dpy, win, atoms[ATOM_TYPE], XA_ATOM, 32,
+		     PropModeReplace, (unsigned char *)&type, 1);
+
+  return win;
+}
+
+/* Reads a window valued root property, n_items is set to its length */
+static Window*
+root_windows_get (Atom atom, int *n_items)
+{
+  Atom           type;
+  int            format;
+  unsigned long  n = 0, bytes_after;
+  unsigned char *data = NULL;
+
+  *n_items = 0;
+
+  if (XGetWindowProperty (dpy, root, atom, 0, MAX_WINS * 4, False,
+			  XA_WINDOW, &type, &format, &n, &bytes_after,
+			  &data) != Success || data == NULL)
+    return NULL;
+
+  if (type != XA_WINDOW || format != 32)
+    {
+      XFree (data);
+      return NULL;
+    }
+
+  *n_items = n;
+  return (Window *)data;
+}
+
+static Bool
+root_windows_has (Atom atom, Window win)
+{
+  Window *wins;
+  int     i, n;
+  Bool    found = False;
+
+  if ((wins = root_windows_get (atom, &n)) == NULL)
+    return False;
+
+  for (i = 0; i < n; i++)
+    if (wins[i] == win)
+      found = True;
+
+  XFree (wins);
+  return found;
+}
+
+/* Waits for an event on win of type ( and atom, for PropertyNotify ),
+ * returning usecs since start or -1 after timeout usecs.
+ */
+static long long
+wait_event_timeout (Window    win,
+		    int       type,
+		    Atom      atom,
+		    long long start,
+		    long long timeout)
+{
+  long long      deadline = start + timeout, left;
+  struct timeval tv;
+  fd_set         fds;
+  XEvent         ev;
+
+  for (;;)
+    {
+      while (XPending (dpy))
+	{
+	  XNextEvent (dpy, &ev);
+
+	  if (ev.type == type && ev.xany.window == win
+	      && (type != PropertyNotify || ev.xproperty.atom == atom))
+	    return now_usec () - start;
+	}
+
+      if ((left = deadline - now_usec ()) <= 0)
+	return -1;
+
+      tv.tv_sec  = left / 1000000;
+      tv.tv_usec = left % 1000000;
+      FD_ZERO (&fds);
+      FD_SET (ConnectionNumber (dpy), &fds);
+      select (ConnectionNumber (dpy) + 1, &fds, NULL, NULL, &tv);
+    }
+}
+
+static long long
+wait_event (Window win, int type, Atom atom, long long start)
+{
+  return wait_event_timeout (win, type, atom, start, TIMEOUT);
+}
+
+/* Waits for win to be, or not be, listed in a root property */
+static long long
+wait_root_windows (Atom atom, Window win, Bool listed, long long start)
+{
+  long long t;
+
+  for (;;)
+    {
+      if (root_windows_has (atom, win) == listed)
+	return now_usec () - start;
+
+      if ((t = wait_event (root, PropertyNotify, atom, start)) < 0)
+	return t;
+    }
+}
+
+/* Throws away anything queued, so waits only see new events */
+static void
+drain (void)
+{
+  XEvent ev;
+
+  XSync (dpy, False);
+
+  while (XPending (dpy))
+    XNextEvent (dpy, &ev);
+}
+
+static void
+map_timed (Window win, Times *t)
+{
+  long long start;
+
+  drain ();
+  start = now_usec ();
+
+  XMapWindow (dpy, win);
+  XFlush (dpy);
+
+  times_add (t, wait_event (win, MapNotify, None, start));
+}
+
+static void
+unmap_timed (Window win, Times *t)
+{
+  long long start;
+
+  drain ();
+  start = now_usec ();
+
+  XUnmapWindow (dpy, win);
+  XFlush (dpy);
+
+  if (t != NULL)
+    times_add (t, wait_root_windows (atoms[ATOM_CLIENT_LIST], win, False,
+				     start));
+  else
+    wait_event (win, UnmapNotify, None, start);
+}
+
+static long long
+activate (Window win)
+{
+  XEvent    ev;
+  long long start;
+
+  drain ();
+
+  memset (&ev, 0, sizeof (ev));
+  ev.xclient.type         = ClientMessage;
+  ev.xclient.window       = win;
+  ev.xclient.message_type = atoms[ATOM_ACTIVE_WINDOW];
+  ev.xclient.format       = 32;
+  ev.xclient.data.l[0]    = 1;	/* From an application */
+
+  start = now_usec ();
+
+  XSendEvent (dpy, root, False,
+	      SubstructureRedirectMask|SubstructureNotifyMask, &ev);
+  XFlush (dpy);
+
+  return wait_root_windows (atoms[ATOM_ACTIVE_WINDOW], win, True, start);
+}
+
+static void
+rename_window (Window win, int n)
+{
+  char name[64];
+
+  snprintf (name, sizeof (name), "app renamed %i", n);
+
+  XStoreName (dpy, win, name);
+  XChangeProperty (dpy, win, atoms[ATOM_WM_NAME], atoms[ATOM_UTF8_STRING],
+		   8, PropModeReplace, (unsigned char *)name, strlen (name));
+}
+
+/* Gets "requests=N events=N" from _MB_X_STATS, once the wm has had
+ * time to publish everything up to now. Both are -1 if it doesn't.
+ */
+static void
+x_stats_get (long *requests, long *events)
+{
+  Atom           type;
+  int            format;
+  unsigned long  n, bytes_after;
+  unsigned char *data = NULL;
+
+  *requests = *events = -1;
+
+  drain ();
+  wait_event_timeout (root, PropertyNotify, atoms[ATOM_X_STATS],
+		      now_usec (), X_STATS_WAIT);
+
+  if (XGetWindowProperty (dpy, root, atoms[ATOM_X_STATS], 0, 64, False,
+			  XA_STRING, &type, &format, &n, &bytes_after,
+			  &data) != Success || data == NULL)
+    return;
+
+  sscanf ((char *)data, "requests=%li events=%li", requests, events);
+  XFree (data);
+}
+
+/* User + system cpu time in msecs from /proc/<pid>/stat, -1 if gone */
+static long
+proc_cpu_msec (int pid)
+{
+  char           path[64], buf[1024], *p;
+  unsigned long  utime, stime;
+  FILE          *fp;
+  long           ret = -1;
+
+  snprintf (path, sizeof (path), "/proc/%i/stat", pid);
+
+  if ((fp = fopen (path, "r")) == NULL)
+    return -1;
+
+  /* comm can have spaces, so skip to after its closing paren */
+  if (fgets (buf, sizeof (buf), fp) && (p = strrchr (buf, ')')) != NULL
+      && sscanf (p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u "
+		 "%lu %lu", &utime, &stime) == 2)
+    ret = (utime + stime) * 1000 / sysconf (_SC_CLK_TCK);
+
+  fclose (fp);
+  return ret;
+}
+
+/* Peak resident set, VmHWM, in kB from /proc/<pid>/status */
+static long
+proc_peak_rss_kb (int pid)
+{
+  char  path[64], buf[256];
+  FILE *fp;
+  long  ret = -1;
+
+  snprintf (path, sizeof (path), "/proc/%i/status", pid);
+
+  if ((fp = fopen (path, "r")) == NULL)
+    return -1;
+
+  while (fgets (buf, sizeof (buf), fp))
+    if (sscanf (buf, "VmHWM: %li", &ret) == 1)
+      break;
+
+  fclose (fp);
+  return ret;
+}
+
+int
+main (int argc, char **argv)
+{
+  char      *display_name = NULL, *config = "default";
+  int        n_apps = 20, n_toolbars = 4, n_rounds = 50, i, dw, dh;
+  int        wm_pid = 0;
+  long       cpu_msec[2] = { -1, -1 };
+  Window     apps[MAX_WINS], toolbars[MAX_WINS], dock, dialog, menu;
+  long       requests[2], events[2];
+  long long  start;
+  char       name[32];
+
+  for (i = 1; i < argc; i++)
+    {
+      if (!strcmp (argv[i], "-display") && i+1 < argc)
+	display_name = argv[++i];
+      else if (!strcmp (argv[i], "-a") && i+1 < argc)
+	n_apps = atoi (argv[++i]);
+      else if (!strcmp (argv[i], "-t") && i+1 < argc)
+	n_toolbars = atoi (argv[++i]);
+      else if (!strcmp (argv[i], "-n") && i+1 < argc)
+	n_rounds = atoi (argv[++i]);
+      else if (!strcmp (argv[i], "-c") && i+1 < argc)
+	config = argv[++i];
+      else if (!strcmp (argv[i], "-p") && i+1 < argc)
+	wm_pid = atoi (argv[++i]);
+      else
+	{
+	  fprintf (stderr, "usage: %s [-display dpy] [-a apps] [-t toolbars] "
+		   "[-n rounds] [-c config name] [-p wm pid]\n", argv[0]);
+	  return 1;
+	}
+    }
+
+  if (n_apps < 2 || n_apps > MAX_WINS || n_toolbars < 0
+      || n_toolbars > MAX_WINS || n_rounds < 1 || n_rounds > MAX_WINS)
+    {
+      fprintf (stderr, "%s: bad window counts\n", argv[0]);
+      return 1;
+    }
+
+  if ((dpy = XOpenDisplay (display_name)) == NULL)
+    {
+      fprintf (stderr, "%s: can't open display\n", argv[0]);
+      return 1;
+    }
+
+  root = DefaultRootWindow (dpy);
+  XInternAtoms (dpy, atom_names, ATOM_COUNT, False, atoms);
+  XSelectInput (dpy, root, PropertyChangeMask);
+
+  dw = DisplayWidth (dpy, DefaultScreen (dpy));
+  dh = DisplayHeight (dpy, DefaultScreen (dpy));
+
+  x_stats_get (&requests[0], &events[0]);
+
+  if (wm_pid)
+    cpu_msec[0] = proc_cpu_msec (wm_pid);
+
+  dock = win_new (0, 0, dw, 24, atoms[ATOM_TYPE_DOCK], "dock", False);
+  map_timed (dock, &t_map_toolbar);
+
+  for (i = 0; i < n_toolbars; i++)
+    {
+      snprintf (name, sizeof (name), "toolbar-%i", i);
+      toolbars[i] = win_new (0, 0, dw, 20, atoms[ATOM_TYPE_TOOLBAR],
+			     name, False);
+      map_timed (toolbars[i], &t_map_toolbar);
+    }
+
+  for (i = 0; i < n_apps; i++)
+    {
+      snprintf (name, sizeof (name), "app-%i", i);
+      apps[i] = win_new (0, 0, dw, dh, None, name, False);
+      map_timed (apps[i], &t_map_app);
+    }
+
+  for (i = 0; i < n_rounds; i++)
+    {
+      Window top = apps[n_apps - 1];
+
+      dialog = win_new (dw / 4, dh / 4, dw / 2, dh / 4,
+			atoms[ATOM_TYPE_DIALOG], "dialog", False);
+      XSetTransientForHint (dpy, dialog, top);
+      map_timed (dialog, &t_map_dialog);
+      unmap_timed (dialog, &t_unmap_dialog);
+      XDestroyWindow (dpy, dialog);
+
+      menu = win_new (i % dw, 24, 120, 160, None, "menu", True);
+      map_timed (menu, &t_map_override);
+      unmap_timed (menu, NULL);
+      XDestroyWindow (dpy, menu);
+
+      times_add (&t_focus, activate (apps[i % n_apps]));
+
+      drain ();
+      start = now_usec ();
+      XResizeWindow (dpy, dock, dw, (i % 2) ? 24 : 48);
+      XFlush (dpy);
+      times_add (&t_panel, wait_event (top, ConfigureNotify, None, start));
+    }
+
+  /* Renames, fenced by a focus change the wm has to get to after them */
+  start = now_usec ();
+  for (i = 0; i < n_rounds; i++)
+    rename_window (apps[i % n_apps], i);
+  if (activate (apps[(n_rounds + 1) % n_apps]) < 0)
+    t_rename.timeouts++;
+  else
+    times_add (&t_rename, now_usec () - start);
+
+  for (i = n_apps - 1; i >= 0; i--)
+    unmap_timed (apps[i], &t_unmap_app);
+
+  x_stats_get (&requests[1], &events[1]);
+
+  if (wm_pid)
+    cpu_msec[1] = proc_cpu_msec (wm_pid);
+
+  printf ("{\n  \"config\": \"%s\",\n  \"apps\": %i,\n  \"toolbars\": %i,\n"
+	  "  \"rounds\": %i,\n", config, n_apps, n_toolbars, n_rounds);
+
+  printf ("  \"usec\": {\n");
+  times_print (&t_map_app, False);
+  times_print (&t_map_toolbar, False);
+  times_print (&t_map_dialog, False);
+  times_print (&t_map_override, False);
+  times_print (&t_unmap_app, False);
+  times_print (&t_unmap_dialog, False);
+  times_print (&t_focus, False);
+  times_print (&t_panel, False);
+  times_print (&t_rename, True);
+  printf ("  },\n");
+
+  printf ("  \"wm_requests\": %li,\n  \"wm_events\": %li,\n"
+	  "  \"client_requests\": %lu,\n",
+	  (requests[0] >= 0 && requests[1] >= 0) ?
+	  requests[1] - requests[0] : -1,
+	  (events[0] >= 0 && events[1] >= 0) ? events[1] - events[0] : -1,
+	  NextRequest (dpy) - 1);
+
+  printf ("  \"wm_cpu_msec\": %li,\n  \"wm_peak_rss_kb\": %li\n}\n",
+	  (cpu_msec[0] >= 0 && cpu_msec[1] >= 0) ?
+	  cpu_msec[1] - cpu_msec[0] : -1,
+	  (wm_pid) ? proc_peak_rss_kb (wm_pid) : -1);
+
+  XCloseDisplay (dpy);
+
+  return 0;
+}
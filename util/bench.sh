@@ -0,0 +1,170 @@
+#!/bin/sh
+#
+#  bench.sh - end to end matchbox-window-manager benchmarks under Xvfb.
+#
+#  Builds util/bench-client if needed and runs it against a fresh
+#  window manager for each configuration the binary supports
+#
+#    plain              Default theme, no shadows, compositing off
+#    composite-none     \
+#    composite-simple    > Default theme with each shadow style, only
+#    composite-gaussian /  for a --enable-composite build
+#    standalone         a --enable-standalone build's built in theme
+#
+#  printing a JSON array with one object per configuration. A second
+#  binary, eg. a standalone build from another tree, can be added
+#  with -s. CPU time and peak RSS are read from /proc, so Linux only.
+#
+#  usage: bench.sh [-n rounds] [-a apps] [-d display] [-w wm binary]
+#                  [-s second wm binary] [-o json file] [-- wm args]
+#
+#  Needs Xvfb and xprop. 'make bench' runs it on the tree's own build.
+#
+
+ROUNDS=50
+APPS=20
+DPY=:77
+WM=./src/matchbox-window-manager
+WM2=""
+OUT=""
+UTIL=`dirname $0`
+TOP=$UTIL/..
+BENCH=$UTIL/bench-client
+
+while [ $# -gt 0 ]; do
+  case "$1" in
+    -n) ROUNDS=$2; shift 2 ;;
+    -a) APPS=$2; shift 2 ;;
+    -d) DPY=$2; shift 2 ;;
+    -w) WM=$2; shift 2 ;;
+    -s) WM2=$2; shift 2 ;;
+    -o) OUT=$2; shift 2 ;;
+    --) shift; break ;;
+    *)  echo "usage: $0 [-n rounds] [-a apps] [-d display] [-w wm]" \
+             "[-s wm] [-o json file] [-- wm args]" >&2
+        exit 1 ;;
+  esac
+done
+
+for tool in Xvfb xprop; do
+  if ! command -v $tool >/dev/null 2>&1; then
+    echo "$0: $tool not found" >&2
+    exit 1
+  fi
+done
+
+for wm in "$WM" $WM2; do
+  if [ ! -x "$wm" ]; then
+    echo "$0: $wm not found, build first or pass -w" >&2
+    exit 1
+  fi
+done
+
+if [ ! -x "$BENCH" ] || [ "$UTIL/bench-client.c" -nt "$BENCH" ]; then
+  ${CC:-cc} ${CFLAGS:--O2} -o $BENCH $UTIL/bench-client.c -lX11 || exit 1
+fi
+
+THEMES=`mktemp -d`
+RESULTS=`mktemp`
+
+Xvfb $DPY -screen 0 800x600x24 -nolisten tcp >/dev/null 2>&1 &
+XVFB_PID=$!
+
+trap 'kill $WM_PID $XVFB_PID 2>/dev/null; rm -rf $THEMES $RESULTS' 0 1 2 15
+
+i=0
+until xprop -display $DPY -root >/dev/null 2>&1; do
+  i=`expr $i + 1`
+  if [ $i -gt 50 ]; then
+    echo "$0: Xvfb failed to start on $DPY" >&2
+    exit 1
+  fi
+  sleep 0.1
+done
+
+# A copy of the Default theme with just the shadow style changed
+theme_for_style () {
+  if [ ! -d $THEMES/$1 ]; then
+    cp -r $TOP/data/themes/Default $THEMES/$1 || exit 1
+    sed -i 's/<shadow style="[a-z]*"/<shadow style="'$1'"/' \
+      $THEMES/$1/theme.xml
+  fi
+  echo $THEMES/$1/theme.xml
+}
+
+# Prints 'name wm theme' for each configuration the binary can do,
+# going by the compile time features its usage message lists
+configs_for () {
+  version=`"$1" --help 2>&1`
+
+  if echo "$version" | grep -q "Theme support *no"; then
+    echo "standalone $1 -"
+    return
+  fi
+
+  echo "plain $1 `theme_for_style none`"
+
+  if echo "$version" | grep -q "composite support *yes"; then
+    for style in none simple gaussian; do
+      echo "composite-$style $1 `theme_for_style $style`"
+    done
+  fi
+}
+
+WM_ARGS="$*"
+FAILED=0
+FIRST=1
+
+{ configs_for "$WM"; [ -n "$WM2" ] && configs_for "$WM2"; } > $THEMES/configs
+
+echo "[" > $RESULTS
+
+while read name wm theme; do
+
+  if [ "$theme" = "-" ]; then
+    "$wm" -display $DPY $WM_ARGS >/dev/null 2>&1 &
+  else
+    "$wm" -display $DPY -theme $theme $WM_ARGS >/dev/null 2>&1 &
+  fi
+  WM_PID=$!
+
+  i=0
+  until xprop -display $DPY -root _NET_SUPPORTING_WM_CHECK 2>/dev/null \
+          | grep -q "window id"; do
+    i=`expr $i + 1`
+    if [ $i -gt 50 ]; then
+      echo "$0: $wm failed to start" >&2
+      exit 1
+    fi
+    sleep 0.1
+  done
+
+  # Composite builds start with the engine on, plain turns it off
+  if [ "$name" = "plain" ] \
+     && "$wm" --help 2>&1 | grep -q "composite support *yes"; then
+    DISPLAY=$DPY `dirname $wm`/matchbox-remote -composite-toggle
+  fi
+
+  [ $FIRST -eq 0 ] && echo "," >> $RESULTS
+  FIRST=0
+
+  $BENCH -display $DPY -c $name -a $APPS -n $ROUNDS -p $WM_PID \
+    >> $RESULTS < /dev/null || FAILED=1
+
+  kill $WM_PID 2>/dev/null
+  wait $WM_PID 2>/dev/null
+  WM_PID=""
+  xprop -display $DPY -root -remove _NET_SUPPORTING_WM_CHECK
+  xprop -display $DPY -root -remove _MB_X_STATS
+
+done < $THEMES/configs
+
+echo "]" >> $RESULTS
+
+if [ -n "$OUT" ]; then
+  cp $RESULTS "$OUT"
+else
+  cat $RESULTS
+fi
+
+exit $FAILED
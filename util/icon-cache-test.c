@@ -0,0 +1,148 @@
+/*
+ *  icon-cache-test - check the shared _NET_WM_ICON cache hands back its
+ *  cached images.
+ *
+ *  Builds the window manager's own icon-cache.c, list.c and pool.c in
+ *  with stand in libmb image calls that count decodes and frees, feeds
+ *  it a fake 16x16 + 48x48 icon set and checks
+ *
+ *    - the same size fetched twice is decoded once, same image back
+ *    - each size gets its own image and earlier ones stay cached
+ *    - zero or negative sizes are refused
+ *    - two windows with the same icons share one MBIcon
+ *    - dropping the last ref frees every scaled image
+ *
+ *  Exits non zero on the first failure. No X server is needed. Needs a
+ *  configured, themed tree for config.h, see icon-cache-test.sh.
+ */
+
+#include "icon-cache.c"
+#include "list.c"
+#include "pool.c"
+
+static int n_decoded, n_scaled, n_freed;
+
+#define ICON_ITEMS (2 + 16*16 + 2 + 48*48)
+
+/* icon-cache.c pulls these in */
+
+unsigned long *
+ewmh_get_icon_prop_data (Wm *w, Window win, unsigned long *n_items)
+{
+  unsigned long *data;
+  int            i = 0;
+
+  /* XFree() is just free(), so malloc() it like Xlib would */
+  data = malloc(ICON_ITEMS * sizeof(unsigned long));
+  memset(data, 0, ICON_ITEMS * sizeof(unsigned long));
+
+  data[i] = 16; data[i+1] = 16; i += 2 + 16*16;
+  data[i] = 48; data[i+1] = 48;
+
+  *n_items = ICON_ITEMS;
+  return data;
+}
+
+MBPixbufImage *
+mb_pixbuf_img_new_from_long_data (MBPixbuf *pb, const unsigned long *data,
+				  int width, int height)
+{
+  MBPixbufImage *img;
+
+  img = malloc(sizeof(MBPixbufImage));
+  memset(img, 0, sizeof(MBPixbufImage));
+
+  img->width  = width;
+  img->height = height;
+
+  n_decoded++;
+  return img;
+}
+
+MBPixbufImage *
+mb_pixbuf_img_scale (MBPixbuf *pb, MBPixbufImage *img, int width, int height)
+{
+  MBPixbufImage *scaled;
+
+  scaled = malloc(sizeof(MBPixbufImage));
+  memset(scaled, 0, sizeof(MBPixbufImage));
+
+  scaled->width  = width;
+  scaled->height = height;
+
+  n_scaled++;
+  return scaled;
+}
+
+void
+mb_pixbuf_img_free (MBPixbuf *pb, MBPixbufImage *img)
+{
+  n_freed++;
+  free(img);
+}
+
+#define CHECK(cond)							\
+  if (!(cond))								\
+    {									\
+      fprintf(stderr, "icon-cache-test: %s:%i: failed: %s\n",		\
+	      __FILE__, __LINE__, #cond);				\
+      exit(1);								\
+    }
+
+int
+main (int argc, char **argv)
+{
+  Wm            *w;
+  MBIcon        *icon, *other;
+  MBPixbufImage *img16, *img24, *img;
+
+  w = malloc(sizeof(Wm));
+  memset(w, 0, sizeof(Wm));
+
+  icon = icon_cache_get_for_window(w, 1);
+  CHECK(icon != NULL);
+
+  /* Exact fit, no scaling, then a cache hit */
+  img16 = icon_cache_get_image(w, icon, 16, 16);
+  CHECK(img16 != NULL);
+  CHECK(img16->width == 16 && img16->height == 16);
+  CHECK(n_decoded == 1 && n_scaled == 0);
+
+  img = icon_cache_get_image(w, icon, 16, 16);
+  CHECK(img == img16);
+  CHECK(n_decoded == 1);
+
+  /* Scaled down from 48x48, then a cache hit */
+  img24 = icon_cache_get_image(w, icon, 24, 24);
+  CHECK(img24 != NULL && img24 != img16);
+  CHECK(img24->width == 24 && img24->height == 24);
+  CHECK(n_decoded == 2 && n_scaled == 1 && n_freed == 1);
+
+  img = icon_cache_get_image(w, icon, 24, 24);
+  CHECK(img == img24);
+  CHECK(icon_cache_get_image(w, icon, 16, 16) == img16);
+  CHECK(n_decoded == 2 && n_scaled == 1);
+
+  /* Would key as id 0, or alias other sizes */
+  CHECK(icon_cache_get_image(w, icon, 0, 0) == NULL);
+  CHECK(icon_cache_get_image(w, icon, 0, 16) == NULL);
+  CHECK(icon_cache_get_image(w, icon, -1, 16) == NULL);
+  CHECK(n_decoded == 2);
+
+  /* Same icon set on another window is shared, cached images with it */
+  other = icon_cache_get_for_window(w, 2);
+  CHECK(other == icon && icon->refcnt == 2);
+  CHECK(icon_cache_get_image(w, other, 24, 24) == img24);
+
+  icon_cache_unref(w, other);
+  CHECK(w->icon_cache != NULL && n_freed == 1);
+
+  icon_cache_unref(w, icon);
+  CHECK(w->icon_cache == NULL);
+  CHECK(n_freed == 3);
+
+  printf("icon-cache-test: ok\n");
+
+  free(w);
+  return 0;
+}
@@ -0,0 +1,34 @@
+#!/bin/sh
+#
+#  icon-cache-test.sh - build and run util/icon-cache-test against the
+#  window manager's icon cache. Run from the top of a configured tree,
+#  the test needs config.h and the same defines the wm was built with.
+#
+#  usage: icon-cache-test.sh
+#
+
+UTIL=`dirname $0`
+TOP=$UTIL/..
+TEST=$UTIL/icon-cache-test
+
+if [ ! -f $TOP/config.h ]; then
+  echo "$0: no config.h, run configure first" >&2
+  exit 1
+fi
+
+# The icon cache is only built into themed builds
+if grep -q '^#define STANDALONE' $TOP/config.h; then
+  echo "$0: standalone build has no icon cache, skipping" >&2
+  exit 0
+fi
+
+DEFS=`pkg-config --cflags libmb` || exit 1
+
+if [ ! -x "$TEST" ] || [ "$UTIL/icon-cache-test.c" -nt "$TEST" ] \
+   || [ "$TOP/src/icon-cache.c" -nt "$TEST" ] \
+   || [ "$TOP/src/structs.h" -nt "$TEST" ]; then
+  ${CC:-cc} ${CFLAGS:--O2} -I$TOP -I$TOP/src $DEFS \
+    -o $TEST $UTIL/icon-cache-test.c -lX11 || exit 1
+fi
+
+$TEST
@@ -0,0 +1,237 @@
+/*
+ *  layout-bench - time window manager relayouts with lots of toolbars 
+ *  and panels mapped.
+ *
+ *  Maps -a app windows, -t toolbars and -p docks ( spread over the four
+ *  screen edges ), then for -n rounds alternately resizes a toolbar and
+ *  unmaps/remaps a west dock, both of which make the window manager 
+ *  relayout every app. Each round is timed from the request to the top
+ *  app window seeing its ConfigureNotify.
+ *
+ *  cc -o layout-bench layout-bench.c -lX11
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/select.h>
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+
+#define MAX_WINS 256
+
+static Display *dpy;
+static Atom     atom_type, atom_type_toolbar, atom_type_dock;
+
+static long long
+now_usec (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static Window
+win_new (int x, int y, int width, int height, Atom type, char *name)
+{
+  Window win;
+
+  win = XCreateSimpleWindow (dpy, DefaultRootWindow (dpy), 
+			     x, y, width, height, 0, 0, 
+			     WhitePixel (dpy, DefaultScreen (dpy)));
+
+  XSelectInput (dpy, win, StructureNotifyMask);
+  XStoreName (dpy, win, name);
+
+  if (type != None)
+    XChangeProperty (dpy, win, atom_type, XA_ATOM, 32, PropModeReplace,
+		     (unsigned char *)&type, 1);
+
+  return win;
+}
+
+static void
+win_map_wait (Window win)
+{
+  XEvent ev;
+
+  XMapWindow (dpy, win);
+
+  do
+    XWindowEvent (dpy, win, StructureNotifyMask, &ev);
+  while (ev.type != MapNotify);
+}
+
+/* Wait up to a second for win to be configured, returns usecs taken */
+static long long
+wait_configure (Window win, long long start)
+{
+  long long      deadline = start + 1000000, left;
+  struct timeval tv;
+  fd_set         fds;
+  XEvent         ev;
+
+  for (;;)
+    {
+      while (XPending (dpy))
+	{
+	  XNextEvent (dpy, &ev);
+	  if (ev.type == ConfigureNotify && ev.xconfigure.window == win)
+	    return now_usec () - start;
+	}
+
+      if ((left = deadline - now_usec ()) <= 0)
+	return -1;
+
+      tv.tv_sec  = left / 1000000;
+      tv.tv_usec = left % 1000000;
+      FD_ZERO (&fds);
+      FD_SET (ConnectionNumber (dpy), &fds);
+      select (ConnectionNumber (dpy) + 1, &fds, NULL, NULL, &tv);
+    }
+}
+
+static int
+cmp_ll (const void *a, const void *b)
+{
+  long long x = *(long long *)a, y = *(long long *)b;
+
+  return (x > y) - (x < y);
+}
+
+int
+main (int argc, char **argv)
+{
+  char      *display_name = NULL;
+  int        n_apps = 20, n_toolbars = 8, n_docks = 8, n_rounds = 100;
+  int        i, dw, dh, n_times = 0, n_timeouts = 0;
+  Window     apps[MAX_WINS], toolbars[MAX_WINS], docks[MAX_WINS];
+  Window     west_dock = None;
+  long long *times, t, total = 0;
+  char       name[32];
+
+  for (i = 1; i < argc; i++)
+    {
+      if (!strcmp (argv[i], "-display") && i+1 < argc)
+	display_name = argv[++i];
+      else if (!strcmp (argv[i], "-a") && i+1 < argc)
+	n_apps = atoi (argv[++i]);
+      else if (!strcmp (argv[i], "-t") && i+1 < argc)
+	n_toolbars = atoi (argv[++i]);
+      else if (!strcmp (argv[i], "-p") && i+1 < argc)
+	n_docks = atoi (argv[++i]);
+      else if (!strcmp (argv[i], "-n") && i+1 < argc)
+	n_rounds = atoi (argv[++i]);
+      else
+	{
+	  fprintf (stderr, "usage: %s [-display dpy] [-a apps] [-t toolbars] "
+		   "[-p docks] [-n rounds]\n", argv[0]);
+	  return 1;
+	}
+    }
+
+  if (n_apps < 1 || n_apps > MAX_WINS || n_toolbars < 1 
+      || n_toolbars > MAX_WINS || n_docks > MAX_WINS || n_rounds < 1)
+    {
+      fprintf (stderr, "%s: bad window counts\n", argv[0]);
+      return 1;
+    }
+
+  if ((dpy = XOpenDisplay (display_name)) == NULL)
+    {
+      fprintf (stderr, "%s: can't open display\n", argv[0]);
+      return 1;
+    }
+
+  atom_type         = XInternAtom (dpy, "_NET_WM_WINDOW_TYPE", False);
+  atom_type_toolbar = XInternAtom (dpy, "_NET_WM_WINDOW_TYPE_TOOLBAR", False);
+  atom_type_dock    = XInternAtom (dpy, "_NET_WM_WINDOW_TYPE_DOCK", False);
+
+  dw = DisplayWidth (dpy, DefaultScreen (dpy));
+  dh = DisplayHeight (dpy, DefaultScreen (dpy));
+
+  /* Docks go round the edges, wide ones north/south, tall east/west */
+  for (i = 0; i < n_docks; i++)
+    {
+      snprintf (name, sizeof (name), "dock-%i", i);
+
+      switch (i % 4)
+	{
+	case 0:
+	  docks[i] = win_new (0, 0, dw, 8, atom_type_dock, name);
+	  break;
+	case 1:
+	  docks[i] = win_new (0, dh - 8, dw, 8, atom_type_dock, name);
+	  break;
+	case 2:
+	  docks[i] = win_new (0, 0, 8, dh / 2, atom_type_dock, name);
+	  if (west_dock == None)
+	    west_dock = docks[i];
+	  break;
+	case 3:
+	  docks[i] = win_new (dw - 8, 0, 8, dh / 2, atom_type_dock, name);
+	  break;
+	}
+
+      win_map_wait (docks[i]);
+    }
+
+  for (i = 0; i < n_toolbars; i++)
+    {
+      snprintf (name, sizeof (name), "toolbar-%i", i);
+      toolbars[i] = win_new (0, 0, dw, 20, atom_type_toolbar, name);
+      win_map_wait (toolbars[i]);
+    }
+
+  for (i = 0; i < n_apps; i++)
+    {
+      snprintf (name, sizeof (name), "app-%i", i);
+      apps[i] = win_new (0, 0, dw, dh, None, name);
+      win_map_wait (apps[i]);
+    }
+
+  /* Let things settle */
+  wait_configure (None, now_usec () - 500000);
+
+  times = malloc (sizeof (long long) * n_rounds);
+
+  for (i = 0; i < n_rounds; i++)
+    {
+      long long start = now_usec ();
+
+      if (i % 2 == 0 || west_dock == None)
+	XResizeWindow (dpy, toolbars[0], dw, (i / 2) % 2 ? 20 : 40);
+      else if ((i / 2) % 2 == 0)
+	XUnmapWindow (dpy, west_dock);
+      else
+	XMapWindow (dpy, west_dock);
+
+      XFlush (dpy);
+
+      if ((t = wait_configure (apps[n_apps-1], start)) < 0)
+	n_timeouts++;
+      else
+	{
+	  times[n_times++] = t;
+	  total += t;
+	}
+    }
+
+  if (n_times)
+    {
+      qsort (times, n_times, sizeof (long long), cmp_ll);
+
+      printf ("apps=%i toolbars=%i docks=%i rounds=%i "
+	      "median=%lli mean=%lli max=%lli timeouts=%i\n",
+	      n_apps, n_toolbars, n_docks, n_rounds,
+	      times[n_times / 2], total / n_times, times[n_times - 1],
+	      n_timeouts);
+    }
+  else printf ("no relayouts seen, timeouts=%i\n", n_timeouts);
+
+  XCloseDisplay (dpy);
+
+  return n_times ? 0 : 1;
+}
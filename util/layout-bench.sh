@@ -0,0 +1,88 @@
+#!/bin/sh
+#
+#  layout-bench.sh - time matchbox-window-manager relayouts under Xvfb.
+#
+#  Builds util/layout-bench if needed and runs it against the window
+#  manager with a few different numbers of apps, toolbars and docks.
+#  Times are in microseconds per relayout.
+#
+#  usage: layout-bench.sh [-n rounds] [-d display] [-w wm binary] [-- wm args]
+#
+
+ROUNDS=100
+DPY=:75
+WM=./src/matchbox-window-manager
+UTIL=`dirname $0`
+BENCH=$UTIL/layout-bench
+
+while [ $# -gt 0 ]; do
+  case "$1" in
+    -n) ROUNDS=$2; shift 2 ;;
+    -d) DPY=$2; shift 2 ;;
+    -w) WM=$2; shift 2 ;;
+    --) shift; break ;;
+    *)  echo "usage: $0 [-n rounds] [-d display] [-w wm] [-- wm args]" >&2
+        exit 1 ;;
+  esac
+done
+
+for tool in Xvfb xprop; do
+  if ! command -v $tool >/dev/null 2>&1; then
+    echo "$0: $tool not found" >&2
+    exit 1
+  fi
+done
+
+if [ ! -x "$WM" ]; then
+  echo "$0: $WM not found, build first or pass -w" >&2
+  exit 1
+fi
+
+if [ ! -x "$BENCH" ] || [ "$UTIL/layout-bench.c" -nt "$BENCH" ]; then
+  ${CC:-cc} -o $BENCH $UTIL/layout-bench.c -lX11 || exit 1
+fi
+
+Xvfb $DPY -screen 0 800x600x16 -nolisten tcp >/dev/null 2>&1 &
+XVFB_PID=$!
+
+trap 'kill $WM_PID $XVFB_PID 2>/dev/null' 0 1 2 15
+
+i=0
+until xprop -display $DPY -root >/dev/null 2>&1; do
+  i=`expr $i + 1`
+  if [ $i -gt 50 ]; then
+    echo "$0: Xvfb failed to start on $DPY" >&2
+    exit 1
+  fi
+  sleep 0.1
+done
+
+WM_ARGS="$*"
+FAILED=0
+
+# A fresh wm for each run, so earlier windows don't skew the next
+for sizes in "5 2 2" "20 8 8" "50 16 16"; do
+  set -- $sizes
+
+  $WM -display $DPY $WM_ARGS &
+  WM_PID=$!
+
+  i=0
+  until xprop -display $DPY -root _NET_SUPPORTING_WM_CHECK 2>/dev/null \
+          | grep -q "window id"; do
+    i=`expr $i + 1`
+    if [ $i -gt 50 ]; then
+      echo "$0: $WM failed to start" >&2
+      exit 1
+    fi
+    sleep 0.1
+  done
+
+  $BENCH -display $DPY -a $1 -t $2 -p $3 -n $ROUNDS || FAILED=1
+
+  kill $WM_PID 2>/dev/null
+  wait $WM_PID 2>/dev/null
+  xprop -display $DPY -root -remove _NET_SUPPORTING_WM_CHECK
+done
+
+exit $FAILED
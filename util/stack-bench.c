@@ -0,0 +1,170 @@
+/*
+ *  stack-bench - time stack walks over lots of synthetic clients.
+ *
+ *  Builds the window manager's own stack.c, list.c and pool.c in with
+ *  -n fake clients of mixed types ( mostly apps, some dialogs, toolbars,
+ *  panels and overrides ), shuffles the stack so stacking order has
+ *  nothing to do with allocation order, then times for -r rounds
+ *
+ *    enumerate    a full stack_enumerate() reading type, mapped and x
+ *    reverse      the same with stack_enumerate_reverse()
+ *    highest      stack_get_highest() for each client type
+ *    above/below  stack_get_above() / stack_get_below() from every
+ *                 client, looking for a dialog / panel
+ *
+ *  Times are nanoseconds per client visited for the two full walks and
+ *  per call for the rest.
+ *  No X server is needed. Needs a configured tree for config.h, see
+ *  stack-bench.sh.
+ */
+
+#include "stack.c"
+#include "list.c"
+#include "pool.c"
+
+#include <sys/time.h>
+
+/* stack.c pulls these in, the walks timed here never call them */
+
+void
+client_get_transient_list(Wm *w, MBList **list, Client *c)
+{
+}
+
+void
+misc_trap_xerrors(void)
+{
+}
+
+int
+misc_untrap_xerrors(void)
+{
+  return 0;
+}
+
+static long long
+now_usec (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static MBClientTypeEnum types[] = {
+  MBCLIENT_TYPE_APP, MBCLIENT_TYPE_APP, MBCLIENT_TYPE_APP,
+  MBCLIENT_TYPE_APP, MBCLIENT_TYPE_APP, MBCLIENT_TYPE_APP,
+  MBCLIENT_TYPE_DIALOG, MBCLIENT_TYPE_TOOLBAR, MBCLIENT_TYPE_PANEL,
+  MBCLIENT_TYPE_OVERRIDE
+};
+
+#define N_TYPES (sizeof(types) / sizeof(MBClientTypeEnum))
+
+static void
+report (const char *what, long long usec, long visits)
+{
+  printf ("%-12s %8.2f ns\n", what,
+	  (visits) ? (usec * 1000.0) / visits : 0.0);
+}
+
+int
+main (int argc, char **argv)
+{
+  Wm        *w;
+  Client   **clients, *c;
+  int        n_clients = 1000, rounds = 200, seed = 1, i, r, t;
+  long long  start, sum = 0;
+
+  for (i = 1; i < argc; i++)
+    {
+      if (!strcmp(argv[i], "-n") && i+1 < argc)
+	n_clients = atoi(argv[++i]);
+      else if (!strcmp(argv[i], "-r") && i+1 < argc)
+	rounds = atoi(argv[++i]);
+      else if (!strcmp(argv[i], "-s") && i+1 < argc)
+	seed = atoi(argv[++i]);
+      else
+	{
+	  fprintf(stderr, "usage: %s [-n clients] [-r rounds] [-s seed]\n",
+		  argv[0]);
+	  exit(1);
+	}
+    }
+
+  if (n_clients < 2) n_clients = 2;
+
+  srand(seed);
+
+  w = malloc(sizeof(Wm));
+  memset(w, 0, sizeof(Wm));
+
+  clients = malloc(sizeof(Client*) * n_clients);
+
+  for (i = 0; i < n_clients; i++)
+    {
+      c = pool_alloc(POOL_CLIENT);
+
+      c->wm     = w;
+      c->type   = types[rand() % N_TYPES];
+      c->mapped = (rand() % 10 != 0);
+      c->x      = i;
+
+      stack_append_top(c);
+      clients[i] = c;
+    }
+
+  for (i = 0; i < n_clients * 4; i++)
+    {
+      Client *a = clients[rand() % n_clients], *b = clients[rand() % n_clients];
+
+      if (a != b)
+	stack_move_above_client(a, b);
+    }
+
+  printf("%i clients, %i rounds, Client is %i bytes\n",
+	 n_clients, rounds, (int)sizeof(Client));
+
+  start = now_usec();
+  for (r = 0; r < rounds; r++)
+    stack_enumerate(w, c)
+      if (c->mapped && c->type != MBCLIENT_TYPE_OVERRIDE)
+	sum += c->x;
+  report("enumerate", now_usec() - start, (long)rounds * n_clients);
+
+  start = now_usec();
+  for (r = 0; r < rounds; r++)
+    stack_enumerate_reverse(w, c)
+      if (c->mapped && c->type != MBCLIENT_TYPE_OVERRIDE)
+	sum += c->x;
+  report("reverse", now_usec() - start, (long)rounds * n_clients);
+
+  start = now_usec();
+  for (r = 0; r < rounds; r++)
+    for (t = 0; t < N_TYPES; t++)
+      if ((c = stack_get_highest(w, types[t])) != NULL)
+	sum += c->x;
+  report("highest", now_usec() - start, (long)rounds * N_TYPES);
+
+  start = now_usec();
+  for (r = 0; r < rounds; r++)
+    for (i = 0; i < n_clients; i++)
+      {
+	c = stack_get_above(clients[i], MBCLIENT_TYPE_DIALOG);
+	sum += c->x;
+      }
+  report("above", now_usec() - start, (long)rounds * n_clients);
+
+  start = now_usec();
+  for (r = 0; r < rounds; r++)
+    for (i = 0; i < n_clients; i++)
+      {
+	c = stack_get_below(clients[i], MBCLIENT_TYPE_PANEL);
+	sum += c->x;
+      }
+  report("below", now_usec() - start, (long)rounds * n_clients);
+
+  /* Keeps the walks from being optimised away */
+  if (sum == 42) printf("\n");
+
+  return 0;
+}
@@ -0,0 +1,34 @@
+#!/bin/sh
+#
+#  stack-bench.sh - build and run util/stack-bench against the window 
+#  manager's stack code. Run from the top of a configured tree, the
+#  bench needs config.h and the same defines the wm was built with.
+#
+#  usage: stack-bench.sh [stack-bench args]
+#
+
+UTIL=`dirname $0`
+TOP=$UTIL/..
+BENCH=$UTIL/stack-bench
+
+if [ ! -f $TOP/config.h ]; then
+  echo "$0: no config.h, run configure first" >&2
+  exit 1
+fi
+
+# Only a standalone build gets by without libmb's headers
+DEFS=""
+if ! grep -q '^#define STANDALONE' $TOP/config.h; then
+  DEFS=`pkg-config --cflags libmb` || exit 1
+fi
+
+if [ ! -x "$BENCH" ] || [ "$UTIL/stack-bench.c" -nt "$BENCH" ] \
+   || [ "$TOP/src/structs.h" -nt "$BENCH" ]; then
+  ${CC:-cc} ${CFLAGS:--O2} -I$TOP -I$TOP/src $DEFS \
+    -o $BENCH $UTIL/stack-bench.c -lX11 || exit 1
+fi
+
+for n in 100 1000 10000; do
+  $BENCH -n $n "$@" || exit 1
+  echo
+done
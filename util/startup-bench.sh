@@ -0,0 +1,107 @@
+#!/bin/sh
+#
+#  startup-bench.sh - time matchbox-window-manager startup under Xvfb.
+#
+#  Starts a private Xvfb, launches the window manager N times and
+#  reports the median of each phase in the _MB_STARTUP_REPORT root
+#  property ( microseconds / X requests ), plus time to first frame.
+#
+#  usage: startup-bench.sh [-n runs] [-d display] [-w wm binary] [-- wm args]
+#
+#  Needs Xvfb and xprop. Any clients to manage at startup ( eg. to 
+#  measure wm_init_existing ) can be started on the display by setting
+#  BENCH_CLIENTS to a command line.
+#
+
+RUNS=10
+DPY=:73
+WM=./src/matchbox-window-manager
+
+while [ $# -gt 0 ]; do
+  case "$1" in
+    -n) RUNS=$2; shift 2 ;;
+    -d) DPY=$2; shift 2 ;;
+    -w) WM=$2; shift 2 ;;
+    --) shift; break ;;
+    *)  echo "usage: $0 [-n runs] [-d display] [-w wm] [-- wm args]" >&2
+        exit 1 ;;
+  esac
+done
+
+for tool in Xvfb xprop; do
+  if ! command -v $tool >/dev/null 2>&1; then
+    echo "$0: $tool not found" >&2
+    exit 1
+  fi
+done
+
+if [ ! -x "$WM" ]; then
+  echo "$0: $WM not found, build first or pass -w" >&2
+  exit 1
+fi
+
+RESULTS=`mktemp`
+
+Xvfb $DPY -screen 0 640x480x16 -nolisten tcp >/dev/null 2>&1 &
+XVFB_PID=$!
+
+trap 'kill $XVFB_PID $BENCH_CLIENTS_PID 2>/dev/null; rm -f $RESULTS' 0 1 2 15
+
+# Wait for the server to come up
+i=0
+until xprop -display $DPY -root >/dev/null 2>&1; do
+  i=`expr $i + 1`
+  if [ $i -gt 50 ]; then
+    echo "$0: Xvfb failed to start on $DPY" >&2
+    exit 1
+  fi
+  sleep 0.1
+done
+
+if [ -n "$BENCH_CLIENTS" ]; then
+  DISPLAY=$DPY sh -c "$BENCH_CLIENTS" &
+  BENCH_CLIENTS_PID=$!
+  sleep 1
+fi
+
+run=0
+while [ $run -lt $RUNS ]; do
+
+  xprop -display $DPY -root -remove _MB_STARTUP_REPORT
+
+  "$WM" -display $DPY "$@" >/dev/null 2>&1 &
+  WM_PID=$!
+
+  i=0
+  report=""
+  while [ -z "$report" ] && [ $i -lt 100 ]; do
+    sleep 0.05
+    report=`xprop -display $DPY -root _MB_STARTUP_REPORT 2>/dev/null \
+            | sed -n 's/^_MB_STARTUP_REPORT(STRING) = "\(.*\)"$/\1/p'`
+    i=`expr $i + 1`
+  done
+
+  kill $WM_PID 2>/dev/null
+  wait $WM_PID 2>/dev/null
+
+  if [ -z "$report" ]; then
+    echo "$0: run $run: no startup report, is the wm running ?" >&2
+    exit 1
+  fi
+
+  echo "$report" >> $RESULTS
+  run=`expr $run + 1`
+done
+
+echo "matchbox startup, median of $RUNS runs ( usec / X requests )"
+
+# One field per line, 'name usec requests', then the median per name
+tr ' ' '\n' < $RESULTS | sed 's/[=/]/ /g' | sort -k1,1 -k2,2n | awk '
+  { name[NR] = $1; usec[NR] = $2; reqs[NR] = $3; n[$1]++ }
+  END {
+    for (i = 1; i <= NR; i++) {
+      k = name[i]; seen[k]++
+      if (seen[k] == int((n[k] + 1) / 2))
+        printf "  %-20s %10d %6s\n", k, usec[i], reqs[i]
+    }
+  }'
@@ -0,0 +1,243 @@
+/*
+ *  sync-client - exercise the window manager's _NET_WM_SYNC_REQUEST
+ *  support.
+ *
+ *  Maps a window advertising _NET_WM_SYNC_REQUEST, then asks the window
+ *  manager to toggle it fullscreen as fast as it can. Each configure is
+ *  'repainted' ( ie. slept on for -d msecs ) before the sync counter is
+ *  updated, so a window manager that honours the protocol sends fewer 
+ *  configures than toggles were requested.
+ *
+ *  -s N  stops answering after N requests, to exercise the window 
+ *        manager's timeouts and it eventually giving up on the client.
+ *  -r    replaces the counter half way through, as a restarted toolkit
+ *        might.
+ *
+ *  Prints configures, requests and answers seen, exits non zero if the 
+ *  window manager never sent a sync request. See sync-test.sh.
+ *
+ *  cc -o sync-client sync-client.c -lX11 -lXext
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/select.h>
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include <X11/extensions/sync.h>
+
+static Display      *dpy;
+static Window        win;
+static XSyncCounter  counter;
+static Atom          atom_protocols, atom_sync_request, atom_sync_counter,
+                     atom_delete, atom_state, atom_fullscreen;
+
+static int           n_configures, n_requests, n_answered;
+static int           delay_ms, stall_after = -1;
+static Bool          have_request;
+static XSyncValue    request_value;
+
+static void
+counter_create (void)
+{
+  XSyncValue zero;
+
+  XSyncIntToValue (&zero, 0);
+  counter = XSyncCreateCounter (dpy, zero);
+
+  XChangeProperty (dpy, win, atom_sync_counter, XA_CARDINAL, 32,
+		   PropModeReplace, (unsigned char *)&counter, 1);
+}
+
+static void
+toggle_fullscreen (void)
+{
+  XEvent e;
+
+  memset (&e, 0, sizeof (XEvent));
+  e.xclient.type         = ClientMessage;
+  e.xclient.window       = win;
+  e.xclient.message_type = atom_state;
+  e.xclient.format       = 32;
+  e.xclient.data.l[0]    = 2; /* _NET_WM_STATE_TOGGLE */
+  e.xclient.data.l[1]    = atom_fullscreen;
+
+  XSendEvent (dpy, DefaultRootWindow (dpy), False,
+	      SubstructureRedirectMask|SubstructureNotifyMask, &e);
+  XFlush (dpy);
+}
+
+static void
+handle_event (XEvent *ev)
+{
+  switch (ev->type)
+    {
+    case ClientMessage:
+      if (ev->xclient.message_type == atom_protocols
+	  && (Atom)ev->xclient.data.l[0] == atom_sync_request)
+	{
+	  XSyncIntsToValue (&request_value, 
+			    (unsigned int)ev->xclient.data.l[2],
+			    (int)ev->xclient.data.l[3]);
+	  have_request = True;
+	  n_requests++;
+	}
+      break;
+    case ConfigureNotify:
+      if (ev->xconfigure.window != win)
+	break;
+
+      n_configures++;
+
+      /* 'Repaint', then tell the wm we're done with its last request */
+      if (delay_ms)
+	usleep (delay_ms * 1000);
+
+      if (have_request && (stall_after < 0 || n_answered < stall_after))
+	{
+	  XSyncSetCounter (dpy, counter, request_value);
+	  XFlush (dpy);
+	  n_answered++;
+	}
+      have_request = False;
+      break;
+    }
+}
+
+/* Handle events for up to msecs */
+static void
+run (int msecs)
+{
+  struct timeval end, now, tv;
+  fd_set         fds;
+  XEvent         ev;
+
+  gettimeofday (&end, NULL);
+  end.tv_sec  += msecs / 1000;
+  end.tv_usec += (msecs % 1000) * 1000;
+  if (end.tv_usec >= 1000000) 
+    { end.tv_sec++; end.tv_usec -= 1000000; }
+
+  for (;;)
+    {
+      while (XPending (dpy))
+	{
+	  XNextEvent (dpy, &ev);
+	  handle_event (&ev);
+	}
+
+      gettimeofday (&now, NULL);
+      if (!timercmp (&now, &end, <))
+	return;
+
+      timersub (&end, &now, &tv);
+      FD_ZERO (&fds);
+      FD_SET (ConnectionNumber (dpy), &fds);
+      select (ConnectionNumber (dpy) + 1, &fds, NULL, NULL, &tv);
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  char  *display_name = NULL;
+  int    n_toggles = 50, interval_ms = 10, i, major, minor;
+  Bool   reset_counter = False;
+  Atom   protocols[2];
+  XEvent ev;
+
+  for (i = 1; i < argc; i++)
+    {
+      if (!strcmp (argv[i], "-display") && i+1 < argc)
+	display_name = argv[++i];
+      else if (!strcmp (argv[i], "-n") && i+1 < argc)
+	n_toggles = atoi (argv[++i]);
+      else if (!strcmp (argv[i], "-i") && i+1 < argc)
+	interval_ms = atoi (argv[++i]);
+      else if (!strcmp (argv[i], "-d") && i+1 < argc)
+	delay_ms = atoi (argv[++i]);
+      else if (!strcmp (argv[i], "-s") && i+1 < argc)
+	stall_after = atoi (argv[++i]);
+      else if (!strcmp (argv[i], "-r"))
+	reset_counter = True;
+      else
+	{
+	  fprintf (stderr, "usage: %s [-display dpy] [-n toggles] "
+		   "[-i interval ms] [-d repaint ms] [-s stall after] [-r]\n",
+		   argv[0]);
+	  return 1;
+	}
+    }
+
+  if ((dpy = XOpenDisplay (display_name)) == NULL)
+    {
+      fprintf (stderr, "%s: can't open display\n", argv[0]);
+      return 1;
+    }
+
+  if (!XSyncQueryExtension (dpy, &i, &i) 
+      || !XSyncInitialize (dpy, &major, &minor))
+    {
+      fprintf (stderr, "%s: no SYNC extension\n", argv[0]);
+      return 1;
+    }
+
+  atom_protocols    = XInternAtom (dpy, "WM_PROTOCOLS", False);
+  atom_delete       = XInternAtom (dpy, "WM_DELETE_WINDOW", False);
+  atom_sync_request = XInternAtom (dpy, "_NET_WM_SYNC_REQUEST", False);
+  atom_sync_counter = XInternAtom (dpy, "_NET_WM_SYNC_REQUEST_COUNTER", 
+				   False);
+  atom_state        = XInternAtom (dpy, "_NET_WM_STATE", False);
+  atom_fullscreen   = XInternAtom (dpy, "_NET_WM_STATE_FULLSCREEN", False);
+
+  win = XCreateSimpleWindow (dpy, DefaultRootWindow (dpy), 0, 0, 200, 200,
+			     0, 0, WhitePixel (dpy, DefaultScreen (dpy)));
+
+  XSelectInput (dpy, win, StructureNotifyMask);
+  XStoreName (dpy, win, "sync-client");
+
+  protocols[0] = atom_delete;
+  protocols[1] = atom_sync_request;
+  XSetWMProtocols (dpy, win, protocols, 2);
+
+  counter_create ();
+
+  XMapWindow (dpy, win);
+
+  do 
+    XNextEvent (dpy, &ev);
+  while (ev.type != MapNotify);
+
+  run (200);
+
+  for (i = 0; i < n_toggles; i++)
+    {
+      if (reset_counter && i == n_toggles / 2)
+	{
+	  XSyncDestroyCounter (dpy, counter);
+	  counter_create ();
+	}
+
+      toggle_fullscreen ();
+      run (interval_ms);
+    }
+
+  /* Let any held back configures and timeouts play out */
+  run (2000);
+
+  printf ("toggles=%i configures=%i requests=%i answered=%i\n",
+	  n_toggles, n_configures, n_requests, n_answered);
+
+  XCloseDisplay (dpy);
+
+  if (n_requests == 0)
+    {
+      fprintf (stderr, "%s: window manager sent no sync requests\n", argv[0]);
+      return 1;
+    }
+
+  return 0;
+}
@@ -0,0 +1,88 @@
+#!/bin/sh
+#
+#  sync-test.sh - run sync-client against matchbox-window-manager 
+#  under Xvfb.
+#
+#  Builds util/sync-client if needed, then runs it with a well behaved,
+#  a slow, a stalling and a counter swapping client. The wm must be 
+#  built with XSync support ( the default, see --disable-xsync ).
+#
+#  usage: sync-test.sh [-d display] [-w wm binary] [-- wm args]
+#
+
+DPY=:74
+WM=./src/matchbox-window-manager
+UTIL=`dirname $0`
+CLIENT=$UTIL/sync-client
+
+while [ $# -gt 0 ]; do
+  case "$1" in
+    -d) DPY=$2; shift 2 ;;
+    -w) WM=$2; shift 2 ;;
+    --) shift; break ;;
+    *)  echo "usage: $0 [-d display] [-w wm] [-- wm args]" >&2
+        exit 1 ;;
+  esac
+done
+
+for tool in Xvfb xprop; do
+  if ! command -v $tool >/dev/null 2>&1; then
+    echo "$0: $tool not found" >&2
+    exit 1
+  fi
+done
+
+if [ ! -x "$WM" ]; then
+  echo "$0: $WM not found, build first or pass -w" >&2
+  exit 1
+fi
+
+if [ ! -x "$CLIENT" ] || [ "$UTIL/sync-client.c" -nt "$CLIENT" ]; then
+  ${CC:-cc} -o $CLIENT $UTIL/sync-client.c -lX11 -lXext || exit 1
+fi
+
+Xvfb $DPY -screen 0 640x480x16 -nolisten tcp >/dev/null 2>&1 &
+XVFB_PID=$!
+
+trap 'kill $WM_PID $XVFB_PID 2>/dev/null' 0 1 2 15
+
+i=0
+until xprop -display $DPY -root >/dev/null 2>&1; do
+  i=`expr $i + 1`
+  if [ $i -gt 50 ]; then
+    echo "$0: Xvfb failed to start on $DPY" >&2
+    exit 1
+  fi
+  sleep 0.1
+done
+
+$WM -display $DPY "$@" &
+WM_PID=$!
+
+# Wait for the wm to be managing
+i=0
+until xprop -display $DPY -root _NET_SUPPORTING_WM_CHECK 2>/dev/null \
+        | grep -q "window id"; do
+  i=`expr $i + 1`
+  if [ $i -gt 50 ]; then
+    echo "$0: $WM failed to start" >&2
+    exit 1
+  fi
+  sleep 0.1
+done
+
+FAILED=0
+
+run_case ()
+{
+  name=$1; shift
+  printf "%-10s " $name
+  $CLIENT -display $DPY "$@" || FAILED=1
+}
+
+run_case normal
+run_case slow    -d 30
+run_case stall   -s 5
+run_case reset   -r -d 10
+
+exit $FAILED
@@ -0,0 +1,585 @@
+/*
+ *  trace-replay - replay and compare matchbox-window-manager event traces.
+ *
+ *  A trace is written by a window manager run with MB_TRACE=<file>, on
+ *  SIGUSR1 or at exit ( see src/trace.h ).
+ *
+ *    trace-replay [-display dpy] [-s speed] trace
+ *
+ *  plays the client side of a trace back against a running window
+ *  manager; windows are created and mapped with the type the wm gave
+ *  them, configure requests, unmaps, destroys, title changes and
+ *  client messages are resent, with the recorded gaps between them
+ *  divided by speed ( 0 for as fast as possible ). Key presses and
+ *  pointer events can't be sent without XTest and are skipped, as is
+ *  anything about windows that existed before the trace started.
+ *
+ *    trace-replay -c baseline new
+ *
+ *  compares the time the wm spent handling each event type in two
+ *  traces, eg. one from a device and one from a replay of it.
+ *
+ *    trace-replay -p trace
+ *
+ *  prints every record.
+ *
+ *  cc -I src -o trace-replay trace-replay.c -lX11
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include <X11/Xutil.h>
+
+#define MBTRACE_FORMAT_ONLY
+#include "trace.h"
+
+#define MB_CMD_EXIT 2		/* From src/structs.h */
+
+typedef struct TraceAtom
+{
+  uint32_t atom;
+  char    *name;
+  Atom     replay_atom;		/* Interned on the replay display */
+
+} TraceAtom;
+
+typedef struct Trace
+{
+  MBTraceHeader  header;
+  MBTraceRecord *records;
+  TraceAtom     *atoms;
+
+} Trace;
+
+typedef struct ReplayWindow
+{
+  uint32_t window;		/* As recorded */
+  Window   replay_window;
+
+} ReplayWindow;
+
+static Display      *dpy;
+static Window        root;
+static ReplayWindow *windows;
+static int           n_windows;
+
+static char *event_names[] = {
+  "", "", "KeyPress", "KeyRelease", "ButtonPress", "ButtonRelease",
+  "MotionNotify", "EnterNotify", "LeaveNotify", "FocusIn", "FocusOut",
+  "KeymapNotify", "Expose", "GraphicsExpose", "NoExpose",
+  "VisibilityNotify", "CreateNotify", "DestroyNotify", "UnmapNotify",
+  "MapNotify", "MapRequest", "ReparentNotify", "ConfigureNotify",
+  "ConfigureRequest", "GravityNotify", "ResizeRequest",
+  "CirculateNotify", "CirculateRequest", "PropertyNotify",
+  "SelectionClear", "SelectionRequest", "SelectionNotify",
+  "ColormapNotify", "ClientMessage", "MappingNotify"
+};
+
+static const char*
+event_name (int type)
+{
+  static char buf[16];
+
+  if (type >= 0 && type < (int) (sizeof (event_names) / sizeof (char *)))
+    return event_names[type];
+
+  snprintf (buf, sizeof (buf), "ext-%i", type);
+  return buf;
+}
+
+static long long
+now_usec (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static Trace*
+trace_load (const char *path)
+{
+  Trace   *trace;
+  FILE    *fp;
+  uint16_t len;
+  uint32_t i;
+
+  if ((fp = fopen (path, "r")) == NULL)
+    {
+      fprintf (stderr, "trace-replay: can't open %s\n", path);
+      return NULL;
+    }
+
+  trace = calloc (1, sizeof (Trace));
+
+  if (fread (&trace->header, sizeof (MBTraceHeader), 1, fp) != 1
+      || trace->header.magic != MBTRACE_MAGIC
+      || trace->header.version != MBTRACE_VERSION
+      || trace->header.record_size != sizeof (MBTraceRecord))
+    {
+      fprintf (stderr, "trace-replay: %s is not a version %i trace\n",
+	       path, MBTRACE_VERSION);
+      goto fail;
+    }
+
+  trace->records = malloc (sizeof (MBTraceRecord)
+			   * (trace->header.n_records + 1));
+  trace->atoms   = calloc (trace->header.n_atoms + 1, sizeof (TraceAtom));
+
+  if (fread (trace->records, sizeof (MBTraceRecord),
+	     trace->header.n_records, fp) != trace->header.n_records)
+    goto truncated;
+
+  for (i = 0; i < trace->header.n_atoms; i++)
+    {
+      if (fread (&trace->atoms[i].atom, sizeof (uint32_t), 1, fp) != 1
+	  || fread (&len, sizeof (len), 1, fp) != 1)
+	goto truncated;
+
+      trace->atoms[i].name = calloc (1, len + 1);
+
+      if (fread (trace->atoms[i].name, 1, len, fp) != len)
+	goto truncated;
+    }
+
+  fclose (fp);
+  return trace;
+
+ truncated:
+  fprintf (stderr, "trace-replay: %s is truncated\n", path);
+ fail:
+  fclose (fp);
+  free (trace);
+  return NULL;
+}
+
+static TraceAtom*
+trace_atom_find (Trace *trace, uint32_t atom)
+{
+  uint32_t i;
+
+  for (i = 0; i < trace->header.n_atoms; i++)
+    if (trace->atoms[i].atom == atom)
+      return &trace->atoms[i];
+
+  return NULL;
+}
+
+static const char*
+trace_atom_name (Trace *trace, uint32_t atom)
+{
+  TraceAtom *a = trace_atom_find (trace, atom);
+
+  return (a) ? a->name : "?";
+}
+
+/* The recorded atom on the replay display, None if it wasn't named */
+static Atom
+replay_atom (Trace *trace, uint32_t atom)
+{
+  TraceAtom *a = trace_atom_find (trace, atom);
+
+  if (a == NULL)
+    return None;
+
+  if (a->replay_atom == None)
+    a->replay_atom = XInternAtom (dpy, a->name, False);
+
+  return a->replay_atom;
+}
+
+static Window
+replay_window (Trace *trace, uint32_t window)
+{
+  int i;
+
+  if (window == trace->header.root)
+    return root;
+
+  for (i = 0; i < n_windows; i++)
+    if (windows[i].window == window)
+      return windows[i].replay_window;
+
+  return None;
+}
+
+static Window
+replay_window_new (MBTraceRecord *r, Bool override)
+{
+  XSetWindowAttributes attr;
+  Window               win;
+  char                 name[32];
+
+  attr.override_redirect = override;
+  attr.background_pixel  = WhitePixel (dpy, DefaultScreen (dpy));
+
+  win = XCreateWindow (dpy, root, r->x, r->y,
+		       (r->width) ? r->width : 100,
+		       (r->height) ? r->height : 100, 0,
+		       CopyFromParent, CopyFromParent, CopyFromParent,
+		       CWOverrideRedirect|CWBackPixel, &attr);
+
+  snprintf (name, sizeof (name), "replay-%#x", r->window);
+  XStoreName (dpy, win, name);
+
+  windows = realloc (windows, sizeof (ReplayWindow) * (n_windows + 1));
+  windows[n_windows].window        = r->window;
+  windows[n_windows].replay_window = win;
+  n_windows++;
+
+  return win;
+}
+
+static void
+replay_window_set_type (Window win, const char *type_name)
+{
+  Atom type = XInternAtom (dpy, type_name, False);
+
+  XChangeProperty (dpy, win, XInternAtom (dpy, "_NET_WM_WINDOW_TYPE", False),
+		   XA_ATOM, 32, PropModeReplace, (unsigned char *)&type, 1);
+}
+
+static Bool
+replay_map_request (Trace *trace, MBTraceRecord *r)
+{
+  Window win, trans;
+
+  if ((win = replay_window (trace, r->window)) != None)
+    {
+      XMapWindow (dpy, win);
+      return True;
+    }
+
+  switch (r->flags)
+    {
+    case TRACE_CLIENT_NONE:
+    case TRACE_CLIENT_OVERRIDE:
+      return False;
+    }
+
+  win = replay_window_new (r, False);
+
+  switch (r->flags)
+    {
+    case TRACE_CLIENT_DIALOG:
+      replay_window_set_type (win, "_NET_WM_WINDOW_TYPE_DIALOG");
+      if ((trans = replay_window (trace, r->data[0])) != None)
+	XSetTransientForHint (dpy, win, trans);
+      break;
+    case TRACE_CLIENT_TOOLBAR:
+      replay_window_set_type (win, "_NET_WM_WINDOW_TYPE_TOOLBAR");
+      break;
+    case TRACE_CLIENT_PANEL:
+      replay_window_set_type (win, "_NET_WM_WINDOW_TYPE_DOCK");
+      break;
+    case TRACE_CLIENT_DESKTOP:
+      replay_window_set_type (win, "_NET_WM_WINDOW_TYPE_DESKTOP");
+      break;
+    }
+
+  XMapWindow (dpy, win);
+  return True;
+}
+
+static Bool
+replay_client_message (Trace *trace, MBTraceRecord *r)
+{
+  XEvent      ev;
+  Window      win;
+  const char *name = trace_atom_name (trace, r->atom);
+  int         i;
+
+  /* Ping replies would be for pings this wm never sent */
+  if (!strcmp (name, "?") || !strcmp (name, "WM_PROTOCOLS"))
+    return False;
+
+  if (!strcmp (name, "_MB_COMMAND") && r->data[0] == MB_CMD_EXIT)
+    return False;
+
+  if ((win = replay_window (trace, r->window)) == None)
+    return False;
+
+  memset (&ev, 0, sizeof (ev));
+  ev.xclient.type         = ClientMessage;
+  ev.xclient.window       = win;
+  ev.xclient.message_type = replay_atom (trace, r->atom);
+  ev.xclient.format       = (r->detail) ? r->detail : 32;
+
+  for (i = 0; i < 3; i++)
+    ev.xclient.data.l[i] = r->data[i];
+
+  if (!strcmp (name, "_NET_WM_STATE"))
+    {
+      ev.xclient.data.l[1] = replay_atom (trace, r->data[1]);
+      ev.xclient.data.l[2] = replay_atom (trace, r->data[2]);
+    }
+
+  XSendEvent (dpy, root, False,
+	      SubstructureRedirectMask|SubstructureNotifyMask, &ev);
+  return True;
+}
+
+static Bool
+replay_record (Trace *trace, MBTraceRecord *r, int n)
+{
+  XWindowChanges changes;
+  Window         win;
+  const char    *name;
+  char           title[32];
+
+  if (r->type == MapRequest)
+    return replay_map_request (trace, r);
+
+  if (r->type == MapNotify && r->flags == TRACE_CLIENT_OVERRIDE)
+    {
+      if ((win = replay_window (trace, r->window)) == None)
+	win = replay_window_new (r, True);
+      XMapWindow (dpy, win);
+      return True;
+    }
+
+  if (r->type == ClientMessage)
+    return replay_client_message (trace, r);
+
+  /* Everything else needs a window we created */
+  if ((win = replay_window (trace, r->window)) == None || win == root)
+    return False;
+
+  switch (r->type)
+    {
+    case UnmapNotify:
+      if (r->detail != TRACE_UNMAP_WITHDRAWN)
+	return False;
+      XUnmapWindow (dpy, win);
+      return True;
+    case DestroyNotify:
+      XDestroyWindow (dpy, win);
+      return True;
+    case ConfigureRequest:
+      changes.x      = r->x;
+      changes.y      = r->y;
+      changes.width  = (r->width) ? r->width : 1;
+      changes.height = (r->height) ? r->height : 1;
+      XConfigureWindow (dpy, win, r->flags & (CWX|CWY|CWWidth|CWHeight),
+			&changes);
+      return True;
+    case PropertyNotify:
+      name = trace_atom_name (trace, r->atom);
+      if (r->detail != PropertyNewValue
+	  || (strcmp (name, "WM_NAME") && strcmp (name, "_NET_WM_NAME")))
+	return False;
+      snprintf (title, sizeof (title), "replay title %i", n);
+      XChangeProperty (dpy, win, replay_atom (trace, r->atom),
+		       (!strcmp (name, "WM_NAME")) ?
+		       XA_STRING : XInternAtom (dpy, "UTF8_STRING", False),
+		       8, PropModeReplace, (unsigned char *)title,
+		       strlen (title));
+      return True;
+    }
+
+  return False;
+}
+
+static int
+replay (Trace *trace, double speed)
+{
+  long long start = now_usec (), due;
+  uint32_t  i;
+  int       n_replayed = 0, n_skipped = 0;
+
+  for (i = 0; i < trace->header.n_records; i++)
+    {
+      MBTraceRecord *r = &trace->records[i];
+
+      if (speed > 0)
+	{
+	  due = start + (r->usec - trace->records[0].usec) / speed;
+
+	  XFlush (dpy);
+	  if (due > now_usec ())
+	    usleep (due - now_usec ());
+	}
+
+      if (replay_record (trace, r, i))
+	n_replayed++;
+      else
+	n_skipped++;
+    }
+
+  /* Give the wm a chance to catch up before the caller stops it */
+  XSync (dpy, False);
+  sleep (1);
+
+  printf ("replayed %i of %i records in %lli ms, %i not replayable\n",
+	  n_replayed, trace->header.n_records,
+	  (now_usec () - start) / 1000, n_skipped);
+
+  return 0;
+}
+
+static void
+print_records (Trace *trace)
+{
+  uint32_t i;
+
+  printf ("%i records, %i lost, %ix%i screen\n", trace->header.n_records,
+	  trace->header.n_lost, trace->header.screen_width,
+	  trace->header.screen_height);
+
+  for (i = 0; i < trace->header.n_records; i++)
+    {
+      MBTraceRecord *r = &trace->records[i];
+
+      printf ("%12lli %6u %-18s %#10x", (long long)r->usec, r->handler_usec,
+	      event_name (r->type), r->window);
+
+      if (r->type == PropertyNotify || r->type == ClientMessage)
+	printf (" %s", trace_atom_name (trace, r->atom));
+
+      if (r->width || r->height)
+	printf (" %ix%i+%i+%i", r->width, r->height, r->x, r->y);
+
+      if (r->detail || r->flags)
+	printf (" detail=%i flags=%#x", r->detail, r->flags);
+
+      printf ("\n");
+    }
+}
+
+static int
+cmp_u32 (const void *a, const void *b)
+{
+  uint32_t x = *(uint32_t *)a, y = *(uint32_t *)b;
+
+  return (x > y) - (x < y);
+}
+
+/* n, median, mean and 95th percentile handler usecs for an event type */
+static int
+handler_times (Trace *trace, int type, uint32_t *median, uint32_t *mean,
+	       uint32_t *p95)
+{
+  uint32_t           *v;
+  unsigned long long  total = 0;
+  uint32_t            i;
+  int                 n = 0;
+
+  v = malloc (sizeof (uint32_t) * (trace->header.n_records + 1));
+
+  for (i = 0; i < trace->header.n_records; i++)
+    if (trace->records[i].type == type)
+      {
+	v[n++] = trace->records[i].handler_usec;
+	total += trace->records[i].handler_usec;
+      }
+
+  *median = *mean = *p95 = 0;
+
+  if (n)
+    {
+      qsort (v, n, sizeof (uint32_t), cmp_u32);
+      *median = v[n / 2];
+      *mean   = total / n;
+      *p95    = v[(n * 95) / 100];
+    }
+
+  free (v);
+  return n;
+}
+
+static int
+compare (Trace *base, Trace *new)
+{
+  uint32_t b_median, b_mean, b_p95, n_median, n_mean, n_p95;
+  int      type, b_n, n_n;
+
+  printf ("handler usecs, baseline -> new\n");
+  printf ("  %-18s %7s %7s   %15s %15s %15s\n", "event", "n", "n",
+	  "median", "mean", "p95");
+
+  for (type = 0; type < 256; type++)
+    {
+      b_n = handler_times (base, type, &b_median, &b_mean, &b_p95);
+      n_n = handler_times (new, type, &n_median, &n_mean, &n_p95);
+
+      if (b_n == 0 && n_n == 0)
+	continue;
+
+      printf ("  %-18s %7i %7i   %6u -> %6u %6u -> %6u %6u -> %6u",
+	      event_name (type), b_n, n_n, b_median, n_median,
+	      b_mean, n_mean, b_p95, n_p95);
+
+      if (b_mean && n_n)
+	printf ("  %+.0f%%", (n_mean - (double)b_mean) * 100.0 / b_mean);
+
+      printf ("\n");
+    }
+
+  return 0;
+}
+
+static void
+usage (char *progname)
+{
+  fprintf (stderr,
+	   "usage: %s [-display dpy] [-s speed] trace\n"
+	   "       %s -c baseline-trace new-trace\n"
+	   "       %s -p trace\n", progname, progname, progname);
+  exit (1);
+}
+
+int
+main (int argc, char **argv)
+{
+  char   *display_name = NULL;
+  double  speed = 1.0;
+  Trace  *trace, *base;
+  int     i;
+
+  for (i = 1; i < argc; i++)
+    {
+      if (!strcmp (argv[i], "-display") && i+1 < argc)
+	display_name = argv[++i];
+      else if (!strcmp (argv[i], "-s") && i+1 < argc)
+	speed = atof (argv[++i]);
+      else if (!strcmp (argv[i], "-c") && i+2 == argc - 1)
+	{
+	  if ((base = trace_load (argv[i+1])) == NULL
+	      || (trace = trace_load (argv[i+2])) == NULL)
+	    return 1;
+	  return compare (base, trace);
+	}
+      else if (!strcmp (argv[i], "-p") && i+1 == argc - 1)
+	{
+	  if ((trace = trace_load (argv[i+1])) == NULL)
+	    return 1;
+	  print_records (trace);
+	  return 0;
+	}
+      else if (i == argc - 1 && argv[i][0] != '-')
+	break;
+      else
+	usage (argv[0]);
+    }
+
+  if (i != argc - 1)
+    usage (argv[0]);
+
+  if ((trace = trace_load (argv[i])) == NULL)
+    return 1;
+
+  if ((dpy = XOpenDisplay (display_name)) == NULL)
+    {
+      fprintf (stderr, "%s: can't open display\n", argv[0]);
+      return 1;
+    }
+
+  root = DefaultRootWindow (dpy);
+
+  return replay (trace, speed);
+}
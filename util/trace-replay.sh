@@ -0,0 +1,105 @@
+#!/bin/sh
+#
+#  trace-replay.sh - replay a recorded event trace under Xvfb and compare
+#  handler times against the recording.
+#
+#  Record a trace by running the window manager with MB_TRACE=<file>,
+#  then send it SIGUSR1 or let it exit. This builds util/trace-replay
+#  if needed, starts a private Xvfb the size of the recorded screen and
+#  a traced window manager on it, replays the trace and prints the
+#  per event type handler times of the recording next to the replay's.
+#
+#  usage: trace-replay.sh [-d display] [-w wm binary] [-s speed]
+#                         trace [-- wm args]
+#
+#  Needs Xvfb and xprop.
+#
+
+DPY=:79
+WM=./src/matchbox-window-manager
+SPEED=1
+UTIL=`dirname $0`
+REPLAY=$UTIL/trace-replay
+TRACE=""
+USAGE="usage: $0 [-d display] [-w wm] [-s speed] trace [-- wm args]"
+
+while [ $# -gt 0 ]; do
+  case "$1" in
+    -d) DPY=$2; shift 2 ;;
+    -w) WM=$2; shift 2 ;;
+    -s) SPEED=$2; shift 2 ;;
+    --) shift; break ;;
+    *)  if [ -n "$TRACE" ] || [ "${1#-}" != "$1" ]; then
+          echo "$USAGE" >&2
+          exit 1
+        fi
+        TRACE=$1; shift ;;
+  esac
+done
+
+if [ -z "$TRACE" ]; then
+  echo "$USAGE" >&2
+  exit 1
+fi
+
+for tool in Xvfb xprop; do
+  if ! command -v $tool >/dev/null 2>&1; then
+    echo "$0: $tool not found" >&2
+    exit 1
+  fi
+done
+
+if [ ! -x "$WM" ]; then
+  echo "$0: $WM not found, build first or pass -w" >&2
+  exit 1
+fi
+
+if [ ! -x "$REPLAY" ] || [ "$UTIL/trace-replay.c" -nt "$REPLAY" ] \
+   || [ "$UTIL/../src/trace.h" -nt "$REPLAY" ]; then
+  ${CC:-cc} -I$UTIL/../src -o $REPLAY $UTIL/trace-replay.c -lX11 || exit 1
+fi
+
+SCREEN=`$REPLAY -p "$TRACE" | sed -n '1s/.* \([0-9]*x[0-9]*\) screen$/\1/p'`
+if [ -z "$SCREEN" ]; then
+  exit 1
+fi
+
+REPLAYED=`mktemp`
+
+Xvfb $DPY -screen 0 ${SCREEN}x16 -nolisten tcp >/dev/null 2>&1 &
+XVFB_PID=$!
+
+trap 'kill $WM_PID $XVFB_PID 2>/dev/null; rm -f $REPLAYED' 0 1 2 15
+
+i=0
+until xprop -display $DPY -root >/dev/null 2>&1; do
+  i=`expr $i + 1`
+  if [ $i -gt 50 ]; then
+    echo "$0: Xvfb failed to start on $DPY" >&2
+    exit 1
+  fi
+  sleep 0.1
+done
+
+MB_TRACE=$REPLAYED "$WM" -display $DPY "$@" &
+WM_PID=$!
+
+i=0
+until xprop -display $DPY -root _NET_SUPPORTING_WM_CHECK 2>/dev/null \
+        | grep -q "window id"; do
+  i=`expr $i + 1`
+  if [ $i -gt 50 ]; then
+    echo "$0: $WM failed to start" >&2
+    exit 1
+  fi
+  sleep 0.1
+done
+
+$REPLAY -display $DPY -s $SPEED "$TRACE" || exit 1
+
+# The wm writes its trace out as it exits
+kill $WM_PID
+wait $WM_PID 2>/dev/null
+WM_PID=""
+
+$REPLAY -c "$TRACE" $REPLAYED